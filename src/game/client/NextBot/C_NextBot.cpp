@@ -8,6 +8,8 @@
 #include "debugoverlay_shared.h"
 #include <bitbuf.h>
 #include "viewrender.h"
+#include "C_NextBotPoseCache.h"
+#include "bone_setup.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -15,6 +17,10 @@
 #undef NextBot
 
 ConVar NextBotShadowDist( "nb_shadow_dist", "400" );
+ConVar NextBotPoseCache( "nb_pose_cache", "1", 0, "Share sequence poses between NextBots playing the same animation" );
+ConVar NextBotAnimStep( "nb_anim_step", "0.05", 0, "Seconds of animation between the poses NextBots beyond nb_anim_lod_dist share, twice as long at long range. Nearby NextBots animate at full rate." );
+ConVar NextBotAnimLODDist( "nb_anim_lod_dist", "1000", 0, "Beyond this range NextBots update their pose at a lower rate" );
+ConVar NextBotAnimLODFarDist( "nb_anim_lod_far_dist", "2000", 0, "Beyond this range NextBots update their pose at the lowest rate and skip bones used only by hitboxes" );
 
 //-----------------------------------------------------------------------------
 IMPLEMENT_CLIENTCLASS_DT( C_NextBotCombatCharacter, DT_NextBot, NextBotCombatCharacter )
@@ -31,6 +37,8 @@ C_NextBotCombatCharacter::C_NextBotCombatCharacter()
 	m_forcedShadowType = SHADOWS_NONE;
 	m_bForceShadowType = false;
 
+	m_animLOD = ANIM_LOD_NEAR;
+
 	TheClientNextBots().Register( this );
 	UseClientSideAnimation();
 }
@@ -58,10 +66,120 @@ void C_NextBotCombatCharacter::UpdateClientSideAnimation()
 		return;
 	}
 
+	if ( m_animLODTimer.IsElapsed() )
+	{
+		m_animLODTimer.Start( 0.15f );
+		UpdateAnimLOD();
+	}
+
 	BaseClass::UpdateClientSideAnimation();
 }
 
 
+//--------------------------------------------------------------------------------------------------------
+void C_NextBotCombatCharacter::UpdateAnimLOD( void )
+{
+	C_BasePlayer *localPlayer = C_BasePlayer::GetLocalPlayer();
+	if ( !localPlayer )
+	{
+		m_animLOD = ANIM_LOD_NEAR;
+		return;
+	}
+
+	Vector delta = GetAbsOrigin() - localPlayer->GetAbsOrigin();
+
+	if ( delta.IsLengthLessThan( NextBotAnimLODDist.GetFloat() ) )
+	{
+		m_animLOD = ANIM_LOD_NEAR;
+	}
+	else if ( delta.IsLengthLessThan( NextBotAnimLODFarDist.GetFloat() ) )
+	{
+		m_animLOD = ANIM_LOD_MID;
+	}
+	else
+	{
+		m_animLOD = ANIM_LOD_FAR;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------
+/**
+ * Build our sequence's pose at a quantized cycle and quantized pose parameters, so bots playing
+ * the same animation share it through the pose cache. Only bots beyond the near LOD are quantized,
+ * far ones more coarsely, which lowers the rate their pose changes at and makes them more likely to share it.
+ * May be called from several threads at once by the parallel bone setup.
+ */
+void C_NextBotCombatCharacter::BuildSequencePose( IBoneSetup &boneSetup, Vector pos[], Quaternion q[], float flCycle, float currentTime, const float poseParameter[], int boneMask )
+{
+	CStudioHdr *hdr = boneSetup.GetStudioHdr();
+	int sequence = GetSequence();
+
+	// nearby bots animate smoothly, and IK rules and realtime sequences depend on more than the key
+	if ( !NextBotPoseCache.GetBool() || m_animLOD == ANIM_LOD_NEAR || m_pIk || ( hdr->pSeqdesc( sequence ).flags & STUDIO_REALTIME ) )
+	{
+		BaseClass::BuildSequencePose( boneSetup, pos, q, flCycle, currentTime, poseParameter, boneMask );
+		return;
+	}
+
+	static const float lodStepScale[] = { 0.0f, 1.0f, 2.0f };		// near bots aren't quantized
+	float step = MAX( NextBotAnimStep.GetFloat(), 0.001f ) * lodStepScale[ m_animLOD ];
+
+	C_NextBotPoseCache::Key key;
+	V_memset( &key, 0, sizeof( key ) );
+	key.model = hdr->GetRenderHdr();
+	key.sequence = sequence;
+	key.boneMask = boneMask;
+
+	// far away, bones used only by hitboxes aren't worth animating
+	if ( m_animLOD == ANIM_LOD_FAR && ( boneMask & ~BONE_USED_BY_HITBOX ) )
+	{
+		key.boneMask &= ~BONE_USED_BY_HITBOX;
+	}
+
+	// quantize time rather than cycle, so long and short sequences change pose at the same rate
+	int frameCount = MAX( 1, RoundFloatToInt( SequenceDuration( hdr, sequence ) / step ) );
+	key.cycle = clamp( RoundFloatToInt( flCycle * frameCount ), 0, frameCount );
+
+	float sharedPoseParameter[ MAXSTUDIOPOSEPARAM ];
+	for( int i=0; i<MAXSTUDIOPOSEPARAM; ++i )
+	{
+		if ( i < hdr->GetNumPoseParameters() )
+		{
+			key.poseParameter[i] = RoundFloatToInt( clamp( poseParameter[i], 0.0f, 1.0f ) * NEXTBOT_POSE_PARAMETER_STEPS );
+		}
+
+		sharedPoseParameter[i] = (float)key.poseParameter[i] / NEXTBOT_POSE_PARAMETER_STEPS;
+	}
+
+	int boneCount = hdr->numbones();
+
+	if ( !TheClientNextBotPoseCache().Find( key, pos, q, boneCount ) )
+	{
+		IBoneSetup sharedBoneSetup( hdr, key.boneMask, sharedPoseParameter );
+		sharedBoneSetup.InitPose( pos, q );
+		sharedBoneSetup.AccumulatePose( pos, q, sequence, (float)key.cycle / frameCount, 1.0f, currentTime, NULL );
+
+		TheClientNextBotPoseCache().Store( key, pos, q, boneCount );
+	}
+
+	if ( key.boneMask != boneMask )
+	{
+		// the bones we skipped still get transformed, so leave them in their bind pose
+		for( int i=0; i<boneCount; ++i )
+		{
+			int flags = hdr->boneFlags( i );
+			if ( ( flags & boneMask ) && !( flags & key.boneMask ) )
+			{
+				const mstudiobone_t *bone = hdr->pBone( i );
+				pos[i] = bone->pos;
+				q[i] = bone->quat;
+			}
+		}
+	}
+}
+
+
 //--------------------------------------------------------------------------------------------------------
 void C_NextBotCombatCharacter::UpdateShadowLOD( void )
 {
@@ -47,6 +47,8 @@ public:
 	void ForceShadowCastType( bool bForce, ShadowType_t forcedShadowType = SHADOWS_NONE ) { m_bForceShadowType = bForce; m_forcedShadowType = forcedShadowType; }
 	bool GetForcedShadowCastType( ShadowType_t* pForcedShadowType ) const;
 
+	virtual void BuildSequencePose( IBoneSetup &boneSetup, Vector pos[], Quaternion q[], float flCycle, float currentTime, const float poseParameter[], int boneMask );
+
 	// Local In View Data.
 	void InitFrustumData( void )						{ m_bInFrustum = false; m_flFrustumDistanceSqr = FLT_MAX; m_nInFrustumFrame = gpGlobals->framecount; }
 	bool IsInFrustumValid( void )						{ return ( m_nInFrustumFrame == gpGlobals->framecount ); }
@@ -62,6 +64,16 @@ private:
 	bool			m_bForceShadowType;
 	void UpdateShadowLOD( void );
 
+	enum AnimLODType
+	{
+		ANIM_LOD_NEAR,
+		ANIM_LOD_MID,			// pose updated at a lower rate
+		ANIM_LOD_FAR,			// pose updated at the lowest rate, and bones used only by hitboxes are left in their bind pose
+	};
+	AnimLODType		m_animLOD;
+	CountdownTimer	m_animLODTimer;		// Timer to throttle checks for animation LOD
+	void UpdateAnimLOD( void );
+
 	// Local In View Data.
 	int			m_nInFrustumFrame;
 	bool		m_bInFrustum;
@@ -0,0 +1,152 @@
+// C_NextBotPoseCache.cpp
+// Sequence poses shared between identical NextBots
+//========= Copyright Valve Corporation, All rights reserved. ============//
+
+#include "cbase.h"
+#include "C_NextBotPoseCache.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar nb_pose_cache_size( "nb_pose_cache_size", "256", 0, "Maximum number of sequence poses shared between NextBots" );
+
+
+//----------------------------------------------------------------------------------------------------------------
+/**
+ * Singleton accessor.
+ */
+static C_NextBotPoseCache s_poseCache;
+
+C_NextBotPoseCache &TheClientNextBotPoseCache( void )
+{
+	return s_poseCache;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------
+C_NextBotPoseCache::C_NextBotPoseCache( void ) : CAutoGameSystem( "C_NextBotPoseCache" ), m_entryMap( KeyLessFunc )
+{
+	m_hitCount = 0;
+	m_missCount = 0;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------
+bool C_NextBotPoseCache::KeyLessFunc( const Key &lhs, const Key &rhs )
+{
+	// keys are zeroed before they are filled in, so padding compares equal
+	return V_memcmp( &lhs, &rhs, sizeof( Key ) ) < 0;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------
+void C_NextBotPoseCache::RemoveEntry( unsigned short index )
+{
+	m_entryMap.Remove( m_entryList[ index ].m_key );
+	m_entryList.Remove( index );
+}
+
+
+//----------------------------------------------------------------------------------------------------------------
+bool C_NextBotPoseCache::Find( const Key &key, Vector pos[], Quaternion q[], int boneCount )
+{
+	AUTO_LOCK( m_mutex );
+
+	unsigned short mapIndex = m_entryMap.Find( key );
+	if ( mapIndex == m_entryMap.InvalidIndex() )
+	{
+		++m_missCount;
+		return false;
+	}
+
+	unsigned short index = m_entryMap[ mapIndex ];
+	const Entry &entry = m_entryList[ index ];
+
+	// the model data may have been reloaded at the same address
+	if ( entry.m_pos.Count() != boneCount )
+	{
+		RemoveEntry( index );
+		++m_missCount;
+		return false;
+	}
+
+	V_memcpy( pos, entry.m_pos.Base(), boneCount * sizeof( Vector ) );
+	V_memcpy( q, entry.m_q.Base(), boneCount * sizeof( Quaternion ) );
+
+	// most recently used goes to the front
+	m_entryList.Unlink( index );
+	m_entryList.LinkToHead( index );
+
+	++m_hitCount;
+	return true;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------
+void C_NextBotPoseCache::Store( const Key &key, const Vector pos[], const Quaternion q[], int boneCount )
+{
+	AUTO_LOCK( m_mutex );
+
+	// another thread may have built the same pose meanwhile
+	if ( m_entryMap.Find( key ) != m_entryMap.InvalidIndex() )
+		return;
+
+	// make room, dropping the least recently used
+	int maxSize = MAX( nb_pose_cache_size.GetInt(), 1 );
+	while( m_entryList.Count() >= maxSize )
+	{
+		RemoveEntry( m_entryList.Tail() );
+	}
+
+	unsigned short index = m_entryList.AddToHead();
+	Entry &entry = m_entryList[ index ];
+	entry.m_key = key;
+	entry.m_pos.CopyArray( pos, boneCount );
+	entry.m_q.CopyArray( q, boneCount );
+
+	m_entryMap.Insert( key, index );
+}
+
+
+//----------------------------------------------------------------------------------------------------------------
+void C_NextBotPoseCache::Invalidate( void )
+{
+	AUTO_LOCK( m_mutex );
+
+	m_entryList.RemoveAll();
+	m_entryMap.RemoveAll();
+}
+
+
+//----------------------------------------------------------------------------------------------------------------
+void C_NextBotPoseCache::PrintStats( void )
+{
+	AUTO_LOCK( m_mutex );
+
+	unsigned int lookupCount = m_hitCount + m_missCount;
+	float hitRate = ( lookupCount > 0 ) ? 100.0f * m_hitCount / lookupCount : 0.0f;
+
+	Msg( "Pose cache: %u hits, %u misses (%.1f%% hit rate), %d of %d entries\n", m_hitCount, m_missCount, hitRate, m_entryList.Count(), nb_pose_cache_size.GetInt() );
+}
+
+
+//----------------------------------------------------------------------------------------------------------------
+void C_NextBotPoseCache::ResetStats( void )
+{
+	AUTO_LOCK( m_mutex );
+
+	m_hitCount = 0;
+	m_missCount = 0;
+}
+
+
+//----------------------------------------------------------------------------------------------------------------
+CON_COMMAND( nb_pose_cache_stats, "Show the hits and misses of the NextBot pose cache. 'nb_pose_cache_stats reset' clears the counters." )
+{
+	TheClientNextBotPoseCache().PrintStats();
+
+	if ( args.ArgC() > 1 && FStrEq( args[1], "reset" ) )
+	{
+		TheClientNextBotPoseCache().ResetStats();
+	}
+}
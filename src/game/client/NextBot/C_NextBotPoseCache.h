@@ -0,0 +1,73 @@
+// C_NextBotPoseCache.h
+// Sequence poses shared between identical NextBots
+//========= Copyright Valve Corporation, All rights reserved. ============//
+
+#ifndef _C_NEXT_BOT_POSE_CACHE_H_
+#define _C_NEXT_BOT_POSE_CACHE_H_
+
+#include "igamesystem.h"
+#include "studio.h"
+#include "utlmap.h"
+#include "utllinkedlist.h"
+
+#define NEXTBOT_POSE_PARAMETER_STEPS	32		// pose parameters are quantized to 1/NEXTBOT_POSE_PARAMETER_STEPS
+
+
+//----------------------------------------------------------------------------------------------------------------
+/**
+ * A least-recently-used cache of sequence poses, shared between all NextBots using the same model.
+ * A pose is built for a quantized cycle and quantized pose parameters, so crowds of bots playing
+ * the same animation compute it once and copy it from here. Transitions, layers and everything
+ * else that differs between bots is blended on top of the shared pose by each bot.
+ * Safe to use from several threads at once, for parallel bone setup.
+ */
+class C_NextBotPoseCache : public CAutoGameSystem
+{
+public:
+	C_NextBotPoseCache( void );
+
+	virtual void LevelShutdownPostEntity( void )	{ Invalidate(); }
+
+	struct Key
+	{
+		const studiohdr_t *model;
+		int sequence;
+		int cycle;									// quantized, in animation frames of the bot's LOD time step
+		int boneMask;
+		unsigned char poseParameter[ MAXSTUDIOPOSEPARAM ];	// quantized, see NEXTBOT_POSE_PARAMETER_STEPS
+	};
+
+	bool Find( const Key &key, Vector pos[], Quaternion q[], int boneCount );
+	void Store( const Key &key, const Vector pos[], const Quaternion q[], int boneCount );
+
+	void Invalidate( void );						// forget all cached poses
+
+	void PrintStats( void );
+	void ResetStats( void );
+
+private:
+	struct Entry
+	{
+		Key m_key;
+		CUtlVector< Vector > m_pos;
+		CUtlVector< Quaternion > m_q;
+	};
+
+	static bool KeyLessFunc( const Key &lhs, const Key &rhs );
+
+	void RemoveEntry( unsigned short index );
+
+	CUtlLinkedList< Entry, unsigned short > m_entryList;	// most recently used first
+	CUtlMap< Key, unsigned short > m_entryMap;				// key to m_entryList index
+
+	unsigned int m_hitCount;
+	unsigned int m_missCount;
+
+	CThreadFastMutex m_mutex;
+};
+
+// singleton accessor
+extern C_NextBotPoseCache &TheClientNextBotPoseCache( void );
+
+
+#endif // _C_NEXT_BOT_POSE_CACHE_H_
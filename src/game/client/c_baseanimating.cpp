@@ -653,6 +653,9 @@ static unsigned long	g_iModelBoneCounter = 0;
 CUtlVector<C_BaseAnimating *> g_PreviousBoneSetups;
 static unsigned long	g_iPreviousBoneCounter = (unsigned)-1;
 
+// Entities that set up their bones in parallel each frame, see EnableParallelBoneSetup()
+static CUtlVector<C_BaseAnimating *> g_ParallelBoneSetups;
+
 class C_BaseAnimatingGameSystem : public CAutoGameSystem
 {
 	void LevelShutdownPostEntity()
@@ -756,6 +759,10 @@ C_BaseAnimating::~C_BaseAnimating()
 	if ( i != -1 )
 		g_PreviousBoneSetups.FastRemove( i );
 
+	i = g_ParallelBoneSetups.Find( this );
+	if ( i != -1 )
+		g_ParallelBoneSetups.FastRemove( i );
+
 	TermRopes();
 
 	Assert( !m_pRagdoll );
@@ -1982,8 +1989,7 @@ void C_BaseAnimating::StandardBlendingRules( CStudioHdr *hdr, Vector pos[], Quat
 #endif
 
 	IBoneSetup boneSetup( hdr, boneMask, poseparam );
-	boneSetup.InitPose( pos, q );
-	boneSetup.AccumulatePose( pos, q, GetSequence(), fCycle, 1.0, currentTime, m_pIk );
+	BuildSequencePose( boneSetup, pos, q, fCycle, currentTime, poseparam, boneMask );
 
 	// debugoverlay->AddTextOverlay( GetAbsOrigin() + Vector( 0, 0, 64 ), 0, 0, "%30s %6.2f : %6.2f", hdr->pSeqdesc( GetSequence() )->pszLabel( ), fCycle, 1.0 );
 
@@ -2018,6 +2024,16 @@ void C_BaseAnimating::StandardBlendingRules( CStudioHdr *hdr, Vector pos[], Quat
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Build the pose of our current sequence at flCycle
+//-----------------------------------------------------------------------------
+void C_BaseAnimating::BuildSequencePose( IBoneSetup &boneSetup, Vector pos[], Quaternion q[], float flCycle, float currentTime, const float poseParameter[], int boneMask )
+{
+	boneSetup.InitPose( pos, q );
+	boneSetup.AccumulatePose( pos, q, GetSequence(), flCycle, 1.0, currentTime, m_pIk );
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: Put a value into an attachment point by index
 // Input  : number - which point
@@ -2743,6 +2759,8 @@ ConVar cl_warn_thread_contested_bone_setup("cl_warn_thread_contested_bone_setup"
 ConVar cl_threaded_bone_setup("cl_threaded_bone_setup", "0", FCVAR_DEVELOPMENTONLY | FCVAR_INTERNAL_USE,
                               "Enable parallel processing of C_BaseAnimating::SetupBones()" );
 
+ConVar cl_parallel_bone_setup( "cl_parallel_bone_setup", "1", 0, "Set up the bones of crowds (mobs, zombies) on worker threads before rendering" );
+
 //-----------------------------------------------------------------------------
 // Purpose: Do the default sequence blending rules as done in HL1
 //-----------------------------------------------------------------------------
@@ -2774,10 +2792,71 @@ void C_BaseAnimating::ShutdownBoneSetupThreadPool()
 {
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Set up our bones with the parallel batch each frame we are visible
+//-----------------------------------------------------------------------------
+void C_BaseAnimating::EnableParallelBoneSetup()
+{
+	if ( g_ParallelBoneSetups.Find( this ) == -1 )
+	{
+		g_ParallelBoneSetups.AddToTail( this );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Called on the main thread before the parallel bone setup. Does the
+//			work SetupBones can't safely do on a worker thread, and returns true
+//			if we should be added to the batch.
+//-----------------------------------------------------------------------------
+bool C_BaseAnimating::PrepareParallelBoneSetup()
+{
+	// already in the batch
+	if ( m_iMostRecentBoneSetupRequest == g_iPreviousBoneCounter )
+		return false;
+
+	// move children need their parent's bones, and ragdolls their physics
+	if ( IsDormant() || !ShouldDraw() || GetMoveParent() || IsRagdoll() || GetSequence() == -1 )
+		return false;
+
+	// only batch what was drawn last frame. Anything that needed its bones
+	// earlier this frame (for attachments, etc) has already set them up.
+	if ( m_iMostRecentModelBoneCounter != g_iModelBoneCounter - 1 )
+		return false;
+
+	// GetModelPtr() may have to create the studio header
+	CStudioHdr *hdr = GetModelPtr();
+	if ( !hdr || !hdr->SequencesAvailable() )
+		return false;
+
+	// IK traces against the world, which isn't safe off the main thread
+	if ( hdr->numikchains() > 0 && !( m_EntClientFlags & ENTCLIENTFLAG_DONTUSEIK ) && !IsModelScaled() )
+		return false;
+
+	// compute our abs transform now, rather than while other threads may read it
+	GetRenderOrigin();
+	GetRenderAngles();
+
+	m_iMostRecentBoneSetupRequest = g_iPreviousBoneCounter;
+	return true;
+}
+
 void C_BaseAnimating::ThreadedBoneSetup()
 {
 	g_bDoThreadedBoneSetup = cl_threaded_bone_setup.GetBool();
-	if ( g_bDoThreadedBoneSetup )
+
+	bool bParallelBoneSetup = cl_parallel_bone_setup.GetBool() && g_pThreadPool->NumThreads() > 0;
+	if ( bParallelBoneSetup )
+	{
+		FOR_EACH_VEC( g_ParallelBoneSetups, i )
+		{
+			if ( g_ParallelBoneSetups[i]->PrepareParallelBoneSetup() )
+			{
+				g_PreviousBoneSetups.AddToTail( g_ParallelBoneSetups[i] );
+			}
+		}
+	}
+
+	if ( g_bDoThreadedBoneSetup || bParallelBoneSetup )
 	{
 		int nCount = g_PreviousBoneSetups.Count();
 		if ( nCount > 1 )
@@ -2934,7 +3013,10 @@ bool C_BaseAnimating::SetupBones( matrix3x4_t *pBoneToWorldOut, int nMaxBones, i
 		}
 		else
 		{
-			TrackBoneSetupEnt( this );
+			if ( !g_bInThreadedBoneSetup )
+			{
+				TrackBoneSetupEnt( this );
+			}
 			
 			// This is necessary because it's possible that CalculateIKLocks will trigger our move children
 			// to call GetAbsOrigin(), and they'll use our OLD bone transforms to get their attachments
@@ -2982,7 +3064,10 @@ bool C_BaseAnimating::SetupBones( matrix3x4_t *pBoneToWorldOut, int nMaxBones, i
 			}
 
 			// Let pose debugger know that we are blending
-			g_pPoseDebugger->StartBlending( this, hdr );
+			if ( !g_bInThreadedBoneSetup )
+			{
+				g_pPoseDebugger->StartBlending( this, hdr );
+			}
 
 			StandardBlendingRules( hdr, pos, q, currentTime, bonesMaskNeedRecalc );
 
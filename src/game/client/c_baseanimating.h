@@ -185,6 +185,9 @@ public:
 	virtual	void StandardBlendingRules( CStudioHdr *pStudioHdr, Vector pos[], Quaternion q[], float currentTime, int boneMask );
 	void UnragdollBlend( CStudioHdr *hdr, Vector pos[], Quaternion q[], float currentTime );
 
+	// Set pos/q to the pose of our current sequence alone, before transitions and layers are blended in
+	virtual void BuildSequencePose( IBoneSetup &boneSetup, Vector pos[], Quaternion q[], float flCycle, float currentTime, const float poseParameter[], int boneMask );
+
 	void MaintainSequenceTransitions( IBoneSetup &boneSetup, float flCycle, Vector pos[], Quaternion q[] );
 	virtual void AccumulateLayers( IBoneSetup &boneSetup, Vector pos[], Quaternion q[], float currentTime );
 
@@ -470,7 +473,13 @@ protected:
 
 	virtual bool					ShouldFlipViewModel();
 
+	// Set up our bones on worker threads before rendering, along with the rest of the crowd (see ThreadedBoneSetup).
+	// For models drawn in large numbers, like mobs and zombies.
+	void							EnableParallelBoneSetup();
+
 private:
+	bool							PrepareParallelBoneSetup();
+
 	// This method should return true if the bones have changed + SetupBones needs to be called
 	virtual float					LastBoneChangedTime() { return FLT_MAX; }
 
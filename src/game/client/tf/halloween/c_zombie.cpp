@@ -17,6 +17,8 @@ END_RECV_TABLE()
 
 C_Zombie::C_Zombie()
 {
+	// zombies come in hordes
+	EnableParallelBoneSetup();
 }
 
 
@@ -16,6 +16,8 @@
 //-----------------------------------------------------------------------------
 IMPLEMENT_CLIENTCLASS_DT( C_TFFlyingMob, DT_TFFlyingMob, CTFFlyingMob )
 
+	RecvPropVectorXY( RECVINFO_NAME( m_vecNetworkOrigin, m_vecOrigin ) ),
+	RecvPropFloat( RECVINFO_NAME( m_vecNetworkOrigin[2], m_vecOrigin[2] ) ),
 	RecvPropVector( RECVINFO( m_lookAtSpot ) ),
 	
 END_RECV_TABLE()
@@ -25,6 +27,11 @@ END_RECV_TABLE()
 C_TFFlyingMob::C_TFFlyingMob()
 {
 	m_auraEffect = NULL;
+
+	// not networked for mobs
+	m_fadeMinDist = 0.0f;
+	m_fadeMaxDist = 0.0f;
+	m_flFadeScale = 0.0f;
 }
 
 
@@ -60,6 +67,13 @@ void C_TFFlyingMob::OnDataChanged( DataUpdateType_t updateType )
 	{
 		// eyeboss_aura_calm, eyeboss_aura_grumpy, eyeboss_aura_angry
 		m_auraEffect = ParticleProp()->Create( "eyeboss_aura_calm", PATTACH_ABSORIGIN_FOLLOW );
+
+		// pose parameters aren't networked for mobs - flying mobs are always angry, see CTFFlyingMob::Spawn
+		int angryPoseParameter = LookupPoseParameter( "anger" );
+		if ( angryPoseParameter >= 0 )
+		{
+			SetPoseParameter( angryPoseParameter, 1 );
+		}
 	}
 }
 
@@ -11,12 +11,28 @@
 
 //-----------------------------------------------------------------------------
 IMPLEMENT_CLIENTCLASS_DT( C_TFMeleeMob, DT_TFMeleeMob, CTFMeleeMob )
-	RecvPropFloat( RECVINFO( m_flHeadScale ) ),
+	RecvPropVectorXY( RECVINFO_NAME( m_vecNetworkOrigin, m_vecOrigin ) ),
+	RecvPropFloat( RECVINFO_NAME( m_vecNetworkOrigin[2], m_vecOrigin[2] ) ),
+	RecvPropFloat( RECVINFO_NAME( m_angNetworkAngles[1], m_angRotation[1] ) ),
+	RecvPropInt( RECVINFO( m_nType ) ),
 END_RECV_TABLE()
 
 
 C_TFMeleeMob::C_TFMeleeMob()
 {
+	m_nType = MELEE_NORMAL;
+
+	m_moveXPoseParameter = -1;
+	m_moveYPoseParameter = -1;
+	m_poseParameterModelIndex = -1;
+
+	// not networked for mobs
+	m_fadeMinDist = 0.0f;
+	m_fadeMaxDist = 0.0f;
+	m_flFadeScale = 0.0f;
+
+	// mobs come in hordes
+	EnableParallelBoneSetup();
 }
 
 
@@ -28,11 +44,67 @@ bool C_TFMeleeMob::ShouldCollide( int collisionGroup, int contentsMask ) const
 	return BaseClass::ShouldCollide( collisionGroup, contentsMask );
 }
 
+
+//-----------------------------------------------------------------------------
+// Pose parameters and playback rate are not networked for mobs, so derive them
+// from our motion the same way CTFMeleeMobBody::Update does on the server
+void C_TFMeleeMob::UpdateClientSideAnimation()
+{
+	if ( m_poseParameterModelIndex != GetModelIndex() )
+	{
+		m_moveXPoseParameter = LookupPoseParameter( "move_x" );
+		m_moveYPoseParameter = LookupPoseParameter( "move_y" );
+		m_poseParameterModelIndex = GetModelIndex();
+	}
+
+	Vector velocity;
+	EstimateAbsVelocity( velocity );
+	velocity.z = 0.0f;
+
+	float speed = velocity.NormalizeInPlace();
+
+	if ( speed < 0.01f )
+	{
+		// stopped
+		if ( m_moveXPoseParameter >= 0 )
+		{
+			SetPoseParameter( m_moveXPoseParameter, 0.0f );
+		}
+
+		if ( m_moveYPoseParameter >= 0 )
+		{
+			SetPoseParameter( m_moveYPoseParameter, 0.0f );
+		}
+	}
+	else
+	{
+		Vector forward, right;
+		AngleVectors( GetAbsAngles(), &forward, &right, NULL );
+
+		// move_x == 1.0 at full forward motion and -1.0 in full reverse
+		if ( m_moveXPoseParameter >= 0 )
+		{
+			SetPoseParameter( m_moveXPoseParameter, DotProduct( velocity, forward ) );
+		}
+
+		if ( m_moveYPoseParameter >= 0 )
+		{
+			SetPoseParameter( m_moveYPoseParameter, DotProduct( velocity, right ) );
+		}
+	}
+
+	// adjust animation speed to actual movement speed
+	float groundSpeed = GetSequenceGroundSpeed( GetSequence() ) * GetModelScale();
+	SetPlaybackRate( ( groundSpeed > 0.0f ) ? clamp( speed / groundSpeed, -4.f, 12.f ) : 1.0f );
+
+	BaseClass::UpdateClientSideAnimation();
+}
+
 extern void BuildBigHeadTransformations( CBaseAnimating *pObject, CStudioHdr *hdr, Vector *pos, Quaternion q[], const matrix3x4_t& cameraTransform, int boneMask, CBoneBitList &boneComputed, float flScale );
 void C_TFMeleeMob::BuildTransformations( CStudioHdr *hdr, Vector *pos, Quaternion q[], const matrix3x4_t& cameraTransform, int boneMask, CBoneBitList &boneComputed )
 {
 	BaseClass::BuildTransformations( hdr, pos, q, cameraTransform, boneMask, boneComputed );
 
 	m_BoneAccessor.SetWritableBones( BONE_USED_BY_ANYTHING );
-	BuildBigHeadTransformations( this, hdr, pos, q, cameraTransform, boneMask, boneComputed, m_flHeadScale );
+	BuildBigHeadTransformations( this, hdr, pos, q, cameraTransform, boneMask, boneComputed, GetMobHeadScale( (MobType_t)m_nType ) );
 }
@@ -22,12 +22,18 @@ public:
 
 	virtual bool ShouldCollide( int collisionGroup, int contentsMask ) const;
 
+	virtual void UpdateClientSideAnimation() OVERRIDE;
+
 	virtual void BuildTransformations( CStudioHdr *hdr, Vector *pos, Quaternion q[], const matrix3x4_t& cameraTransform, int boneMask, CBoneBitList &boneComputed ) OVERRIDE;
 
 private:
 	C_TFMeleeMob( const C_TFMeleeMob & );				// not defined, not accessible
 
-	float m_flHeadScale;
+	int m_nType;							// MobType_t
+
+	int m_moveXPoseParameter;
+	int m_moveYPoseParameter;
+	int m_poseParameterModelIndex;			// model the pose parameter indices were looked up for
 };
 
 #endif // C_TF_MELEE_MOB_H
@@ -889,6 +889,16 @@ Vector NextBotGroundLocomotion::ResolveZombieCollisions( const Vector &pos )
 #endif // _DEBUG
 
 
+//----------------------------------------------------------------------------------------------------------
+/**
+ * Adjust a move for nearby actors. By default actors only collide through traces.
+ */
+Vector NextBotGroundLocomotion::ResolveCrowdCollisions( const Vector &pos )
+{
+	return pos;
+}
+
+
 //----------------------------------------------------------------------------------------------------------
 /**
  * Move to newPos, resolving any collisions along the way
@@ -904,11 +914,15 @@ void NextBotGroundLocomotion::UpdatePosition( const Vector &newPos )
 
 	// avoid very nearby Actors to simulate "mushy" collisions between actors in contact with each other
 	//Vector adjustedNewPos = ResolveZombieCollisions( newPos );
-	Vector adjustedNewPos = newPos;
+	Vector adjustedNewPos = ResolveCrowdCollisions( newPos );
 
 	// check for collisions during move and resolve them	
-	const int recursionLimit = 3;
-	Vector safePos = ResolveCollision( m_nextBot->GetPosition(), adjustedNewPos, recursionLimit );
+	Vector safePos = adjustedNewPos;
+	if ( !IsMoveClearOfCollisions( m_nextBot->GetPosition(), adjustedNewPos ) )
+	{
+		const int recursionLimit = 3;
+		safePos = ResolveCollision( m_nextBot->GetPosition(), adjustedNewPos, recursionLimit );
+	}
 
 	// set the bot's position
 	if ( GetBot()->GetIntentionInterface()->IsPositionAllowed( GetBot(), safePos ) != ANSWER_NO )
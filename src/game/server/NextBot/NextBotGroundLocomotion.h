@@ -102,6 +102,9 @@ private:
 	virtual float GetFrictionSideways( void ) const;		// return magnitude of lateral friction
 	virtual float GetMaxYawRate( void ) const;				// return max rate of yaw rotation
 
+	virtual Vector ResolveCrowdCollisions( const Vector &pos );	// (EXTEND) push 'pos' away from nearby actors without tracing against them
+	virtual bool IsMoveClearOfCollisions( const Vector &from, const Vector &to ) const	{ return false; }	// (EXTEND) return true if the move is known to be unobstructed, skipping collision traces
+
 
 private:
 	NextBotCombatCharacter *m_nextBot;
@@ -25,6 +25,8 @@ ConVar NextBotDebugHistory( "nb_debug_history", IsX360() ? "0" : "1", FCVAR_CHEA
 INextBot::INextBot( void ) : m_debugHistory( MAX_NEXTBOT_DEBUG_HISTORY, 0 )	// CUtlVector: grow to max length, alloc 0 initially
 {
 	m_tickLastUpdate = -999;
+	m_updateTier = NEXTBOT_UPDATE_NEAR;
+	m_tickLastTierUpdate = -999;
 	m_id = -1;
 	m_componentList = NULL;
 	m_debugDisplayLine = 0;
@@ -67,6 +69,8 @@ INextBot::~INextBot()
 void INextBot::Reset( void )
 {
 	m_tickLastUpdate = -999;
+	m_updateTier = NEXTBOT_UPDATE_NEAR;
+	m_tickLastTierUpdate = -999;
 	m_debugType = 0;
 	m_debugDisplayLine = 0;
 
@@ -17,6 +17,34 @@
 class CBaseCombatCharacter;
 class PathFollower;
 
+//----------------------------------------------------------------------------------------------------------------
+/**
+ * Update level of detail. Bots far from and unseen by players are updated less often.
+ */
+enum NextBotUpdateTier
+{
+	NEXTBOT_UPDATE_NEAR,			// updated every nb_update_frequency
+	NEXTBOT_UPDATE_MID,				// updated every nb_lod_mid_frequency
+	NEXTBOT_UPDATE_FAR,				// updated every nb_lod_far_frequency
+
+	NEXTBOT_UPDATE_TIER_COUNT
+};
+
+
+//----------------------------------------------------------------------------------------------------------------
+/**
+ * Kinds of world events the NextBotManager relays to bots
+ */
+enum NextBotEventKind
+{
+	NEXTBOT_EVENT_OTHER_KILLED	= 0x01,
+	NEXTBOT_EVENT_SOUND			= 0x02,
+	NEXTBOT_EVENT_SPOKE_CONCEPT	= 0x04,
+	NEXTBOT_EVENT_WEAPON_FIRED	= 0x08,
+
+	NEXTBOT_EVENT_ALL			= 0x0F
+};
+
 //----------------------------------------------------------------------------------------------------------------
 /**
  * A general purpose filter interface for various bot systems
@@ -49,6 +77,29 @@ public:
 	int GetTickLastUpdate() const;
 	void SetTickLastUpdate( int );
 
+	NextBotUpdateTier GetUpdateTier( void ) const;
+	void SetUpdateTier( NextBotUpdateTier tier );
+	int GetTickLastTierUpdate( void ) const;
+	virtual bool ShouldUpdateAtFullRate( void ) const { return false; }	// (EXTEND) return true while in a state that must not be slowed by update LOD
+
+	/**
+	 * Split update. Each tick a bot is scheduled, the NextBotManager first calls
+	 * PrepareParallelThink() on the main thread, then ParallelThink() on a worker
+	 * thread alongside the other scheduled bots, then Update() as usual.
+	 * ParallelThink() may only read the world (traces, entity positions) and write
+	 * this bot's own results - movement, damage and entity I/O belong in Update().
+	 */
+	virtual bool HasParallelThink( void ) const { return false; }	// (EXTEND)
+	virtual void PrepareParallelThink( void ) { }					// (EXTEND) main thread - bring any shared state ParallelThink() reads up to date
+	virtual void ParallelThink( void ) { }							// (EXTEND) worker thread - read-only decisions for this tick
+
+	/**
+	 * Event subscription. The NextBotManager only relays events of the kinds
+	 * in GetEventInterest() that occur within GetEventInterestRange() of us.
+	 */
+	virtual unsigned int GetEventInterest( void ) const { return NEXTBOT_EVENT_ALL; }	// (EXTEND) mask of NextBotEventKind
+	virtual float GetEventInterestRange( NextBotEventKind kind ) const { return FLT_MAX; }	// (EXTEND)
+
 	virtual bool IsRemovedOnReset( void ) const { return true; }	// remove this bot when the NextBot manager calls Reset
 
 	virtual CBaseCombatCharacter *GetEntity( void ) const	= 0;
@@ -167,6 +218,8 @@ private:
 	int m_id;
 	bool m_bFlaggedForUpdate;
 	int m_tickLastUpdate;
+	NextBotUpdateTier m_updateTier;
+	int m_tickLastTierUpdate;
 
 	unsigned int m_debugType;
 	mutable int m_debugDisplayLine;
@@ -273,6 +326,22 @@ inline void INextBot::SetTickLastUpdate( int tick )
 	m_tickLastUpdate = tick;
 }
 
+inline NextBotUpdateTier INextBot::GetUpdateTier( void ) const
+{
+	return m_updateTier;
+}
+
+inline void INextBot::SetUpdateTier( NextBotUpdateTier tier )
+{
+	m_updateTier = tier;
+	m_tickLastTierUpdate = gpGlobals->tickcount;
+}
+
+inline int INextBot::GetTickLastTierUpdate( void ) const
+{
+	return m_tickLastTierUpdate;
+}
+
 inline bool INextBot::IsImmobile( void ) const
 {
 	return m_immobileTimer.HasStarted();
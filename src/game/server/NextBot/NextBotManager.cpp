@@ -6,6 +6,11 @@
 
 #include "NextBotManager.h"
 #include "NextBotInterface.h"
+#include "nav_mesh.h"
+#include "nav_pathfind.h"
+#include "Path/NextBotPathFollow.h"
+#include "datacache/imdlcache.h"
+#include "vstdlib/jobthread.h"
 
 #ifdef TERROR
 #include "ZombieBot/Infected/Infected.h"
@@ -25,6 +30,23 @@ ConVar nb_update_frequency( "nb_update_frequency", ".05", FCVAR_CHEAT );
 ConVar nb_update_framelimit( "nb_update_framelimit", ( IsDebug() ) ? "30" : "15", FCVAR_CHEAT );
 ConVar nb_update_maxslide( "nb_update_maxslide", "2", FCVAR_CHEAT );
 ConVar nb_update_debug( "nb_update_debug", "0", FCVAR_CHEAT );
+ConVar nb_path_budget( "nb_path_budget", "2", FCVAR_CHEAT, "Milliseconds per frame spent computing queued NextBot path requests" );
+
+ConVar nb_parallel_think( "nb_parallel_think", "1", FCVAR_CHEAT, "Run the read-only think phase of scheduled NextBots across the thread pool" );
+ConVar nb_parallel_think_min( "nb_parallel_think_min", "8", FCVAR_CHEAT, "Fewest thinking NextBots worth spreading across threads" );
+
+ConVar nb_event_batch( "nb_event_batch", "1", FCVAR_CHEAT, "Queue NextBot events and deliver them once per tick" );
+ConVar nb_event_cell_size( "nb_event_cell_size", "512", FCVAR_CHEAT, "Size of the spatial buckets NextBot events are sorted into for delivery", true, 1.0f, false, 0.0f );
+
+ConVar nb_lod( "nb_lod", "1", FCVAR_CHEAT, "Update NextBots far from and unseen by players less often" );
+ConVar nb_lod_near_range( "nb_lod_near_range", "1000", FCVAR_CHEAT, "Bots closer than this to a player update every nb_update_frequency" );
+ConVar nb_lod_far_range( "nb_lod_far_range", "2500", FCVAR_CHEAT, "Bots farther than this from every player update every nb_lod_far_frequency" );
+ConVar nb_lod_view_cone( "nb_lod_view_cone", "0.5", FCVAR_CHEAT, "Cosine of the half angle of a player's view within which bots are promoted one tier" );
+ConVar nb_lod_mid_frequency( "nb_lod_mid_frequency", "0.15", FCVAR_CHEAT );
+ConVar nb_lod_far_frequency( "nb_lod_far_frequency", "0.4", FCVAR_CHEAT );
+ConVar nb_lod_mid_budget( "nb_lod_mid_budget", "0.75", FCVAR_CHEAT, "Fraction of nb_update_framelimit mid tier bots may update within" );
+ConVar nb_lod_far_budget( "nb_lod_far_budget", "0.5", FCVAR_CHEAT, "Fraction of nb_update_framelimit far tier bots may update within" );
+ConVar nb_lod_retier_interval( "nb_lod_retier_interval", "0.25", FCVAR_CHEAT, "Seconds between re-evaluating a bot's update tier" );
 
 //---------------------------------------------------------------------------------------------
 //---------------------------------------------------------------------------------------------
@@ -234,6 +256,13 @@ void CC_WarpSelectedHere( const CCommand &args )
 static ConCommand WarpSelectedHere( "nb_warp_selected_here", CC_WarpSelectedHere, "Teleport the selected bot to your cursor position", FCVAR_CHEAT );
 
 
+//--------------------------------------------------------------------------------------------------------
+CON_COMMAND_F( nb_lod_stats, "Show the number of NextBots in each update tier and what they cost", FCVAR_CHEAT )
+{
+	TheNextBots().PrintUpdateTierStats();
+}
+
+
 //---------------------------------------------------------------------------------------------
 //---------------------------------------------------------------------------------------------
 NextBotManager::NextBotManager( void )
@@ -242,6 +271,14 @@ NextBotManager::NextBotManager( void )
 	m_selectedBot = NULL;
 	
 	m_iUpdateTickrate = 0;
+	m_curUpdateTier = NEXTBOT_UPDATE_NEAR;
+	m_isDispatching = false;
+
+	for( int t=0; t<NEXTBOT_UPDATE_TIER_COUNT; ++t )
+	{
+		m_tierTickInterval[t] = 0;
+		V_memset( &m_tierStats[t], 0, sizeof( TierStats ) );
+	}
 }
 
 //---------------------------------------------------------------------------------------------
@@ -270,6 +307,16 @@ void NextBotManager::Reset( void )
 	}
 
 	m_selectedBot = NULL;
+
+	// events raised before the reset are stale
+	FOR_EACH_VEC( m_eventQueue, e )
+	{
+		if ( m_eventQueue[e].keys )
+		{
+			m_eventQueue[e].keys->deleteThis();
+		}
+	}
+	m_eventQueue.RemoveAll();
 }
 
 
@@ -294,6 +341,12 @@ inline bool IsDead( INextBot *pBot )
 		{
 			return true;
 		}
+
+		if ( pEntity->IsDormant() )
+		{
+			// pooled entities waiting to be reused
+			return true;
+		}
 	}
 	return false;
 }
@@ -328,6 +381,9 @@ void NextBotManager::Update( void )
 			return;
 		}
 
+		// spread queued path computations over frames
+		UpdatePathRequests();
+
 		int tickRate = TIME_TO_TICKS( nb_update_frequency.GetFloat() );
 		if ( tickRate < 0 )
 		{
@@ -340,28 +396,64 @@ void NextBotManager::Update( void )
 			m_iUpdateTickrate = tickRate;
 		}
 
+		// lower tiers never update more often than the near tier
+		m_tierTickInterval[ NEXTBOT_UPDATE_NEAR ] = m_iUpdateTickrate;
+		m_tierTickInterval[ NEXTBOT_UPDATE_MID ] = MAX( m_iUpdateTickrate, TIME_TO_TICKS( nb_lod_mid_frequency.GetFloat() ) );
+		m_tierTickInterval[ NEXTBOT_UPDATE_FAR ] = MAX( m_tierTickInterval[ NEXTBOT_UPDATE_MID ], TIME_TO_TICKS( nb_lod_far_frequency.GetFloat() ) );
+
+		// fold last frame's tier costs into the running averages
+		for( int t=0; t<NEXTBOT_UPDATE_TIER_COUNT; ++t )
+		{
+			TierStats &stats = m_tierStats[t];
+			stats.avgFrameTime = 0.9f * stats.avgFrameTime + 0.1f * ( stats.frameTime * 1000.0 );
+			stats.frameTime = 0.0;
+			stats.run = 0;
+			stats.count = 0;
+		}
+
 		int i = 0;
 		int nScheduled = 0;
 		int nNonResponsive = 0;
 		int nDead = 0;
+		int nIntentionalSliders = 0;
 		if ( m_iUpdateTickrate > 0 )
 		{
 			INextBot *pBot;
+			int curtickcount = gpGlobals->tickcount;
+			int retierTicks = TIME_TO_TICKS( nb_lod_retier_interval.GetFloat() );
 
-			// Count dead bots, they won't update and balancing calculations should exclude them
+			CollectLODViewers();
+
+			// Count dead bots, they won't update and balancing calculations should exclude them.
+			// Re-tier live bots whose tier is stale.
 			for( i = m_botList.Head(); i != m_botList.InvalidIndex(); i = m_botList.Next( i ) )
 			{
-				if ( IsDead( m_botList[i] ) )
+				pBot = m_botList[i];
+				if ( IsDead( pBot ) )
 				{
+					// don't leave a stale update pending for when it is reused
+					pBot->FlagForUpdate( false );
 					nDead++;
+					continue;
 				}
-			}
 
+				if ( curtickcount - pBot->GetTickLastTierUpdate() >= retierTicks )
+				{
+					pBot->SetUpdateTier( ComputeUpdateTier( pBot ) );
+				}
 
-			int nTargetToRun = ceilf( (float)( m_botList.Count() - nDead ) / (float)m_iUpdateTickrate );
-			int curtickcount = gpGlobals->tickcount;
+				m_tierStats[ pBot->GetUpdateTier() ].count++;
+			}
 
-			for( i = m_botList.Head(); nTargetToRun && i != m_botList.InvalidIndex(); i = m_botList.Next( i ) )
+			// spread each tier's updates evenly over its interval
+			int nTargetToRun[ NEXTBOT_UPDATE_TIER_COUNT ];
+			for( int t=0; t<NEXTBOT_UPDATE_TIER_COUNT; ++t )
+			{
+				nTargetToRun[t] = ceilf( (float)m_tierStats[t].count / (float)m_tierTickInterval[t] );
+			}
+
+			// the list is in least recently updated order, so the most overdue bots of each tier go first
+			for( i = m_botList.Head(); i != m_botList.InvalidIndex(); i = m_botList.Next( i ) )
 			{
 				pBot = m_botList[i];
 				if ( pBot->IsFlaggedForUpdate() )
@@ -370,19 +462,24 @@ void NextBotManager::Update( void )
 					// Leave the flag set so that bot will run right away later, but be ignored
 					// until then
 					nNonResponsive++;
+					continue;
+				}
+
+				int tier = pBot->GetUpdateTier();
+				if ( curtickcount - pBot->GetTickLastUpdate() < m_tierTickInterval[ tier ] || IsDead( pBot ) )
+				{
+					continue;
+				}
+
+				if ( nTargetToRun[ tier ] > 0 )
+				{
+					pBot->FlagForUpdate();
+					nTargetToRun[ tier ]--;
+					nScheduled++;
 				}
 				else
 				{
-					if ( curtickcount - pBot->GetTickLastUpdate() < m_iUpdateTickrate )
-					{
-						break;
-					}
-					if ( !IsDead( pBot ) )
-					{
-						pBot->FlagForUpdate();
-						nTargetToRun--;
-						nScheduled++;
-					}
+					nIntentionalSliders++;
 				}
 			}
 		}
@@ -391,27 +488,210 @@ void NextBotManager::Update( void )
 			nScheduled = m_botList.Count();
 		}
 
+		RunParallelThink();
+
 		if ( nb_update_debug.GetBool() )
 		{
-			int nIntentionalSliders = 0;
-			if ( m_iUpdateTickrate > 0 )
+			Msg( "Frame %8d/tick %8d: %3d run of %3d, %3d sliders, %3d blocked slides, scheduled %3d for next tick, %3d intentional sliders, %d nonresponsive, %d dead\n", gpGlobals->framecount - 1, gpGlobals->tickcount - 1, g_nRun, m_botList.Count() - nDead, g_nSlid, g_nBlockedSlides, nScheduled, nIntentionalSliders, nNonResponsive, nDead );
+			g_nRun = g_nSlid = g_nBlockedSlides = 0;
+		}
+
+	}
+}
+
+//---------------------------------------------------------------------------------------------
+static void PreParallelThink( void )
+{
+	mdlcache->BeginLock();
+}
+
+static void PostParallelThink( void )
+{
+	mdlcache->EndLock();
+}
+
+static void ParallelThinkBot( INextBot *&bot )
+{
+	bot->ParallelThink();
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Run the think phase of every bot scheduled to update this tick.
+ * Bot entities update later this frame, after all thinking is done.
+ */
+void NextBotManager::RunParallelThink( void )
+{
+	VPROF_BUDGET( "NextBotManager::RunParallelThink", "NextBot" );
+
+	m_thinkVector.RemoveAll();
+
+	for( int i=m_botList.Head(); i != m_botList.InvalidIndex(); i = m_botList.Next( i ) )
+	{
+		INextBot *bot = m_botList[i];
+		if ( !bot->HasParallelThink() || IsDead( bot ) )
+		{
+			continue;
+		}
+
+		if ( m_iUpdateTickrate > 0 && !bot->IsFlaggedForUpdate() )
+		{
+			// not updating this tick
+			continue;
+		}
+
+		bot->PrepareParallelThink();
+		m_thinkVector.AddToTail( bot );
+	}
+
+	if ( m_thinkVector.Count() == 0 )
+	{
+		return;
+	}
+
+	int maxParallel = ( nb_parallel_think.GetBool() && m_thinkVector.Count() >= nb_parallel_think_min.GetInt() ) ? INT_MAX : 0;
+
+	ParallelProcess( "NextBotManager::RunParallelThink", m_thinkVector.Base(), m_thinkVector.Count(), &ParallelThinkBot, &PreParallelThink, &PostParallelThink, maxParallel );
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Queue a path computation from 'bot' to 'subject' for 'path'.
+ * If 'path' already has a pending request, it is replaced but keeps its place in the queue.
+ */
+void NextBotManager::RequestPath( INextBot *bot, PathFollower *path, CBaseCombatCharacter *subject, const IPathCost &costFunc )
+{
+	if ( !bot || !path || !subject )
+	{
+		return;
+	}
+
+	if ( path->m_pathRequest < 0 || !m_pathRequestList.IsValidIndex( path->m_pathRequest ) )
+	{
+		path->m_pathRequest = m_pathRequestList.AddToTail();
+	}
+
+	PathRequest &request = m_pathRequestList[ path->m_pathRequest ];
+	request.bot = bot;
+	request.path = path;
+	request.subject = subject;
+	request.cost = &costFunc;
+	request.shareKey = costFunc.GetShareKey();
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Drop the pending request of the given path, if any
+ */
+void NextBotManager::CancelPathRequest( PathFollower *path )
+{
+	if ( path->m_pathRequest >= 0 )
+	{
+		if ( m_pathRequestList.IsValidIndex( path->m_pathRequest ) )
+		{
+			m_pathRequestList.Remove( path->m_pathRequest );
+		}
+
+		path->m_pathRequest = -1;
+	}
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Compute queued paths in order until this frame's budget is spent.
+ * When a computed path is shareable, queued requests from the same start area
+ * to the same subject receive a copy instead of running their own search.
+ */
+void NextBotManager::UpdatePathRequests( void )
+{
+	if ( m_pathRequestList.Count() == 0 )
+	{
+		return;
+	}
+
+	VPROF_BUDGET( "NextBotManager::UpdatePathRequests", "NextBot" );
+
+	const double budget = nb_path_budget.GetFloat() / 1000.0;
+	const double startTime = Plat_FloatTime();
+
+	int nComputed = 0;
+	int nShared = 0;
+	int nDropped = 0;
+
+	while( m_pathRequestList.Count() )
+	{
+		// always make some progress, even if the budget is tiny
+		if ( nComputed > 0 && Plat_FloatTime() - startTime > budget )
+		{
+			break;
+		}
+
+		int head = m_pathRequestList.Head();
+		PathRequest request = m_pathRequestList[ head ];
+		m_pathRequestList.Remove( head );
+		request.path->m_pathRequest = -1;
+
+		CBaseCombatCharacter *subject = request.subject;
+		if ( !subject || IsDead( request.bot ) || !request.bot->GetEntity()->IsAlive() )
+		{
+			request.path->Invalidate();
+			request.path->OnPathRequestComplete( request.bot, Path::NO_PATH );
+			++nDropped;
+			continue;
+		}
+
+		request.path->Compute( request.bot, subject, *request.cost );
+		++nComputed;
+
+		Path::ResultType result = request.path->IsValid() ? request.path->GetResult() : Path::NO_PATH;
+		request.path->OnPathRequestComplete( request.bot, result );
+
+		if ( request.shareKey == 0 || !request.path->IsValid() )
+		{
+			continue;
+		}
+
+		CNavArea *startArea = request.bot->GetEntity()->GetLastKnownArea();
+		int team = request.bot->GetEntity()->GetTeamNumber();
+
+		int i = m_pathRequestList.Head();
+		while( i != m_pathRequestList.InvalidIndex() )
+		{
+			int next = m_pathRequestList.Next( i );
+
+			PathRequest &other = m_pathRequestList[i];
+			if ( other.shareKey == request.shareKey &&
+				 other.subject == request.subject &&
+				 !IsDead( other.bot ) &&
+				 other.bot->GetEntity()->GetLastKnownArea() == startArea &&
+				 other.bot->GetEntity()->GetTeamNumber() == team )
 			{
-				for( ; i != m_botList.InvalidIndex(); i = m_botList.Next( i ) )
-				{
-					if ( gpGlobals->tickcount - m_botList[i]->GetTickLastUpdate() >= m_iUpdateTickrate )
-					{
-						nIntentionalSliders++;
-					}
-				}
+				INextBot *otherBot = other.bot;
+				PathFollower *otherPath = other.path;
+
+				m_pathRequestList.Remove( i );
+				otherPath->m_pathRequest = -1;
+
+				otherPath->Copy( otherBot, *request.path );
+				otherPath->OnPathRequestComplete( otherBot, result );
+				++nShared;
 			}
 
-			Msg( "Frame %8d/tick %8d: %3d run of %3d, %3d sliders, %3d blocked slides, scheduled %3d for next tick, %3d intentional sliders, %d nonresponsive, %d dead\n", gpGlobals->framecount - 1, gpGlobals->tickcount - 1, g_nRun, m_botList.Count() - nDead, g_nSlid, g_nBlockedSlides, nScheduled, nIntentionalSliders, nNonResponsive, nDead );
-			g_nRun = g_nSlid = g_nBlockedSlides = 0;
+			i = next;
 		}
+	}
 
+	if ( nb_update_debug.GetBool() )
+	{
+		Msg( "Frame %8d/tick %8d: %3d paths computed, %3d shared, %3d dropped, %3d queued (%.2fms)\n", gpGlobals->framecount, gpGlobals->tickcount, nComputed, nShared, nDropped, m_pathRequestList.Count(), ( Plat_FloatTime() - startTime ) * 1000.0 );
 	}
 }
 
+
 //---------------------------------------------------------------------------------------------
 bool NextBotManager::ShouldUpdate( INextBot *bot )
 {
@@ -420,7 +700,19 @@ bool NextBotManager::ShouldUpdate( INextBot *bot )
 		return true;
 	}
 
+	int tier = bot->GetUpdateTier();
+
+	// lower tiers only get what the frame has left
 	float frameLimit = nb_update_framelimit.GetFloat();
+	if ( tier == NEXTBOT_UPDATE_MID )
+	{
+		frameLimit *= nb_lod_mid_budget.GetFloat();
+	}
+	else if ( tier == NEXTBOT_UPDATE_FAR )
+	{
+		frameLimit *= nb_lod_far_budget.GetFloat();
+	}
+
 	float sumFrameTime = 0;
 	if ( bot->IsFlaggedForUpdate() )
 	{
@@ -439,11 +731,11 @@ bool NextBotManager::ShouldUpdate( INextBot *bot )
 		}
 	}
 
-	int nTicksSlid = ( gpGlobals->tickcount - bot->GetTickLastUpdate() ) - m_iUpdateTickrate;
+	int nTicksSlid = ( gpGlobals->tickcount - bot->GetTickLastUpdate() ) - m_tierTickInterval[ tier ];
 
 	if ( nTicksSlid >= nb_update_maxslide.GetInt() )
 	{
-		if ( frameLimit == 0.0 || sumFrameTime < nb_update_framelimit.GetFloat() * 2.0 )
+		if ( frameLimit == 0.0 || sumFrameTime < frameLimit * 2.0 )
 		{
 			g_nBlockedSlides++;
 			return true;
@@ -473,6 +765,7 @@ void NextBotManager::NotifyBeginUpdate( INextBot *bot )
 	m_botList.LinkToTail( bot->GetBotId() );
 	bot->SetTickLastUpdate( gpGlobals->tickcount );
 
+	m_curUpdateTier = bot->GetUpdateTier();
 	m_CurUpdateStartTime = Plat_FloatTime();
 }
 
@@ -480,7 +773,115 @@ void NextBotManager::NotifyBeginUpdate( INextBot *bot )
 void NextBotManager::NotifyEndUpdate( INextBot *bot )
 {
 	// This might be a good place to detect a particular bot had spiked [3/14/2008 tom]
-	m_SumFrameTime += Plat_FloatTime() - m_CurUpdateStartTime;
+	double updateTime = Plat_FloatTime() - m_CurUpdateStartTime;
+	m_SumFrameTime += updateTime;
+
+	TierStats &stats = m_tierStats[ m_curUpdateTier ];
+	stats.frameTime += updateTime;
+	stats.run++;
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Gather the players whose proximity and view keep bots at full update rate
+ */
+void NextBotManager::CollectLODViewers( void )
+{
+	m_lodViewerVector.RemoveAll();
+
+	for( int i=1; i<=gpGlobals->maxClients; ++i )
+	{
+		CBasePlayer *player = UTIL_PlayerByIndex( i );
+		if ( !player || !player->IsAlive() || player->GetTeamNumber() <= TEAM_SPECTATOR )
+		{
+			continue;
+		}
+
+		LODViewer &viewer = m_lodViewerVector[ m_lodViewerVector.AddToTail() ];
+		viewer.eye = player->EyePosition();
+		player->EyeVectors( &viewer.forward );
+	}
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Choose how often the given bot should update
+ */
+NextBotUpdateTier NextBotManager::ComputeUpdateTier( INextBot *bot ) const
+{
+	if ( !nb_lod.GetBool() || m_lodViewerVector.Count() == 0 )
+	{
+		return NEXTBOT_UPDATE_NEAR;
+	}
+
+	if ( bot == m_selectedBot || bot->IsDebugging( NEXTBOT_DEBUG_ALL ) || bot->ShouldUpdateAtFullRate() )
+	{
+		return NEXTBOT_UPDATE_NEAR;
+	}
+
+	const Vector &pos = bot->GetEntity()->WorldSpaceCenter();
+	const float nearRangeSq = nb_lod_near_range.GetFloat() * nb_lod_near_range.GetFloat();
+	const float farRangeSq = nb_lod_far_range.GetFloat() * nb_lod_far_range.GetFloat();
+	const float viewCone = nb_lod_view_cone.GetFloat();
+
+	float closeRangeSq = FLT_MAX;
+	bool isInView = false;
+
+	FOR_EACH_VEC( m_lodViewerVector, it )
+	{
+		const LODViewer &viewer = m_lodViewerVector[ it ];
+
+		Vector to = pos - viewer.eye;
+		float rangeSq = to.LengthSqr();
+		if ( rangeSq < nearRangeSq )
+		{
+			return NEXTBOT_UPDATE_NEAR;
+		}
+
+		if ( rangeSq < closeRangeSq )
+		{
+			closeRangeSq = rangeSq;
+		}
+
+		// view cone only, no line of sight - this runs for every bot
+		if ( !isInView && DotProduct( to, viewer.forward ) > viewCone * FastSqrt( rangeSq ) )
+		{
+			isInView = true;
+		}
+	}
+
+	NextBotUpdateTier tier = ( closeRangeSq < farRangeSq ) ? NEXTBOT_UPDATE_MID : NEXTBOT_UPDATE_FAR;
+
+	if ( isInView )
+	{
+		// someone is looking our way, promote one tier
+		tier = (NextBotUpdateTier)( tier - 1 );
+	}
+
+	return tier;
+}
+
+
+//---------------------------------------------------------------------------------------------
+int NextBotManager::GetUpdateTickInterval( NextBotUpdateTier tier ) const
+{
+	return m_tierTickInterval[ tier ];
+}
+
+
+//---------------------------------------------------------------------------------------------
+void NextBotManager::PrintUpdateTierStats( void ) const
+{
+	static const char *tierName[ NEXTBOT_UPDATE_TIER_COUNT ] = { "near", "mid", "far" };
+
+	Msg( "%d NextBots, %d viewers\n", m_botList.Count(), m_lodViewerVector.Count() );
+	for( int t=0; t<NEXTBOT_UPDATE_TIER_COUNT; ++t )
+	{
+		const TierStats &stats = m_tierStats[t];
+		Msg( "  %-4s: %4d bots, every %2d ticks, %4d run last frame, %.2fms/frame avg\n", tierName[t], stats.count, m_tierTickInterval[t], stats.run, stats.avgFrameTime );
+	}
 }
 
 //---------------------------------------------------------------------------------------------
@@ -515,6 +916,19 @@ void NextBotManager::UnRegister( INextBot *bot )
 {
 	m_botList.Remove( bot->GetBotId() );
 
+	// drop any path requests still pending for this bot
+	int i = m_pathRequestList.Head();
+	while( i != m_pathRequestList.InvalidIndex() )
+	{
+		int next = m_pathRequestList.Next( i );
+		if ( m_pathRequestList[i].bot == bot )
+		{
+			m_pathRequestList[i].path->m_pathRequest = -1;
+			m_pathRequestList.Remove( i );
+		}
+		i = next;
+	}
+
 	if ( bot == m_selectedBot)
 	{
 		// we can't access virtual methods because this is called from a destructor, so just clear it
@@ -529,164 +943,388 @@ void NextBotManager::OnBeginChangeLevel( void )
 }
 
 
-//----------------------------------------------------------------------------------------------------------
-class NextBotKilledNotifyScan
+//---------------------------------------------------------------------------------------------
+/**
+ * Add an event to the queue, to be delivered by the next DispatchEvents()
+ */
+NextBotManager::QueuedEvent *NextBotManager::QueueEvent( NextBotEventKind kind, const Vector &pos, CBaseEntity *subject )
+{
+	QueuedEvent &event = m_eventQueue[ m_eventQueue.AddToTail() ];
+	event.kind = kind;
+	event.pos = pos;
+	event.subject = subject;
+	event.hasSubject = ( subject != NULL );
+	event.keys = NULL;
+
+	return &event;
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * When an actor is killed.  Propagate to interested NextBots.
+ */
+void NextBotManager::OnKilled( CBaseCombatCharacter *victim, const CTakeDamageInfo &info )
 {
-public:
-	NextBotKilledNotifyScan( CBaseCombatCharacter *victim, const CTakeDamageInfo &info )
+	QueuedEvent *event = QueueEvent( NEXTBOT_EVENT_OTHER_KILLED, victim->WorldSpaceCenter(), victim );
+	event->info = info;
+
+	if ( !nb_event_batch.GetBool() )
 	{
-		m_victim = victim;
-		m_info = info;
+		DispatchEvents();
 	}
+}
 
-	bool operator() ( INextBot *bot )
+
+//---------------------------------------------------------------------------------------------
+/**
+ * When an entity emits a sound
+ */
+void NextBotManager::OnSound( CBaseEntity *source, const Vector &pos, KeyValues *keys )
+{
+	QueuedEvent *event = QueueEvent( NEXTBOT_EVENT_SOUND, pos, source );
+
+	// the caller owns 'keys' and it won't outlive this call
+	event->keys = keys ? keys->MakeCopy() : NULL;
+
+	if ( !nb_event_batch.GetBool() )
+	{
+		DispatchEvents();
+	}
+
+	if ( source && IsDebugging( NEXTBOT_HEARING ) )
 	{
-		if ( bot->GetEntity()->IsAlive() && !bot->IsSelf( m_victim ) )
+		int r,g,b;
+		switch( source->GetTeamNumber() )
 		{
-			bot->OnOtherKilled( m_victim, m_info );
+			case FIRST_GAME_TEAM:		r = 0;   g = 255; b = 0; break;
+			case (FIRST_GAME_TEAM+1):	r = 255; g = 0;   b = 0; break;
+			default:					r = 255; g = 255; b = 0; break;
 		}
-		return true;
+		NDebugOverlay::Circle( pos, Vector( 1, 0, 0 ), Vector( 0, -1, 0 ), 5.0f, r, g, b, 255, true, 3.0f );
 	}
+}
 
-	CBaseCombatCharacter *m_victim;
-	CTakeDamageInfo m_info;
-};
+
+//---------------------------------------------------------------------------------------------
+/**
+ * When an Actor speaks a concept.
+ * Delivered immediately - the response is only valid for the duration of this call.
+ */
+void NextBotManager::OnSpokeConcept( CBaseCombatCharacter *who, AIConcept_t conc, AI_Response *response )
+{
+	const Vector &pos = who->WorldSpaceCenter();
+
+	for( int i=m_botList.Head(); i != m_botList.InvalidIndex(); i = m_botList.Next( i ) )
+	{
+		INextBot *bot = m_botList[i];
+		if ( bot->GetEntity()->IsAlive() && IsInterested( bot, NEXTBOT_EVENT_SPOKE_CONCEPT, pos ) )
+		{
+			bot->OnSpokeConcept( who, conc, response );
+		}
+	}
+
+	if ( IsDebugging( NEXTBOT_HEARING ) )
+	{
+		// const char *who = response->GetCriteria()->GetValue( response->GetCriteria()->FindCriterionIndex( "Who" ) );
+
+		// TODO: Need conc.GetStringConcept()
+		DevMsg( "%3.2f: OnSpokeConcept( %s, %s )\n", gpGlobals->curtime, who->GetDebugName(), "conc.GetStringConcept()" );
+	}
+}
 
 
 //---------------------------------------------------------------------------------------------
 /**
- * When an actor is killed.  Propagate to all NextBots.
+ * When someone fires a weapon
  */
-void NextBotManager::OnKilled( CBaseCombatCharacter *victim, const CTakeDamageInfo &info )
+void NextBotManager::OnWeaponFired( CBaseCombatCharacter *whoFired, CBaseCombatWeapon *weapon )
 {
-	NextBotKilledNotifyScan notify( victim, info );
-	TheNextBots().ForEachBot( notify );
+	QueuedEvent *event = QueueEvent( NEXTBOT_EVENT_WEAPON_FIRED, whoFired->WorldSpaceCenter(), whoFired );
+	event->weapon = weapon;
+
+	if ( !nb_event_batch.GetBool() )
+	{
+		DispatchEvents();
+	}
+
+	if ( IsDebugging( NEXTBOT_EVENTS ) )
+	{
+		DevMsg( "%3.2f: OnWeaponFired( %s, %s )\n", gpGlobals->curtime, whoFired->GetDebugName(), weapon->GetName() );
+	}
 }
 
 
-//----------------------------------------------------------------------------------------------------------
-class NextBotSoundNotifyScan
+//---------------------------------------------------------------------------------------------
+/**
+ * Return true if the given bot wants to hear about an event of the given kind at 'pos'
+ */
+bool NextBotManager::IsInterested( INextBot *bot, NextBotEventKind kind, const Vector &pos ) const
 {
-public:
-	NextBotSoundNotifyScan( CBaseEntity *source, const Vector &pos, KeyValues *keys ) : m_source( source ), m_pos( pos ), m_keys( keys )
+	if ( !( bot->GetEventInterest() & kind ) )
 	{
+		return false;
 	}
 
-	bool operator() ( INextBot *bot )
+	float range = bot->GetEventInterestRange( kind );
+	if ( range >= FLT_MAX )
 	{
-		if ( bot->GetEntity()->IsAlive() && !bot->IsSelf( m_source ) )
-		{
-			bot->OnSound( m_source, m_pos, m_keys );
-		}
 		return true;
 	}
 
-	CBaseEntity *m_source;
-	const Vector &m_pos;
-	KeyValues *m_keys;
-};
+	return ( bot->GetEntity()->WorldSpaceCenter() - pos ).IsLengthLessThan( range );
+}
+
+
+//---------------------------------------------------------------------------------------------
+static int EventKindIndex( unsigned int kind )
+{
+	int k = 0;
+	while( kind > 1 )
+	{
+		kind >>= 1;
+		++k;
+	}
+	return k;
+}
+
+
+//---------------------------------------------------------------------------------------------
+static int CompareEventIndex( const int *a, const int *b )
+{
+	return *a - *b;
+}
 
 
 //---------------------------------------------------------------------------------------------
 /**
- * When an entity emits a sound
+ * Gather the indices of the batched events of 'kindMask' kinds the given bot is interested in, in the order they occurred
  */
-void NextBotManager::OnSound( CBaseEntity *source, const Vector &pos, KeyValues *keys )
+void NextBotManager::CollectInterestingEvents( INextBot *bot, unsigned int kindMask, CUtlVector< int > *matchVector )
 {
-	NextBotSoundNotifyScan notify( source, pos, keys );
-	TheNextBots().ForEachBot( notify );
+	matchVector->RemoveAll();
 
-	if ( source && IsDebugging( NEXTBOT_HEARING ) )
+	unsigned int interest = bot->GetEventInterest() & kindMask;
+	if ( !interest )
 	{
-		int r,g,b;
-		switch( source->GetTeamNumber() )
+		return;
+	}
+
+	// fetch the range of each kind we care about once
+	float rangeSq[ 4 ];
+	float maxRange = 0.0f;
+	for( int k=0; k<4; ++k )
+	{
+		NextBotEventKind kind = (NextBotEventKind)( 1 << k );
+		if ( interest & kind )
 		{
-			case FIRST_GAME_TEAM:		r = 0;   g = 255; b = 0; break;
-			case (FIRST_GAME_TEAM+1):	r = 255; g = 0;   b = 0; break;
-			default:					r = 255; g = 255; b = 0; break;
+			float range = bot->GetEventInterestRange( kind );
+			rangeSq[k] = ( range >= FLT_MAX ) ? FLT_MAX : range * range;
+			maxRange = MAX( maxRange, range );
 		}
-		NDebugOverlay::Circle( pos, Vector( 1, 0, 0 ), Vector( 0, -1, 0 ), 5.0f, r, g, b, 255, true, 3.0f );
 	}
-}
 
+	const Vector &pos = bot->GetEntity()->WorldSpaceCenter();
+	const float cellSize = m_eventHash.GetCellSize();
 
-//----------------------------------------------------------------------------------------------------------
-class NextBotResponseNotifyScan
-{
-public:
-	NextBotResponseNotifyScan( CBaseCombatCharacter *who, AIConcept_t conc, AI_Response *response ) : m_who( who ), m_concept( conc ), m_response( response )
+	// the cells our interest covers, clamped to those holding any events
+	int minX = m_eventHash.GetMinCellX(), maxX = m_eventHash.GetMaxCellX();
+	int minY = m_eventHash.GetMinCellY(), maxY = m_eventHash.GetMaxCellY();
+
+	float cellRange = ceil( maxRange / cellSize );
+	if ( cellRange < EVENT_HASH_SIZE )
 	{
+		int myCellX = m_eventHash.CellCoord( pos.x );
+		int myCellY = m_eventHash.CellCoord( pos.y );
+		int r = (int)cellRange;
+
+		minX = MAX( minX, myCellX - r );
+		maxX = MIN( maxX, myCellX + r );
+		minY = MAX( minY, myCellY - r );
+		maxY = MIN( maxY, myCellY + r );
 	}
 
-	bool operator() ( INextBot *bot )
+	if ( minX > maxX || minY > maxY )
 	{
-		if ( bot->GetEntity()->IsAlive() )
+		// no events near us
+		return;
+	}
+
+	int64 cellCount = (int64)( maxX - minX + 1 ) * ( maxY - minY + 1 );
+	if ( cellRange >= EVENT_HASH_SIZE || cellCount > EVENT_HASH_SIZE || cellCount > m_eventBatch.Count() )
+	{
+		// visiting the cells would cost more than just checking every event
+		FOR_EACH_VEC( m_eventBatch, i )
 		{
-			bot->OnSpokeConcept( m_who, m_concept, m_response );
+			const QueuedEvent &event = m_eventBatch[i];
+			if ( !( interest & event.kind ) )
+			{
+				continue;
+			}
+
+			int k = EventKindIndex( event.kind );
+			if ( rangeSq[k] >= FLT_MAX || ( event.pos - pos ).LengthSqr() < rangeSq[k] )
+			{
+				matchVector->AddToTail( i );
+			}
 		}
-		return true;
+
+		return;
 	}
 
-	CBaseCombatCharacter *m_who;
-	AIConcept_t m_concept;
-	AI_Response *m_response;
-};
+	for( int cx = minX; cx <= maxX; ++cx )
+	{
+		for( int cy = minY; cy <= maxY; ++cy )
+		{
+			for( int i = m_eventHash.FirstInCell( cx, cy ); i >= 0; i = m_eventHash.NextInCell( i ) )
+			{
+				const QueuedEvent &event = m_eventBatch[i];
+				if ( !( interest & event.kind ) )
+				{
+					continue;
+				}
+
+				int k = EventKindIndex( event.kind );
+				if ( ( event.pos - pos ).LengthSqr() < rangeSq[k] )
+				{
+					matchVector->AddToTail( i );
+				}
+			}
+		}
+	}
+
+	// cells are visited out of order
+	matchVector->Sort( CompareEventIndex );
+}
 
 
 //---------------------------------------------------------------------------------------------
-/**
- * When an Actor speaks a concept
- */
-void NextBotManager::OnSpokeConcept( CBaseCombatCharacter *who, AIConcept_t conc, AI_Response *response )
+void NextBotManager::DeliverEvent( INextBot *bot, const QueuedEvent &event )
 {
-	NextBotResponseNotifyScan notify( who, conc, response );
-	TheNextBots().ForEachBot( notify );
+	CBaseEntity *subject = event.subject;
+	if ( event.hasSubject && !subject )
+	{
+		// removed immediately after raising the event, there is nothing left to pass along
+		return;
+	}
 
-	if ( IsDebugging( NEXTBOT_HEARING ) )
+	switch( event.kind )
 	{
-		// const char *who = response->GetCriteria()->GetValue( response->GetCriteria()->FindCriterionIndex( "Who" ) );
+	case NEXTBOT_EVENT_OTHER_KILLED:
+		if ( !bot->IsSelf( subject ) )
+		{
+			bot->OnOtherKilled( (CBaseCombatCharacter *)subject, event.info );
+		}
+		break;
 
-		// TODO: Need conc.GetStringConcept()
-		DevMsg( "%3.2f: OnSpokeConcept( %s, %s )\n", gpGlobals->curtime, who->GetDebugName(), "conc.GetStringConcept()" );
+	case NEXTBOT_EVENT_SOUND:
+		if ( !bot->IsSelf( subject ) )
+		{
+			bot->OnSound( subject, event.pos, event.keys );
+		}
+		break;
+
+	case NEXTBOT_EVENT_WEAPON_FIRED:
+		bot->OnWeaponFired( (CBaseCombatCharacter *)subject, event.weapon );
+		break;
+
+	default:
+		break;
 	}
 }
 
 
-//----------------------------------------------------------------------------------------------------------
-class NextBotWeaponFiredNotifyScan
+//---------------------------------------------------------------------------------------------
+/**
+ * Deliver the events raised since the last dispatch.
+ * Each bot only visits the events it subscribed to near it, instead of every
+ * event being broadcast to every bot as it happens.
+ */
+void NextBotManager::DispatchEvents( void )
 {
-public:
-	NextBotWeaponFiredNotifyScan( CBaseCombatCharacter *who, CBaseCombatWeapon *weapon ) : m_who( who ), m_weapon( weapon )
+	// a bot reacting to an event can raise another one, which is only queued
+	// while we are still delivering - the batch must not change under us
+	if ( m_isDispatching )
 	{
+		return;
 	}
 
-	bool operator() ( INextBot *bot )
+	m_isDispatching = true;
+
+	do
 	{
-		if ( bot->GetEntity()->IsAlive() )
-		{
-			bot->OnWeaponFired( m_who, m_weapon );
-		}
-		return true;
+		DispatchEventBatch();
 	}
+	while( !nb_event_batch.GetBool() && m_eventQueue.Count() > 0 );		// unbatched, deliver those raised meanwhile now
 
-	CBaseCombatCharacter *m_who;
-	CBaseCombatWeapon *m_weapon;
-};
+	m_isDispatching = false;
+}
 
 
 //---------------------------------------------------------------------------------------------
 /**
- * When someone fires a weapon
+ * Deliver the events queued so far as one batch
  */
-void NextBotManager::OnWeaponFired( CBaseCombatCharacter *whoFired, CBaseCombatWeapon *weapon )
+void NextBotManager::DispatchEventBatch( void )
 {
-	NextBotWeaponFiredNotifyScan notify( whoFired, weapon );
-	TheNextBots().ForEachBot( notify );
+	if ( m_eventQueue.Count() == 0 )
+	{
+		return;
+	}
 
-	if ( IsDebugging( NEXTBOT_EVENTS ) )
+	VPROF_BUDGET( "NextBotManager::DispatchEvents", "NextBot" );
+
+	// events raised while we deliver these go in the next batch
+	m_eventBatch.Swap( m_eventQueue );
+
+	m_eventHash.Reset( nb_event_cell_size.GetFloat() );
+	unsigned int kindMask = 0;
+
+	FOR_EACH_VEC( m_eventBatch, i )
 	{
-		DevMsg( "%3.2f: OnWeaponFired( %s, %s )\n", gpGlobals->curtime, whoFired->GetDebugName(), weapon->GetName() );
+		m_eventHash.Insert( m_eventBatch[i].pos );
+		kindMask |= m_eventBatch[i].kind;
 	}
+
+	int nDelivered = 0;
+
+	for( int b=m_botList.Head(); b != m_botList.InvalidIndex(); b = m_botList.Next( b ) )
+	{
+		INextBot *bot = m_botList[b];
+		if ( !bot->GetEntity()->IsAlive() )
+		{
+			continue;
+		}
+
+		CollectInterestingEvents( bot, kindMask, &m_eventMatchVector );
+
+		FOR_EACH_VEC( m_eventMatchVector, it )
+		{
+			// an earlier event may have killed us
+			if ( !bot->GetEntity()->IsAlive() )
+			{
+				break;
+			}
+
+			DeliverEvent( bot, m_eventBatch[ m_eventMatchVector[ it ] ] );
+			++nDelivered;
+		}
+	}
+
+	if ( nb_update_debug.GetBool() )
+	{
+		Msg( "Frame %8d/tick %8d: %3d events dispatched, %4d deliveries\n", gpGlobals->framecount, gpGlobals->tickcount, m_eventBatch.Count(), nDelivered );
+	}
+
+	FOR_EACH_VEC( m_eventBatch, i )
+	{
+		if ( m_eventBatch[i].keys )
+		{
+			m_eventBatch[i].keys->deleteThis();
+		}
+	}
+
+	m_eventBatch.RemoveAll();
 }
 
 
@@ -6,8 +6,11 @@
 #define _NEXT_BOT_MANAGER_H_
 
 #include "NextBotInterface.h"
+#include "NextBotSpatialHash.h"
 
 class CTerrorPlayer;
+class PathFollower;
+class IPathCost;
 
 //----------------------------------------------------------------------------------------------------------------
 /**
@@ -28,6 +31,15 @@ public:
 
 	int GetNextBotCount( void ) const;				// How many nextbots are alive right now?
 
+	/**
+	 * Update level of detail.
+	 * Each bot is assigned a tier from its range to the closest player, whether a player
+	 * is looking its way and its own ShouldUpdateAtFullRate(). Lower tiers update less
+	 * often and only while the frame has budget left after higher tiers.
+	 */
+	int GetUpdateTickInterval( NextBotUpdateTier tier ) const;	// ticks between updates of the given tier
+	void PrintUpdateTierStats( void ) const;
+
 
 	/**
 	 * Populate given vector with all bots in the system
@@ -99,6 +111,16 @@ public:
 		return close;
 	}
 
+	/**
+	 * Path request queue.
+	 * Requests are computed in order within a per-frame time budget and delivered to
+	 * the requesting PathFollower via OnPathRequestComplete(). A new request from the
+	 * same PathFollower replaces its pending one. The cost functor must outlive the request.
+	 */
+	void RequestPath( INextBot *bot, PathFollower *path, CBaseCombatCharacter *subject, const IPathCost &costFunc );
+	void CancelPathRequest( PathFollower *path );
+	int GetPathRequestCount( void ) const;			// number of pending path requests
+
 	/**
 	 * Event propagators
 	 */
@@ -110,6 +132,9 @@ public:
 	virtual void OnSpokeConcept( CBaseCombatCharacter *who, AIConcept_t conc, AI_Response *response );	// when an Actor speaks a concept
 	virtual void OnWeaponFired( CBaseCombatCharacter *whoFired, CBaseCombatWeapon *weapon );		// when someone fires a weapon
 
+	void DispatchEvents( void );					// deliver queued events to the bots interested in them, once per tick
+	int GetQueuedEventCount( void ) const;
+
 	/**
 	 * Debugging
 	 */
@@ -145,8 +170,71 @@ protected:
 	int Register( INextBot *bot );
 	void UnRegister( INextBot *bot );
 
+	void UpdatePathRequests( void );				// compute queued paths within budget
+	void RunParallelThink( void );					// think phase for the bots scheduled this tick
+	CUtlVector< INextBot * > m_thinkVector;
+
+	void CollectLODViewers( void );
+	NextBotUpdateTier ComputeUpdateTier( INextBot *bot ) const;
+
+	struct LODViewer
+	{
+		Vector eye;
+		Vector forward;
+	};
+	CUtlVector< LODViewer > m_lodViewerVector;		// players that keep nearby bots at full update rate
+
+	int m_tierTickInterval[ NEXTBOT_UPDATE_TIER_COUNT ];
+
+	struct TierStats
+	{
+		int count;									// live bots in this tier
+		int run;									// bots of this tier updated this frame
+		double frameTime;							// time spent updating this tier this frame
+		float avgFrameTime;							// smoothed time per frame, in milliseconds
+	};
+	TierStats m_tierStats[ NEXTBOT_UPDATE_TIER_COUNT ];
+	NextBotUpdateTier m_curUpdateTier;				// tier of the bot being updated
+
+	struct PathRequest
+	{
+		INextBot *bot;
+		PathFollower *path;
+		CHandle< CBaseCombatCharacter > subject;
+		const IPathCost *cost;
+		int shareKey;								// requests with equal non-zero keys, start and goal areas share one result
+	};
+	CUtlLinkedList< PathRequest > m_pathRequestList;
+
 	CUtlLinkedList< INextBot * > m_botList;				// list of all active NextBots
 
+	/**
+	 * Queued events are hashed by position, so each bot only visits the
+	 * events in the cells its interest range overlaps.
+	 */
+	struct QueuedEvent
+	{
+		NextBotEventKind kind;
+		Vector pos;
+		EHANDLE subject;							// victim, sound source or shooter
+		bool hasSubject;							// false if raised without one, rather than the subject being gone
+		CTakeDamageInfo info;						// NEXTBOT_EVENT_OTHER_KILLED
+		CHandle< CBaseCombatWeapon > weapon;		// NEXTBOT_EVENT_WEAPON_FIRED
+		KeyValues *keys;							// NEXTBOT_EVENT_SOUND, our own copy
+	};
+	enum { EVENT_HASH_SIZE = 256 };
+	CUtlVector< QueuedEvent > m_eventQueue;			// events raised since the last dispatch
+	CUtlVector< QueuedEvent > m_eventBatch;			// events being dispatched
+	CNextBotSpatialHash< EVENT_HASH_SIZE > m_eventHash;	// positions of m_eventBatch, same indices
+	CUtlVector< int > m_eventMatchVector;
+	bool m_isDispatching;							// delivering m_eventBatch, new events only get queued
+
+	void DispatchEventBatch( void );
+	QueuedEvent *QueueEvent( NextBotEventKind kind, const Vector &pos, CBaseEntity *subject );
+	void CollectInterestingEvents( INextBot *bot, unsigned int kindMask, CUtlVector< int > *matchVector );
+	void DeliverEvent( INextBot *bot, const QueuedEvent &event );
+	bool IsInterested( INextBot *bot, NextBotEventKind kind, const Vector &pos ) const;
+
 	int m_iUpdateTickrate;
 	double m_CurUpdateStartTime;
 	double m_SumFrameTime;
@@ -169,6 +257,16 @@ inline int NextBotManager::GetNextBotCount( void ) const
 	return m_botList.Count();
 }
 
+inline int NextBotManager::GetPathRequestCount( void ) const
+{
+	return m_pathRequestList.Count();
+}
+
+inline int NextBotManager::GetQueuedEventCount( void ) const
+{
+	return m_eventQueue.Count();
+}
+
 inline bool NextBotManager::IsDebugging( unsigned int type ) const
 {
 	if ( type & m_debugType )
@@ -0,0 +1,114 @@
+// NextBotSpatialHash.h
+// Fixed size spatial hash of 2D grid cells, for per-tick neighbor queries
+//========= Copyright Valve Corporation, All rights reserved. ============//
+
+#ifndef _NEXT_BOT_SPATIAL_HASH_H_
+#define _NEXT_BOT_SPATIAL_HASH_H_
+
+#include "utlvector.h"
+
+//--------------------------------------------------------------------------------------------
+/**
+ * Hashes items by the grid cell their position falls into.
+ * Items are numbered in the order they are inserted, so callers keep their own data
+ * in a parallel vector and use these indices into it.
+ * Any number of cells share the HASH_SIZE buckets - FirstInCell() and NextInCell()
+ * skip items of other cells that hash alike.
+ */
+template < int HASH_SIZE >
+class CNextBotSpatialHash
+{
+public:
+	CNextBotSpatialHash( float cellSize = 1.0f )
+	{
+		COMPILE_TIME_ASSERT( ( HASH_SIZE & ( HASH_SIZE - 1 ) ) == 0 );		// must be a power of two
+		Reset( cellSize );
+	}
+
+	void Reset( float cellSize )						// remove all items and set the cell size for the next ones
+	{
+		m_cellSize = cellSize;
+		m_itemVector.RemoveAll();
+
+		for( int i=0; i<HASH_SIZE; ++i )
+		{
+			m_cellHead[i] = -1;
+		}
+
+		m_minCellX = m_minCellY = INT_MAX;
+		m_maxCellX = m_maxCellY = INT_MIN;
+	}
+
+	int Insert( const Vector &pos )						// add an item at the given position and return its index
+	{
+		Item_t item;
+		item.m_cellX = CellCoord( pos.x );
+		item.m_cellY = CellCoord( pos.y );
+
+		m_minCellX = MIN( m_minCellX, item.m_cellX );
+		m_minCellY = MIN( m_minCellY, item.m_cellY );
+		m_maxCellX = MAX( m_maxCellX, item.m_cellX );
+		m_maxCellY = MAX( m_maxCellY, item.m_cellY );
+
+		int bucket = HashCell( item.m_cellX, item.m_cellY );
+		item.m_nextInBucket = m_cellHead[ bucket ];
+		m_cellHead[ bucket ] = m_itemVector.AddToTail( item );
+
+		return m_cellHead[ bucket ];
+	}
+
+	int Count( void ) const						{ return m_itemVector.Count(); }
+	float GetCellSize( void ) const				{ return m_cellSize; }
+	int CellCoord( float v ) const				{ return (int)floor( v / m_cellSize ); }
+
+	int GetCellX( int i ) const					{ return m_itemVector[i].m_cellX; }
+	int GetCellY( int i ) const					{ return m_itemVector[i].m_cellY; }
+
+	// bounds of the occupied cells, min > max if empty
+	int GetMinCellX( void ) const				{ return m_minCellX; }
+	int GetMinCellY( void ) const				{ return m_minCellY; }
+	int GetMaxCellX( void ) const				{ return m_maxCellX; }
+	int GetMaxCellY( void ) const				{ return m_maxCellY; }
+
+	/**
+	 * Iterate the items in cell (x,y):
+	 * for( int i = hash.FirstInCell( x, y ); i >= 0; i = hash.NextInCell( i ) )
+	 */
+	int FirstInCell( int x, int y ) const
+	{
+		return SkipToCell( m_cellHead[ HashCell( x, y ) ], x, y );
+	}
+
+	int NextInCell( int i ) const
+	{
+		const Item_t &item = m_itemVector[i];
+		return SkipToCell( item.m_nextInBucket, item.m_cellX, item.m_cellY );
+	}
+
+	static int HashCell( int x, int y )			{ return ( x * 73856093 ^ y * 19349663 ) & ( HASH_SIZE - 1 ); }
+
+private:
+	int SkipToCell( int i, int x, int y ) const
+	{
+		while( i >= 0 && ( m_itemVector[i].m_cellX != x || m_itemVector[i].m_cellY != y ) )
+		{
+			i = m_itemVector[i].m_nextInBucket;
+		}
+
+		return i;
+	}
+
+	struct Item_t
+	{
+		int m_cellX, m_cellY;
+		int m_nextInBucket;			// next item in the same bucket, or -1
+	};
+
+	CUtlVector< Item_t > m_itemVector;
+	int m_cellHead[ HASH_SIZE ];
+	float m_cellSize;
+	int m_minCellX, m_minCellY;
+	int m_maxCellX, m_maxCellY;
+};
+
+#endif // _NEXT_BOT_SPATIAL_HASH_H_
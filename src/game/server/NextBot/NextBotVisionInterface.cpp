@@ -13,11 +13,10 @@
 #include "NextBotBodyInterface.h"
 #include "NextBotUtil.h"
 
-#ifdef TERROR
 #include "querycache.h"
-#endif
 
 #include "tier0/vprof.h"
+#include "mathlib/ssemath.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -25,6 +24,9 @@
 
 ConVar nb_blind( "nb_blind", "0", FCVAR_CHEAT, "Disable vision" );
 ConVar nb_debug_known_entities( "nb_debug_known_entities", "0", FCVAR_CHEAT, "Show the 'known entities' for the bot that is the current spectator target" );
+ConVar nb_vision_cull( "nb_vision_cull", "1", FCVAR_CHEAT, "Reject potentially visible entities out of range, view or nav area visibility in batches before testing each one" );
+ConVar nb_vision_los_cache( "nb_vision_los_cache", "1", FCVAR_CHEAT, "Use the query cache for line-of-sight checks to entities" );
+ConVar nb_vision_los_cache_interval( "nb_vision_los_cache_interval", "0.1", FCVAR_CHEAT, "Seconds a cached line-of-sight result to an entity is reused" );
 
 
 //------------------------------------------------------------------------------------------
@@ -363,6 +365,114 @@ public:
 };
 
 
+//------------------------------------------------------------------------------------------
+/**
+ * Remove the entities we can't possibly see from 'potentiallyVisible': those out of range,
+ * outside of our field of view, or in areas not potentially visible from ours.
+ * Range and field of view are tested four entities at a time. Every test is conservative,
+ * IsAbleToSee() still decides for the entities that remain. Fields of view of 180 degrees
+ * or more aren't culled by view at all.
+ */
+void IVision::CullPotentiallyVisibleEntities( CUtlVector< CBaseEntity * > *potentiallyVisible ) const
+{
+	VPROF_BUDGET( "IVision::CullPotentiallyVisibleEntities", "NextBot" );
+
+	CBaseCombatCharacter *me = GetBot()->GetEntity();
+	IBody *body = GetBot()->GetBodyInterface();
+
+	// without visibility data no other area is potentially visible, so only cull by area on analyzed meshes
+	CNavArea *myArea = TheNavMesh->IsAnalyzed() ? me->GetLastKnownArea() : NULL;
+
+	FourVectors eye, view, myCenter;
+	eye.DuplicateVector( body->GetEyePosition() );
+	view.DuplicateVector( body->GetViewVector() );
+	myCenter.DuplicateVector( me->WorldSpaceCenter() );
+
+	// the test below only holds for fields of view under 180 degrees, wider ones aren't culled by view
+	const bool isFOVCulled = ( m_cosHalfFOV > 0.0f );
+	const fltx4 cosHalfFOVSq = ReplicateX4( m_cosHalfFOV * m_cosHalfFOV );
+	const fltx4 range = ReplicateX4( GetMaxVisionRange() + me->CollisionProp()->BoundingRadius() );
+
+	const int count = potentiallyVisible->Count();
+	int keepCount = 0;
+
+	for( int i=0; i<count; i += 4 )
+	{
+		CBaseEntity *subject[4];
+		Vector center[4], subjectEye[4];
+		float radius[4];
+
+		for( int j=0; j<4; ++j )
+		{
+			// pad the last group with empty slots
+			subject[j] = ( i+j < count ) ? potentiallyVisible->Element( i+j ) : NULL;
+
+			if ( subject[j] )
+			{
+				center[j] = subject[j]->WorldSpaceCenter();
+				subjectEye[j] = subject[j]->EyePosition();
+				radius[j] = subject[j]->CollisionProp()->BoundingRadius();
+			}
+			else
+			{
+				center[j] = subjectEye[j] = vec3_origin;
+				radius[j] = 0.0f;
+			}
+		}
+
+		// bounding spheres closer than our vision range (IsRangeGreaterThan() measures between the collision boxes)
+		FourVectors fourCenter;
+		fourCenter.LoadAndSwizzle( center[0], center[1], center[2], center[3] );
+
+		FourVectors between = fourCenter;
+		between -= myCenter;
+
+		fltx4 maxRange = AddSIMD( range, LoadUnalignedSIMD( radius ) );
+		fltx4 isInRange = CmpLeSIMD( between * between, MulSIMD( maxRange, maxRange ) );
+
+		fltx4 isCandidate = isInRange;
+
+		if ( isFOVCulled )
+		{
+			// center or eyes within our field of view, as PointWithinViewAngle() computes it
+			FourVectors fourEye;
+			fourEye.LoadAndSwizzle( subjectEye[0], subjectEye[1], subjectEye[2], subjectEye[3] );
+
+			fltx4 isInFOV = Four_Zeros;
+			FourVectors *spot[2] = { &fourCenter, &fourEye };
+			for( int s=0; s<2; ++s )
+			{
+				FourVectors to = *spot[s];
+				to -= eye;
+
+				fltx4 cosDiff = to * view;
+				fltx4 isInView = AndSIMD( CmpGeSIMD( cosDiff, Four_Zeros ), CmpGtSIMD( MulSIMD( cosDiff, cosDiff ), MulSIMD( to * to, cosHalfFOVSq ) ) );
+				isInFOV = OrSIMD( isInFOV, isInView );
+			}
+
+			isCandidate = AndSIMD( isCandidate, isInFOV );
+		}
+
+		int keepMask = TestSignSIMD( isCandidate );
+
+		for( int j=0; j<4; ++j )
+		{
+			if ( !subject[j] || !( keepMask & ( 1 << j ) ) )
+				continue;
+
+			CBaseCombatCharacter *combat = subject[j]->MyCombatCharacterPointer();
+			if ( combat && myArea && combat->GetLastKnownArea() && !myArea->IsPotentiallyVisible( combat->GetLastKnownArea() ) )
+				continue;
+
+			// never overwrites an entry of a group not yet loaded, since keepCount <= i
+			potentiallyVisible->Element( keepCount++ ) = subject[j];
+		}
+	}
+
+	potentiallyVisible->RemoveMultipleFromTail( count - keepCount );
+}
+
+
 //------------------------------------------------------------------------------------------
 void IVision::UpdateKnownEntities( void )
 {
@@ -372,6 +482,11 @@ void IVision::UpdateKnownEntities( void )
 	CUtlVector< CBaseEntity * > potentiallyVisible;
 	CollectPotentiallyVisibleEntities( &potentiallyVisible );
 
+	if ( nb_vision_cull.GetBool() )
+	{
+		CullPotentiallyVisibleEntities( &potentiallyVisible );
+	}
+
 	// collect set of visible and recognized entities at this moment
 	CollectVisible visibleNow( this );
 	FOR_EACH_VEC( potentiallyVisible, pit )
@@ -746,9 +861,15 @@ bool IVision::IsLineOfSightClearToEntity( const CBaseEntity *subject, Vector *vi
 
 #else
 
-	// TODO: Use plain-old traces until querycache/etc gets integrated
 	VPROF_BUDGET( "IVision::IsLineOfSightClearToEntity", "NextBot" );
 
+	// the query cache is only safe to use from the main thread
+	EEntityOffsetMode_t eyeMode;
+	if ( !visibleSpot && nb_vision_los_cache.GetBool() && ThreadInMainThread() && GetEyeOffsetMode( &eyeMode ) )
+	{
+		return IsLineOfSightClearToEntityCached( subject, eyeMode );
+	}
+
 	trace_t result;
 	NextBotTraceFilterIgnoreActors filter( subject, COLLISION_GROUP_NONE );
 
@@ -774,6 +895,60 @@ bool IVision::IsLineOfSightClearToEntity( const CBaseEntity *subject, Vector *vi
 }
 
 
+//------------------------------------------------------------------------------------------
+/**
+ * The query cache can only trace from points on our entity. Return the one our body
+ * uses as its eye position, or false if it uses some other point.
+ */
+bool IVision::GetEyeOffsetMode( EEntityOffsetMode_t *mode ) const
+{
+	CBaseCombatCharacter *me = GetBot()->GetEntity();
+	const Vector &eye = GetBot()->GetBodyInterface()->GetEyePosition();
+
+	if ( VectorsAreEqual( eye, me->EyePosition(), 0.1f ) )
+	{
+		*mode = EOFFSET_MODE_EYEPOSITION;
+		return true;
+	}
+
+	if ( VectorsAreEqual( eye, me->WorldSpaceCenter(), 0.1f ) )
+	{
+		*mode = EOFFSET_MODE_WORLDSPACE_CENTER;
+		return true;
+	}
+
+	return false;
+}
+
+
+//------------------------------------------------------------------------------------------
+/**
+ * Line-of-sight from our 'eyeMode' point to the subject's center, eyes, or feet, through the query cache.
+ * Queries made this tick are issued again together, in parallel, by UpdateQueryCache()
+ * before entities think next tick, so the results are usually ready when we ask.
+ */
+bool IVision::IsLineOfSightClearToEntityCached( const CBaseEntity *subject, EEntityOffsetMode_t eyeMode ) const
+{
+	static const EEntityOffsetMode_t spot[] = { EOFFSET_MODE_WORLDSPACE_CENTER, EOFFSET_MODE_EYEPOSITION, EOFFSET_MODE_ABSORIGIN };
+
+	CBaseEntity *target = const_cast< CBaseEntity * >( subject );
+
+	for( int i=0; i<ARRAYSIZE( spot ); ++i )
+	{
+		if ( IsLineOfSightBetweenTwoEntitiesClear( GetBot()->GetEntity(), eyeMode,
+												   target, spot[i],
+												   target, COLLISION_GROUP_NONE,
+												   MASK_BLOCKLOS_AND_NPCS|CONTENTS_IGNORE_NODRAW_OPAQUE,
+												   IgnoreActorsTraceFilterFunction, nb_vision_los_cache_interval.GetFloat() ) )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
 //------------------------------------------------------------------------------------------
 /**
  * Are we looking directly at the given position
@@ -8,6 +8,7 @@
 
 #include "NextBotComponentInterface.h"
 #include "NextBotKnownEntity.h"
+#include "querycache.h"
 
 class IBody;
 class INextBotEntityFilter;
@@ -116,6 +117,9 @@ private:
 	
 	CUtlVector< CKnownEntity > m_knownEntityVector;		// the set of enemies/friends we are aware of
 	void UpdateKnownEntities( void );
+	void CullPotentiallyVisibleEntities( CUtlVector< CBaseEntity * > *potentiallyVisible ) const;	// remove the entities we can't possibly see
+	bool GetEyeOffsetMode( EEntityOffsetMode_t *mode ) const;
+	bool IsLineOfSightClearToEntityCached( const CBaseEntity *subject, EEntityOffsetMode_t eyeMode ) const;
 	bool IsAwareOf( const CKnownEntity &known ) const;	// return true if our reaction time has passed for this entity
 	mutable CHandle< CBaseEntity > m_primaryThreat;
 
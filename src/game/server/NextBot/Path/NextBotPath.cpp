@@ -9,6 +9,7 @@
 #include "fmtstr.h"
 
 #include "NextBotPath.h"
+#include "NextBotPathCache.h"
 #include "NextBotInterface.h"
 #include "NextBotLocomotionInterface.h"
 #include "NextBotBodyInterface.h"
@@ -36,6 +37,58 @@ Path::Path( void )
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Fill in the areas of a path recently computed between the same areas with the same cost.
+ * Returns false if there is none.
+ */
+bool Path::AssembleCachedPath( CNavArea *startArea, CNavArea *goalArea, int shareKey, int teamID, bool *pathResult )
+{
+	if ( shareKey == 0 || goalArea == NULL )
+		return false;
+
+	CNextBotPathCache::Key key = { startArea, goalArea, shareKey, teamID };
+	CNextBotPathCache::Step steps[ MAX_PATH_SEGMENTS-1 ];
+
+	int count = TheNextBotPathCache().Find( key, steps, MAX_PATH_SEGMENTS-1, pathResult );
+	if ( count == 0 )
+		return false;
+
+	m_segmentCount = count;
+	for( int i=0; i<count; ++i )
+	{
+		m_path[i].area = steps[i].area;
+		m_path[i].how = steps[i].how;
+		m_path[i].type = ON_GROUND;
+	}
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Remember the areas just assembled, so other paths between the same areas can skip the search
+ */
+void Path::CachePath( CNavArea *startArea, CNavArea *goalArea, int shareKey, int teamID, bool pathResult ) const
+{
+	if ( shareKey == 0 || goalArea == NULL )
+		return;
+
+	CNextBotPathCache::Key key = { startArea, goalArea, shareKey, teamID };
+	CNextBotPathCache::Step steps[ MAX_PATH_SEGMENTS-1 ];
+
+	int count = MIN( m_segmentCount, MAX_PATH_SEGMENTS-1 );
+	for( int i=0; i<count; ++i )
+	{
+		steps[i].area = m_path[i].area;
+		steps[i].how = m_path[i].how;
+	}
+
+	TheNextBotPathCache().Store( key, steps, count, pathResult );
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Determine actual path positions
@@ -852,6 +905,8 @@ void Path::Copy( INextBot *bot, const Path &path )
 		m_path[i] = path.m_path[i];
 	}
 	m_segmentCount = path.m_segmentCount;
+	m_subject = path.m_subject;
+	m_ageTimer = path.m_ageTimer;
 
 	OnPathChanged( bot, COMPLETE_PATH );
 }
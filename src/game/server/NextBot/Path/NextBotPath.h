@@ -7,6 +7,7 @@
 #define _NEXT_BOT_PATH_H_
 
 #include "NextBotInterface.h"
+#include "nav_hierarchy.h"
 
 #include "tier0/vprof.h"
 
@@ -27,8 +28,16 @@ class IPathCost
 {
 public:
 	virtual float operator()( CNavArea *area, CNavArea *fromArea, const CNavLadder *ladder, const CFuncElevator *elevator, float length ) const = 0;
+
+	// Non-zero if this cost doesn't depend on which bot uses it. Queued path requests
+	// with the same key, start area and goal area are computed once and shared.
+	virtual int GetShareKey( void ) const { return 0; }
 };
 
+// Share key of a path cost, used to look up cached paths. Template cost functors are never shared.
+inline int GetPathShareKey( const IPathCost *costFunc )	{ return costFunc->GetShareKey(); }
+inline int GetPathShareKey( const void *costFunc )		{ return 0; }
+
 
 //---------------------------------------------------------------------------------------------------------------
 /**
@@ -187,51 +196,61 @@ public:
 		}
 
 		//
-		// Compute shortest path to subject
+		// Compute shortest path to subject, or reuse a recent path between the same areas
 		//
 		CNavArea *closestArea = NULL;
-		bool pathResult = NavAreaBuildPath( startArea, subjectArea, &subjectPos, costFunc, &closestArea, maxPathLength, bot->GetEntity()->GetTeamNumber() );
+		bool pathResult;
+		const int shareKey = ( maxPathLength == PATH_NO_LENGTH_LIMIT ) ? GetPathShareKey( &costFunc ) : 0;
+		if ( !AssembleCachedPath( startArea, subjectArea, shareKey, bot->GetEntity()->GetTeamNumber(), &pathResult ) )
+		{
+			CNavSearchContext &context = CNavSearchContext::ForThisThread();
+			pathResult = NavAreaBuildHierarchicalPath( context, startArea, subjectArea, &subjectPos, costFunc, &closestArea, maxPathLength, bot->GetEntity()->GetTeamNumber(), &m_hierarchyRoute );
 
-		// Failed?
-		if ( closestArea == NULL )
-			return false;
+			// Failed?
+			if ( closestArea == NULL )
+				return false;
 
-		//
-		// Build actual path by following parent links back from goal area
-		//
-
-		// get count
-		int count = 0;
-		CNavArea *area;
-		for( area = closestArea; area; area = area->GetParent() )
-		{
-			++count;
+			//
+			// Build actual path by following parent links back from goal area
+			//
 
-			if ( area == startArea )
+			// get count
+			int count = 0;
+			CNavArea *area;
+			for( area = closestArea; area; area = context.GetParent( area ) )
 			{
-				// startArea can be re-evaluated during the pathfind and given a parent...
-				break;
+				++count;
+
+				if ( area == startArea )
+				{
+					// startArea can be re-evaluated during the pathfind and given a parent...
+					break;
+				}
+				if ( count >= MAX_PATH_SEGMENTS-1 ) // save room for endpoint
+					break;
 			}
-			if ( count >= MAX_PATH_SEGMENTS-1 ) // save room for endpoint
-				break;
-		}
 		
-		if ( count == 1 )
-		{
-			BuildTrivialPath( bot, subjectPos );
-			return pathResult;
-		}
+			if ( count == 1 )
+			{
+				BuildTrivialPath( bot, subjectPos );
+				return pathResult;
+			}
 
-		// assemble path
-		m_segmentCount = count;
-		for( area = closestArea; count && area; area = area->GetParent() )
-		{
-			--count;
-			m_path[ count ].area = area;
-			m_path[ count ].how = area->GetParentHow();
-			m_path[ count ].type = ON_GROUND;
+			// assemble path
+			m_segmentCount = count;
+			for( area = closestArea; count && area; area = context.GetParent( area ) )
+			{
+				--count;
+				m_path[ count ].area = area;
+				m_path[ count ].how = context.GetParentHow( area );
+				m_path[ count ].type = ON_GROUND;
+			}
+
+			CachePath( startArea, subjectArea, shareKey, bot->GetEntity()->GetTeamNumber(), pathResult );
 		}
 
+		closestArea = m_path[ m_segmentCount-1 ].area;
+
 		if ( pathResult || includeGoalIfPathFails )
 		{
 			// append actual subject position
@@ -315,51 +334,61 @@ public:
 		}
 
 		//
-		// Compute shortest path to goal
+		// Compute shortest path to goal, or reuse a recent path between the same areas
 		//
 		CNavArea *closestArea = NULL;
-		bool pathResult = NavAreaBuildPath( startArea, goalArea, &goal, costFunc, &closestArea, maxPathLength, bot->GetEntity()->GetTeamNumber() );
+		bool pathResult;
+		const int shareKey = ( maxPathLength == PATH_NO_LENGTH_LIMIT ) ? GetPathShareKey( &costFunc ) : 0;
+		if ( !AssembleCachedPath( startArea, goalArea, shareKey, bot->GetEntity()->GetTeamNumber(), &pathResult ) )
+		{
+			CNavSearchContext &context = CNavSearchContext::ForThisThread();
+			pathResult = NavAreaBuildHierarchicalPath( context, startArea, goalArea, &goal, costFunc, &closestArea, maxPathLength, bot->GetEntity()->GetTeamNumber(), &m_hierarchyRoute );
 
-		// Failed?
-		if ( closestArea == NULL )
-			return false;
+			// Failed?
+			if ( closestArea == NULL )
+				return false;
 
-		//
-		// Build actual path by following parent links back from goal area
-		//
+			//
+			// Build actual path by following parent links back from goal area
+			//
 
-		// get count
-		int count = 0;
-		CNavArea *area;
-		for( area = closestArea; area; area = area->GetParent() )
-		{
-			++count;
-
-			if ( area == startArea )
+			// get count
+			int count = 0;
+			CNavArea *area;
+			for( area = closestArea; area; area = context.GetParent( area ) )
 			{
-				// startArea can be re-evaluated during the pathfind and given a parent...
-				break;
+				++count;
+
+				if ( area == startArea )
+				{
+					// startArea can be re-evaluated during the pathfind and given a parent...
+					break;
+				}
+				if ( count >= MAX_PATH_SEGMENTS-1 ) // save room for endpoint
+					break;
 			}
-			if ( count >= MAX_PATH_SEGMENTS-1 ) // save room for endpoint
-				break;
-		}
 		
-		if ( count == 1 )
-		{
-			BuildTrivialPath( bot, goal );
-			return pathResult;
-		}
+			if ( count == 1 )
+			{
+				BuildTrivialPath( bot, goal );
+				return pathResult;
+			}
 
-		// assemble path
-		m_segmentCount = count;
-		for( area = closestArea; count && area; area = area->GetParent() )
-		{
-			--count;
-			m_path[ count ].area = area;
-			m_path[ count ].how = area->GetParentHow();
-			m_path[ count ].type = ON_GROUND;
+			// assemble path
+			m_segmentCount = count;
+			for( area = closestArea; count && area; area = context.GetParent( area ) )
+			{
+				--count;
+				m_path[ count ].area = area;
+				m_path[ count ].how = context.GetParentHow( area );
+				m_path[ count ].type = ON_GROUND;
+			}
+
+			CachePath( startArea, goalArea, shareKey, bot->GetEntity()->GetTeamNumber(), pathResult );
 		}
 
+		closestArea = m_path[ m_segmentCount-1 ].area;
+
 		if ( pathResult || includeGoalIfPathFails )
 		{
 			// append actual goal position
@@ -594,6 +623,9 @@ private:
 
 	bool ComputePathDetails( INextBot *bot, const Vector &start );		// determine actual path positions 
 
+	bool AssembleCachedPath( CNavArea *startArea, CNavArea *goalArea, int shareKey, int teamID, bool *pathResult );	// fill in the areas of a recent path between the same areas, if there is one
+	void CachePath( CNavArea *startArea, CNavArea *goalArea, int shareKey, int teamID, bool pathResult ) const;		// remember the areas just assembled for other paths between the same areas
+
 	void Optimize( INextBot *bot );
 	void PostProcess( void );
 	int FindNextOccludedNode( INextBot *bot, int anchor );	// used by Optimize()
@@ -609,6 +641,7 @@ private:
 
 	IntervalTimer m_ageTimer;					// how old is this path?
 	CHandle< CBaseCombatCharacter > m_subject;	// the subject this path leads to
+	NavHierarchyRoute m_hierarchyRoute;			// cluster portals of the last long path, reused by repaths to the same goal
 
 	/**
 	 * Build a vector of adjacent areas reachable from the given area
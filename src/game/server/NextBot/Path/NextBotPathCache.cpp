@@ -0,0 +1,189 @@
+// NextBotPathCache.cpp
+// Recently computed area sequences, shared between paths with the same ends
+//========= Copyright Valve Corporation, All rights reserved. ============//
+
+#include "cbase.h"
+
+#include "nav_mesh.h"
+#include "nav_hierarchy.h"
+
+#include "NextBotPathCache.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar nb_path_cache( "nb_path_cache", "1", FCVAR_CHEAT, "Reuse the areas of recently computed paths with the same start area, goal area, cost and team" );
+ConVar nb_path_cache_size( "nb_path_cache_size", "128", FCVAR_CHEAT, "Maximum number of cached paths", true, 1.0f, true, 4096.0f );		// entries are indexed by unsigned short
+ConVar nb_path_cache_max_age( "nb_path_cache_max_age", "1", FCVAR_CHEAT, "Seconds a cached path stays valid" );
+
+
+//---------------------------------------------------------------------------------------------------------------
+/**
+ * Singleton accessor.
+ */
+static CNextBotPathCache s_pathCache;
+
+CNextBotPathCache &TheNextBotPathCache( void )
+{
+	return s_pathCache;
+}
+
+
+//---------------------------------------------------------------------------------------------------------------
+CNextBotPathCache::CNextBotPathCache( void ) : m_entryMap( KeyLessFunc )
+{
+	m_hierarchyVersion = 0;
+	m_hitCount = 0;
+	m_missCount = 0;
+}
+
+
+//---------------------------------------------------------------------------------------------------------------
+bool CNextBotPathCache::KeyLessFunc( const Key &lhs, const Key &rhs )
+{
+	if ( lhs.startArea != rhs.startArea )
+		return lhs.startArea < rhs.startArea;
+
+	if ( lhs.goalArea != rhs.goalArea )
+		return lhs.goalArea < rhs.goalArea;
+
+	if ( lhs.shareKey != rhs.shareKey )
+		return lhs.shareKey < rhs.shareKey;
+
+	return lhs.team < rhs.team;
+}
+
+
+//---------------------------------------------------------------------------------------------------------------
+void CNextBotPathCache::RemoveEntry( unsigned short index )
+{
+	m_entryMap.Remove( m_entryList[ index ].m_key );
+	m_entryList.Remove( index );
+}
+
+
+//---------------------------------------------------------------------------------------------------------------
+int CNextBotPathCache::Find( const Key &key, Step *steps, int maxSteps, bool *isComplete )
+{
+	if ( !nb_path_cache.GetBool() || key.shareKey == 0 )
+		return 0;
+
+	AUTO_LOCK( m_mutex );
+
+	// cached areas may have been deleted since the hierarchy was last rebuilt
+	if ( m_hierarchyVersion != TheNavHierarchy().GetVersion() )
+	{
+		m_entryList.RemoveAll();
+		m_entryMap.RemoveAll();
+		m_hierarchyVersion = TheNavHierarchy().GetVersion();
+	}
+
+	unsigned short mapIndex = m_entryMap.Find( key );
+	if ( mapIndex == m_entryMap.InvalidIndex() )
+	{
+		++m_missCount;
+		return 0;
+	}
+
+	unsigned short index = m_entryMap[ mapIndex ];
+	const Entry &entry = m_entryList[ index ];
+
+	if ( gpGlobals->curtime - entry.m_timestamp > nb_path_cache_max_age.GetFloat() || entry.m_steps.Count() > maxSteps )
+	{
+		RemoveEntry( index );
+		++m_missCount;
+		return 0;
+	}
+
+	V_memcpy( steps, entry.m_steps.Base(), entry.m_steps.Count() * sizeof( Step ) );
+	*isComplete = entry.m_isComplete;
+
+	// most recently used goes to the front
+	m_entryList.Unlink( index );
+	m_entryList.LinkToHead( index );
+
+	++m_hitCount;
+	return entry.m_steps.Count();
+}
+
+
+//---------------------------------------------------------------------------------------------------------------
+void CNextBotPathCache::Store( const Key &key, const Step *steps, int stepCount, bool isComplete )
+{
+	if ( !nb_path_cache.GetBool() || key.shareKey == 0 || stepCount <= 0 )
+		return;
+
+	AUTO_LOCK( m_mutex );
+
+	if ( m_hierarchyVersion != TheNavHierarchy().GetVersion() )
+		return;
+
+	// replace any older result for this key
+	unsigned short mapIndex = m_entryMap.Find( key );
+	if ( mapIndex != m_entryMap.InvalidIndex() )
+	{
+		RemoveEntry( m_entryMap[ mapIndex ] );
+	}
+
+	// make room, dropping the least recently used
+	while( m_entryList.Count() >= nb_path_cache_size.GetInt() )
+	{
+		RemoveEntry( m_entryList.Tail() );
+	}
+
+	unsigned short index = m_entryList.AddToHead();
+	Entry &entry = m_entryList[ index ];
+	entry.m_key = key;
+	entry.m_steps.CopyArray( steps, stepCount );
+	entry.m_isComplete = isComplete;
+	entry.m_timestamp = gpGlobals->curtime;
+
+	m_entryMap.Insert( key, index );
+}
+
+
+//---------------------------------------------------------------------------------------------------------------
+void CNextBotPathCache::Invalidate( void )
+{
+	AUTO_LOCK( m_mutex );
+
+	m_entryList.RemoveAll();
+	m_entryMap.RemoveAll();
+}
+
+
+//---------------------------------------------------------------------------------------------------------------
+void CNextBotPathCache::PrintStats( void )
+{
+	AUTO_LOCK( m_mutex );
+
+	unsigned int lookupCount = m_hitCount + m_missCount;
+	float hitRate = ( lookupCount > 0 ) ? 100.0f * m_hitCount / lookupCount : 0.0f;
+
+	Msg( "Path cache: %u hits, %u misses (%.1f%% hit rate), %d of %d entries\n", m_hitCount, m_missCount, hitRate, m_entryList.Count(), nb_path_cache_size.GetInt() );
+}
+
+
+//---------------------------------------------------------------------------------------------------------------
+void CNextBotPathCache::ResetStats( void )
+{
+	AUTO_LOCK( m_mutex );
+
+	m_hitCount = 0;
+	m_missCount = 0;
+}
+
+
+//---------------------------------------------------------------------------------------------------------------
+CON_COMMAND_F( nb_path_cache_stats, "Show the hits and misses of the NextBot path cache. 'nb_path_cache_stats reset' clears the counters.", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	TheNextBotPathCache().PrintStats();
+
+	if ( args.ArgC() > 1 && FStrEq( args[1], "reset" ) )
+	{
+		TheNextBotPathCache().ResetStats();
+	}
+}
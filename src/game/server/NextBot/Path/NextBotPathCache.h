@@ -0,0 +1,82 @@
+// NextBotPathCache.h
+// Recently computed area sequences, shared between paths with the same ends
+//========= Copyright Valve Corporation, All rights reserved. ============//
+
+#ifndef _NEXT_BOT_PATH_CACHE_H_
+#define _NEXT_BOT_PATH_CACHE_H_
+
+#include "nav.h"
+#include "utlmap.h"
+#include "utllinkedlist.h"
+
+class CNavArea;
+
+
+//---------------------------------------------------------------------------------------------------------------
+/**
+ * A least-recently-used cache of the areas of computed paths.
+ * Only paths whose cost functor has a share key (see IPathCost::GetShareKey) are cached,
+ * since the cost of any other path depends on the bot that computed it.
+ * Entries expire after a short time, as costs change with the state of the game,
+ * and are all dropped when blocked areas change or any area is destroyed.
+ * Safe to use from several threads at once.
+ */
+class CNextBotPathCache
+{
+public:
+	CNextBotPathCache( void );
+
+	struct Key
+	{
+		CNavArea *startArea;
+		CNavArea *goalArea;
+		int shareKey;
+		int team;
+	};
+
+	struct Step
+	{
+		CNavArea *area;
+		NavTraverseType how;						// how we got into this area
+	};
+
+	/**
+	 * Copy the steps of the path cached for 'key' into 'steps', which must have room for 'maxSteps'.
+	 * Returns the step count, or zero on a miss.
+	 */
+	int Find( const Key &key, Step *steps, int maxSteps, bool *isComplete );
+	void Store( const Key &key, const Step *steps, int stepCount, bool isComplete );
+
+	void Invalidate( void );						// forget all cached paths
+
+	void PrintStats( void );
+	void ResetStats( void );
+
+private:
+	struct Entry
+	{
+		Key m_key;
+		CUtlVector< Step > m_steps;
+		bool m_isComplete;
+		float m_timestamp;
+	};
+
+	static bool KeyLessFunc( const Key &lhs, const Key &rhs );
+
+	void RemoveEntry( unsigned short index );
+
+	CUtlLinkedList< Entry, unsigned short > m_entryList;	// most recently used first
+	CUtlMap< Key, unsigned short > m_entryMap;				// key to m_entryList index
+	int m_hierarchyVersion;									// the nav hierarchy version cached areas belong to
+
+	unsigned int m_hitCount;
+	unsigned int m_missCount;
+
+	CThreadFastMutex m_mutex;
+};
+
+// singleton accessor
+extern CNextBotPathCache &TheNextBotPathCache( void );
+
+
+#endif // _NEXT_BOT_PATH_CACHE_H_
@@ -49,6 +49,8 @@ PathFollower::PathFollower( void )
 
 	// was 10.0f for L4D - need a better solution here (MSB 5/15/09)
 	m_goalTolerance = 25.0f;
+
+	m_pathRequest = -1;
 }
 
 
@@ -73,6 +75,8 @@ public:
 //--------------------------------------------------------------------------------------------------------------
 PathFollower::~PathFollower()
 {
+	TheNextBots().CancelPathRequest( this );
+
 	// allow bots to detach pointer to me
 	CDetachPath detach( this );
 	TheNextBots().ForEachBot( detach );
@@ -108,6 +112,16 @@ void PathFollower::OnPathChanged( INextBot *bot, Path::ResultType result )
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Invoked when a queued path request has been computed (or dropped)
+ */
+void PathFollower::OnPathRequestComplete( INextBot *bot, Path::ResultType result )
+{
+	m_result = result;
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Adjust speed based on path curvature
@@ -42,7 +42,12 @@ public:
 
 	Path::ResultType GetResult() const { return m_result;  }
 
+	bool IsPathRequestPending( void ) const { return m_pathRequest >= 0; }	// return true if waiting on a NextBotManager::RequestPath() result
+	virtual void OnPathRequestComplete( INextBot *bot, Path::ResultType result );	// invoked when a queued path request has been computed (or dropped)
+
 private:
+	friend class NextBotManager;
+	int m_pathRequest;								// index of our pending request in the manager's queue, or -1
 	const Path::Segment *m_goal;					// our current goal along the path
 	float m_minLookAheadRange;
 
@@ -1226,6 +1226,11 @@ void CServerGameDLL::GameFrame( bool simulating )
 	extern void ServiceEventQueue( void );
 	extern void Physics_RunThinkFunctions( bool simulating );
 
+#ifdef NEXT_BOT
+	// deliver events raised outside of the frameloop while their subjects are still around
+	TheNextBots().DispatchEvents();
+#endif
+
 	// Delete anything that was marked for deletion
 	//  outside of server frameloop (e.g., in response to concommand)
 	gEntList.CleanupDeleteList();
@@ -1256,6 +1261,12 @@ void CServerGameDLL::GameFrame( bool simulating )
 	// service event queue, firing off any actions whos time has come
 	ServiceEventQueue();
 
+#ifdef NEXT_BOT
+	// deliver the NextBot events raised this tick in one batch, before
+	// the entities they refer to are deleted
+	TheNextBots().DispatchEvents();
+#endif
+
 	// free all ents marked in think functions
 	gEntList.CleanupDeleteList();
 
@@ -19,6 +19,7 @@
 #include "nav_mesh.h"
 #include "nav_node.h"
 #include "nav_pathfind.h"
+#include "nav_hierarchy.h"
 #include "nav_colors.h"
 #include "fmtstr.h"
 #include "props_shared.h"
@@ -35,6 +36,10 @@
 #include "team.h"
 #include "nav_entities.h"
 
+#ifdef NEXT_BOT
+#include "NextBot/Path/NextBotPathCache.h"
+#endif
+
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
@@ -186,6 +191,8 @@ CNavArea::CNavArea( void )
 
 	m_parent = NULL;
 	m_parentHow = GO_NORTH;
+	m_cluster = -1;
+	m_clusterIndex = -1;
 	m_attributeFlags = 0;
 	m_place = TheNavMesh->GetNavPlace();
 	m_isUnderwater = false;
@@ -538,6 +545,17 @@ CNavArea::~CNavArea()
 	if (m_isReset)
 		return;
 
+	// the hierarchy refers to us
+	if ( m_cluster >= 0 )
+	{
+		TheNavHierarchy().Reset();
+	}
+
+#ifdef NEXT_BOT
+	// cached paths may lead through us, whether or not we were clustered
+	TheNextBotPathCache().Invalidate();
+#endif
+
 	// tell the other areas and ladders we are going away
 	AreaDestroyNotification notification( this );
 	TheNavMesh->ForAllAreas( notification );
@@ -766,10 +784,15 @@ void CNavArea::OnDestroyNotify( CNavArea *dead )
 		m_incomingConnect[ d ].FindAndRemove( con );
 	}
 
-	// remove all visibility info, since we're editing the mesh anyways
-	m_inheritVisibilityFrom.area = NULL;
-	m_potentiallyVisibleAreas.RemoveAll();
-	m_isInheritedFrom = false;
+	// forget the dead area but keep the rest of our visibility, so it can be updated incrementally
+	if ( m_inheritVisibilityFrom.area == dead )
+	{
+		ExpandInheritedVisibility();
+	}
+
+	AreaBindInfo info;
+	info.area = dead;
+	m_potentiallyVisibleAreas.FindAndRemove( info );
 }
 
 
@@ -3552,6 +3575,159 @@ void CNavArea::ClearSearchLists( void )
 	m_openListTail = NULL;
 }
 
+
+//--------------------------------------------------------------------------------------------------------------
+static CTHREADLOCALPTR( const CNavSearchContext ) s_activeSearchContext;
+static CTHREADLOCALPTR( CNavSearchContext ) s_threadSearchContext;
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavSearchContext::CNavSearchContext( void )
+{
+	// areas never touched by a search have marker zero
+	m_marker = 1;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the calling thread's own context, creating it on first use.
+ * A context lives as long as its thread, which for the main thread and the
+ * job pool is the life of the process.
+ */
+CNavSearchContext &CNavSearchContext::ForThisThread( void )
+{
+	CNavSearchContext *context = s_threadSearchContext;
+	if ( context == NULL )
+	{
+		context = new CNavSearchContext;
+		s_threadSearchContext = context;
+	}
+
+	return *context;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+const CNavSearchContext *CNavSearchContext::GetActive( void )
+{
+	return s_activeSearchContext;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+CNavSearchContext::ActiveScope::ActiveScope( const CNavSearchContext *context )
+{
+	m_prior = s_activeSearchContext;
+	s_activeSearchContext = context;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+CNavSearchContext::ActiveScope::~ActiveScope()
+{
+	s_activeSearchContext = m_prior;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavSearchContext::ClearSearchLists( void )
+{
+	// effectively clears all per-area state
+	++m_marker;
+	if ( m_marker == 0 )
+	{
+		// wrapped - stale states could match again
+		for( int i=0; i<m_areaState.Count(); ++i )
+		{
+			m_areaState[i].marker = 0;
+		}
+		m_marker = 1;
+	}
+
+	m_openHeap.RemoveAll();
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavSearchContext::GrowAreaState( unsigned int id )
+{
+	int oldCount = m_areaState.Count();
+
+	// room for the whole mesh, so a search grows this at most once
+	int newCount = MAX( (int)id + 1, TheNavAreas.Count() + 1 );
+	m_areaState.AddMultipleToTail( newCount - oldCount );
+
+	for( int i=oldCount; i<newCount; ++i )
+	{
+		m_areaState[i].marker = 0;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavSearchContext::AddToOpenList( CNavArea *area )
+{
+	AreaState &state = State( area );
+	state.list = ON_OPEN_LIST;
+
+	// sift the new entry up the heap
+	int i = m_openHeap.AddToTail();
+	while( i > 0 )
+	{
+		int parent = ( i - 1 ) / 2;
+		if ( m_openHeap[ parent ].totalCost <= state.totalCost )
+			break;
+
+		m_openHeap[i] = m_openHeap[ parent ];
+		i = parent;
+	}
+
+	m_openHeap[i].totalCost = state.totalCost;
+	m_openHeap[i].area = area;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Remove and return the open area with the lowest total cost, or NULL if there are none left
+ */
+CNavArea *CNavSearchContext::PopOpenList( void )
+{
+	while( m_openHeap.Count() )
+	{
+		OpenEntry top = m_openHeap[0];
+
+		// move the last entry to the root and sift it down
+		OpenEntry last = m_openHeap.Tail();
+		m_openHeap.RemoveMultipleFromTail( 1 );
+
+		int count = m_openHeap.Count();
+		if ( count )
+		{
+			int i = 0;
+			while( true )
+			{
+				int child = 2 * i + 1;
+				if ( child >= count )
+					break;
+
+				if ( child + 1 < count && m_openHeap[ child + 1 ].totalCost < m_openHeap[ child ].totalCost )
+					++child;
+
+				if ( last.totalCost <= m_openHeap[ child ].totalCost )
+					break;
+
+				m_openHeap[i] = m_openHeap[ child ];
+				i = child;
+			}
+			m_openHeap[i] = last;
+		}
+
+		// skip entries left behind when an area was closed or re-added with a lower cost
+		AreaState &state = State( top.area );
+		if ( state.list != ON_OPEN_LIST || state.totalCost != top.totalCost )
+			continue;
+
+		state.list = NOT_LISTED;
+		return top.area;
+	}
+
+	return NULL;
+}
+
 //--------------------------------------------------------------------------------------------------------------
 void CNavArea::SetCorner( NavCornerType corner, const Vector& newPosition )
 {
@@ -5240,8 +5416,6 @@ static ConCommand nav_select_overlapping( "nav_select_overlapping", CommandNavSe
 static byte m_PVS[PAD_NUMBER( MAX_MAP_CLUSTERS,8 ) / 8];
 static int m_nPVSSize;		// PVS size in bytes
 
-CUtlHash< NavVisPair_t, CVisPairHashFuncs, CVisPairHashFuncs > *g_pNavVisPairHash;
-
 #define MASK_NAV_VISION				(MASK_BLOCKLOS_AND_NPCS|CONTENTS_IGNORE_NODRAW_OPAQUE)
 
 
@@ -5253,7 +5427,18 @@ CUtlHash< NavVisPair_t, CVisPairHashFuncs, CVisPairHashFuncs > *g_pNavVisPairHas
 void CNavArea::SetupPVS( void ) const
 {
 	m_nPVSSize = sizeof( m_PVS );
-	engine->ResetPVS( m_PVS, m_nPVSSize );
+	SetupPVS( m_PVS, m_nPVSSize );
+}
+
+
+//--------------------------------------------------------------------------------------------------------
+/**
+ * Build the PVS as seen from anywhere within this nav area into the given buffer.
+ * The engine builds a PVS through shared state, so this must not run on several threads at once.
+ */
+void CNavArea::SetupPVS( byte *pvs, int pvsSize ) const
+{
+	engine->ResetPVS( pvs, pvsSize );
 
 	const float margin = GenerationStepSize/2.0f;
 	Vector eye( 0, 0, 0.75f * HumanHeight );
@@ -5303,6 +5488,22 @@ bool CNavArea::IsInPVS( void ) const
  * Do actual line-of-sight traces to determine if any part of given area is visible from this area
  */
 CNavArea::VisibilityType CNavArea::ComputeVisibility( const CNavArea *area, bool isPVSValid, bool bCheckPVS, bool *pOutsidePVS ) const
+{
+	if ( !isPVSValid )
+	{
+		SetupPVS();
+	}
+
+	return ComputeVisibility( area, bCheckPVS ? m_PVS : NULL, m_nPVSSize, pOutsidePVS );
+}
+
+
+//--------------------------------------------------------------------------------------------------------
+/**
+ * Do actual line-of-sight traces to determine if any part of given area is visible from this area,
+ * first rejecting areas outside of 'pvs' unless it is NULL
+ */
+CNavArea::VisibilityType CNavArea::ComputeVisibility( const CNavArea *area, const byte *pvs, int pvsSize, bool *pOutsidePVS ) const
 {
 	float distanceSq = area->GetCenter().DistToSqr( GetCenter() );
 
@@ -5316,14 +5517,9 @@ CNavArea::VisibilityType CNavArea::ComputeVisibility( const CNavArea *area, bool
 		}
 	}
 
-	if ( !isPVSValid )
-	{
-		SetupPVS();
-	}
-
 	Vector eye( 0, 0, 0.75f * HumanHeight );
 
-	if ( bCheckPVS )
+	if ( pvs )
 	{
 		Extent areaExtent;
 		areaExtent.lo = areaExtent.hi = area->GetCenter() + eye;
@@ -5331,7 +5527,7 @@ CNavArea::VisibilityType CNavArea::ComputeVisibility( const CNavArea *area, bool
 		areaExtent.Encompass( area->GetCorner( NORTH_EAST ) + eye );
 		areaExtent.Encompass( area->GetCorner( SOUTH_WEST ) + eye );
 		areaExtent.Encompass( area->GetCorner( SOUTH_EAST ) + eye );
-		if ( !engine->CheckBoxInPVS( areaExtent.lo, areaExtent.hi, m_PVS, m_nPVSSize ) )
+		if ( !engine->CheckBoxInPVS( areaExtent.lo, areaExtent.hi, pvs, pvsSize ) )
 		{
 			if ( pOutsidePVS )
 				*pOutsidePVS = true;
@@ -5514,116 +5710,62 @@ const CNavArea::CAreaBindInfoArray &CNavArea::ComputeVisibilityDelta( const CNav
 //--------------------------------------------------------------------------------------------------------
 void CNavArea::ResetPotentiallyVisibleAreas()
 {
+	m_inheritVisibilityFrom.area = NULL;
 	m_potentiallyVisibleAreas.RemoveAll();
+	m_isInheritedFrom = false;
 }
 
 
 //--------------------------------------------------------------------------------------------------------
 /**
- * Determine visibility between areas.
- * Compute full list of all areas visible for each area.  This list will be compressed into deltas
- * in the PostCustomAnalysis() step.
+ * Return the range of precomputed visibility
  */
-
-CNavArea *g_pCurVisArea;
-CTSListWithFreeList< CNavArea::AreaBindInfo > g_ComputedVis;
-
-void CNavArea::ComputeVisToArea( CNavArea *&pOtherArea )
+float CNavArea::GetVisibilityRange( void )
 {
-	CNavArea *area = assert_cast< CNavArea * >( pOtherArea );
-	VisibilityType visThisToOther = ( area == g_pCurVisArea ) ? COMPLETELY_VISIBLE : NOT_VISIBLE;
-	VisibilityType visOtherToThis = NOT_VISIBLE;
-
-	if ( area != g_pCurVisArea )
-	{
-		bool bOutsidePVS;
-
-		visOtherToThis = g_pCurVisArea->ComputeVisibility( area, true, true, &bOutsidePVS ); // TODO: Hacky right now. Compute visibility for the "complete" case actually returns how completely visible the area is to the other. Should fix it to be more clear [1/30/2009 tom]
-
-		if ( !bOutsidePVS && ( visOtherToThis || ( g_pCurVisArea->GetCenter() - area->GetCenter() ).LengthSqr() < Sqr( nav_max_view_distance.GetFloat() ) ) )
-		{
-			visThisToOther = area->ComputeVisibility( g_pCurVisArea, true, false );
-		}
-
-		if ( !visOtherToThis && visThisToOther )
-		{
-			visOtherToThis = POTENTIALLY_VISIBLE;
-		}
-
-		if ( !visThisToOther && visOtherToThis )
-		{
-			visThisToOther = POTENTIALLY_VISIBLE;
-		}
-	}
-
-	CNavArea::AreaBindInfo info;
-	if ( visThisToOther != NOT_VISIBLE )
+	float radius = nav_max_view_distance.GetFloat();
+	if ( radius == 0.0f )
 	{
-		info.area = area;
-		info.attributes = visThisToOther;
-		g_ComputedVis.PushItem( info );
+		radius = DEF_NAV_VIEW_DISTANCE;
 	}
 
-	if ( visOtherToThis != NOT_VISIBLE )
-	{
-		info.area = g_pCurVisArea;
-		info.attributes = visOtherToThis;
-		area->m_potentiallyVisibleAreas.AddToTail( info );
-	}
+	return radius;
 }
 
 
 //--------------------------------------------------------------------------------------------------------
 /**
- * Determine visibility from this area to all potentially/completely visible areas in the mesh
+ * Replace our list of additions and deletions to the inherited list with the full list it stands for
  */
-void CNavArea::ComputeVisibilityToMesh( void )
+void CNavArea::ExpandInheritedVisibility( void )
 {
-	m_inheritVisibilityFrom.area = NULL;
-	m_isInheritedFrom = false;
-
-	// collect all possible nav areas that could be visible from this area
-	NavAreaCollector collector;
-	float radius = nav_max_view_distance.GetFloat();
-	if ( radius == 0.0f )
+	CNavArea *anchor = m_inheritVisibilityFrom.area;
+	if ( anchor == NULL )
 	{
-		radius = DEF_NAV_VIEW_DISTANCE;
+		return;
 	}
-	collector.m_area.EnsureCapacity( 1000 );
-	TheNavMesh->ForAllAreasInRadius( collector, GetCenter(), radius );
 
-	NavVisPair_t visPair;
-	UtlHashHandle_t hHash;
+	CAreaBindInfoArray full;
+	full.EnsureCapacity( anchor->m_potentiallyVisibleAreas.Count() + m_potentiallyVisibleAreas.Count() );
 
-	// First eliminate the ones already calculated
-	for ( int i = collector.m_area.Count() - 1; i >= 0; --i )
+	// our own entries override the inherited ones
+	for( int i=0; i<anchor->m_potentiallyVisibleAreas.Count(); ++i )
 	{
-		visPair.SetPair( this, collector.m_area[i] );
-
-		hHash = g_pNavVisPairHash->Find( visPair );
-		if ( hHash != g_pNavVisPairHash->InvalidHandle() )
+		if ( !m_potentiallyVisibleAreas.IsValidIndex( m_potentiallyVisibleAreas.Find( anchor->m_potentiallyVisibleAreas[i] ) ) )
 		{
-			collector.m_area.FastRemove( i );
+			full.AddToTail( anchor->m_potentiallyVisibleAreas[i] );
 		}
 	}
 
-	SetupPVS();
-
-	g_pCurVisArea = this;
-	ParallelProcess( "CNavArea::ComputeVisibilityToMesh", collector.m_area.Base(), collector.m_area.Count(), &ComputeVisToArea );
-
-	m_potentiallyVisibleAreas.EnsureCapacity( g_ComputedVis.Count() );
-	while ( g_ComputedVis.Count() )
+	for( int i=0; i<m_potentiallyVisibleAreas.Count(); ++i )
 	{
-		g_ComputedVis.PopItem( &m_potentiallyVisibleAreas[ m_potentiallyVisibleAreas.AddToTail() ] );
+		if ( m_potentiallyVisibleAreas[i].attributes != NOT_VISIBLE )
+		{
+			full.AddToTail( m_potentiallyVisibleAreas[i] );
+		}
 	}
 
-	FOR_EACH_VEC( collector.m_area, it )
-	{
-		visPair.SetPair( this, (CNavArea *)collector.m_area[it] );
-		Assert( g_pNavVisPairHash->Find( visPair ) == g_pNavVisPairHash->InvalidHandle() );
-		g_pNavVisPairHash->Insert( visPair );
-	}
+	m_potentiallyVisibleAreas = full;
+	m_inheritVisibilityFrom.area = NULL;
 }
 
 
@@ -23,6 +23,7 @@ enum { MAX_NAV_TEAMS = 2 };
 class CFuncElevator;
 class CFuncNavPrerequisite;
 class CFuncNavCost;
+class CNavSearchContext;
 
 class CNavVectorNoEditAllocator
 {
@@ -247,6 +248,9 @@ protected:
 
 	/* 128*/	CFuncElevator *m_elevator;									// if non-NULL, this area is in an elevator's path. The elevator can transport us vertically to another area.
 
+	/* 132*/	int m_cluster;												// cluster of the nav hierarchy this area belongs to, or -1
+	/* 136*/	int m_clusterIndex;											// index of this area within its cluster
+
 	// --- End critical data --- 
 };
 
@@ -275,6 +279,8 @@ public:
 	virtual void Save( CUtlBuffer &fileBuffer, unsigned int version ) const;	// (EXTEND)
 	virtual NavErrorType Load( CUtlBuffer &fileBuffer, unsigned int version, unsigned int subVersion );		// (EXTEND)
 	virtual NavErrorType PostLoad( void );								// (EXTEND) invoked after all areas have been loaded - for pointer binding, etc
+	virtual void SaveCompactData( CUtlBuffer &fileBuffer ) const { }		// (EXTEND) store derived class data for the compact nav file
+	virtual void LoadCompactData( CUtlBuffer &fileBuffer ) { }				// (EXTEND) load derived class data from the compact nav file
 
 	virtual void SaveToSelectedSet( KeyValues *areaKey ) const;		// (EXTEND) saves attributes for the area to a KeyValues
 	virtual void RestoreFromSelectedSet( KeyValues *areaKey );		// (EXTEND) restores attributes from a KeyValues
@@ -429,8 +435,10 @@ public:
 	BOOL IsMarked( void ) const			{ return (m_marker == m_masterMarker) ? true : false; }
 	
 	void SetParent( CNavArea *parent, NavTraverseType how = NUM_TRAVERSE_TYPES )	{ m_parent = parent; m_parentHow = how; }
-	CNavArea *GetParent( void ) const	{ return m_parent; }
-	NavTraverseType GetParentHow( void ) const	{ return m_parentHow; }
+	CNavArea *GetParent( void ) const;								// from the active CNavSearchContext, if any
+	NavTraverseType GetParentHow( void ) const;
+	CNavArea *GetParent( const CNavSearchContext *context ) const;	// from the given context, or from the area itself if NULL - no thread local lookup
+	NavTraverseType GetParentHow( const CNavSearchContext *context ) const;
 
 	bool IsOpen( void ) const;									// true if on "open list"
 	void AddToOpenList( void );									// add to open list in decreasing value order
@@ -446,14 +454,21 @@ public:
 
 	static void ClearSearchLists( void );						// clears the open and closed lists for a new search
 
+	//- hierarchical pathfinding ------------------------------------------------------------------------
+	int GetCluster( void ) const		{ return m_cluster; }			// see CNavHierarchy
+	int GetClusterIndex( void ) const	{ return m_clusterIndex; }
+	void SetCluster( int cluster, int index )	{ m_cluster = cluster; m_clusterIndex = index; }
+
 	void SetTotalCost( float value )	{ DebuggerBreakOnNaN_StagingOnly( value ); Assert( value >= 0.0 && !IS_NAN(value) ); m_totalCost = value; }
 	float GetTotalCost( void ) const	{ DebuggerBreakOnNaN_StagingOnly( m_totalCost ); return m_totalCost; }
 
 	void SetCostSoFar( float value )	{ DebuggerBreakOnNaN_StagingOnly( value ); Assert( value >= 0.0 && !IS_NAN(value) ); m_costSoFar = value; }
-	float GetCostSoFar( void ) const	{ DebuggerBreakOnNaN_StagingOnly( m_costSoFar ); return m_costSoFar; }
+	float GetCostSoFar( void ) const;								// from the active CNavSearchContext, if any
+	float GetCostSoFar( const CNavSearchContext *context ) const;	// from the given context, or from the area itself if NULL
 
 	void SetPathLengthSoFar( float value )	{ DebuggerBreakOnNaN_StagingOnly( value ); Assert( value >= 0.0 && !IS_NAN(value) ); m_pathLengthSoFar = value; }
-	float GetPathLengthSoFar( void ) const	{ DebuggerBreakOnNaN_StagingOnly( m_pathLengthSoFar ); return m_pathLengthSoFar; }
+	float GetPathLengthSoFar( void ) const;							// from the active CNavSearchContext, if any
+	float GetPathLengthSoFar( const CNavSearchContext *context ) const;	// from the given context, or from the area itself if NULL
 
 	//- editing -----------------------------------------------------------------------------------------
 	virtual void Draw( void ) const;							// draw area for debugging & editing
@@ -497,7 +512,9 @@ public:
 	};
 
 	VisibilityType ComputeVisibility( const CNavArea *area, bool isPVSValid, bool bCheckPVS = true, bool *pOutsidePVS = NULL ) const;	// do actual line-of-sight traces to determine if any part of given area is visible from this area
+	VisibilityType ComputeVisibility( const CNavArea *area, const byte *pvs, int pvsSize, bool *pOutsidePVS = NULL ) const;		// as above, checking against the given PVS unless it is NULL. Safe to call from several threads.
 	void SetupPVS( void ) const;
+	void SetupPVS( byte *pvs, int pvsSize ) const;	// build our PVS into the given buffer
 	bool IsInPVS( void ) const;					// return true if this area is within the current PVS
 
 	struct AreaBindInfo							// for pointer loading and binding
@@ -643,6 +660,7 @@ public:
 private:
 	friend class CNavMesh;
 	friend class CNavLadder;
+	friend class CNavVisibilityBuilder;
 	friend class CCSNavArea;									// allow CS load code to complete replace our default load behavior
 
 	static bool m_isReset;										// if true, don't bother cleaning up in destructor since everything is going away
@@ -737,9 +755,9 @@ private:
 
 
 	//- visibility --------------------------------------------------------------------------------------
-	void ComputeVisibilityToMesh( void );						// compute visibility to surrounding mesh
 	void ResetPotentiallyVisibleAreas();
-	static void ComputeVisToArea( CNavArea *&pOtherArea );
+	void ExpandInheritedVisibility( void );						// stop inheriting, keeping the full list of visible areas
+	static float GetVisibilityRange( void );					// areas farther apart than this are never potentially visible
 
 #ifndef _X360
 	typedef CUtlVectorConservative<AreaBindInfo> CAreaBindInfoArray; // shaves 8 bytes off structure caused by need to support editing
@@ -763,6 +781,124 @@ typedef CUtlVector< CNavArea * > NavAreaVector;
 extern NavAreaVector TheNavAreas;
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The state of one A* search, kept outside of the areas so that searches
+ * can run concurrently on different threads, each with its own context.
+ * Per-area state lives in a side table indexed by area ID, and the open
+ * list is a binary heap.
+ *
+ * While a search runs, its context is "active" on that thread, and the
+ * CNavArea search accessors cost functors use (GetCostSoFar(), GetParent(), etc)
+ * read from it instead of from the area.
+ */
+class CNavSearchContext
+{
+public:
+	CNavSearchContext( void );
+
+	static CNavSearchContext &ForThisThread( void );			// a context owned by the calling thread
+	static const CNavSearchContext *GetActive( void );			// the context of the search running on this thread, or NULL
+
+	// make a context active on this thread for the lifetime of the scope
+	class ActiveScope
+	{
+	public:
+		ActiveScope( const CNavSearchContext *context );		// NULL makes searches use the areas themselves
+		~ActiveScope();
+	private:
+		const CNavSearchContext *m_prior;
+	};
+
+	void ClearSearchLists( void );								// start a new search
+
+	bool IsOpen( const CNavArea *area ) const		{ const AreaState *state = Find( area ); return state && state->list == ON_OPEN_LIST; }
+	bool IsClosed( const CNavArea *area ) const		{ const AreaState *state = Find( area ); return state && state->list == ON_CLOSED_LIST; }
+
+	void AddToOpenList( CNavArea *area );						// uses the area's total cost in this context
+	void UpdateOnOpenList( CNavArea *area )			{ AddToOpenList( area ); }
+	CNavArea *PopOpenList( void );								// NULL when the open list is empty
+	void AddToClosedList( CNavArea *area )			{ State( area ).list = ON_CLOSED_LIST; }
+	void RemoveFromClosedList( CNavArea *area )		{ State( area ).list = NOT_LISTED; }
+
+	void SetParent( CNavArea *area, CNavArea *parent, NavTraverseType how = NUM_TRAVERSE_TYPES )	{ AreaState &state = State( area ); state.parent = parent; state.parentHow = how; }
+	CNavArea *GetParent( const CNavArea *area ) const				{ const AreaState *state = Find( area ); return state ? state->parent : NULL; }
+	NavTraverseType GetParentHow( const CNavArea *area ) const		{ const AreaState *state = Find( area ); return state ? (NavTraverseType)state->parentHow : NUM_TRAVERSE_TYPES; }
+
+	void SetTotalCost( CNavArea *area, float value )				{ Assert( value >= 0.0 && !IS_NAN( value ) ); State( area ).totalCost = value; }
+	float GetTotalCost( const CNavArea *area ) const				{ const AreaState *state = Find( area ); return state ? state->totalCost : 0.0f; }
+
+	void SetCostSoFar( CNavArea *area, float value )				{ Assert( value >= 0.0 && !IS_NAN( value ) ); State( area ).costSoFar = value; }
+	float GetCostSoFar( const CNavArea *area ) const				{ const AreaState *state = Find( area ); return state ? state->costSoFar : 0.0f; }
+
+	void SetPathLengthSoFar( CNavArea *area, float value )			{ Assert( value >= 0.0 && !IS_NAN( value ) ); State( area ).pathLengthSoFar = value; }
+	float GetPathLengthSoFar( const CNavArea *area ) const			{ const AreaState *state = Find( area ); return state ? state->pathLengthSoFar : 0.0f; }
+
+private:
+	enum ListType
+	{
+		NOT_LISTED,
+		ON_OPEN_LIST,
+		ON_CLOSED_LIST,
+	};
+
+	struct AreaState
+	{
+		CNavArea *parent;
+		float costSoFar;
+		float totalCost;
+		float pathLengthSoFar;
+		unsigned int marker;									// state is only valid for the search with this marker
+		unsigned char parentHow;
+		unsigned char list;
+	};
+
+	const AreaState *Find( const CNavArea *area ) const
+	{
+		unsigned int id = area->GetID();
+		if ( id < (unsigned int)m_areaState.Count() && m_areaState[ id ].marker == m_marker )
+		{
+			return &m_areaState[ id ];
+		}
+		return NULL;
+	}
+
+	AreaState &State( const CNavArea *area )					// touch this area's state, starting it fresh if this search hasn't yet
+	{
+		unsigned int id = area->GetID();
+		if ( id >= (unsigned int)m_areaState.Count() )
+		{
+			GrowAreaState( id );
+		}
+
+		AreaState &state = m_areaState[ id ];
+		if ( state.marker != m_marker )
+		{
+			state.parent = NULL;
+			state.costSoFar = 0.0f;
+			state.totalCost = 0.0f;
+			state.pathLengthSoFar = 0.0f;
+			state.marker = m_marker;
+			state.parentHow = NUM_TRAVERSE_TYPES;
+			state.list = NOT_LISTED;
+		}
+		return state;
+	}
+
+	void GrowAreaState( unsigned int id );
+
+	CUtlVector< AreaState > m_areaState;						// indexed by area ID
+	unsigned int m_marker;
+
+	struct OpenEntry
+	{
+		float totalCost;
+		CNavArea *area;
+	};
+	CUtlVector< OpenEntry > m_openHeap;							// entries for areas whose cost has since dropped are skipped when popped
+};
+
+
 //--------------------------------------------------------------------------------------------------------------
 //--------------------------------------------------------------------------------------------------------------
 //
@@ -820,6 +956,66 @@ inline CNavArea *CNavArea::GetAdjacentArea( NavDirType dir, int i ) const
 	return m_connect[dir][i].area;
 }
 
+//--------------------------------------------------------------------------------------------------------------
+inline CNavArea *CNavArea::GetParent( const CNavSearchContext *context ) const
+{
+	return context ? context->GetParent( this ) : m_parent;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline CNavArea *CNavArea::GetParent( void ) const
+{
+	return GetParent( CNavSearchContext::GetActive() );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline NavTraverseType CNavArea::GetParentHow( const CNavSearchContext *context ) const
+{
+	return context ? context->GetParentHow( this ) : m_parentHow;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline NavTraverseType CNavArea::GetParentHow( void ) const
+{
+	return GetParentHow( CNavSearchContext::GetActive() );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline float CNavArea::GetCostSoFar( const CNavSearchContext *context ) const
+{
+	if ( context )
+	{
+		return context->GetCostSoFar( this );
+	}
+
+	DebuggerBreakOnNaN_StagingOnly( m_costSoFar );
+	return m_costSoFar;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline float CNavArea::GetCostSoFar( void ) const
+{
+	return GetCostSoFar( CNavSearchContext::GetActive() );
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline float CNavArea::GetPathLengthSoFar( const CNavSearchContext *context ) const
+{
+	if ( context )
+	{
+		return context->GetPathLengthSoFar( this );
+	}
+
+	DebuggerBreakOnNaN_StagingOnly( m_pathLengthSoFar );
+	return m_pathLengthSoFar;
+}
+
+//--------------------------------------------------------------------------------------------------------------
+inline float CNavArea::GetPathLengthSoFar( void ) const
+{
+	return GetPathLengthSoFar( CNavSearchContext::GetActive() );
+}
+
 //--------------------------------------------------------------------------------------------------------------
 inline bool CNavArea::IsOpen( void ) const
 {
@@ -0,0 +1,161 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// nav_compact.h
+// Layout of the compact Navigation Mesh file
+//
+// The compact file is a cache of a map's .nav data, written next to it as
+// maps/<map>.navc. It has no pointers or IDs to resolve: every block is a
+// flat array starting on an aligned offset from the start of the file, and
+// areas, ladders and hiding spots refer to each other by index. Per-area data
+// is stored as parallel arrays (one block per field), and variable-length
+// per-area lists (connections, hiding spots, visibility, etc) as a block of
+// elements plus a "range" block of offsets into it, where the elements of
+// area 'i' are [ range[i], range[i+1] ). Visibility lists are compressed
+// bitsets over area indices (see nav_visibility.h), and their range is in bytes.
+//
+// Data is in native byte order. The file records the size and time stamp of
+// the .nav it was made from and is ignored once those no longer match.
+//
+//=============================================================================//
+
+#ifndef _NAV_COMPACT_H_
+#define _NAV_COMPACT_H_
+
+#define NAV_COMPACT_MAGIC_NUMBER	0x4E415643		// 'NAVC'
+#define NAV_COMPACT_VERSION			2
+#define NAV_COMPACT_ALIGNMENT		16				// every block starts on a multiple of this
+#define NAV_COMPACT_NONE			0xFFFFFFFF		// "no area" index
+
+#ifdef _X360
+	#define FORMAT_NAVCOMPACTFILE "maps\\%s.360.navc"
+#else
+	#define FORMAT_NAVCOMPACTFILE "maps\\%s.navc"
+#endif
+
+
+//--------------------------------------------------------------------------------------------------------------
+enum NavCompactBlockType
+{
+	// one element per area
+	NAV_COMPACT_AREA_ID,					// unsigned int
+	NAV_COMPACT_AREA_ATTRIBUTES,			// int
+	NAV_COMPACT_AREA_NW_CORNER,				// Vector
+	NAV_COMPACT_AREA_SE_CORNER,				// Vector
+	NAV_COMPACT_AREA_CORNER_Z,				// NavCompactCornerZ
+	NAV_COMPACT_AREA_FLAGS,					// unsigned char, NavCompactAreaFlags
+	NAV_COMPACT_AREA_PLACE,					// unsigned short, PlaceDirectory index
+	NAV_COMPACT_AREA_OCCUPY_TIME,			// float[ MAX_NAV_TEAMS ]
+	NAV_COMPACT_AREA_LIGHT,					// float[ NUM_CORNERS ]
+	NAV_COMPACT_AREA_INHERIT_VISIBILITY,	// unsigned int area index, or NAV_COMPACT_NONE
+
+	// adjacent areas, NUM_DIRECTIONS lists per area
+	NAV_COMPACT_CONNECT_RANGE,				// unsigned int
+	NAV_COMPACT_CONNECT,					// NavCompactConnect
+
+	// one-way connections into the area, NUM_DIRECTIONS lists per area
+	NAV_COMPACT_INCOMING_RANGE,				// unsigned int
+	NAV_COMPACT_INCOMING,					// NavCompactConnect
+
+	// ladders, CNavLadder::NUM_LADDER_DIRECTIONS lists per area
+	NAV_COMPACT_LADDER_RANGE,				// unsigned int
+	NAV_COMPACT_LADDER,						// unsigned int ladder index
+
+	// hiding spots, one list per area
+	NAV_COMPACT_SPOT_RANGE,					// unsigned int
+	NAV_COMPACT_SPOT,						// NavCompactHidingSpot
+
+	// potentially visible areas, one list per area
+	NAV_COMPACT_VISIBILITY_RANGE,			// unsigned int byte offset
+	NAV_COMPACT_VISIBILITY,					// unsigned char, NavWriteVisibilityBitset()
+
+	// spot encounters, one list per area
+	NAV_COMPACT_ENCOUNTER_RANGE,			// unsigned int
+	NAV_COMPACT_ENCOUNTER,					// NavCompactEncounter
+	NAV_COMPACT_ENCOUNTER_SPOT,				// NavCompactSpotOrder, indexed by NavCompactEncounter
+
+	// data owned by CNavArea-derived classes, one byte stream per area
+	NAV_COMPACT_CUSTOM_AREA_RANGE,			// unsigned int
+	NAV_COMPACT_CUSTOM_AREA,				// unsigned char
+
+	// byte streams in the regular .nav encoding
+	NAV_COMPACT_PLACE_DIRECTORY,			// PlaceDirectory::Save()
+	NAV_COMPACT_LADDERS,					// count, then CNavLadder::Save() for each
+	NAV_COMPACT_CUSTOM_PRE_AREA,			// CNavMesh::SaveCustomDataPreArea()
+	NAV_COMPACT_CUSTOM,						// CNavMesh::SaveCustomData()
+
+	NAV_COMPACT_BLOCK_COUNT
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+struct NavCompactBlock
+{
+	unsigned int offset;					// from start of file
+	unsigned int count;						// number of elements
+	unsigned int elementSize;
+};
+
+struct NavCompactHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int navVersion;				// .nav version and sub-version the data was taken from
+	unsigned int navSubVersion;
+	unsigned int sourceSize;				// size and time stamp of the data the compact file was made from
+	unsigned int sourceTime;
+	unsigned int bspSize;
+	unsigned int isAnalyzed;
+
+	unsigned int areaCount;
+	unsigned int hidingSpotCount;
+
+	NavCompactBlock block[ NAV_COMPACT_BLOCK_COUNT ];
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+enum NavCompactAreaFlags
+{
+	NAV_COMPACT_AREA_UNDERWATER		= 0x01,
+};
+
+struct NavCompactCornerZ
+{
+	float neZ;
+	float swZ;
+};
+
+struct NavCompactConnect
+{
+	unsigned int area;						// area index
+	float length;
+};
+
+struct NavCompactHidingSpot
+{
+	Vector pos;
+	unsigned int id;
+	unsigned int area;						// index of the area the spot is within, or NAV_COMPACT_NONE
+	unsigned int flags;
+};
+
+struct NavCompactEncounter
+{
+	Vector pathFrom;
+	Vector pathTo;
+	unsigned int fromArea;					// area indices
+	unsigned int toArea;
+	unsigned char fromDir;
+	unsigned char toDir;
+	unsigned short spotCount;
+	unsigned int firstSpot;					// into NAV_COMPACT_ENCOUNTER_SPOT
+};
+
+struct NavCompactSpotOrder
+{
+	unsigned int spot;						// hiding spot index, in NAV_COMPACT_SPOT order
+	float t;
+};
+
+
+#endif // _NAV_COMPACT_H_
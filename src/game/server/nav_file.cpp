@@ -11,6 +11,9 @@
 
 #include "cbase.h"
 #include "nav_mesh.h"
+#include "nav_compact.h"
+#include "nav_hierarchy.h"
+#include "nav_visibility.h"
 #include "gamerules.h"
 #include "datacache/imdlcache.h"
 
@@ -46,6 +49,8 @@
 // TODO: Was changed from 15, update when latest 360 code is integrated (MSB 5/5/09)
 const int NavCurrentVersion = 16;
 
+ConVar nav_compact( "nav_compact", "1", FCVAR_GAMEDLL | FCVAR_CHEAT, "If nonzero, keep a compact copy of the Navigation Mesh next to the .nav file and load from it while it is current." );
+
 //--------------------------------------------------------------------------------------------------------------
 //
 // The 'place directory' is used to save and load places from
@@ -1220,6 +1225,12 @@ bool CNavMesh::Save( void ) const
 	unsigned int navSize = filesystem->Size( filename );
 	DevMsg( "Size of nav file '%s' is %u bytes.\n", filename, navSize );
 
+	if ( nav_compact.GetBool() )
+	{
+		// the compact copy is stamped with the .nav we just wrote
+		SaveCompact();
+	}
+
 	return true;
 }
 
@@ -1446,6 +1457,11 @@ NavErrorType CNavMesh::Load( void )
 
 	CNavArea::m_nextID = 1;
 
+	if ( nav_compact.GetBool() && LoadCompact() == NAV_OK )
+	{
+		return NAV_OK;
+	}
+
 	bool navIsInBsp = false;
 	CUtlBuffer fileBuffer( 4096, 1024*1024, CUtlBuffer::READ_ONLY );
 	NavErrorType readResult = GetNavDataFromFile( fileBuffer, &navIsInBsp );
@@ -1605,6 +1621,12 @@ NavErrorType CNavMesh::Load( void )
 
 	WarnIfMeshNeedsAnalysis( version );
 
+	if ( loadResult == NAV_OK && nav_compact.GetBool() )
+	{
+		// next time, skip all of the above
+		SaveCompact();
+	}
+
 	return loadResult;
 }
 
@@ -1712,6 +1734,18 @@ NavErrorType CNavMesh::PostLoad( unsigned int version )
 
 	ValidateNavAreaConnections();
 
+	OnLoadFinished();
+	
+	return NAV_OK;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Invoked once all mesh data is loaded and bound, however it was loaded
+ */
+void CNavMesh::OnLoadFinished( void )
+{
 	// TERROR: loading into a map directly creates entities before the mesh is loaded.  Tell the preexisting
 	// entities now that the mesh is loaded so they can update areas.
 	for ( int i=0; i<m_avoidanceObstacles.Count(); ++i )
@@ -1719,8 +1753,856 @@ NavErrorType CNavMesh::PostLoad( unsigned int version )
 		m_avoidanceObstacles[i]->OnNavMeshLoaded();
 	}
 
+	// bind or build the cluster layer for long-range pathfinding
+	TheNavHierarchy().OnMeshLoaded();
+
+	// remember what the loaded visibility belongs to, for incremental updates
+	TheNavVisibilityBuilder().OnMeshLoaded();
+
 	// the Navigation Mesh has been successfully loaded
 	m_isLoaded = true;
-	
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+//
+// Compact nav file - see nav_compact.h
+//
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the size and time stamp of the file this map's nav data is read from
+ */
+static void GetNavSourceStamp( const char *mapName, unsigned int *size, unsigned int *time )
+{
+	char filename[MAX_PATH] = { 0 };
+	const char *pathID = "MOD";
+
+	Q_snprintf( filename, sizeof( filename ), FORMAT_NAVFILE, mapName );
+	if ( !filesystem->FileExists( filename, pathID ) )
+	{
+		// the nav data is embedded in the map
+		Q_snprintf( filename, sizeof( filename ), FORMAT_BSPFILE, mapName );
+		pathID = NULL;
+	}
+
+	*size = filesystem->Size( filename, pathID );
+	*time = (unsigned int)filesystem->GetFileTime( filename, pathID );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Append a block to the compact file, starting on an aligned offset, and record it in the header
+ */
+static void PutCompactBlock( CUtlBuffer &fileBuffer, NavCompactHeader *header, NavCompactBlockType type, const void *data, int count, int elementSize )
+{
+	while( fileBuffer.TellPut() % NAV_COMPACT_ALIGNMENT )
+	{
+		fileBuffer.PutUnsignedChar( 0 );
+	}
+
+	header->block[ type ].offset = fileBuffer.TellPut();
+	header->block[ type ].count = count;
+	header->block[ type ].elementSize = elementSize;
+
+	if ( count > 0 )
+	{
+		fileBuffer.Put( data, count * elementSize );
+	}
+}
+
+template< typename T >
+static void PutCompactBlock( CUtlBuffer &fileBuffer, NavCompactHeader *header, NavCompactBlockType type, const CUtlVector< T > &data )
+{
+	PutCompactBlock( fileBuffer, header, type, data.Base(), data.Count(), sizeof( T ) );
+}
+
+static void PutCompactBlock( CUtlBuffer &fileBuffer, NavCompactHeader *header, NavCompactBlockType type, const CUtlBuffer &data )
+{
+	PutCompactBlock( fileBuffer, header, type, data.Base(), data.TellPut(), 1 );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+static int CompareVisibilityEntries( const NavVisibilityEntry *lhs, const NavVisibilityEntry *rhs )
+{
+	if ( lhs->index != rhs->index )
+	{
+		return ( lhs->index < rhs->index ) ? -1 : 1;
+	}
+
+	return 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Store the compact image of the current mesh
+ */
+bool CNavMesh::SaveCompact( void ) const
+{
+	if ( IsX360() )
+	{
+		// the 360 keeps its own pre-swapped nav files
+		return false;
+	}
+
+	if ( !IsCompactFileSupported() )
+	{
+		// the areas would silently lose whatever they keep beyond the CNavArea fields
+		static bool warned = false;
+		if ( !warned )
+		{
+			Warning( "This nav mesh does not support compact nav files - set nav_compact 0.\n" );
+			warned = true;
+		}
+		return false;
+	}
+
+	VPROF_BUDGET( "CNavMesh::SaveCompact", "NextBot" );
+
+	char maptmp[256];
+	const char *mapName = GetCleanMapName( STRING( gpGlobals->mapname ), maptmp );
+
+	char bspFilename[MAX_PATH] = { 0 };
+	Q_snprintf( bspFilename, sizeof( bspFilename ), FORMAT_BSPFILE, STRING( gpGlobals->mapname ) );
+
+	NavCompactHeader header;
+	V_memset( &header, 0, sizeof( header ) );
+
+	header.magic = NAV_COMPACT_MAGIC_NUMBER;
+	header.version = NAV_COMPACT_VERSION;
+	header.navVersion = NavCurrentVersion;
+	header.navSubVersion = GetSubVersionNumber();
+	GetNavSourceStamp( mapName, &header.sourceSize, &header.sourceTime );
+	header.bspSize = filesystem->Size( bspFilename );
+	header.isAnalyzed = m_isAnalyzed;
+	header.areaCount = TheNavAreas.Count();
+
+	// areas and hiding spots are stored by index
+	CUtlVector< unsigned int > areaIndex;
+	areaIndex.SetCount( CNavArea::m_nextID );
+	areaIndex.FillWithValue( NAV_COMPACT_NONE );
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		areaIndex[ TheNavAreas[ it ]->GetID() ] = it;
+	}
+
+	CUtlVector< unsigned int > spotIndex;
+	spotIndex.SetCount( HidingSpot::m_nextID );
+	spotIndex.FillWithValue( NAV_COMPACT_NONE );
+
+	// place directory - our own, the global one belongs to loading
+	PlaceDirectory directory;
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		directory.AddPlace( TheNavAreas[ it ]->GetPlace() );
+	}
+
+	CUtlBuffer placeBuffer;
+	directory.Save( placeBuffer );
+
+	// per-area fields
+	int areaCount = TheNavAreas.Count();
+
+	CUtlVector< unsigned int > ids;
+	CUtlVector< int > attributes;
+	CUtlVector< Vector > nwCorners, seCorners;
+	CUtlVector< NavCompactCornerZ > cornerZ;
+	CUtlVector< unsigned char > flags;
+	CUtlVector< unsigned short > places;
+	CUtlVector< float > occupyTimes, lightIntensity;
+	CUtlVector< unsigned int > inheritVisibility;
+
+	ids.EnsureCapacity( areaCount );
+	attributes.EnsureCapacity( areaCount );
+	nwCorners.EnsureCapacity( areaCount );
+	seCorners.EnsureCapacity( areaCount );
+	cornerZ.EnsureCapacity( areaCount );
+	flags.EnsureCapacity( areaCount );
+	places.EnsureCapacity( areaCount );
+	occupyTimes.EnsureCapacity( areaCount * MAX_NAV_TEAMS );
+	lightIntensity.EnsureCapacity( areaCount * NUM_CORNERS );
+	inheritVisibility.EnsureCapacity( areaCount );
+
+	// per-area lists
+	CUtlVector< unsigned int > connectRange, incomingRange, ladderRange, spotRange, visibilityRange, encounterRange, customRange;
+	CUtlVector< NavCompactConnect > connects, incoming;
+	CUtlVector< unsigned int > ladders;
+	CUtlVector< NavCompactHidingSpot > spots;
+	CUtlVector< NavVisibilityEntry > visibleAreas;
+	CUtlBuffer visibility;
+	CUtlVector< NavCompactEncounter > encounters;
+	CUtlVector< NavCompactSpotOrder > encounterSpots;
+	CUtlBuffer custom;
+
+	// hiding spots first, since encounters can refer to the spots of any area
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		const CNavArea *area = TheNavAreas[ it ];
+
+		spotRange.AddToTail( spots.Count() );
+
+		FOR_EACH_VEC( area->m_hidingSpots, sit )
+		{
+			const HidingSpot *spot = area->m_hidingSpots[ sit ];
+
+			NavCompactHidingSpot compact;
+			compact.pos = spot->GetPosition();
+			compact.id = spot->GetID();
+			compact.area = spot->GetArea() ? areaIndex[ spot->GetArea()->GetID() ] : NAV_COMPACT_NONE;
+			compact.flags = spot->GetFlags();
+
+			spotIndex[ spot->GetID() ] = spots.AddToTail( compact );
+		}
+	}
+	spotRange.AddToTail( spots.Count() );
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		const CNavArea *area = TheNavAreas[ it ];
+
+		ids.AddToTail( area->GetID() );
+		attributes.AddToTail( area->m_attributeFlags );
+		nwCorners.AddToTail( area->m_nwCorner );
+		seCorners.AddToTail( area->m_seCorner );
+
+		NavCompactCornerZ z;
+		z.neZ = area->m_neZ;
+		z.swZ = area->m_swZ;
+		cornerZ.AddToTail( z );
+
+		flags.AddToTail( area->m_isUnderwater ? NAV_COMPACT_AREA_UNDERWATER : 0 );
+		places.AddToTail( directory.GetIndex( area->GetPlace() ) );
+		occupyTimes.AddMultipleToTail( MAX_NAV_TEAMS, area->m_earliestOccupyTime );
+		lightIntensity.AddMultipleToTail( NUM_CORNERS, area->m_lightIntensity );
+		inheritVisibility.AddToTail( area->m_inheritVisibilityFrom.area ? areaIndex[ area->m_inheritVisibilityFrom.area->GetID() ] : NAV_COMPACT_NONE );
+
+		for( int d=0; d<NUM_DIRECTIONS; ++d )
+		{
+			connectRange.AddToTail( connects.Count() );
+
+			FOR_EACH_VEC( area->m_connect[d], cit )
+			{
+				const NavConnect &connect = area->m_connect[d][ cit ];
+
+				NavCompactConnect compact;
+				compact.area = areaIndex[ connect.area->GetID() ];
+				compact.length = connect.length;
+				connects.AddToTail( compact );
+			}
+
+			incomingRange.AddToTail( incoming.Count() );
+
+			FOR_EACH_VEC( area->m_incomingConnect[d], cit )
+			{
+				const NavConnect &connect = area->m_incomingConnect[d][ cit ];
+
+				NavCompactConnect compact;
+				compact.area = areaIndex[ connect.area->GetID() ];
+				compact.length = connect.length;
+				incoming.AddToTail( compact );
+			}
+		}
+
+		for( int dir=0; dir<CNavLadder::NUM_LADDER_DIRECTIONS; ++dir )
+		{
+			ladderRange.AddToTail( ladders.Count() );
+
+			FOR_EACH_VEC( area->m_ladder[dir], lit )
+			{
+				int ladderIndex = m_ladders.Find( area->m_ladder[dir][ lit ].ladder );
+				if ( ladderIndex != m_ladders.InvalidIndex() )
+				{
+					ladders.AddToTail( ladderIndex );
+				}
+			}
+		}
+
+		visibilityRange.AddToTail( visibility.TellPut() );
+
+		visibleAreas.RemoveAll();
+		for( int v=0; v<area->m_potentiallyVisibleAreas.Count(); ++v )
+		{
+			const CNavArea::AreaBindInfo &info = area->m_potentiallyVisibleAreas[v];
+			if ( info.area )
+			{
+				NavVisibilityEntry entry;
+				entry.index = areaIndex[ info.area->GetID() ];
+				entry.attributes = info.attributes;
+				visibleAreas.AddToTail( entry );
+			}
+		}
+
+		visibleAreas.Sort( CompareVisibilityEntries );
+		NavWriteVisibilityBitset( visibility, visibleAreas );
+
+		encounterRange.AddToTail( encounters.Count() );
+
+		FOR_EACH_VEC( area->m_spotEncounters, eit )
+		{
+			const SpotEncounter *e = area->m_spotEncounters[ eit ];
+
+			NavCompactEncounter compact;
+			compact.pathFrom = e->path.from;
+			compact.pathTo = e->path.to;
+			compact.fromArea = e->from.area ? areaIndex[ e->from.area->GetID() ] : NAV_COMPACT_NONE;
+			compact.toArea = e->to.area ? areaIndex[ e->to.area->GetID() ] : NAV_COMPACT_NONE;
+			compact.fromDir = e->fromDir;
+			compact.toDir = e->toDir;
+			compact.firstSpot = encounterSpots.Count();
+
+			FOR_EACH_VEC( e->spots, sit )
+			{
+				const SpotOrder &order = e->spots[ sit ];
+				if ( order.spot == NULL || spotIndex[ order.spot->GetID() ] == NAV_COMPACT_NONE )
+					continue;
+
+				NavCompactSpotOrder compactOrder;
+				compactOrder.spot = spotIndex[ order.spot->GetID() ];
+				compactOrder.t = order.t;
+				encounterSpots.AddToTail( compactOrder );
+			}
+
+			compact.spotCount = encounterSpots.Count() - compact.firstSpot;
+			encounters.AddToTail( compact );
+		}
+
+		customRange.AddToTail( custom.TellPut() );
+		area->SaveCompactData( custom );
+	}
+
+	connectRange.AddToTail( connects.Count() );
+	incomingRange.AddToTail( incoming.Count() );
+	ladderRange.AddToTail( ladders.Count() );
+	visibilityRange.AddToTail( visibility.TellPut() );
+	encounterRange.AddToTail( encounters.Count() );
+	customRange.AddToTail( custom.TellPut() );
+
+	header.hidingSpotCount = spots.Count();
+
+	// data kept in the regular encoding
+	CUtlBuffer ladderBuffer;
+	ladderBuffer.PutUnsignedInt( m_ladders.Count() );
+	FOR_EACH_VEC( m_ladders, lit )
+	{
+		m_ladders[ lit ]->Save( ladderBuffer, NavCurrentVersion );
+	}
+
+	CUtlBuffer customPreAreaBuffer;
+	SaveCustomDataPreArea( customPreAreaBuffer );
+
+	CUtlBuffer customBuffer;
+	SaveCustomData( customBuffer );
+
+	//
+	// Lay out the file
+	//
+	CUtlBuffer fileBuffer( 4096, 1024*1024 );
+
+	// the header is rewritten once the block offsets are known
+	fileBuffer.Put( &header, sizeof( header ) );
+
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_AREA_ID, ids );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_AREA_ATTRIBUTES, attributes );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_AREA_NW_CORNER, nwCorners );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_AREA_SE_CORNER, seCorners );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_AREA_CORNER_Z, cornerZ );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_AREA_FLAGS, flags );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_AREA_PLACE, places );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_AREA_OCCUPY_TIME, occupyTimes.Base(), areaCount, MAX_NAV_TEAMS * sizeof( float ) );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_AREA_LIGHT, lightIntensity.Base(), areaCount, NUM_CORNERS * sizeof( float ) );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_AREA_INHERIT_VISIBILITY, inheritVisibility );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_CONNECT_RANGE, connectRange );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_CONNECT, connects );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_INCOMING_RANGE, incomingRange );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_INCOMING, incoming );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_LADDER_RANGE, ladderRange );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_LADDER, ladders );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_SPOT_RANGE, spotRange );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_SPOT, spots );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_VISIBILITY_RANGE, visibilityRange );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_VISIBILITY, visibility );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_ENCOUNTER_RANGE, encounterRange );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_ENCOUNTER, encounters );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_ENCOUNTER_SPOT, encounterSpots );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_CUSTOM_AREA_RANGE, customRange );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_CUSTOM_AREA, custom );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_PLACE_DIRECTORY, placeBuffer );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_LADDERS, ladderBuffer );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_CUSTOM_PRE_AREA, customPreAreaBuffer );
+	PutCompactBlock( fileBuffer, &header, NAV_COMPACT_CUSTOM, customBuffer );
+
+	V_memcpy( fileBuffer.Base(), &header, sizeof( header ) );
+
+	char filename[MAX_PATH] = { 0 };
+	Q_snprintf( filename, sizeof( filename ), FORMAT_NAVCOMPACTFILE, mapName );
+
+	if ( !filesystem->WriteFile( filename, "MOD", fileBuffer ) )
+	{
+		DevWarning( "Unable to save compact nav file '%s'\n", filename );
+		return false;
+	}
+
+	DevMsg( "Saved compact nav file '%s' (%d bytes).\n", filename, fileBuffer.TellPut() );
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the elements of a compact file block, or NULL if the block doesn't fit the file
+ */
+static const void *GetCompactBlock( const CUtlBuffer &fileBuffer, const NavCompactHeader &header, NavCompactBlockType type, unsigned int elementSize, unsigned int *count )
+{
+	const NavCompactBlock &block = header.block[ type ];
+	unsigned int fileSize = fileBuffer.TellPut();
+
+	*count = 0;
+
+	if ( block.elementSize != elementSize || block.offset % NAV_COMPACT_ALIGNMENT != 0 )
+		return NULL;
+
+	if ( block.offset < sizeof( NavCompactHeader ) || block.offset > fileSize || block.count > ( fileSize - block.offset ) / elementSize )
+		return NULL;
+
+	*count = block.count;
+	return (const unsigned char *)fileBuffer.Base() + block.offset;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return the elements of a compact file block with one element per area, or NULL if the block is malformed
+ */
+static const void *GetCompactAreaBlock( const CUtlBuffer &fileBuffer, const NavCompactHeader &header, NavCompactBlockType type, unsigned int elementSize )
+{
+	unsigned int count;
+	const void *data = GetCompactBlock( fileBuffer, header, type, elementSize, &count );
+
+	return ( count == header.areaCount ) ? data : NULL;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return true if 'range' holds 'listCount' ascending offsets covering all 'elementCount' elements
+ */
+static bool IsValidCompactRange( const unsigned int *range, unsigned int rangeCount, unsigned int listCount, unsigned int elementCount )
+{
+	if ( range == NULL || rangeCount != listCount + 1 )
+		return false;
+
+	if ( range[0] != 0 || range[ listCount ] != elementCount )
+		return false;
+
+	for( unsigned int i=1; i<rangeCount; ++i )
+	{
+		if ( range[i] < range[i-1] )
+			return false;
+	}
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Load the compact image of this map's nav data.
+ * Fails without touching the mesh if there is none, or it is out of date or malformed.
+ */
+NavErrorType CNavMesh::LoadCompact( void )
+{
+	if ( IsX360() )
+	{
+		return NAV_CANT_ACCESS_FILE;
+	}
+
+	if ( !IsCompactFileSupported() )
+	{
+		return NAV_CANT_ACCESS_FILE;
+	}
+
+	VPROF_BUDGET( "CNavMesh::LoadCompact", "NextBot" );
+
+	char maptmp[256];
+	const char *mapName = GetCleanMapName( STRING( gpGlobals->mapname ), maptmp );
+
+	char filename[MAX_PATH] = { 0 };
+	Q_snprintf( filename, sizeof( filename ), FORMAT_NAVCOMPACTFILE, mapName );
+
+	CUtlBuffer fileBuffer( 4096, 1024*1024, CUtlBuffer::READ_ONLY );
+	if ( !filesystem->ReadFile( filename, "MOD", fileBuffer ) )
+	{
+		return NAV_CANT_ACCESS_FILE;
+	}
+
+	if ( fileBuffer.TellPut() < (int)sizeof( NavCompactHeader ) )
+	{
+		return NAV_INVALID_FILE;
+	}
+
+	NavCompactHeader header;
+	V_memcpy( &header, fileBuffer.Base(), sizeof( header ) );
+
+	if ( header.magic != NAV_COMPACT_MAGIC_NUMBER || header.version != NAV_COMPACT_VERSION )
+	{
+		return NAV_BAD_FILE_VERSION;
+	}
+
+	if ( header.navVersion != (unsigned int)NavCurrentVersion || header.navSubVersion != GetSubVersionNumber() )
+	{
+		return NAV_BAD_FILE_VERSION;
+	}
+
+	unsigned int sourceSize, sourceTime;
+	GetNavSourceStamp( mapName, &sourceSize, &sourceTime );
+	if ( sourceSize != header.sourceSize || sourceTime != header.sourceTime )
+	{
+		DevMsg( "Compact nav file '%s' is out of date.\n", filename );
+		return NAV_FILE_OUT_OF_DATE;
+	}
+
+	//
+	// Find and validate every block before creating anything
+	//
+	const unsigned int areaCount = header.areaCount;
+	const unsigned int spotCount = header.hidingSpotCount;
+	if ( areaCount == 0 )
+	{
+		return NAV_INVALID_FILE;
+	}
+
+	const unsigned int *ids = (const unsigned int *)GetCompactAreaBlock( fileBuffer, header, NAV_COMPACT_AREA_ID, sizeof( unsigned int ) );
+	const int *attributes = (const int *)GetCompactAreaBlock( fileBuffer, header, NAV_COMPACT_AREA_ATTRIBUTES, sizeof( int ) );
+	const Vector *nwCorners = (const Vector *)GetCompactAreaBlock( fileBuffer, header, NAV_COMPACT_AREA_NW_CORNER, sizeof( Vector ) );
+	const Vector *seCorners = (const Vector *)GetCompactAreaBlock( fileBuffer, header, NAV_COMPACT_AREA_SE_CORNER, sizeof( Vector ) );
+	const NavCompactCornerZ *cornerZ = (const NavCompactCornerZ *)GetCompactAreaBlock( fileBuffer, header, NAV_COMPACT_AREA_CORNER_Z, sizeof( NavCompactCornerZ ) );
+	const unsigned char *flags = (const unsigned char *)GetCompactAreaBlock( fileBuffer, header, NAV_COMPACT_AREA_FLAGS, sizeof( unsigned char ) );
+	const unsigned short *places = (const unsigned short *)GetCompactAreaBlock( fileBuffer, header, NAV_COMPACT_AREA_PLACE, sizeof( unsigned short ) );
+	const float *occupyTimes = (const float *)GetCompactAreaBlock( fileBuffer, header, NAV_COMPACT_AREA_OCCUPY_TIME, MAX_NAV_TEAMS * sizeof( float ) );
+	const float *lightIntensity = (const float *)GetCompactAreaBlock( fileBuffer, header, NAV_COMPACT_AREA_LIGHT, NUM_CORNERS * sizeof( float ) );
+	const unsigned int *inheritVisibility = (const unsigned int *)GetCompactAreaBlock( fileBuffer, header, NAV_COMPACT_AREA_INHERIT_VISIBILITY, sizeof( unsigned int ) );
+
+	if ( !ids || !attributes || !nwCorners || !seCorners || !cornerZ || !flags || !places || !occupyTimes || !lightIntensity || !inheritVisibility )
+	{
+		return NAV_INVALID_FILE;
+	}
+
+	unsigned int connectRangeCount, connectCount, incomingRangeCount, incomingCount, ladderRangeCount, ladderCount;
+	unsigned int spotRangeCount, spotBlockCount, visibilityRangeCount, visibilityCount, encounterRangeCount, encounterCount, encounterSpotCount;
+	unsigned int customRangeCount, customCount, placeSize, laddersSize, customPreAreaSize, customSize;
+
+	const unsigned int *connectRange = (const unsigned int *)GetCompactBlock( fileBuffer, header, NAV_COMPACT_CONNECT_RANGE, sizeof( unsigned int ), &connectRangeCount );
+	const NavCompactConnect *connects = (const NavCompactConnect *)GetCompactBlock( fileBuffer, header, NAV_COMPACT_CONNECT, sizeof( NavCompactConnect ), &connectCount );
+	const unsigned int *incomingRange = (const unsigned int *)GetCompactBlock( fileBuffer, header, NAV_COMPACT_INCOMING_RANGE, sizeof( unsigned int ), &incomingRangeCount );
+	const NavCompactConnect *incoming = (const NavCompactConnect *)GetCompactBlock( fileBuffer, header, NAV_COMPACT_INCOMING, sizeof( NavCompactConnect ), &incomingCount );
+	const unsigned int *ladderRange = (const unsigned int *)GetCompactBlock( fileBuffer, header, NAV_COMPACT_LADDER_RANGE, sizeof( unsigned int ), &ladderRangeCount );
+	const unsigned int *ladders = (const unsigned int *)GetCompactBlock( fileBuffer, header, NAV_COMPACT_LADDER, sizeof( unsigned int ), &ladderCount );
+	const unsigned int *spotRange = (const unsigned int *)GetCompactBlock( fileBuffer, header, NAV_COMPACT_SPOT_RANGE, sizeof( unsigned int ), &spotRangeCount );
+	const NavCompactHidingSpot *spots = (const NavCompactHidingSpot *)GetCompactBlock( fileBuffer, header, NAV_COMPACT_SPOT, sizeof( NavCompactHidingSpot ), &spotBlockCount );
+	const unsigned int *visibilityRange = (const unsigned int *)GetCompactBlock( fileBuffer, header, NAV_COMPACT_VISIBILITY_RANGE, sizeof( unsigned int ), &visibilityRangeCount );
+	const unsigned char *visibility = (const unsigned char *)GetCompactBlock( fileBuffer, header, NAV_COMPACT_VISIBILITY, 1, &visibilityCount );
+	const unsigned int *encounterRange = (const unsigned int *)GetCompactBlock( fileBuffer, header, NAV_COMPACT_ENCOUNTER_RANGE, sizeof( unsigned int ), &encounterRangeCount );
+	const NavCompactEncounter *encounters = (const NavCompactEncounter *)GetCompactBlock( fileBuffer, header, NAV_COMPACT_ENCOUNTER, sizeof( NavCompactEncounter ), &encounterCount );
+	const NavCompactSpotOrder *encounterSpots = (const NavCompactSpotOrder *)GetCompactBlock( fileBuffer, header, NAV_COMPACT_ENCOUNTER_SPOT, sizeof( NavCompactSpotOrder ), &encounterSpotCount );
+	const unsigned int *customRange = (const unsigned int *)GetCompactBlock( fileBuffer, header, NAV_COMPACT_CUSTOM_AREA_RANGE, sizeof( unsigned int ), &customRangeCount );
+	const unsigned char *custom = (const unsigned char *)GetCompactBlock( fileBuffer, header, NAV_COMPACT_CUSTOM_AREA, 1, &customCount );
+	const unsigned char *placeData = (const unsigned char *)GetCompactBlock( fileBuffer, header, NAV_COMPACT_PLACE_DIRECTORY, 1, &placeSize );
+	const unsigned char *laddersData = (const unsigned char *)GetCompactBlock( fileBuffer, header, NAV_COMPACT_LADDERS, 1, &laddersSize );
+	const unsigned char *customPreAreaData = (const unsigned char *)GetCompactBlock( fileBuffer, header, NAV_COMPACT_CUSTOM_PRE_AREA, 1, &customPreAreaSize );
+	const unsigned char *customData = (const unsigned char *)GetCompactBlock( fileBuffer, header, NAV_COMPACT_CUSTOM, 1, &customSize );
+
+	if ( !connects || !incoming || !ladders || !spots || spotBlockCount != spotCount || !visibility || !encounters || !encounterSpots || !custom || !placeData || !laddersData || !customPreAreaData || !customData )
+	{
+		return NAV_INVALID_FILE;
+	}
+
+	if ( !IsValidCompactRange( connectRange, connectRangeCount, areaCount * NUM_DIRECTIONS, connectCount ) ||
+		 !IsValidCompactRange( incomingRange, incomingRangeCount, areaCount * NUM_DIRECTIONS, incomingCount ) ||
+		 !IsValidCompactRange( ladderRange, ladderRangeCount, areaCount * CNavLadder::NUM_LADDER_DIRECTIONS, ladderCount ) ||
+		 !IsValidCompactRange( spotRange, spotRangeCount, areaCount, spotCount ) ||
+		 !IsValidCompactRange( visibilityRange, visibilityRangeCount, areaCount, visibilityCount ) ||
+		 !IsValidCompactRange( encounterRange, encounterRangeCount, areaCount, encounterCount ) ||
+		 !IsValidCompactRange( customRange, customRangeCount, areaCount, customCount ) )
+	{
+		return NAV_INVALID_FILE;
+	}
+
+	// number of ladders leads the ladder data
+	if ( laddersSize < sizeof( unsigned int ) )
+	{
+		return NAV_INVALID_FILE;
+	}
+	unsigned int meshLadderCount = *(const unsigned int *)laddersData;
+
+	// check every index
+	unsigned int i;
+	for( i=0; i<areaCount; ++i )
+	{
+		if ( inheritVisibility[i] != NAV_COMPACT_NONE && inheritVisibility[i] >= areaCount )
+			return NAV_CORRUPT_DATA;
+	}
+	for( i=0; i<connectCount; ++i )
+	{
+		if ( connects[i].area >= areaCount )
+			return NAV_CORRUPT_DATA;
+	}
+	for( i=0; i<incomingCount; ++i )
+	{
+		if ( incoming[i].area >= areaCount )
+			return NAV_CORRUPT_DATA;
+	}
+	for( i=0; i<ladderCount; ++i )
+	{
+		if ( ladders[i] >= meshLadderCount )
+			return NAV_CORRUPT_DATA;
+	}
+	for( i=0; i<spotCount; ++i )
+	{
+		if ( spots[i].area != NAV_COMPACT_NONE && spots[i].area >= areaCount )
+			return NAV_CORRUPT_DATA;
+	}
+	for( i=0; i<areaCount; ++i )
+	{
+		if ( !NavReadVisibilityBitset( visibility + visibilityRange[i], visibilityRange[ i+1 ] - visibilityRange[i], areaCount, NULL ) )
+			return NAV_CORRUPT_DATA;
+	}
+	for( i=0; i<encounterCount; ++i )
+	{
+		const NavCompactEncounter &e = encounters[i];
+
+		if ( ( e.fromArea != NAV_COMPACT_NONE && e.fromArea >= areaCount ) || ( e.toArea != NAV_COMPACT_NONE && e.toArea >= areaCount ) )
+			return NAV_CORRUPT_DATA;
+
+		if ( e.fromDir >= NUM_DIRECTIONS || e.toDir >= NUM_DIRECTIONS || e.firstSpot > encounterSpotCount || e.spotCount > encounterSpotCount - e.firstSpot )
+			return NAV_CORRUPT_DATA;
+	}
+	for( i=0; i<encounterSpotCount; ++i )
+	{
+		if ( encounterSpots[i].spot >= spotCount )
+			return NAV_CORRUPT_DATA;
+	}
+
+	//
+	// Build the mesh
+	//
+	char bspFilename[MAX_PATH] = { 0 };
+	Q_snprintf( bspFilename, sizeof( bspFilename ), FORMAT_BSPFILE, STRING( gpGlobals->mapname ) );
+	if ( filesystem->Size( bspFilename ) != header.bspSize )
+	{
+		DevMsg( "The Navigation Mesh was built using a different version of this map.\n" );
+		m_isOutOfDate = true;
+	}
+
+	m_isAnalyzed = header.isAnalyzed != 0;
+
+	CUtlBuffer placeBuffer( placeData, placeSize, CUtlBuffer::READ_ONLY );
+	placeDirectory.Load( placeBuffer, NavCurrentVersion );
+
+	CUtlBuffer customPreAreaBuffer( customPreAreaData, customPreAreaSize, CUtlBuffer::READ_ONLY );
+	LoadCustomDataPreArea( customPreAreaBuffer, header.navSubVersion );
+
+	Extent extent;
+	extent.lo.x = 9999999999.9f;
+	extent.lo.y = 9999999999.9f;
+	extent.hi.x = -9999999999.9f;
+	extent.hi.y = -9999999999.9f;
+
+	PreLoadAreas( areaCount );
+	TheNavAreas.EnsureCapacity( areaCount );
+
+	for( i=0; i<areaCount; ++i )
+	{
+		CNavArea *area = CreateArea();
+
+		area->m_id = ids[i];
+		if ( area->m_id >= CNavArea::m_nextID )
+		{
+			CNavArea::m_nextID = area->m_id + 1;
+		}
+
+		area->m_attributeFlags = attributes[i];
+		area->m_nwCorner = nwCorners[i];
+		area->m_seCorner = seCorners[i];
+		area->m_center = ( area->m_nwCorner + area->m_seCorner ) / 2.0f;
+
+		if ( ( area->m_seCorner.x - area->m_nwCorner.x ) > 0.0f && ( area->m_seCorner.y - area->m_nwCorner.y ) > 0.0f )
+		{
+			area->m_invDxCorners = 1.0f / ( area->m_seCorner.x - area->m_nwCorner.x );
+			area->m_invDyCorners = 1.0f / ( area->m_seCorner.y - area->m_nwCorner.y );
+		}
+		else
+		{
+			area->m_invDxCorners = area->m_invDyCorners = 0;
+		}
+
+		area->m_neZ = cornerZ[i].neZ;
+		area->m_swZ = cornerZ[i].swZ;
+		area->m_isUnderwater = ( flags[i] & NAV_COMPACT_AREA_UNDERWATER ) != 0;
+		area->SetPlace( placeDirectory.IndexToPlace( places[i] ) );
+
+		V_memcpy( area->m_earliestOccupyTime, &occupyTimes[ i * MAX_NAV_TEAMS ], MAX_NAV_TEAMS * sizeof( float ) );
+		V_memcpy( area->m_lightIntensity, &lightIntensity[ i * NUM_CORNERS ], NUM_CORNERS * sizeof( float ) );
+
+		TheNavAreas.AddToTail( area );
+
+		extent.lo.x = MIN( extent.lo.x, area->m_nwCorner.x );
+		extent.lo.y = MIN( extent.lo.y, area->m_nwCorner.y );
+		extent.hi.x = MAX( extent.hi.x, area->m_seCorner.x );
+		extent.hi.y = MAX( extent.hi.y, area->m_seCorner.y );
+	}
+
+	// add the areas to the grid
+	AllocateGrid( extent.lo.x, extent.hi.x, extent.lo.y, extent.hi.y );
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		AddNavArea( TheNavAreas[ it ] );
+	}
+
+	// ladders bind to areas by ID themselves
+	CUtlBuffer ladderBuffer( laddersData, laddersSize, CUtlBuffer::READ_ONLY );
+	ladderBuffer.GetUnsignedInt();
+
+	m_ladders.EnsureCapacity( meshLadderCount );
+	for( i=0; i<meshLadderCount; ++i )
+	{
+		CNavLadder *ladder = new CNavLadder;
+		ladder->Load( ladderBuffer, NavCurrentVersion );
+		m_ladders.AddToTail( ladder );
+	}
+
+	// hiding spots
+	CUtlVector< HidingSpot * > spotVector;
+	spotVector.EnsureCapacity( spotCount );
+
+	for( i=0; i<spotCount; ++i )
+	{
+		HidingSpot *spot = CreateHidingSpot();
+
+		spot->m_id = spots[i].id;
+		if ( spot->m_id >= HidingSpot::m_nextID )
+		{
+			HidingSpot::m_nextID = spot->m_id + 1;
+		}
+
+		spot->m_pos = spots[i].pos;
+		spot->m_flags = spots[i].flags;
+		spot->m_area = ( spots[i].area == NAV_COMPACT_NONE ) ? NULL : TheNavAreas[ spots[i].area ];
+
+		spotVector.AddToTail( spot );
+	}
+
+	// everything else refers to areas by index
+	CUtlVector< NavVisibilityEntry > visibleAreas;
+
+	for( i=0; i<areaCount; ++i )
+	{
+		CNavArea *area = TheNavAreas[i];
+
+		for( int d=0; d<NUM_DIRECTIONS; ++d )
+		{
+			unsigned int list = i * NUM_DIRECTIONS + d;
+
+			area->m_connect[d].EnsureCapacity( connectRange[ list+1 ] - connectRange[ list ] );
+			for( unsigned int c=connectRange[ list ]; c<connectRange[ list+1 ]; ++c )
+			{
+				NavConnect connect;
+				connect.area = TheNavAreas[ connects[c].area ];
+				connect.length = connects[c].length;
+				area->m_connect[d].AddToTail( connect );
+			}
+
+			area->m_incomingConnect[d].EnsureCapacity( incomingRange[ list+1 ] - incomingRange[ list ] );
+			for( unsigned int c=incomingRange[ list ]; c<incomingRange[ list+1 ]; ++c )
+			{
+				NavConnect connect;
+				connect.area = TheNavAreas[ incoming[c].area ];
+				connect.length = incoming[c].length;
+				area->m_incomingConnect[d].AddToTail( connect );
+			}
+		}
+
+		for( int dir=0; dir<CNavLadder::NUM_LADDER_DIRECTIONS; ++dir )
+		{
+			unsigned int list = i * CNavLadder::NUM_LADDER_DIRECTIONS + dir;
+
+			area->m_ladder[dir].EnsureCapacity( ladderRange[ list+1 ] - ladderRange[ list ] );
+			for( unsigned int l=ladderRange[ list ]; l<ladderRange[ list+1 ]; ++l )
+			{
+				NavLadderConnect connect;
+				connect.ladder = m_ladders[ ladders[l] ];
+				area->m_ladder[dir].AddToTail( connect );
+			}
+		}
+
+		area->m_hidingSpots.EnsureCapacity( spotRange[ i+1 ] - spotRange[i] );
+		for( unsigned int s=spotRange[i]; s<spotRange[ i+1 ]; ++s )
+		{
+			area->m_hidingSpots.AddToTail( spotVector[s] );
+		}
+
+		NavReadVisibilityBitset( visibility + visibilityRange[i], visibilityRange[ i+1 ] - visibilityRange[i], areaCount, &visibleAreas );
+
+		area->m_potentiallyVisibleAreas.EnsureCapacity( visibleAreas.Count() );
+		FOR_EACH_VEC( visibleAreas, v )
+		{
+			CNavArea::AreaBindInfo info;
+			info.area = TheNavAreas[ visibleAreas[v].index ];
+			info.attributes = visibleAreas[v].attributes;
+			area->m_potentiallyVisibleAreas.AddToTail( info );
+		}
+
+		area->m_inheritVisibilityFrom.area = ( inheritVisibility[i] == NAV_COMPACT_NONE ) ? NULL : TheNavAreas[ inheritVisibility[i] ];
+
+		area->m_spotEncounters.EnsureCapacity( encounterRange[ i+1 ] - encounterRange[i] );
+		for( unsigned int e=encounterRange[i]; e<encounterRange[ i+1 ]; ++e )
+		{
+			const NavCompactEncounter &compact = encounters[e];
+
+			SpotEncounter *encounter = new SpotEncounter;
+			encounter->from.area = ( compact.fromArea == NAV_COMPACT_NONE ) ? NULL : TheNavAreas[ compact.fromArea ];
+			encounter->fromDir = (NavDirType)compact.fromDir;
+			encounter->to.area = ( compact.toArea == NAV_COMPACT_NONE ) ? NULL : TheNavAreas[ compact.toArea ];
+			encounter->toDir = (NavDirType)compact.toDir;
+			encounter->path.from = compact.pathFrom;
+			encounter->path.to = compact.pathTo;
+
+			encounter->spots.EnsureCapacity( compact.spotCount );
+			for( unsigned int s=compact.firstSpot; s<compact.firstSpot + compact.spotCount; ++s )
+			{
+				SpotOrder order;
+				order.spot = spotVector[ encounterSpots[s].spot ];
+				order.t = encounterSpots[s].t;
+				encounter->spots.AddToTail( order );
+			}
+
+			area->m_spotEncounters.AddToTail( encounter );
+		}
+
+		CUtlBuffer customBuffer( custom + customRange[i], customRange[ i+1 ] - customRange[i], CUtlBuffer::READ_ONLY );
+		area->LoadCompactData( customBuffer );
+
+		// func avoid/prefer attributes are controlled by func_nav_cost entities
+		area->ClearAllNavCostEntities();
+	}
+
+	//
+	// Load derived class mesh info
+	//
+	CUtlBuffer customBuffer( customData, customSize, CUtlBuffer::READ_ONLY );
+	LoadCustomData( customBuffer, header.navSubVersion );
+
+	OnLoadFinished();
+
+	WarnIfMeshNeedsAnalysis( NavCurrentVersion );
+
+	DevMsg( "Loaded compact nav file '%s'.\n", filename );
+
 	return NAV_OK;
 }
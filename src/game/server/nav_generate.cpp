@@ -14,9 +14,11 @@
 #include "nav_mesh.h"
 #include "nav_node.h"
 #include "nav_pathfind.h"
+#include "nav_visibility.h"
 #include "viewport_panel_names.h"
 //#include "terror/TerrorShared.h"
 #include "fmtstr.h"
+#include "vstdlib/jobthread.h"
 
 #ifdef TERROR
 #include "func_simpleladder.h"
@@ -43,6 +45,8 @@ ConVar nav_generate_jump_connections( "nav_generate_jump_connections", "1", FCVA
 ConVar nav_generate_incremental_range( "nav_generate_incremental_range", "2000", FCVAR_CHEAT );
 ConVar nav_generate_incremental_tolerance( "nav_generate_incremental_tolerance", "0", FCVAR_CHEAT, "Z tolerance for adding new nav areas." );
 ConVar nav_area_max_size( "nav_area_max_size", "50", FCVAR_CHEAT, "Max area size created in nav generation" );
+ConVar nav_generate_tiled( "nav_generate_tiled", "0", FCVAR_CHEAT, "If nonzero, a full generation samples walkable space in tiles processed in parallel" );
+ConVar nav_generate_tile_size( "nav_generate_tile_size", "32", FCVAR_CHEAT, "Width of the tiles sampled in parallel by nav_generate_tiled, in generation steps" );
 
 // Common bounding box for traces
 Vector NavTraceMins( -0.45, -0.45, 0 );
@@ -3480,6 +3484,12 @@ void CNavMesh::BeginGeneration( bool incremental )
 	// initialize seed list index
 	m_seedIdx = 0;
 
+	m_isSamplingTiles = false;
+	if ( !incremental && nav_generate_tiled.GetBool() )
+	{
+		BeginTiledSampling();
+	}
+
 	Msg( "Generating Navigation Mesh...\n" );
 	m_generationStartTime = Plat_FloatTime();
 }
@@ -3650,6 +3660,20 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 			AnalysisProgress( "Sampling walkable space...", 100, m_sampleTick / 10, false );
 			m_sampleTick = ( m_sampleTick + 1 ) % 1000;
 
+			if ( m_isSamplingTiles )
+			{
+				while ( SampleTiledStep() )
+				{
+					if ( Plat_FloatTime() - startTime > maxTime )
+					{
+						return true;
+					}
+				}
+
+				// the ends of ladders are still searched one step at a time below
+				EndTiledSampling();
+			}
+
 			while ( SampleStep() )
 			{
 				if ( Plat_FloatTime() - startTime > maxTime )
@@ -3793,17 +3817,12 @@ bool CNavMesh::UpdateGeneration( float maxTime )
 		//---------------------------------------------------------------------------
 		case COMPUTE_MESH_VISIBILITY:
 		{
-			while( m_generationIndex < TheNavAreas.Count() )
+			while( TheNavVisibilityBuilder().ComputeBatch() )
 			{
-				CNavArea *area = TheNavAreas[ m_generationIndex ];
-				++m_generationIndex;
-
-				area->ComputeVisibilityToMesh();
-
 				// don't go over our time allotment
 				if ( Plat_FloatTime() - startTime > maxTime )
 				{
-					AnalysisProgress( "Computing mesh visibility...", 100, 100 * m_generationIndex / TheNavAreas.Count() );
+					AnalysisProgress( "Computing mesh visibility...", 100, TheNavVisibilityBuilder().GetPercentComplete() );
 					return true;
 				}
 			}
@@ -4084,6 +4103,58 @@ const char *CNavMesh::GetPlayerSpawnName( void ) const
 	return "info_player_start";
 }
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Connect 'node' back to the 'source' node it was reached from in direction 'dir'
+ */
+static void ConnectBackToSource( CNavNode *node, CNavNode *source, NavDirType dir, float obstacleHeight, float obstacleStartDist, float obstacleEndDist )
+{
+	// optimization: if deltaZ changes very little, assume connection is commutative
+	const float zTolerance = 50.0f;
+	float deltaZ = source->GetPosition()->z - node->GetPosition()->z;
+	if (fabs( deltaZ ) < zTolerance)
+	{
+		if ( obstacleHeight > 0 )
+		{
+			obstacleHeight = MAX( obstacleHeight + deltaZ, 0 );
+			Assert( obstacleHeight > 0 );
+		}
+		node->ConnectTo( source, OppositeDirection( dir ), obstacleHeight, GenerationStepSize - obstacleEndDist, GenerationStepSize - obstacleStartDist );
+		node->MarkAsVisited( OppositeDirection( dir ) );
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Determine if there's a cliff nearby and set an attribute on this node
+ */
+static void MarkCliffNode( CNavNode *node )
+{
+	for ( int i = 0; i < NUM_DIRECTIONS; i++ )
+	{
+		NavDirType dir = (NavDirType) i;
+		if ( CheckCliff( node->GetPosition(), dir ) )
+		{
+			node->SetAttributes( node->GetAttributes() | NAV_MESH_CLIFF );
+			break;
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Mark crouch and cliff attributes of a node that was just created.
+ * Both only depend on the node's position, so every node is checked once, whether sampled serially or in tiles.
+ */
+void CNavMesh::ClassifyNewNode( CNavNode *node ) const
+{
+	node->CheckCrouch();
+	MarkCliffNode( node );
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Add a nav node and connect it.
@@ -4106,38 +4177,14 @@ CNavNode *CNavMesh::AddNode( const Vector &destPos, const Vector &normal, NavDir
 
 	// connect source node to new node
 	source->ConnectTo( node, dir, obstacleHeight, obstacleStartDist, obstacleEndDist );
-
-	// optimization: if deltaZ changes very little, assume connection is commutative
-	const float zTolerance = 50.0f;
-	float deltaZ = source->GetPosition()->z - destPos.z;
-	if (fabs( deltaZ ) < zTolerance)
-	{
-		if ( obstacleHeight > 0 )
-		{
-			obstacleHeight = MAX( obstacleHeight + deltaZ, 0 );
-			Assert( obstacleHeight > 0 );
-		}
-		node->ConnectTo( source, OppositeDirection( dir ), obstacleHeight, GenerationStepSize - obstacleEndDist, GenerationStepSize - obstacleStartDist );
-		node->MarkAsVisited( OppositeDirection( dir ) );
-	}
+	ConnectBackToSource( node, source, dir, obstacleHeight, obstacleStartDist, obstacleEndDist );
 
 	if (useNew)
 	{
 		// new node becomes current node
 		m_currentNode = node;
-	}
-
-	node->CheckCrouch();
 
-	// determine if there's a cliff nearby and set an attribute on this node
-	for ( int i = 0; i < NUM_DIRECTIONS; i++ )
-	{
-		NavDirType dir = (NavDirType) i;
-		if ( CheckCliff( node->GetPosition(), dir ) )
-		{
-			node->SetAttributes( node->GetAttributes() | NAV_MESH_CLIFF );
-			break;
-		}
+		ClassifyNewNode( node );
 	}
 
 	return node;
@@ -4350,6 +4397,231 @@ static bool IsNodeOverlapped( const Vector& pos, const Vector& offset )
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Trace one sampling step from the node position 'from' to the adjacent grid position in direction 'dir'.
+ * Returns false if the step can't be taken. Only reads the mesh, so tiles can sample on several threads at once.
+ */
+bool CNavMesh::ComputeSampleStep( const Vector &from, NavDirType dir, NavSampleStep *step ) const
+{
+	// snap to grid
+	Vector pos = from;
+	int cx = SnapToGrid( pos.x );
+	int cy = SnapToGrid( pos.y );
+
+	// attempt to move to adjacent node
+	switch( dir )
+	{
+		case NORTH:		cy -= GenerationStepSize; break;
+		case SOUTH:		cy += GenerationStepSize; break;
+		case EAST:		cx += GenerationStepSize; break;
+		case WEST:		cx -= GenerationStepSize; break;
+	}
+
+	pos.x = cx;
+	pos.y = cy;
+
+	// sanity check to not generate across the world for incremental generation
+	const float incrementalRange = nav_generate_incremental_range.GetFloat();
+	if ( m_generationMode == GENERATE_INCREMENTAL && incrementalRange > 0 )
+	{
+		bool inRange = false;
+		for ( int i=0; i<m_walkableSeeds.Count(); ++i )
+		{
+			const Vector &seedPos = m_walkableSeeds[i].pos;
+			if ( (seedPos - pos).IsLengthLessThan( incrementalRange ) )
+			{
+				inRange = true;
+				break;
+			}
+		}
+
+		if ( !inRange )
+		{
+			return false;
+		}
+	}
+
+	if ( m_generationMode == GENERATE_SIMPLIFY )
+	{
+		if ( !m_simplifyGenerationExtent.Contains( pos ) )
+		{
+			return false;
+		}
+	}
+
+	// test if we can move to new position
+	trace_t result;
+	CTraceFilterWalkableEntities filter( NULL, COLLISION_GROUP_NONE, WALK_THRU_EVERYTHING );
+	Vector to = vec3_origin, toNormal = vec3_origin;
+	float obstacleHeight = 0, obstacleStartDist = 0, obstacleEndDist = GenerationStepSize;
+	if ( TraceAdjacentNode( 0, from, pos, &result ) )
+	{
+		to = result.endpos;
+		toNormal = result.plane.normal;
+	}
+	else
+	{
+		// test going up ClimbUpHeight
+		bool success = false;
+		for ( float height = StepHeight; height <= ClimbUpHeight; height += 1.0f )
+		{						
+			trace_t tr;
+			Vector start( from );
+			Vector end( pos );
+			start.z += height;
+			end.z += height;
+			UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+			if ( !tr.startsolid && tr.fraction == 1.0f )
+			{
+				if ( !StayOnFloor( &tr ) )
+				{
+					break;
+				}
+
+				to = tr.endpos;
+				toNormal = tr.plane.normal;
+
+				start = end = from;
+				end.z += height;
+				UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+				if ( tr.fraction < 1.0f )
+				{
+					break;
+				}
+
+				// keep track of far up we had to go to find a path to the next node
+				obstacleHeight = height;
+				success = true;
+				break;
+			}
+			else
+			{
+				// Could not trace from node to node at this height, something is in the way.
+				// Trace in the other direction to see if we hit something
+				Vector vecToObstacleStart = tr.endpos - start;
+				Assert( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) );
+				if ( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) )
+				{
+					UTIL_TraceHull( end, start, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
+					if ( !tr.startsolid && tr.fraction < 1.0 )
+					{
+						// We hit something going the other direction.  There is some obstacle between the two nodes.
+						Vector vecToObstacleEnd = tr.endpos - start;
+						Assert( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize ) );
+						if ( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize )  )
+						{
+							// Remember the distances to start and end of the obstacle (with respect to the "from" node).
+							// Keep track of the last distances to obstacle as we keep increasing the height we do a trace for.
+							// If we do eventually clear the obstacle, these values will be the start and end distance to the
+							// very tip of the obstacle.
+							obstacleStartDist = vecToObstacleStart.Length();
+							obstacleEndDist = vecToObstacleEnd.Length();
+							if ( obstacleEndDist == 0 )
+							{
+								obstacleEndDist = GenerationStepSize;
+							}
+						}								
+					}
+				}
+			}
+		}
+
+		if ( !success )
+		{
+			return false;
+		}
+	}
+
+	// Don't generate nodes if we spill off the end of the world onto skybox
+	if ( result.surface.flags & ( SURF_SKY|SURF_SKY2D ) )
+	{
+		return false;
+	}
+
+	// If we're incrementally generating, don't overlap existing nav areas.
+	Vector testPos( to );
+	bool overlapSE = IsNodeOverlapped( testPos, Vector(  1,  1, HalfHumanHeight ) );
+	bool overlapSW = IsNodeOverlapped( testPos, Vector( -1,  1, HalfHumanHeight ) );
+	bool overlapNE = IsNodeOverlapped( testPos, Vector(  1, -1, HalfHumanHeight ) );
+	bool overlapNW = IsNodeOverlapped( testPos, Vector( -1, -1, HalfHumanHeight ) );
+	if ( overlapSE && overlapSW && overlapNE && overlapNW && m_generationMode != GENERATE_SIMPLIFY && m_generationMode != GENERATE_SAMPLE_BENCHMARK )
+	{
+		return false;
+	}
+
+	int nTolerance = nav_generate_incremental_tolerance.GetInt();
+	if ( nTolerance > 0 && m_generationMode == GENERATE_INCREMENTAL )
+	{
+		bool bValid = false;
+		int zPos = to.z;
+		for ( int i=0; i<m_walkableSeeds.Count(); ++i )
+		{
+			const Vector &seedPos = m_walkableSeeds[i].pos;
+			int zMin = seedPos.z - nTolerance;
+			int zMax = seedPos.z + nTolerance;
+
+			if ( zPos >= zMin && zPos <= zMax )
+			{
+				bValid = true;
+				break;
+			}
+		}
+
+		if ( !bValid )
+			return false;
+	}
+
+
+	bool isOnDisplacement = result.IsDispSurface();
+
+	if ( nav_displacement_test.GetInt() > 0 )
+	{
+		// Test for nodes under displacement surfaces.
+		// This happens during development, and is a pain because the space underneath a displacement
+		// is not 'solid'.
+		Vector start = to + Vector( 0, 0, 0 );
+		Vector end = start + Vector( 0, 0, nav_displacement_test.GetInt() );
+		UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
+
+		if ( result.fraction > 0 )
+		{
+			end = start;
+			start = result.endpos;
+			UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
+			if ( result.fraction < 1 )
+			{
+				// if we made it down to within StepHeight, maybe we're on a static prop
+				if ( result.endpos.z > to.z + StepHeight )
+				{
+					return false;
+				}
+			}
+		}
+	}
+
+	float deltaZ = to.z - from.z;
+	// If there's an obstacle in the way and it's traversable, or the obstacle is not higher than the destination node itself minus a small epsilon
+	// (meaning the obstacle was just the height change to get to the destination node, no extra obstacle between the two), clear obstacle height
+	// and distances
+	if ( ( obstacleHeight < MaxTraversableHeight ) || ( deltaZ > ( obstacleHeight - 2.0f ) ) )
+	{
+		obstacleHeight = 0;
+		obstacleStartDist = 0;
+		obstacleEndDist = GenerationStepSize;
+	}
+
+	step->to = to;
+	step->normal = toNormal;
+	step->isOnDisplacement = isOnDisplacement;
+	step->obstacleHeight = obstacleHeight;
+	step->obstacleStartDist = obstacleStartDist;
+	step->obstacleEndDist = obstacleEndDist;
+
+	return true;
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Search the world and build a map of possible movements.
@@ -4396,6 +4668,8 @@ bool CNavMesh::SampleStep( void )
 					// all seeds exhausted, sampling complete
 					return false;
 				}
+
+				ClassifyNewNode( m_currentNode );
 			}
 		}
 
@@ -4408,224 +4682,20 @@ bool CNavMesh::SampleStep( void )
 			{
 				// have not searched in this direction yet
 
-				// start at current node position
-				Vector pos = *m_currentNode->GetPosition();
-
-				// snap to grid
-				int cx = SnapToGrid( pos.x );
-				int cy = SnapToGrid( pos.y );
-
-				// attempt to move to adjacent node
-				switch( dir )
-				{
-					case NORTH:		cy -= GenerationStepSize; break;
-					case SOUTH:		cy += GenerationStepSize; break;
-					case EAST:		cx += GenerationStepSize; break;
-					case WEST:		cx -= GenerationStepSize; break;
-				}
-
-				pos.x = cx;
-				pos.y = cy;
-
 				m_generationDir = (NavDirType)dir;
 
 				// mark direction as visited
 				m_currentNode->MarkAsVisited( m_generationDir );
 
-				// sanity check to not generate across the world for incremental generation
-				const float incrementalRange = nav_generate_incremental_range.GetFloat();
-				if ( m_generationMode == GENERATE_INCREMENTAL && incrementalRange > 0 )
-				{
-					bool inRange = false;
-					for ( int i=0; i<m_walkableSeeds.Count(); ++i )
-					{
-						const Vector &seedPos = m_walkableSeeds[i].pos;
-						if ( (seedPos - pos).IsLengthLessThan( incrementalRange ) )
-						{
-							inRange = true;
-							break;
-						}
-					}
-
-					if ( !inRange )
-					{
-						return true;
-					}
-				}
-
-				if ( m_generationMode == GENERATE_SIMPLIFY )
-				{
-					if ( !m_simplifyGenerationExtent.Contains( pos ) )
-					{
-						return true;
-					}
-				}
-
-				// test if we can move to new position
-				trace_t result;
-				Vector from( *m_currentNode->GetPosition() );
-				CTraceFilterWalkableEntities filter( NULL, COLLISION_GROUP_NONE, WALK_THRU_EVERYTHING );
-				Vector to = vec3_origin, toNormal = vec3_origin;
-				float obstacleHeight = 0, obstacleStartDist = 0, obstacleEndDist = GenerationStepSize;
-				if ( TraceAdjacentNode( 0, from, pos, &result ) )
-				{
-					to = result.endpos;
-					toNormal = result.plane.normal;
-				}
-				else
-				{
-					// test going up ClimbUpHeight
-					bool success = false;
-					for ( float height = StepHeight; height <= ClimbUpHeight; height += 1.0f )
-					{						
-						trace_t tr;
-						Vector start( from );
-						Vector end( pos );
-						start.z += height;
-						end.z += height;
-						UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-						if ( !tr.startsolid && tr.fraction == 1.0f )
-						{
-							if ( !StayOnFloor( &tr ) )
-							{
-								break;
-							}
-
-							to = tr.endpos;
-							toNormal = tr.plane.normal;
-
-							start = end = from;
-							end.z += height;
-							UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-							if ( tr.fraction < 1.0f )
-							{
-								break;
-							}
-
-							// keep track of far up we had to go to find a path to the next node
-							obstacleHeight = height;
-							success = true;
-							break;
-						}
-						else
-						{
-							// Could not trace from node to node at this height, something is in the way.
-							// Trace in the other direction to see if we hit something
-							Vector vecToObstacleStart = tr.endpos - start;
-							Assert( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) );
-							if ( vecToObstacleStart.LengthSqr() <= Square( GenerationStepSize ) )
-							{
-								UTIL_TraceHull( end, start, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &tr );
-								if ( !tr.startsolid && tr.fraction < 1.0 )
-								{
-									// We hit something going the other direction.  There is some obstacle between the two nodes.
-									Vector vecToObstacleEnd = tr.endpos - start;
-									Assert( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize ) );
-									if ( vecToObstacleEnd.LengthSqr() <= Square( GenerationStepSize )  )
-									{
-										// Remember the distances to start and end of the obstacle (with respect to the "from" node).
-										// Keep track of the last distances to obstacle as we keep increasing the height we do a trace for.
-										// If we do eventually clear the obstacle, these values will be the start and end distance to the
-										// very tip of the obstacle.
-										obstacleStartDist = vecToObstacleStart.Length();
-										obstacleEndDist = vecToObstacleEnd.Length();
-										if ( obstacleEndDist == 0 )
-										{
-											obstacleEndDist = GenerationStepSize;
-										}
-									}								
-								}
-							}
-						}
-					}
-
-					if ( !success )
-					{
-						return true;
-					}
-				}
-
-				// Don't generate nodes if we spill off the end of the world onto skybox
-				if ( result.surface.flags & ( SURF_SKY|SURF_SKY2D ) )
-				{
-					return true;
-				}
-
-				// If we're incrementally generating, don't overlap existing nav areas.
-				Vector testPos( to );
-				bool overlapSE = IsNodeOverlapped( testPos, Vector(  1,  1, HalfHumanHeight ) );
-				bool overlapSW = IsNodeOverlapped( testPos, Vector( -1,  1, HalfHumanHeight ) );
-				bool overlapNE = IsNodeOverlapped( testPos, Vector(  1, -1, HalfHumanHeight ) );
-				bool overlapNW = IsNodeOverlapped( testPos, Vector( -1, -1, HalfHumanHeight ) );
-				if ( overlapSE && overlapSW && overlapNE && overlapNW && m_generationMode != GENERATE_SIMPLIFY )
+				NavSampleStep step;
+				if ( !ComputeSampleStep( *m_currentNode->GetPosition(), m_generationDir, &step ) )
 				{
 					return true;
 				}
 
-				int nTolerance = nav_generate_incremental_tolerance.GetInt();
-				if ( nTolerance > 0 && m_generationMode == GENERATE_INCREMENTAL )
-				{
-					bool bValid = false;
-					int zPos = to.z;
-					for ( int i=0; i<m_walkableSeeds.Count(); ++i )
-					{
-						const Vector &seedPos = m_walkableSeeds[i].pos;
-						int zMin = seedPos.z - nTolerance;
-						int zMax = seedPos.z + nTolerance;
-
-						if ( zPos >= zMin && zPos <= zMax )
-						{
-							bValid = true;
-							break;
-						}
-					}
-
-					if ( !bValid )
-						return true;
-				}
-
-
-				bool isOnDisplacement = result.IsDispSurface();
-
-				if ( nav_displacement_test.GetInt() > 0 )
-				{
-					// Test for nodes under displacement surfaces.
-					// This happens during development, and is a pain because the space underneath a displacement
-					// is not 'solid'.
-					Vector start = to + Vector( 0, 0, 0 );
-					Vector end = start + Vector( 0, 0, nav_displacement_test.GetInt() );
-					UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
-
-					if ( result.fraction > 0 )
-					{
-						end = start;
-						start = result.endpos;
-						UTIL_TraceHull( start, end, NavTraceMins, NavTraceMaxs, GetGenerationTraceMask(), &filter, &result );
-						if ( result.fraction < 1 )
-						{
-							// if we made it down to within StepHeight, maybe we're on a static prop
-							if ( result.endpos.z > to.z + StepHeight )
-							{
-								return true;
-							}
-						}
-					}
-				}
-
-				float deltaZ = to.z - m_currentNode->GetPosition()->z;
-				// If there's an obstacle in the way and it's traversable, or the obstacle is not higher than the destination node itself minus a small epsilon
-				// (meaning the obstacle was just the height change to get to the destination node, no extra obstacle between the two), clear obstacle height
-				// and distances
-				if ( ( obstacleHeight < MaxTraversableHeight ) || ( deltaZ > ( obstacleHeight - 2.0f ) ) )
-				{
-					obstacleHeight = 0;
-					obstacleStartDist = 0;
-					obstacleEndDist = GenerationStepSize;
-				}
-
 				// we can move here
 				// create a new navigation node, and update current node pointer
-				AddNode( to, toNormal, m_generationDir, m_currentNode, isOnDisplacement, obstacleHeight, obstacleStartDist, obstacleEndDist );
+				AddNode( step.to, step.normal, m_generationDir, m_currentNode, step.isOnDisplacement, step.obstacleHeight, step.obstacleStartDist, step.obstacleEndDist );
 
 				return true;
 			}
@@ -4670,7 +4740,401 @@ CNavNode *CNavMesh::GetNextWalkableSeedNode( void )
 	if ( node )
 		return NULL;
 
-	return new CNavNode( spot.pos, spot.normal, NULL, false );
+	node = new CNavNode( spot.pos, spot.normal, NULL, false );
+	ClassifyNewNode( node );
+
+	return node;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * A square of the sampling grid, sampled by one worker thread at a time.
+ * A tile owns the nodes inside it. Steps that leave the tile are handed to the tile they land in,
+ * which creates or finds the node there and samples onward from it in the next round. Tile nodes
+ * are detached until the sampling is done, so the tiles never touch the shared node list or hash.
+ */
+class CNavSampleTile
+{
+public:
+	CNavSampleTile( int x, int y, int size );
+	~CNavSampleTile();
+
+	struct Seed
+	{
+		Vector pos;
+		Vector normal;
+	};
+
+	struct Edge
+	{
+		CNavNode *from;
+		NavDirType dir;
+		NavSampleStep step;
+	};
+
+	struct Seam
+	{
+		Edge edge;
+		CNavNode *node;								// the node the edge leads to
+	};
+
+	bool HasWork( void ) const	{ return m_seeds.Count() || m_incoming.Count(); }
+	void Sample( void );							// sample from the pending seeds and incoming steps - runs on a worker thread
+	void Attach( void );							// move our nodes to the node list, and connect the steps into them
+
+	CUtlVector< Seed > m_seeds;
+	CUtlVector< Edge > m_incoming;					// steps from other tiles that land in this one
+	CUtlVector< Edge > m_outgoing;					// steps from this tile that land in another one
+
+private:
+	int GetCellIndex( const Vector &pos ) const;	// -1 if not in this tile
+	CNavNode *FindNode( const Vector &pos, int cell ) const;
+	CNavNode *CreateNode( const Vector &pos, const Vector &normal, CNavNode *parent, bool isOnDisplacement, int cell );
+	void SampleFrom( CNavNode *node );
+
+	int m_x, m_y, m_size;
+	CUtlVector< CNavNode * > m_cell;				// nodes in each grid cell, chained through m_nextAtXY
+	CUtlVector< CNavNode * > m_nodes;				// in creation order
+	CUtlVector< Seam > m_seams;
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+inline int SampleGridCoord( float x )
+{
+	return (int)floor( x / GenerationStepSize + 0.5f );
+}
+
+inline int SampleTileCoord( int gridCoord, int tileSize )
+{
+	return ( gridCoord >= 0 ) ? gridCoord / tileSize : -( ( -gridCoord - 1 ) / tileSize ) - 1;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavSampleTile::CNavSampleTile( int x, int y, int size )
+{
+	m_x = x;
+	m_y = y;
+	m_size = size;
+
+	m_cell.SetCount( size * size );
+	for( int i=0; i<m_cell.Count(); ++i )
+	{
+		m_cell[i] = NULL;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavSampleTile::~CNavSampleTile()
+{
+	// nodes that were never attached are not in the node list
+	m_nodes.PurgeAndDeleteElements();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+int CNavSampleTile::GetCellIndex( const Vector &pos ) const
+{
+	int x = SampleGridCoord( pos.x ) - m_x * m_size;
+	int y = SampleGridCoord( pos.y ) - m_y * m_size;
+
+	if ( x < 0 || x >= m_size || y < 0 || y >= m_size )
+		return -1;
+
+	return x + y * m_size;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Same as CNavNode::GetNode(), for the nodes of this tile
+ */
+CNavNode *CNavSampleTile::FindNode( const Vector &pos, int cell ) const
+{
+	const float tolerance = 0.45f * GenerationStepSize;
+
+	for( CNavNode *node = m_cell[ cell ]; node; node = node->m_nextAtXY )
+	{
+		if ( node->m_pos.x == pos.x && node->m_pos.y == pos.y && fabs( node->m_pos.z - pos.z ) < tolerance )
+			return node;
+	}
+
+	return NULL;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavNode *CNavSampleTile::CreateNode( const Vector &pos, const Vector &normal, CNavNode *parent, bool isOnDisplacement, int cell )
+{
+	CNavNode *node = CNavNode::CreateDetached( pos, normal, parent, isOnDisplacement );
+	node->m_nextAtXY = m_cell[ cell ];
+	m_cell[ cell ] = node;
+	m_nodes.AddToTail( node );
+
+	TheNavMesh->ClassifyNewNode( node );
+
+	return node;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavSampleTile::Sample( void )
+{
+	CUtlVector< CNavNode * > starts;
+
+	FOR_EACH_VEC( m_incoming, it )
+	{
+		const Edge &edge = m_incoming[ it ];
+
+		int cell = GetCellIndex( edge.step.to );
+		Assert( cell >= 0 );
+
+		CNavNode *node = FindNode( edge.step.to, cell );
+		if ( !node )
+		{
+			// the search can't pop back into the tile this came from, so start a new one here
+			node = CreateNode( edge.step.to, edge.step.normal, NULL, edge.step.isOnDisplacement, cell );
+			starts.AddToTail( node );
+		}
+
+		// the source node belongs to another tile - connect it to us when the tiles are attached
+		ConnectBackToSource( node, edge.from, edge.dir, edge.step.obstacleHeight, edge.step.obstacleStartDist, edge.step.obstacleEndDist );
+
+		Seam seam;
+		seam.edge = edge;
+		seam.node = node;
+		m_seams.AddToTail( seam );
+	}
+	m_incoming.RemoveAll();
+
+	FOR_EACH_VEC( m_seeds, it )
+	{
+		const Seed &seed = m_seeds[ it ];
+
+		int cell = GetCellIndex( seed.pos );
+		Assert( cell >= 0 );
+
+		if ( !FindNode( seed.pos, cell ) )
+		{
+			starts.AddToTail( CreateNode( seed.pos, seed.normal, NULL, false, cell ) );
+		}
+	}
+	m_seeds.RemoveAll();
+
+	FOR_EACH_VEC( starts, it )
+	{
+		SampleFrom( starts[ it ] );
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Depth-first search of the walkable space within the tile, like CNavMesh::SampleStep()
+ */
+void CNavSampleTile::SampleFrom( CNavNode *node )
+{
+	while( node )
+	{
+		int dir;
+		for( dir = NORTH; dir < NUM_DIRECTIONS; ++dir )
+		{
+			if ( !node->HasVisited( (NavDirType)dir ) )
+				break;
+		}
+
+		if ( dir == NUM_DIRECTIONS )
+		{
+			// all directions have been searched from this node - pop back to its parent and continue
+			node = node->GetParent();
+			continue;
+		}
+
+		node->MarkAsVisited( (NavDirType)dir );
+
+		Edge edge;
+		edge.from = node;
+		edge.dir = (NavDirType)dir;
+		if ( !TheNavMesh->ComputeSampleStep( *node->GetPosition(), edge.dir, &edge.step ) )
+			continue;
+
+		int cell = GetCellIndex( edge.step.to );
+		if ( cell < 0 )
+		{
+			m_outgoing.AddToTail( edge );
+			continue;
+		}
+
+		CNavNode *to = FindNode( edge.step.to, cell );
+		bool isNew = ( to == NULL );
+		if ( isNew )
+		{
+			to = CreateNode( edge.step.to, edge.step.normal, node, edge.step.isOnDisplacement, cell );
+		}
+
+		node->ConnectTo( to, edge.dir, edge.step.obstacleHeight, edge.step.obstacleStartDist, edge.step.obstacleEndDist );
+		ConnectBackToSource( to, node, edge.dir, edge.step.obstacleHeight, edge.step.obstacleStartDist, edge.step.obstacleEndDist );
+
+		if ( isNew )
+		{
+			// new node becomes current node
+			node = to;
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavSampleTile::Attach( void )
+{
+	FOR_EACH_VEC( m_nodes, it )
+	{
+		m_nodes[ it ]->Attach();
+		TheNavMesh->OnNodeAdded( m_nodes[ it ] );
+	}
+	m_nodes.RemoveAll();
+
+	FOR_EACH_VEC( m_seams, it )
+	{
+		const Edge &edge = m_seams[ it ].edge;
+		edge.from->ConnectTo( m_seams[ it ].node, edge.dir, edge.step.obstacleHeight, edge.step.obstacleStartDist, edge.step.obstacleEndDist );
+	}
+	m_seams.RemoveAll();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+static void SampleTile( CNavSampleTile *&tile )
+{
+	tile->Sample();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The tiles of the current tiled sampling, by tile coordinates
+ */
+class CNavSampleTileSet
+{
+public:
+	CNavSampleTileSet( void ) : m_tiles( DefLessFunc( unsigned int ) )
+	{
+		m_size = 1;
+	}
+
+	~CNavSampleTileSet()
+	{
+		RemoveAll();
+	}
+
+	void RemoveAll( void )
+	{
+		FOR_EACH_MAP_FAST( m_tiles, it )
+		{
+			delete m_tiles[ it ];
+		}
+		m_tiles.RemoveAll();
+	}
+
+	CNavSampleTile *GetTile( const Vector &pos )	// return the tile containing 'pos', creating it if needed
+	{
+		int x = SampleTileCoord( SampleGridCoord( pos.x ), m_size );
+		int y = SampleTileCoord( SampleGridCoord( pos.y ), m_size );
+		unsigned int key = ( ( y & 0xFFFF ) << 16 ) | ( x & 0xFFFF );
+
+		unsigned short it = m_tiles.Find( key );
+		if ( it == m_tiles.InvalidIndex() )
+		{
+			it = m_tiles.Insert( key, new CNavSampleTile( x, y, m_size ) );
+		}
+
+		return m_tiles[ it ];
+	}
+
+	CUtlMap< unsigned int, CNavSampleTile * > m_tiles;
+	int m_size;										// in generation steps
+};
+
+static CNavSampleTileSet s_sampleTiles;
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Hand the walkable seeds to the tiles they are in.
+ * Only for a full generation - tiles don't look for nodes that already exist before sampling starts.
+ */
+void CNavMesh::BeginTiledSampling( void )
+{
+	s_sampleTiles.RemoveAll();
+	s_sampleTiles.m_size = MAX( nav_generate_tile_size.GetInt(), 2 );
+
+	for( int i=m_seedIdx; i<m_walkableSeeds.Count(); ++i )
+	{
+		CNavSampleTile::Seed seed;
+		seed.pos = m_walkableSeeds[i].pos;
+		seed.normal = m_walkableSeeds[i].normal;
+
+		s_sampleTiles.GetTile( seed.pos )->m_seeds.AddToTail( seed );
+	}
+
+	m_isSamplingTiles = true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Sample every tile with pending work in parallel, then hand the steps that left each tile to the tile they landed in.
+ * Returns false once no tile has work left.
+ */
+bool CNavMesh::SampleTiledStep( void )
+{
+	CUtlVector< CNavSampleTile * > tiles;
+	FOR_EACH_MAP( s_sampleTiles.m_tiles, it )
+	{
+		if ( s_sampleTiles.m_tiles[ it ]->HasWork() )
+		{
+			tiles.AddToTail( s_sampleTiles.m_tiles[ it ] );
+		}
+	}
+
+	if ( tiles.Count() == 0 )
+		return false;
+
+	ParallelProcess( "CNavMesh::SampleTiledStep", tiles.Base(), tiles.Count(), &SampleTile );
+
+	FOR_EACH_VEC( tiles, it )
+	{
+		CUtlVector< CNavSampleTile::Edge > &outgoing = tiles[ it ]->m_outgoing;
+		FOR_EACH_VEC( outgoing, e )
+		{
+			s_sampleTiles.GetTile( outgoing[e].step.to )->m_incoming.AddToTail( outgoing[e] );
+		}
+		outgoing.RemoveAll();
+	}
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Move the tile nodes to the node list in tile order, and connect the steps across tile seams
+ */
+void CNavMesh::EndTiledSampling( void )
+{
+	FOR_EACH_MAP( s_sampleTiles.m_tiles, it )
+	{
+		s_sampleTiles.m_tiles[ it ]->Attach();
+	}
+	s_sampleTiles.RemoveAll();
+
+	// all seeds have been sampled
+	m_seedIdx = m_walkableSeeds.Count();
+	m_currentNode = NULL;
+	m_isSamplingTiles = false;
 }
 
 
@@ -0,0 +1,894 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// nav_hierarchy.cpp
+// Cluster layer over the Navigation Mesh for long-range (HPA*) pathfinding.
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "nav_mesh.h"
+#include "nav_hierarchy.h"
+#include "utlpriorityqueue.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar nav_hpa( "nav_hpa", "1", FCVAR_CHEAT, "Find long paths through the nav mesh cluster hierarchy" );
+ConVar nav_hpa_min_range( "nav_hpa_min_range", "1500", FCVAR_CHEAT, "Paths between areas closer than this are searched directly" );
+ConVar nav_hpa_cluster_size( "nav_hpa_cluster_size", "1024", FCVAR_CHEAT, "Nav mesh clusters never span more than one cell of this size. Takes effect on the next build." );
+
+#define NAV_HIERARCHY_FILE_VERSION	1
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavHierarchy &TheNavHierarchy( void )
+{
+	static CNavHierarchy hierarchy;
+	return hierarchy;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * A connection out of an area, as NavAreaBuildPath() would traverse it
+ */
+struct NavHierarchyLink
+{
+	CNavArea *area;
+	float length;
+};
+
+
+static void CollectLinks( CNavArea *area, CUtlVector< NavHierarchyLink > *links )
+{
+	links->RemoveAll();
+
+	for( int dir=0; dir<NUM_DIRECTIONS; ++dir )
+	{
+		const NavConnectVector *floorList = area->GetAdjacentAreas( (NavDirType)dir );
+		FOR_EACH_VEC( (*floorList), it )
+		{
+			const NavConnect &connect = floorList->Element( it );
+
+			NavHierarchyLink &link = links->Element( links->AddToTail() );
+			link.area = connect.area;
+			link.length = ( connect.length > 0.0f ) ? connect.length : ( connect.area->GetCenter() - area->GetCenter() ).Length();
+		}
+	}
+
+	const NavLadderConnectVector *upList = area->GetLadders( CNavLadder::LADDER_UP );
+	FOR_EACH_VEC( (*upList), it )
+	{
+		const CNavLadder *ladder = upList->Element( it ).ladder;
+
+		// NavAreaBuildPath() doesn't use the BEHIND top area either
+		CNavArea *top[3] = { ladder->m_topForwardArea, ladder->m_topLeftArea, ladder->m_topRightArea };
+		for( int t=0; t<3; ++t )
+		{
+			if ( top[t] )
+			{
+				NavHierarchyLink &link = links->Element( links->AddToTail() );
+				link.area = top[t];
+				link.length = ladder->m_length;
+			}
+		}
+	}
+
+	const NavLadderConnectVector *downList = area->GetLadders( CNavLadder::LADDER_DOWN );
+	FOR_EACH_VEC( (*downList), it )
+	{
+		const CNavLadder *ladder = downList->Element( it ).ladder;
+		if ( ladder->m_bottomArea )
+		{
+			NavHierarchyLink &link = links->Element( links->AddToTail() );
+			link.area = ladder->m_bottomArea;
+			link.length = ladder->m_length;
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavHierarchy::CNavHierarchy( void )
+{
+	m_isBuilt = false;
+	m_version = 0;
+	m_searchMarker = 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavHierarchy::Reset( void )
+{
+	if ( m_isBuilt )
+	{
+		FOR_EACH_VEC( m_clusters, c )
+		{
+			FOR_EACH_VEC( m_clusters[c].m_areas, i )
+			{
+				m_clusters[c].m_areas[i]->SetCluster( -1, -1 );
+			}
+		}
+	}
+
+	m_clusters.Purge();
+	m_nodes.Purge();
+	m_edges.Purge();
+	m_costs.Purge();
+	m_pendingLoad.Purge();
+
+	m_isBuilt = false;
+
+	// routes of the old hierarchy are stale
+	++m_version;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Partition the current mesh into clusters and compute the abstract graph
+ */
+void CNavHierarchy::Build( void )
+{
+	VPROF_BUDGET( "CNavHierarchy::Build", "NextBot" );
+
+	double startTime = Plat_FloatTime();
+
+	Reset();
+
+	if ( TheNavAreas.Count() == 0 )
+	{
+		return;
+	}
+
+	BuildClusters();
+	BuildNodes();
+
+	m_isBuilt = true;
+
+	DevMsg( "Nav hierarchy: %d areas in %d clusters, %d portals (%.2fms)\n", TheNavAreas.Count(), m_clusters.Count(), m_nodes.Count(), ( Plat_FloatTime() - startTime ) * 1000.0 );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Grow clusters by breadth-first flood from unassigned areas. A cluster only takes areas
+ * in the grid cell of its seed, so it stays compact, and only connected ones, so any
+ * two of its areas are reachable without leaving it (links permitting).
+ */
+void CNavHierarchy::BuildClusters( void )
+{
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		TheNavAreas[ it ]->SetCluster( -1, -1 );
+	}
+
+	const float cellSize = MAX( 100.0f, nav_hpa_cluster_size.GetFloat() );
+	CUtlVector< NavHierarchyLink > links;
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		CNavArea *seed = TheNavAreas[ it ];
+		if ( seed->GetCluster() >= 0 )
+		{
+			continue;
+		}
+
+		int cluster = m_clusters.AddToTail();
+		CUtlVector< CNavArea * > &areas = m_clusters[ cluster ].m_areas;
+
+		int cellX = (int)floor( seed->GetCenter().x / cellSize );
+		int cellY = (int)floor( seed->GetCenter().y / cellSize );
+
+		seed->SetCluster( cluster, areas.AddToTail( seed ) );
+
+		for( int next=0; next < areas.Count() && areas.Count() < NAV_HIERARCHY_MAX_CLUSTER_AREAS; ++next )
+		{
+			CNavArea *area = areas[ next ];
+
+			CollectLinks( area, &links );
+
+			// flood against one-way links too - membership is about proximity, not direction
+			for( int dir=0; dir<NUM_DIRECTIONS; ++dir )
+			{
+				const NavConnectVector *incoming = area->GetIncomingConnections( (NavDirType)dir );
+				FOR_EACH_VEC( (*incoming), i )
+				{
+					NavHierarchyLink &link = links[ links.AddToTail() ];
+					link.area = incoming->Element( i ).area;
+					link.length = 0.0f;
+				}
+			}
+
+			FOR_EACH_VEC( links, i )
+			{
+				CNavArea *adjArea = links[i].area;
+				if ( adjArea->GetCluster() >= 0 )
+				{
+					continue;
+				}
+
+				if ( (int)floor( adjArea->GetCenter().x / cellSize ) != cellX || (int)floor( adjArea->GetCenter().y / cellSize ) != cellY )
+				{
+					continue;
+				}
+
+				adjArea->SetCluster( cluster, areas.AddToTail( adjArea ) );
+
+				if ( areas.Count() >= NAV_HIERARCHY_MAX_CLUSTER_AREAS )
+				{
+					break;
+				}
+			}
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Both ends of every link between clusters become portal nodes. Nodes are linked to the portals
+ * of neighboring clusters by those links, and to every area of their own cluster by local cost.
+ */
+void CNavHierarchy::BuildNodes( void )
+{
+	// flat index of each area is its cluster's offset plus its index in the cluster
+	CUtlVector< int > clusterOffset;
+	clusterOffset.SetCount( m_clusters.Count() );
+
+	int areaCount = 0;
+	FOR_EACH_VEC( m_clusters, c )
+	{
+		clusterOffset[c] = areaCount;
+		areaCount += m_clusters[c].m_areas.Count();
+	}
+
+	CUtlVector< int > nodeOf;
+	nodeOf.SetCount( areaCount );
+	FOR_EACH_VEC( nodeOf, i )
+	{
+		nodeOf[i] = -1;
+	}
+
+	CUtlVector< NavHierarchyLink > links;
+
+	// find the portals
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		CNavArea *area = TheNavAreas[ it ];
+
+		CollectLinks( area, &links );
+		FOR_EACH_VEC( links, i )
+		{
+			CNavArea *adjArea = links[i].area;
+			if ( adjArea->GetCluster() != area->GetCluster() )
+			{
+				nodeOf[ clusterOffset[ area->GetCluster() ] + area->GetClusterIndex() ] = 0;
+				nodeOf[ clusterOffset[ adjArea->GetCluster() ] + adjArea->GetClusterIndex() ] = 0;
+			}
+		}
+	}
+
+	// number them in cluster order
+	FOR_EACH_VEC( m_clusters, c )
+	{
+		Cluster &cluster = m_clusters[c];
+		FOR_EACH_VEC( cluster.m_areas, i )
+		{
+			int &node = nodeOf[ clusterOffset[c] + i ];
+			if ( node >= 0 )
+			{
+				node = m_nodes.AddToTail();
+				m_nodes[ node ].m_area = cluster.m_areas[i];
+				cluster.m_portals.AddToTail( node );
+			}
+		}
+	}
+
+	// link them
+	FOR_EACH_VEC( m_nodes, n )
+	{
+		Node &node = m_nodes[n];
+		const Cluster &cluster = m_clusters[ node.m_area->GetCluster() ];
+
+		node.m_firstEdge = m_edges.Count();
+
+		CollectLinks( node.m_area, &links );
+		FOR_EACH_VEC( links, i )
+		{
+			CNavArea *adjArea = links[i].area;
+			if ( adjArea->GetCluster() != node.m_area->GetCluster() )
+			{
+				Edge &edge = m_edges[ m_edges.AddToTail() ];
+				edge.m_to = nodeOf[ clusterOffset[ adjArea->GetCluster() ] + adjArea->GetClusterIndex() ];
+				edge.m_cost = links[i].length;
+			}
+		}
+
+		node.m_edgeCount = m_edges.Count() - node.m_firstEdge;
+
+		node.m_firstCost = m_costs.Count();
+		m_costs.AddMultipleToTail( cluster.m_areas.Count() );
+		ComputeLocalCosts( node.m_area, m_costs.Base() + node.m_firstCost );
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Fill 'costs' with the shortest travel distance from 'fromArea' to each area of its cluster,
+ * without leaving the cluster. FLT_MAX if unreachable.
+ */
+void CNavHierarchy::ComputeLocalCosts( CNavArea *fromArea, float *costs ) const
+{
+	const CUtlVector< CNavArea * > &areas = m_clusters[ fromArea->GetCluster() ].m_areas;
+	const int count = areas.Count();
+
+	bool isDone[ NAV_HIERARCHY_MAX_CLUSTER_AREAS ];
+	for( int i=0; i<count; ++i )
+	{
+		costs[i] = FLT_MAX;
+		isDone[i] = false;
+	}
+
+	costs[ fromArea->GetClusterIndex() ] = 0.0f;
+
+	CUtlVector< NavHierarchyLink > links;
+
+	// clusters are small - a linear scan for the closest open area is fine
+	for( int pass=0; pass<count; ++pass )
+	{
+		int best = -1;
+		for( int i=0; i<count; ++i )
+		{
+			if ( !isDone[i] && costs[i] < FLT_MAX && ( best < 0 || costs[i] < costs[best] ) )
+			{
+				best = i;
+			}
+		}
+
+		if ( best < 0 )
+		{
+			break;
+		}
+
+		isDone[ best ] = true;
+
+		CollectLinks( areas[ best ], &links );
+		FOR_EACH_VEC( links, l )
+		{
+			CNavArea *adjArea = links[l].area;
+			if ( adjArea->GetCluster() != fromArea->GetCluster() )
+			{
+				continue;
+			}
+
+			float cost = costs[ best ] + links[l].length;
+			if ( cost < costs[ adjArea->GetClusterIndex() ] )
+			{
+				costs[ adjArea->GetClusterIndex() ] = cost;
+			}
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+bool CNavHierarchy::ShouldUse( CNavArea *startArea, CNavArea *goalArea ) const
+{
+	if ( !nav_hpa.GetBool() || !m_isBuilt || !startArea || !goalArea )
+	{
+		return false;
+	}
+
+	if ( startArea->GetCluster() < 0 || goalArea->GetCluster() < 0 || startArea->GetCluster() == goalArea->GetCluster() )
+	{
+		return false;
+	}
+
+	return ( startArea->GetCenter() - goalArea->GetCenter() ).IsLengthGreaterThan( nav_hpa_min_range.GetFloat() );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+bool CNavHierarchy::FindRoute( CNavArea *startArea, CNavArea *goalArea, NavHierarchyRoute *route )
+{
+	if ( route->m_version == m_version && route->m_goalArea == goalArea )
+	{
+		// still heading for the same goal - continue from the last portal in our cluster
+		for( int i=route->m_portals.Count()-1; i >= 0; --i )
+		{
+			if ( route->m_portals[i]->GetCluster() == startArea->GetCluster() )
+			{
+				route->m_portals.RemoveMultipleFromHead( i );
+				return true;
+			}
+		}
+	}
+
+	route->Invalidate();
+
+	AUTO_LOCK( m_searchMutex );
+
+	if ( !SearchPortals( startArea, goalArea, route ) )
+	{
+		return false;
+	}
+
+	route->m_goalArea = goalArea;
+	route->m_version = m_version;
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+struct NavHierarchyOpenNode
+{
+	float totalCost;
+	float costSoFar;
+	int node;
+
+	static bool IsLowerPriority( const NavHierarchyOpenNode &a, const NavHierarchyOpenNode &b )
+	{
+		return a.totalCost > b.totalCost;
+	}
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * A* over portal nodes. The start area enters the graph through the portals of its cluster it can reach,
+ * the goal area is a virtual node reached from the portals of its cluster.
+ */
+bool CNavHierarchy::SearchPortals( CNavArea *startArea, CNavArea *goalArea, NavHierarchyRoute *route )
+{
+	VPROF_BUDGET( "CNavHierarchy::SearchPortals", "NextBotSpiky" );
+
+	const int goalNode = m_nodes.Count();
+	const Vector &goalPos = goalArea->GetCenter();
+
+	if ( m_nodeCost.Count() != goalNode + 1 )
+	{
+		m_nodeCost.SetCount( goalNode + 1 );
+		m_nodeParent.SetCount( goalNode + 1 );
+		m_nodeMarker.SetCount( goalNode + 1 );
+		m_nodeMarker.FillWithValue( 0 );
+		m_searchMarker = 0;
+	}
+
+	if ( ++m_searchMarker == 0 )
+	{
+		m_nodeMarker.FillWithValue( 0 );
+		m_searchMarker = 1;
+	}
+
+	CUtlPriorityQueue< NavHierarchyOpenNode > openList( 0, 64, NavHierarchyOpenNode::IsLowerPriority );
+
+	// enter the graph from the start area
+	const Cluster &startCluster = m_clusters[ startArea->GetCluster() ];
+	m_startCosts.SetCount( startCluster.m_areas.Count() );
+	ComputeLocalCosts( startArea, m_startCosts.Base() );
+
+	FOR_EACH_VEC( startCluster.m_portals, i )
+	{
+		int node = startCluster.m_portals[i];
+		float cost = m_startCosts[ m_nodes[ node ].m_area->GetClusterIndex() ];
+		if ( cost < FLT_MAX )
+		{
+			m_nodeMarker[ node ] = m_searchMarker;
+			m_nodeCost[ node ] = cost;
+			m_nodeParent[ node ] = -1;
+
+			NavHierarchyOpenNode open = { cost + ( m_nodes[ node ].m_area->GetCenter() - goalPos ).Length(), cost, node };
+			openList.Insert( open );
+		}
+	}
+
+	while( openList.Count() )
+	{
+		NavHierarchyOpenNode open = openList.ElementAtHead();
+		openList.RemoveAtHead();
+
+		if ( open.node == goalNode )
+		{
+			// walk back to the start
+			for( int node = m_nodeParent[ goalNode ]; node >= 0; node = m_nodeParent[ node ] )
+			{
+				route->m_portals.AddToHead( m_nodes[ node ].m_area );
+			}
+
+			return true;
+		}
+
+		if ( open.costSoFar > m_nodeCost[ open.node ] )
+		{
+			// stale entry - the node was reached more cheaply since
+			continue;
+		}
+
+		float costSoFar = open.costSoFar;
+		const Node &node = m_nodes[ open.node ];
+
+		// gather successors: the goal, the other portals of our cluster, and linked portals of other clusters
+		const Cluster &cluster = m_clusters[ node.m_area->GetCluster() ];
+
+		int successorCount = cluster.m_portals.Count() + node.m_edgeCount + 1;
+		for( int s=0; s<successorCount; ++s )
+		{
+			int to;
+			float stepCost;
+
+			if ( s < cluster.m_portals.Count() )
+			{
+				to = cluster.m_portals[s];
+				if ( to == open.node )
+				{
+					continue;
+				}
+				stepCost = GetPortalCost( open.node, m_nodes[ to ].m_area );
+			}
+			else if ( s < cluster.m_portals.Count() + node.m_edgeCount )
+			{
+				const Edge &edge = m_edges[ node.m_firstEdge + s - cluster.m_portals.Count() ];
+				to = edge.m_to;
+				stepCost = edge.m_cost;
+			}
+			else
+			{
+				if ( node.m_area->GetCluster() != goalArea->GetCluster() )
+				{
+					continue;
+				}
+				to = goalNode;
+				stepCost = GetPortalCost( open.node, goalArea );
+			}
+
+			if ( stepCost >= FLT_MAX )
+			{
+				continue;
+			}
+
+			float cost = costSoFar + stepCost;
+			if ( m_nodeMarker[ to ] == m_searchMarker && m_nodeCost[ to ] <= cost )
+			{
+				continue;
+			}
+
+			m_nodeMarker[ to ] = m_searchMarker;
+			m_nodeCost[ to ] = cost;
+			m_nodeParent[ to ] = open.node;
+
+			float estimate = ( to == goalNode ) ? 0.0f : ( m_nodes[ to ].m_area->GetCenter() - goalPos ).Length();
+			NavHierarchyOpenNode next = { cost + estimate, cost, to };
+			openList.Insert( next );
+		}
+	}
+
+	return false;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavHierarchyRefinement::Begin( CNavArea *startArea )
+{
+	m_areas.RemoveAll();
+	m_how.RemoveAll();
+
+	m_areas.AddToTail( startArea );
+	m_how.AddToTail( NUM_TRAVERSE_TYPES );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavHierarchyRefinement::AppendStep( const CNavSearchContext &context, CNavArea *fromArea, CNavArea *toArea )
+{
+	int first = m_areas.Count();
+
+	for( CNavArea *area = toArea; area && area != fromArea; area = context.GetParent( area ) )
+	{
+		m_areas.InsertBefore( first, area );
+		m_how.InsertBefore( first, context.GetParentHow( area ) );
+	}
+
+	// cut out any loop where steps double back over each other
+	for( int i=first; i<m_areas.Count(); ++i )
+	{
+		int prior = m_areas.Find( m_areas[i] );
+		if ( prior < i )
+		{
+			m_areas.RemoveMultiple( prior + 1, i - prior );
+			m_how.RemoveMultiple( prior + 1, i - prior );
+			i = prior;
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavHierarchyRefinement::End( CNavSearchContext &context )
+{
+	context.SetParent( m_areas[0], NULL );
+
+	for( int i=1; i<m_areas.Count(); ++i )
+	{
+		context.SetParent( m_areas[i], m_areas[ i-1 ], m_how[i] );
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Store the hierarchy, by area ID. Size-prefixed so loaders can hold it until areas are bound.
+ */
+void CNavHierarchy::Save( CUtlBuffer &fileBuffer ) const
+{
+	CUtlBuffer data;
+
+	data.PutInt( NAV_HIERARCHY_FILE_VERSION );
+
+	data.PutInt( m_isBuilt ? m_clusters.Count() : 0 );
+	if ( m_isBuilt )
+	{
+		FOR_EACH_VEC( m_clusters, c )
+		{
+			const Cluster &cluster = m_clusters[c];
+
+			data.PutInt( cluster.m_areas.Count() );
+			FOR_EACH_VEC( cluster.m_areas, i )
+			{
+				data.PutUnsignedInt( cluster.m_areas[i]->GetID() );
+			}
+		}
+
+		data.PutInt( m_nodes.Count() );
+		FOR_EACH_VEC( m_nodes, n )
+		{
+			data.PutUnsignedInt( m_nodes[n].m_area->GetID() );
+			data.PutInt( m_nodes[n].m_firstEdge );
+			data.PutInt( m_nodes[n].m_edgeCount );
+			data.PutInt( m_nodes[n].m_firstCost );
+		}
+
+		data.PutInt( m_edges.Count() );
+		FOR_EACH_VEC( m_edges, e )
+		{
+			data.PutInt( m_edges[e].m_to );
+			data.PutFloat( m_edges[e].m_cost );
+		}
+
+		data.PutInt( m_costs.Count() );
+		FOR_EACH_VEC( m_costs, i )
+		{
+			data.PutFloat( m_costs[i] );
+		}
+	}
+
+	fileBuffer.PutInt( data.TellPut() );
+	fileBuffer.Put( data.Base(), data.TellPut() );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavHierarchy::Load( CUtlBuffer &fileBuffer )
+{
+	Reset();
+
+	int size = fileBuffer.GetInt();
+	if ( !fileBuffer.IsValid() || size <= 0 || size > fileBuffer.GetBytesRemaining() )
+	{
+		return;
+	}
+
+	m_pendingLoad.Put( fileBuffer.PeekGet(), size );
+	fileBuffer.SeekGet( CUtlBuffer::SEEK_CURRENT, size );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return true if 'count' items of 'itemSize' bytes can still be read from 'data'
+ */
+static bool IsValidLoadCount( const CUtlBuffer &data, int count, int itemSize )
+{
+	return data.IsValid() && count >= 0 && count <= data.GetBytesRemaining() / itemSize;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Bind the data read by Load() to the mesh. If there is none, or it doesn't match
+ * the mesh, build the hierarchy from scratch.
+ * The data comes from a file which may be stale or damaged, so every count and index
+ * is checked before searches trust it.
+ */
+void CNavHierarchy::OnMeshLoaded( void )
+{
+	bool isValid = false;
+
+	if ( m_pendingLoad.TellPut() > 0 && m_pendingLoad.GetInt() == NAV_HIERARCHY_FILE_VERSION )
+	{
+		CUtlBuffer &data = m_pendingLoad;
+		isValid = true;
+
+		// areas listed twice by the file would be left with the wrong cluster
+		FOR_EACH_VEC( TheNavAreas, it )
+		{
+			TheNavAreas[ it ]->SetCluster( -1, -1 );
+		}
+
+		int clusterCount = data.GetInt();
+		int areaCount = 0;
+
+		if ( !IsValidLoadCount( data, clusterCount, sizeof( int ) ) )
+		{
+			clusterCount = 0;
+			isValid = false;
+		}
+
+		m_clusters.SetCount( clusterCount );
+		for( int c=0; c<clusterCount && isValid; ++c )
+		{
+			Cluster &cluster = m_clusters[c];
+
+			int count = data.GetInt();
+			if ( count <= 0 || count > NAV_HIERARCHY_MAX_CLUSTER_AREAS )
+			{
+				isValid = false;
+				break;
+			}
+
+			for( int i=0; i<count; ++i )
+			{
+				CNavArea *area = TheNavMesh->GetNavAreaByID( data.GetUnsignedInt() );
+				if ( !area || area->GetCluster() >= 0 )
+				{
+					isValid = false;
+					break;
+				}
+
+				area->SetCluster( c, cluster.m_areas.AddToTail( area ) );
+				++areaCount;
+			}
+		}
+
+		if ( isValid && areaCount == TheNavAreas.Count() )
+		{
+			int nodeCount = data.GetInt();
+			if ( !IsValidLoadCount( data, nodeCount, 4 * sizeof( int ) ) )
+			{
+				nodeCount = 0;
+				isValid = false;
+			}
+
+			m_nodes.SetCount( nodeCount );
+			FOR_EACH_VEC( m_nodes, n )
+			{
+				Node &node = m_nodes[n];
+				node.m_area = TheNavMesh->GetNavAreaByID( data.GetUnsignedInt() );
+				node.m_firstEdge = data.GetInt();
+				node.m_edgeCount = data.GetInt();
+				node.m_firstCost = data.GetInt();
+
+				if ( !node.m_area || node.m_area->GetCluster() < 0 )
+				{
+					isValid = false;
+					break;
+				}
+
+				m_clusters[ node.m_area->GetCluster() ].m_portals.AddToTail( n );
+			}
+
+			int edgeCount = isValid ? data.GetInt() : 0;
+			if ( !IsValidLoadCount( data, edgeCount, sizeof( int ) + sizeof( float ) ) )
+			{
+				edgeCount = 0;
+				isValid = false;
+			}
+
+			m_edges.SetCount( edgeCount );
+			FOR_EACH_VEC( m_edges, e )
+			{
+				m_edges[e].m_to = data.GetInt();
+				m_edges[e].m_cost = data.GetFloat();
+
+				if ( m_edges[e].m_to < 0 || m_edges[e].m_to >= m_nodes.Count() )
+				{
+					isValid = false;
+					break;
+				}
+			}
+
+			int costCount = isValid ? data.GetInt() : 0;
+			if ( !IsValidLoadCount( data, costCount, sizeof( float ) ) )
+			{
+				costCount = 0;
+				isValid = false;
+			}
+
+			m_costs.SetCount( costCount );
+			FOR_EACH_VEC( m_costs, i )
+			{
+				m_costs[i] = data.GetFloat();
+			}
+
+			// each node's edges and costs must lie within what we read
+			FOR_EACH_VEC( m_nodes, n )
+			{
+				if ( !isValid )
+				{
+					break;
+				}
+
+				const Node &node = m_nodes[n];
+				int clusterAreaCount = m_clusters[ node.m_area->GetCluster() ].m_areas.Count();
+
+				if ( node.m_firstEdge < 0 || node.m_edgeCount < 0 || node.m_edgeCount > m_edges.Count() - node.m_firstEdge ||
+					 node.m_firstCost < 0 || node.m_firstCost > m_costs.Count() - clusterAreaCount )
+				{
+					isValid = false;
+				}
+			}
+
+			isValid = isValid && data.IsValid();
+		}
+		else
+		{
+			isValid = false;
+		}
+	}
+
+	if ( isValid )
+	{
+		m_pendingLoad.Purge();
+		m_isBuilt = true;
+		++m_version;
+	}
+	else
+	{
+		Build();
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavHierarchy::PrintStats( void ) const
+{
+	if ( !m_isBuilt )
+	{
+		Msg( "Nav hierarchy not built\n" );
+		return;
+	}
+
+	int maxAreas = 0;
+	int maxPortals = 0;
+	FOR_EACH_VEC( m_clusters, c )
+	{
+		maxAreas = MAX( maxAreas, m_clusters[c].m_areas.Count() );
+		maxPortals = MAX( maxPortals, m_clusters[c].m_portals.Count() );
+	}
+
+	Msg( "Nav hierarchy: %d areas in %d clusters (max %d areas), %d portals (max %d per cluster), %d links, %d KB of portal costs\n",
+		 TheNavAreas.Count(), m_clusters.Count(), maxAreas, m_nodes.Count(), maxPortals, m_edges.Count(), ( m_costs.Count() * (int)sizeof( float ) ) / 1024 );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CON_COMMAND_F( nav_hpa_build, "Rebuild the nav mesh cluster hierarchy", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	TheNavHierarchy().Build();
+	TheNavHierarchy().PrintStats();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CON_COMMAND_F( nav_hpa_stats, "Show the size of the nav mesh cluster hierarchy", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	TheNavHierarchy().PrintStats();
+}
@@ -0,0 +1,240 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// nav_hierarchy.h
+// Cluster layer over the Navigation Mesh for long-range (HPA*) pathfinding.
+//
+// Areas are grouped into small connected clusters. Areas with a connection
+// into another cluster are the "portals" of the abstract graph, and the cost
+// from each portal to every area of its own cluster is precomputed. A long
+// path is first found over portals, then refined by local A* searches that
+// never leave the two clusters of each step.
+//
+//=============================================================================//
+
+#ifndef _NAV_HIERARCHY_H_
+#define _NAV_HIERARCHY_H_
+
+#include "nav_pathfind.h"
+#include "utlbuffer.h"
+
+#define NAV_HIERARCHY_MAX_CLUSTER_AREAS		128		// clusters stop growing at this many areas
+
+extern ConVar nav_hpa;
+extern ConVar nav_hpa_min_range;
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The portals an abstract path crosses, kept by the path owner so that
+ * repaths toward the same goal can skip the abstract search.
+ */
+class NavHierarchyRoute
+{
+public:
+	NavHierarchyRoute( void )	{ Invalidate(); }
+
+	void Invalidate( void )
+	{
+		m_portals.RemoveAll();
+		m_goalArea = NULL;
+		m_version = -1;
+	}
+
+	CUtlVector< CNavArea * > m_portals;		// in travel order
+	CNavArea *m_goalArea;
+	int m_version;							// CNavHierarchy version the portals belong to
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+class CNavHierarchy
+{
+public:
+	CNavHierarchy( void );
+
+	void Reset( void );									// forget all clusters
+	void Build( void );									// partition the current mesh into clusters
+	bool IsBuilt( void ) const		{ return m_isBuilt; }
+	int GetVersion( void ) const	{ return m_version; }
+
+	void Save( CUtlBuffer &fileBuffer ) const;
+	void Load( CUtlBuffer &fileBuffer );				// areas are not bound yet - data is resolved in OnMeshLoaded()
+	void OnMeshLoaded( void );							// bind loaded data to areas, or build if there is none
+
+	/**
+	 * Return true if a path between these areas should go through the hierarchy
+	 */
+	bool ShouldUse( CNavArea *startArea, CNavArea *goalArea ) const;
+
+	/**
+	 * Find the portals of an abstract path from 'startArea' to 'goalArea', reusing the ones already
+	 * in 'route' if it still leads to the same goal through our cluster. Returns false if there is no abstract path.
+	 * Safe to call from several threads at once.
+	 */
+	bool FindRoute( CNavArea *startArea, CNavArea *goalArea, NavHierarchyRoute *route );
+
+	void PrintStats( void ) const;
+
+private:
+	struct Cluster
+	{
+		CUtlVector< CNavArea * > m_areas;
+		CUtlVector< int > m_portals;					// node indices
+	};
+
+	struct Node
+	{
+		CNavArea *m_area;
+		int m_firstEdge, m_edgeCount;					// inter-cluster edges
+		int m_firstCost;								// cost to each area of our cluster, in cluster order
+	};
+
+	struct Edge
+	{
+		int m_to;
+		float m_cost;
+	};
+
+	void BuildClusters( void );
+	void BuildNodes( void );
+	void ComputeLocalCosts( CNavArea *fromArea, float *costs ) const;	// Dijkstra within the area's cluster
+
+	bool SearchPortals( CNavArea *startArea, CNavArea *goalArea, NavHierarchyRoute *route );
+
+	float GetPortalCost( int node, CNavArea *area ) const	{ return m_costs[ m_nodes[ node ].m_firstCost + area->GetClusterIndex() ]; }
+
+	CUtlVector< Cluster > m_clusters;
+	CUtlVector< Node > m_nodes;
+	CUtlVector< Edge > m_edges;
+	CUtlVector< float > m_costs;
+
+	bool m_isBuilt;
+	int m_version;
+
+	// data read before areas were bound
+	CUtlBuffer m_pendingLoad;
+
+	// search scratch, shared by all threads
+	CThreadFastMutex m_searchMutex;
+	CUtlVector< float > m_nodeCost;
+	CUtlVector< int > m_nodeParent;
+	CUtlVector< unsigned int > m_nodeMarker;
+	unsigned int m_searchMarker;
+	CUtlVector< float > m_startCosts;
+};
+
+// singleton accessor
+extern CNavHierarchy &TheNavHierarchy( void );
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Stitches the refined steps of a hierarchical path into one parent chain.
+ * Each local search clears its context, so the steps are collected here and
+ * written back as parents once the last step is done.
+ */
+class CNavHierarchyRefinement
+{
+public:
+	void Begin( CNavArea *startArea );
+	void AppendStep( const CNavSearchContext &context, CNavArea *fromArea, CNavArea *toArea );	// append the parent chain the last search left from 'toArea' back to 'fromArea'
+	void End( CNavSearchContext &context );														// set parents along the stitched path
+
+private:
+	CUtlVector< CNavArea * > m_areas;
+	CUtlVector< NavTraverseType > m_how;
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Cost functor adapter that keeps a search inside the two given clusters
+ */
+template< typename CostFunctor >
+class NavClusterCostFilter
+{
+public:
+	NavClusterCostFilter( CostFunctor &costFunc, int clusterA, int clusterB ) : m_costFunc( costFunc ), m_clusterA( clusterA ), m_clusterB( clusterB ) { }
+
+	float operator() ( CNavArea *area, CNavArea *fromArea, const CNavLadder *ladder, const CFuncElevator *elevator, float length )
+	{
+		if ( fromArea && area->GetCluster() != m_clusterA && area->GetCluster() != m_clusterB )
+		{
+			return -1.0f;
+		}
+
+		return m_costFunc( area, fromArea, ladder, elevator, length );
+	}
+
+private:
+	CostFunctor &m_costFunc;
+	int m_clusterA, m_clusterB;
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Same contract as NavAreaBuildPath() with a search context. Long paths between known areas
+ * first find the cluster portals to cross, then search only locally between consecutive portals
+ * with the caller's cost. Falls back to a plain NavAreaBuildPath() whenever the hierarchy
+ * does not apply or a local step fails. 'route' may be NULL.
+ */
+template< typename CostFunctor >
+bool NavAreaBuildHierarchicalPath( CNavSearchContext &context, CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos, CostFunctor &costFunc, CNavArea **closestArea = NULL, float maxPathLength = 0.0f, int teamID = TEAM_ANY, NavHierarchyRoute *route = NULL )
+{
+	CNavHierarchy &hierarchy = TheNavHierarchy();
+
+	if ( maxPathLength > 0.0f || !hierarchy.ShouldUse( startArea, goalArea ) || goalArea->IsBlocked( teamID ) )
+	{
+		return NavAreaBuildPath( context, startArea, goalArea, goalPos, costFunc, closestArea, maxPathLength, teamID );
+	}
+
+	VPROF_BUDGET( "NavAreaBuildHierarchicalPath", "NextBotSpiky" );
+
+	NavHierarchyRoute localRoute;
+	if ( !route )
+	{
+		route = &localRoute;
+	}
+
+	if ( !hierarchy.FindRoute( startArea, goalArea, route ) )
+	{
+		return NavAreaBuildPath( context, startArea, goalArea, goalPos, costFunc, closestArea, maxPathLength, teamID );
+	}
+
+	CNavHierarchyRefinement refinement;
+	refinement.Begin( startArea );
+
+	CNavArea *from = startArea;
+	for( int i=0; i<=route->m_portals.Count(); ++i )
+	{
+		CNavArea *to = ( i < route->m_portals.Count() ) ? route->m_portals[i] : goalArea;
+		if ( to == from )
+		{
+			continue;
+		}
+
+		NavClusterCostFilter< CostFunctor > stepCost( costFunc, from->GetCluster(), to->GetCluster() );
+		if ( !NavAreaBuildPath( context, from, to, NULL, stepCost, NULL, 0.0f, teamID ) )
+		{
+			// the portals no longer connect for us - blocked areas, or a cost the abstract graph doesn't know
+			route->Invalidate();
+			return NavAreaBuildPath( context, startArea, goalArea, goalPos, costFunc, closestArea, maxPathLength, teamID );
+		}
+
+		refinement.AppendStep( context, from, to );
+		from = to;
+	}
+
+	refinement.End( context );
+
+	if ( closestArea )
+	{
+		*closestArea = goalArea;
+	}
+
+	return true;
+}
+
+
+#endif // _NAV_HIERARCHY_H_
@@ -21,6 +21,8 @@
 #endif
 #include "functorutils.h"
 #include "nav_pathfind.h"
+#include "nav_hierarchy.h"
+#include "nav_visibility.h"
 
 #ifdef TF_DLL
 #include "tf/nav_mesh/tf_nav_area.h"
@@ -28,6 +30,7 @@
 
 #ifdef NEXT_BOT
 #include "NextBot/NavMeshEntities/func_nav_prerequisite.h"
+#include "NextBot/Path/NextBotPathCache.h"
 #endif
 // Defines the ToHScript and ToNavArea stuff.
 #include "NextBot/NextBotLocomotionInterface.h"
@@ -107,6 +110,7 @@ void CNavMesh::Reset( void )
 
 	m_generationMode = GENERATE_NONE;
 	m_currentNode = NULL;
+	m_isSamplingTiles = false;
 	ClearWalkableSeeds();
 
 	m_isAnalyzed = false;
@@ -162,6 +166,15 @@ CNavArea *CNavMesh::GetMarkedArea( void ) const
  */
 void CNavMesh::DestroyNavigationMesh( bool incremental )
 {
+	// clusters and visibility shapes refer to the areas we're about to destroy or regenerate
+	TheNavHierarchy().Reset();
+	TheNavVisibilityBuilder().Reset();
+
+#ifdef NEXT_BOT
+	// as do cached paths
+	TheNextBotPathCache().Invalidate();
+#endif
+
 	m_blockedAreas.RemoveAll();
 	m_avoidanceObstacleAreas.RemoveAll();
 	m_transientAreas.RemoveAll();
@@ -1604,6 +1617,28 @@ void CommandNavDeleteMarked( void )
 static ConCommand nav_delete_marked( "nav_delete_marked", CommandNavDeleteMarked, "Deletes the currently marked Area (if any).", FCVAR_GAMEDLL | FCVAR_CHEAT );
 
 
+//--------------------------------------------------------------------------------------------------------------
+void CommandNavUpdateVisibility( void )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	TheNavMesh->CommandNavUpdateVisibility();
+}
+static ConCommand nav_update_visibility( "nav_update_visibility", CommandNavUpdateVisibility, "Recomputes visibility only for areas added or reshaped since visibility was last computed.", FCVAR_GAMEDLL | FCVAR_CHEAT );
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CommandNavBenchmarkSampling( const CCommand &args )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	TheNavMesh->CommandNavBenchmarkSampling( args );
+}
+static ConCommand nav_benchmark_sampling( "nav_benchmark_sampling", CommandNavBenchmarkSampling, "Samples the walkable space of the map serially and in parallel tiles, and reports the nodes sampled per second. Use 'serial' or 'tiled' to only run one.", FCVAR_GAMEDLL | FCVAR_CHEAT );
+
+
 //--------------------------------------------------------------------------------------------------------------
 CON_COMMAND_F( nav_flood_select, "Selects the current Area and all Areas connected to it, recursively. To clear a selection, use this command again.", FCVAR_GAMEDLL | FCVAR_CHEAT )
 {
@@ -3431,25 +3466,10 @@ void CNavMesh::UpdateAvoidanceObstacleAreas( void )
 
 
 
-extern CUtlHash< NavVisPair_t, CVisPairHashFuncs, CVisPairHashFuncs > *g_pNavVisPairHash;
-
 //--------------------------------------------------------------------------------------------------------
 void CNavMesh::BeginVisibilityComputations( void )
 {
-	if ( !g_pNavVisPairHash )
-	{
-		g_pNavVisPairHash = new CUtlHash< NavVisPair_t, CVisPairHashFuncs, CVisPairHashFuncs >( 16*1024 );
-	}
-	else
-	{
-		g_pNavVisPairHash->RemoveAll();
-	}
-
-	FOR_EACH_VEC( TheNavAreas, it )
-	{
-		CNavArea *area = TheNavAreas[ it ];
-		area->ResetPotentiallyVisibleAreas();
-	}
+	TheNavVisibilityBuilder().BeginFull();
 }
 
 
@@ -3459,7 +3479,7 @@ void CNavMesh::BeginVisibilityComputations( void )
  */
 void CNavMesh::EndVisibilityComputations( void )
 {
-	g_pNavVisPairHash->RemoveAll();
+	TheNavVisibilityBuilder().End();
 
 	int avgVisLength = 0;
 	int maxVisLength = 0;
@@ -3544,3 +3564,119 @@ void CNavMesh::EndVisibilityComputations( void )
 
 	Msg( "NavMesh Visibility List Lengths:  min = %d, avg = %d, max = %d\n", minVisLength, avgVisLength, maxVisLength );
 }
+
+
+//--------------------------------------------------------------------------------------------------------
+/**
+ * Recompute visibility only between areas added or reshaped since it was last computed and the rest of the mesh
+ */
+void CNavMesh::CommandNavUpdateVisibility( void )
+{
+	if ( IsGenerating() )
+	{
+		Msg( "Cannot update visibility while the mesh is being generated.\n" );
+		return;
+	}
+
+	CNavVisibilityBuilder &builder = TheNavVisibilityBuilder();
+	if ( !builder.BeginIncremental() )
+	{
+		Msg( "Nav mesh visibility is up to date.\n" );
+		return;
+	}
+
+	int count = builder.GetSourceCount();
+	Msg( "Computing visibility of %d areas...\n", count );
+
+	double startTime = Plat_FloatTime();
+
+	while( builder.ComputeBatch() )
+	{
+	}
+
+	EndVisibilityComputations();
+
+	Msg( "Computing visibility of %d areas...DONE (%.2f seconds)\n", count, Plat_FloatTime() - startTime );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Sample walkable space from the walkable seeds serially, with tiles, or both, and report the nodes sampled per second.
+ * Nothing is generated from the samples, and the current mesh is left as it is.
+ */
+void CNavMesh::CommandNavBenchmarkSampling( const CCommand &args )
+{
+	if ( IsGenerating() )
+	{
+		Msg( "Cannot benchmark sampling while the mesh is being generated.\n" );
+		return;
+	}
+
+	bool runSerial = true;
+	bool runTiled = true;
+	if ( args.ArgC() > 1 )
+	{
+		runSerial = FStrEq( args[1], "serial" );
+		runTiled = FStrEq( args[1], "tiled" );
+		if ( !runSerial && !runTiled )
+		{
+			Msg( "Usage: nav_benchmark_sampling [serial|tiled]\n" );
+			return;
+		}
+	}
+
+	CUtlVector< WalkableSeedSpot > savedSeeds;
+	savedSeeds.CopyArray( m_walkableSeeds.Base(), m_walkableSeeds.Count() );
+	int savedSeedIdx = m_seedIdx;
+
+	if ( m_walkableSeeds.Count() == 0 )
+	{
+		AddWalkableSeeds();
+		if ( m_walkableSeeds.Count() == 0 )
+		{
+			Msg( "No valid walkable seed positions.  Cannot benchmark sampling.\n" );
+			return;
+		}
+	}
+
+	for( int tiled=0; tiled<2; ++tiled )
+	{
+		if ( tiled ? !runTiled : !runSerial )
+			continue;
+
+		CNavNode::CleanupGeneration();
+		m_generationMode = GENERATE_SAMPLE_BENCHMARK;
+		m_seedIdx = 0;
+		m_currentNode = NULL;
+
+		double startTime = Plat_FloatTime();
+
+		if ( tiled )
+		{
+			BeginTiledSampling();
+			while( SampleTiledStep() )
+			{
+			}
+			EndTiledSampling();
+		}
+
+		// the ends of ladders are searched one step at a time either way, as in a full generation
+		while( SampleStep() )
+		{
+		}
+
+		double elapsed = Plat_FloatTime() - startTime;
+		unsigned int count = CNavNode::GetListLength();
+
+		Msg( "%s sampling: %d nodes in %.2f seconds (%.0f nodes/sec)\n", tiled ? "Tiled" : "Serial", count, elapsed, ( elapsed > 0.0 ) ? count / elapsed : 0.0 );
+	}
+
+	CNavNode::CleanupGeneration();
+	m_generationMode = GENERATE_NONE;
+	m_currentNode = NULL;
+
+	m_walkableSeeds.RemoveAll();
+	m_walkableSeeds.AddVectorToTail( savedSeeds );
+	m_seedIdx = savedSeedIdx;
+}
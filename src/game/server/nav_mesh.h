@@ -169,49 +169,6 @@ enum GetNavAreaFlags_t
 };
 
 
-//--------------------------------------------------------------------------------------------------------
-// for nav mesh visibilty computation
-struct NavVisPair_t
-{
-	void SetPair( CNavArea *pArea1, CNavArea *pArea2 )
-	{
-		int iArea1 = (int)( pArea1 > pArea2 );
-		int iArea2 = ( iArea1 + 1 ) % 2;
-		pAreas[iArea1] = pArea1;
-		pAreas[iArea2] = pArea2;
-	}
-
-	CNavArea *pAreas[2];
-};
-
-
-// for nav mesh visibilty computation
-class CVisPairHashFuncs
-{
-public:
-	CVisPairHashFuncs( int ) {}
-
-	bool operator()( const NavVisPair_t &lhs, const NavVisPair_t &rhs ) const
-	{
-		return ( lhs.pAreas[0] == rhs.pAreas[0] && lhs.pAreas[1] == rhs.pAreas[1] );
-	}
-
-	unsigned int operator()( const NavVisPair_t &item ) const
-	{
-		COMPILE_TIME_ASSERT( sizeof(CNavArea *) == sizeof( intp ) );
-		intp key[2] = { (intp) ( (intp)item.pAreas[0] + item.pAreas[1]->GetID() ), (intp)( (intp)item.pAreas[1] + item.pAreas[0]->GetID() ) };
-		if ( sizeof( key ) >= 16 )
-		{
-			return Hash16( key );
-		}
-		else
-		{
-			return Hash8( key );
-		}
-	}
-};
-
-
 //--------------------------------------------------------------------------------------------------------------
 //
 // The 'place directory' is used to save and load places from
@@ -256,6 +213,20 @@ private:
 extern PlaceDirectory placeDirectory;
 
 
+//--------------------------------------------------------------------------------------------------------
+/**
+ * The result of one sampling step from a node to the adjacent grid position
+ */
+struct NavSampleStep
+{
+	Vector to;													// ground position of the new node
+	Vector normal;
+	bool isOnDisplacement;
+	float obstacleHeight;										// obstacle that must be climbed to get there, see CNavNode::ConnectTo()
+	float obstacleStartDist;
+	float obstacleEndDist;
+};
+
 
 //--------------------------------------------------------------------------------------------------------
 /**
@@ -299,6 +270,7 @@ public:
 	virtual void LoadCustomData( CUtlBuffer &fileBuffer, unsigned int subVersion ) { }			// load custom mesh data for derived classes
 	virtual void SaveCustomDataPreArea( CUtlBuffer &fileBuffer ) const { }						// store custom mesh data for derived classes that needs to be loaded before areas are read in
 	virtual void LoadCustomDataPreArea( CUtlBuffer &fileBuffer, unsigned int subVersion ) { }	// load custom mesh data for derived classes that needs to be loaded before areas are read in
+	virtual bool IsCompactFileSupported( void ) const { return GetSubVersionNumber() == 0; }	// (EXTEND) true if this mesh and its areas keep all of their data in the compact file - derived formats must opt in once their areas implement SaveCompactData()
 
 	// events
 	virtual void OnServerActivate( void );								// (EXTEND) invoked when server loads a new map
@@ -377,6 +349,8 @@ public:
 	// Edit callbacks from ConCommands
 	void CommandNavDelete( void );										// delete current area
 	void CommandNavDeleteMarked( void );								// delete current marked area
+	void CommandNavUpdateVisibility( void );							// recompute visibility of areas added or reshaped since it was last computed
+	void CommandNavBenchmarkSampling( const CCommand &args );			// time serial and tiled sampling of walkable space from the seeds
 
 	virtual void CommandNavFloodSelect( const CCommand &args );			// select current area and all connected areas, recursively
 	void CommandNavToggleSelectedSet( void );							// toggles all areas into/out of the selected set
@@ -1077,6 +1051,9 @@ public:
 
 protected:
 	NavErrorType GetNavDataFromFile( CUtlBuffer &outBuffer, bool *pNavDataFromBSP = NULL );
+	NavErrorType LoadCompact( void );							// load the compact image of the map's nav data, if it is current (see nav_compact.h)
+	bool SaveCompact( void ) const;								// store the compact image of the current mesh
+	void OnLoadFinished( void );								// tell dependents the mesh is in place, and mark it loaded
 
 	virtual void PostCustomAnalysis( void ) { }					// invoked when custom analysis step is complete
 	bool FindActiveNavArea( void );								// Finds the area or ladder the local player is currently pointing at.  Returns true if a surface was hit by the traceline.
@@ -1089,6 +1066,7 @@ private:
 	friend class CNavArea;
 	friend class CNavNode;
 	friend class CNavUIBasePanel;
+	friend class CNavSampleTile;
 
 	mutable CUtlVector<NavAreaVector> m_grid;
 	float m_gridCellSize;										// the width/height of a grid cell for spatially partitioning nav areas for fast access
@@ -1183,12 +1161,19 @@ private:
 	CNavNode *m_currentNode;									// the current node we are sampling from
 	NavDirType m_generationDir;
 	CNavNode *AddNode( const Vector &destPos, const Vector &destNormal, NavDirType dir, CNavNode *source, bool isOnDisplacement, float obstacleHeight, float flObstacleStartDist, float flObstacleEndDist );		// add a nav node and connect it, update current node
+	void ClassifyNewNode( CNavNode *node ) const;				// mark the crouch and cliff attributes of a new node
 
 	NavLadderVector m_ladders;									// list of ladder navigation representations
 	void BuildLadders( void );
 	void DestroyLadders( void );
 
 	bool SampleStep( void );									// sample the walkable areas of the map
+	bool ComputeSampleStep( const Vector &from, NavDirType dir, NavSampleStep *step ) const;	// trace one step from 'from', return false if it can't be taken
+
+	bool m_isSamplingTiles;										// true while walkable space is sampled in parallel tiles
+	void BeginTiledSampling( void );							// hand the walkable seeds to the tiles they are in
+	bool SampleTiledStep( void );								// sample all tiles with pending work in parallel, return false once none have any
+	void EndTiledSampling( void );								// add the tile nodes to the node list and connect them across tile seams
 	void CreateNavAreasFromNodes( void );						// cover all of the sampled nodes with nav areas
 
 	bool TestArea( CNavNode *node, int width, int height );		// check if an area of size (width, height) can fit, starting from node as upper left corner
@@ -1239,6 +1224,7 @@ private:
 		GENERATE_INCREMENTAL,
 		GENERATE_SIMPLIFY,
 		GENERATE_ANALYSIS_ONLY,
+		GENERATE_SAMPLE_BENCHMARK,								// sampling only, for nav_benchmark_sampling
 	}
 	m_generationMode;											// true while a Navigation Mesh is being generated
 	int m_generationIndex;										// used for iterating nav areas during generation process
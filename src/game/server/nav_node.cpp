@@ -56,11 +56,31 @@ CUtlHash<CNavNode *, CNodeHashFuncs, CNodeHashFuncs> *g_pNavNodeHash;
  * Constructor
  */
 CNavNode::CNavNode( const Vector &pos, const Vector &normal, CNavNode *parent, bool isOnDisplacement )
+{
+	Init( pos, normal, parent, isOnDisplacement );
+	Attach();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Create a node that only its creator knows about. It is found by GetNode() once it is attached.
+ */
+CNavNode *CNavNode::CreateDetached( const Vector &pos, const Vector &normal, CNavNode *parent, bool isOnDisplacement )
+{
+	CNavNode *node = new CNavNode;
+	node->Init( pos, normal, parent, isOnDisplacement );
+	return node;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavNode::Init( const Vector &pos, const Vector &normal, CNavNode *parent, bool isOnDisplacement )
 {
 	m_pos = pos;
 	m_normal = normal;
 
-	m_id = m_nextID++;
+	m_id = 0;
 
 	int i;
 	for( i=0; i<NUM_DIRECTIONS; ++i )
@@ -80,9 +100,8 @@ CNavNode::CNavNode( const Vector &pos, const Vector &normal, CNavNode *parent, b
 	m_visited = 0;
 	m_parent = parent;
 
-	m_next = m_list;
-	m_list = this;
-	m_listLength++;
+	m_next = NULL;
+	m_nextAtXY = NULL;
 
 	m_isCovered = false;
 	m_area = NULL;
@@ -90,6 +109,20 @@ CNavNode::CNavNode( const Vector &pos, const Vector &normal, CNavNode *parent, b
 	m_attributeFlags = 0;
 
 	m_isOnDisplacement = isOnDisplacement;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Add this node to the master list and lookup hash
+ */
+void CNavNode::Attach( void )
+{
+	m_id = m_nextID++;
+
+	m_next = m_list;
+	m_list = this;
+	m_listLength++;
 
 	if ( !g_pNavNodeHash )
 	{
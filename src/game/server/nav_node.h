@@ -31,6 +31,8 @@ public:
 	~CNavNode();
 
 	static CNavNode *GetNode( const Vector &pos );					///< return navigation node at the position, or NULL if none exists
+	static CNavNode *CreateDetached( const Vector &pos, const Vector &normal, CNavNode *parent, bool onDisplacement );	///< create a node that is not in the master list or lookup hash yet, so one thread can build it
+	void Attach( void );											///< add a detached node to the master list and lookup hash, and give it an ID
 	static void CleanupGeneration();
 
 	CNavNode *GetConnectedNode( NavDirType dir ) const;				///< get navigation node connected in given direction, or NULL if cant go that way
@@ -68,6 +70,9 @@ public:
 private:
 	CNavNode() {}													// constructor used only for hash lookup
 	friend class CNavMesh;
+	friend class CNavSampleTile;
+
+	void Init( const Vector &pos, const Vector &normal, CNavNode *parent, bool onDisplacement );
 
 	bool TestForCrouchArea( NavCornerType cornerNum, const Vector& mins, const Vector& maxs, float *groundHeightAboveNode );
 	void CheckCrouch( void );
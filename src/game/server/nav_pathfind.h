@@ -86,19 +86,43 @@ public:
 
 //--------------------------------------------------------------------------------------------------------------
 /**
- * Find path from startArea to goalArea via an A* search, using supplied cost heuristic.
- * If cost functor returns -1 for an area, that area is considered a dead end.
- * This doesn't actually build a path, but the path is defined by following parent
- * pointers back from goalArea to startArea.
- * If 'closestArea' is non-NULL, the closest area to the goal is returned (useful if the path fails).
- * If 'goalArea' is NULL, will compute a path as close as possible to 'goalPos'.
- * If 'goalPos' is NULL, will use the center of 'goalArea' as the goal position.
- * If 'maxPathLength' is nonzero, path building will stop when this length is reached.
- * Returns true if a path exists.
+ * Search state for NavAreaSearchPath() kept on the areas themselves.
+ * Only one such search can run at a time - see CNavSearchContext for re-entrant searches.
  */
-#define IGNORE_NAV_BLOCKERS true
-template< typename CostFunctor >
-bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos, CostFunctor &costFunc, CNavArea **closestArea = NULL, float maxPathLength = 0.0f, int teamID = TEAM_ANY, bool ignoreNavBlockers = false )
+class CNavAreaSearchLists
+{
+public:
+	void ClearSearchLists( void )							{ CNavArea::ClearSearchLists(); }
+
+	bool IsOpen( const CNavArea *area ) const				{ return area->IsOpen(); }
+	bool IsClosed( const CNavArea *area ) const				{ return area->IsClosed(); }
+
+	void AddToOpenList( CNavArea *area )					{ area->AddToOpenList(); }
+	void UpdateOnOpenList( CNavArea *area )					{ area->UpdateOnOpenList(); }
+	CNavArea *PopOpenList( void )							{ return CNavArea::PopOpenList(); }
+	void AddToClosedList( CNavArea *area )					{ area->AddToClosedList(); }
+	void RemoveFromClosedList( CNavArea *area )				{ area->RemoveFromClosedList(); }
+
+	void SetParent( CNavArea *area, CNavArea *parent, NavTraverseType how = NUM_TRAVERSE_TYPES )	{ area->SetParent( parent, how ); }
+	CNavArea *GetParent( const CNavArea *area ) const		{ return area->GetParent( NULL ); }
+
+	void SetTotalCost( CNavArea *area, float value )		{ area->SetTotalCost( value ); }
+	float GetTotalCost( const CNavArea *area ) const		{ return area->GetTotalCost(); }
+
+	void SetCostSoFar( CNavArea *area, float value )		{ area->SetCostSoFar( value ); }
+	float GetCostSoFar( const CNavArea *area ) const		{ return area->GetCostSoFar( NULL ); }
+
+	void SetPathLengthSoFar( CNavArea *area, float value )	{ area->SetPathLengthSoFar( value ); }
+	float GetPathLengthSoFar( const CNavArea *area ) const	{ return area->GetPathLengthSoFar( NULL ); }
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * The A* search behind NavAreaBuildPath(), keeping its state in 'lists'.
+ */
+template< typename SearchLists, typename CostFunctor >
+bool NavAreaSearchPath( SearchLists &lists, CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos, CostFunctor &costFunc, CNavArea **closestArea, float maxPathLength, int teamID, bool ignoreNavBlockers )
 {
 	VPROF_BUDGET( "NavAreaBuildPath", "NextBotSpiky" );
 
@@ -111,7 +135,7 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 	if (startArea == NULL)
 		return false;
 
-	startArea->SetParent( NULL );
+	lists.SetParent( startArea, NULL );
 
 	if (goalArea != NULL && goalArea->IsBlocked( teamID, ignoreNavBlockers ))
 		goalArea = NULL;
@@ -129,30 +153,27 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 	Vector actualGoalPos = (goalPos) ? *goalPos : goalArea->GetCenter();
 
 	// start search
-	CNavArea::ClearSearchLists();
+	lists.ClearSearchLists();
 
 	// compute estimate of path length
 	/// @todo Cost might work as "manhattan distance"
-	startArea->SetTotalCost( (startArea->GetCenter() - actualGoalPos).Length() );
+	lists.SetTotalCost( startArea, (startArea->GetCenter() - actualGoalPos).Length() );
 
 	float initCost = costFunc( startArea, NULL, NULL, NULL, -1.0f );	
 	if (initCost < 0.0f)
 		return false;
-	startArea->SetCostSoFar( initCost );
-	startArea->SetPathLengthSoFar( 0.0 );
+	lists.SetCostSoFar( startArea, initCost );
+	lists.SetPathLengthSoFar( startArea, 0.0 );
 
-	startArea->AddToOpenList();
+	lists.AddToOpenList( startArea );
 
 	// keep track of the area we visit that is closest to the goal
-	float closestAreaDist = startArea->GetTotalCost();
+	float closestAreaDist = lists.GetTotalCost( startArea );
 
 	// do A* search
-	while( !CNavArea::IsOpenListEmpty() )
+	CNavArea *area;
+	while( ( area = lists.PopOpenList() ) != NULL )
 	{
-		// get next area to check
-		CNavArea *area = CNavArea::PopOpenList();
-
-
 		// don't consider blocked areas
 		if ( area->IsBlocked( teamID, ignoreNavBlockers ) )
 			continue;
@@ -323,7 +344,7 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 
 			// don't backtrack
 			Assert( newArea );
-			if ( newArea == area->GetParent() )
+			if ( newArea == lists.GetParent( area ) )
 				continue;
 			if ( newArea == area ) // self neighbor?
 				continue;
@@ -346,13 +367,13 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 
 			// Safety check against a bogus functor.  The cost of the path
 			// A...B, C should always be at least as big as the path A...B.
-			Assert( newCostSoFar >= area->GetCostSoFar() );
+			Assert( newCostSoFar >= lists.GetCostSoFar( area ) );
 
 			// And now that we've asserted, let's be a bit more defensive.
 			// Make sure that any jump to a new area incurs some pathfinsing
 			// cost, to avoid us spinning our wheels over insignificant cost
 			// benefit, floating point precision bug, or busted cost functor.
-			float minNewCostSoFar = area->GetCostSoFar() * 1.00001f + 0.00001f;
+			float minNewCostSoFar = lists.GetCostSoFar( area ) * 1.00001f + 0.00001f;
 			newCostSoFar = Max( newCostSoFar, minNewCostSoFar );
 				
 			// stop if path length limit reached
@@ -360,14 +381,14 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 			{
 				// keep track of path length so far
 				float deltaLength = ( newArea->GetCenter() - area->GetCenter() ).Length();
-				float newLengthSoFar = area->GetPathLengthSoFar() + deltaLength;
+				float newLengthSoFar = lists.GetPathLengthSoFar( area ) + deltaLength;
 				if ( newLengthSoFar > maxPathLength )
 					continue;
 				
-				newArea->SetPathLengthSoFar( newLengthSoFar );
+				lists.SetPathLengthSoFar( newArea, newLengthSoFar );
 			}
 
-			if ( ( newArea->IsOpen() || newArea->IsClosed() ) && newArea->GetCostSoFar() <= newCostSoFar )
+			if ( ( lists.IsOpen( newArea ) || lists.IsClosed( newArea ) ) && lists.GetCostSoFar( newArea ) <= newCostSoFar )
 			{
 				// this is a worse path - skip it
 				continue;
@@ -385,36 +406,76 @@ bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *go
 					closestAreaDist = newCostRemaining;
 				}
 				
-				newArea->SetCostSoFar( newCostSoFar );
-				newArea->SetTotalCost( newCostSoFar + newCostRemaining );
+				lists.SetCostSoFar( newArea, newCostSoFar );
+				lists.SetTotalCost( newArea, newCostSoFar + newCostRemaining );
 
-				if ( newArea->IsClosed() )
+				if ( lists.IsClosed( newArea ) )
 				{
-					newArea->RemoveFromClosedList();
+					lists.RemoveFromClosedList( newArea );
 				}
 
-				if ( newArea->IsOpen() )
+				if ( lists.IsOpen( newArea ) )
 				{
 					// area already on open list, update the list order to keep costs sorted
-					newArea->UpdateOnOpenList();
+					lists.UpdateOnOpenList( newArea );
 				}
 				else
 				{
-					newArea->AddToOpenList();
+					lists.AddToOpenList( newArea );
 				}
 
-				newArea->SetParent( area, how );
+				lists.SetParent( newArea, area, how );
 			}
 		}
 
 		// we have searched this area
-		area->AddToClosedList();
+		lists.AddToClosedList( area );
 	}
 
 	return false;
 }
 
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Find path from startArea to goalArea via an A* search, using supplied cost heuristic.
+ * If cost functor returns -1 for an area, that area is considered a dead end.
+ * This doesn't actually build a path, but the path is defined by following parent
+ * pointers back from goalArea to startArea.
+ * If 'closestArea' is non-NULL, the closest area to the goal is returned (useful if the path fails).
+ * If 'goalArea' is NULL, will compute a path as close as possible to 'goalPos'.
+ * If 'goalPos' is NULL, will use the center of 'goalArea' as the goal position.
+ * If 'maxPathLength' is nonzero, path building will stop when this length is reached.
+ * Returns true if a path exists.
+ */
+#define IGNORE_NAV_BLOCKERS true
+template< typename CostFunctor >
+bool NavAreaBuildPath( CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos, CostFunctor &costFunc, CNavArea **closestArea = NULL, float maxPathLength = 0.0f, int teamID = TEAM_ANY, bool ignoreNavBlockers = false )
+{
+	// search state lives on the areas, so cost functors must read it from there
+	CNavSearchContext::ActiveScope scope( NULL );
+
+	CNavAreaSearchLists lists;
+	return NavAreaSearchPath( lists, startArea, goalArea, goalPos, costFunc, closestArea, maxPathLength, teamID, ignoreNavBlockers );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * As above, but the search state is kept in 'context' instead of on the areas, so
+ * searches with different contexts can run at the same time on different threads.
+ * The path is defined by following context.GetParent() back from goalArea to startArea.
+ */
+template< typename CostFunctor >
+bool NavAreaBuildPath( CNavSearchContext &context, CNavArea *startArea, CNavArea *goalArea, const Vector *goalPos, CostFunctor &costFunc, CNavArea **closestArea = NULL, float maxPathLength = 0.0f, int teamID = TEAM_ANY, bool ignoreNavBlockers = false )
+{
+	// let cost functors that read GetCostSoFar(), etc from areas see this search
+	CNavSearchContext::ActiveScope scope( &context );
+
+	return NavAreaSearchPath( context, startArea, goalArea, goalPos, costFunc, closestArea, maxPathLength, teamID, ignoreNavBlockers );
+}
+
+
 //--------------------------------------------------------------------------------------------------------------
 /**
  * Compute distance between two areas. Return -1 if can't reach 'endArea' from 'startArea'.
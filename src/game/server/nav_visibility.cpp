@@ -0,0 +1,518 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// nav_visibility.cpp
+// Computation of the potentially visible areas of the Navigation Mesh
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "nav_mesh.h"
+#include "nav_visibility.h"
+#include "vstdlib/jobthread.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar nav_visibility_batch_size( "nav_visibility_batch_size", "64", FCVAR_CHEAT, "Number of areas whose visibility is computed in parallel at a time" );
+
+extern ConVar nav_max_view_distance;
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavVisibilityBuilder &TheNavVisibilityBuilder( void )
+{
+	static CNavVisibilityBuilder builder;
+	return builder;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CNavVisibilityBuilder::CNavVisibilityBuilder( void )
+{
+	m_hasShapes = false;
+	m_sourceIndex = 0;
+	m_isIncremental = false;
+	m_pvsSize = 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavVisibilityBuilder::Reset( void )
+{
+	m_shape.RemoveAll();
+	m_hasShapes = false;
+
+	m_sources.RemoveAll();
+	m_sourceIndex = 0;
+	m_isSource.RemoveAll();
+	m_isIncremental = false;
+
+	m_jobs.Purge();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavVisibilityBuilder::OnMeshLoaded( void )
+{
+	Reset();
+
+	// a mesh without visibility data has nothing to update - the first update computes all of it
+	if ( TheNavMesh->IsAnalyzed() )
+	{
+		CaptureShapes();
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Remember the shape of every area, to find the ones edited since
+ */
+void CNavVisibilityBuilder::CaptureShapes( void )
+{
+	unsigned int idCount = CNavArea::m_nextID;
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		idCount = MAX( idCount, TheNavAreas[ it ]->GetID() + 1 );
+	}
+
+	m_shape.RemoveAll();
+	m_shape.EnsureCount( idCount );
+
+	for( int i=0; i<m_shape.Count(); ++i )
+	{
+		m_shape[i].id = 0;
+	}
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		const CNavArea *area = TheNavAreas[ it ];
+
+		AreaShape &shape = m_shape[ area->GetID() ];
+		shape.id = area->GetID();
+		shape.nwCorner = area->m_nwCorner;
+		shape.seCorner = area->m_seCorner;
+		shape.neZ = area->m_neZ;
+		shape.swZ = area->m_swZ;
+	}
+
+	m_hasShapes = true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Return true if the area is new or has been reshaped since its visibility was computed
+ */
+bool CNavVisibilityBuilder::HasChanged( const CNavArea *area ) const
+{
+	unsigned int id = area->GetID();
+	if ( id >= (unsigned int)m_shape.Count() || m_shape[ id ].id != id )
+	{
+		return true;
+	}
+
+	const AreaShape &shape = m_shape[ id ];
+	return ( shape.nwCorner != area->m_nwCorner || shape.seCorner != area->m_seCorner || shape.neZ != area->m_neZ || shape.swZ != area->m_swZ );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavVisibilityBuilder::BeginFull( void )
+{
+	m_isIncremental = false;
+	m_isSource.RemoveAll();
+
+	m_sources.RemoveAll();
+	m_sources.EnsureCapacity( TheNavAreas.Count() );
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		CNavArea *area = TheNavAreas[ it ];
+		area->ResetPotentiallyVisibleAreas();
+		m_sources.AddToTail( area );
+	}
+
+	m_sourceIndex = 0;
+	m_pvsSize = PAD_NUMBER( MAX( engine->GetClusterCount(), 1 ), 32 ) / 8;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Drop all visibility involving areas added or reshaped since visibility was last computed,
+ * and set them up to be computed again
+ */
+bool CNavVisibilityBuilder::BeginIncremental( void )
+{
+	if ( !m_hasShapes )
+	{
+		// we don't know what the current visibility belongs to
+		BeginFull();
+		return m_sources.Count() > 0;
+	}
+
+	m_isIncremental = true;
+	m_sources.RemoveAll();
+	unsigned int idCount = CNavArea::m_nextID;
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		idCount = MAX( idCount, TheNavAreas[ it ]->GetID() + 1 );
+	}
+
+	m_isSource.RemoveAll();
+	m_isSource.EnsureCount( idCount );
+
+	for( int i=0; i<m_isSource.Count(); ++i )
+	{
+		m_isSource[i] = false;
+	}
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		CNavArea *area = TheNavAreas[ it ];
+		if ( HasChanged( area ) )
+		{
+			m_isSource[ area->GetID() ] = true;
+			m_sources.AddToTail( area );
+		}
+	}
+
+	m_sourceIndex = 0;
+
+	if ( m_sources.Count() == 0 )
+	{
+		return false;
+	}
+
+	// the lists are about to change, so undo the delta compression
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		TheNavAreas[ it ]->ExpandInheritedVisibility();
+	}
+
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		CNavArea *area = TheNavAreas[ it ];
+		area->m_isInheritedFrom = false;
+
+		if ( m_isSource[ area->GetID() ] )
+		{
+			area->m_potentiallyVisibleAreas.RemoveAll();
+			continue;
+		}
+
+		for( int i=area->m_potentiallyVisibleAreas.Count()-1; i>=0; --i )
+		{
+			if ( m_isSource[ area->m_potentiallyVisibleAreas[i].area->GetID() ] )
+			{
+				area->m_potentiallyVisibleAreas.FastRemove( i );
+			}
+		}
+	}
+
+	m_pvsSize = PAD_NUMBER( MAX( engine->GetClusterCount(), 1 ), 32 ) / 8;
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+class NavVisibilityCandidateCollector
+{
+public:
+	NavVisibilityCandidateCollector( CUtlVector< CNavArea * > *candidates ) : m_candidates( candidates ) { }
+
+	bool operator() ( CNavArea *area )
+	{
+		m_candidates->AddToTail( area );
+		return true;
+	}
+
+	CUtlVector< CNavArea * > *m_candidates;
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Collect everything the traces from 'source' need. The engine builds a PVS through
+ * shared state, and the area grid is walked with shared markers, so this runs on the main thread.
+ */
+void CNavVisibilityBuilder::PrepareJob( Job *job, CNavArea *source )
+{
+	job->source = source;
+	job->results.RemoveAll();
+	job->candidates.RemoveAll();
+
+	NavVisibilityCandidateCollector collector( &job->candidates );
+	TheNavMesh->ForAllAreasInRadius( collector, source->GetCenter(), CNavArea::GetVisibilityRange() );
+
+	// each pair is traced once, from the source with the lower ID
+	for( int i=job->candidates.Count()-1; i>=0; --i )
+	{
+		const CNavArea *area = job->candidates[i];
+		if ( area->GetID() >= source->GetID() )
+		{
+			continue;
+		}
+
+		// in an incremental update, pairs with an area that did not change are only traced from the changed one
+		if ( m_isIncremental && !m_isSource[ area->GetID() ] )
+		{
+			continue;
+		}
+
+		job->candidates.FastRemove( i );
+	}
+
+	job->pvs.SetCount( m_pvsSize );
+	source->SetupPVS( job->pvs.Base(), job->pvs.Count() );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Trace between the source of the job and all of its candidates. Runs on a worker thread.
+ */
+static void ComputeVisibilityJob( CNavVisibilityBuilder::Job &job )
+{
+	const CNavArea *source = job.source;
+	const float maxRangeSq = Sqr( nav_max_view_distance.GetFloat() );
+
+	FOR_EACH_VEC( job.candidates, it )
+	{
+		CNavArea *area = job.candidates[ it ];
+		CNavArea::VisibilityType sourceSees = ( area == source ) ? CNavArea::COMPLETELY_VISIBLE : CNavArea::NOT_VISIBLE;
+		CNavArea::VisibilityType areaSees = CNavArea::NOT_VISIBLE;
+
+		if ( area != source )
+		{
+			bool isOutsidePVS = false;
+
+			// "completely visible" means the source is completely visible from 'area'
+			areaSees = source->ComputeVisibility( area, job.pvs.Base(), job.pvs.Count(), &isOutsidePVS );
+
+			if ( !isOutsidePVS && ( areaSees || ( source->GetCenter() - area->GetCenter() ).LengthSqr() < maxRangeSq ) )
+			{
+				sourceSees = area->ComputeVisibility( source, (const byte *)NULL, 0 );
+			}
+
+			if ( !areaSees && sourceSees )
+			{
+				areaSees = CNavArea::POTENTIALLY_VISIBLE;
+			}
+
+			if ( !sourceSees && areaSees )
+			{
+				sourceSees = CNavArea::POTENTIALLY_VISIBLE;
+			}
+		}
+
+		if ( sourceSees != CNavArea::NOT_VISIBLE || areaSees != CNavArea::NOT_VISIBLE )
+		{
+			CNavVisibilityBuilder::Result &result = job.results[ job.results.AddToTail() ];
+			result.area = area;
+			result.sourceSees = sourceSees;
+			result.areaSees = areaSees;
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+bool CNavVisibilityBuilder::ComputeBatch( void )
+{
+	if ( m_sourceIndex >= m_sources.Count() )
+	{
+		return false;
+	}
+
+	int batchSize = clamp( nav_visibility_batch_size.GetInt(), 1, m_sources.Count() - m_sourceIndex );
+
+	// jobs keep their buffers from batch to batch
+	while( m_jobs.Count() < batchSize )
+	{
+		m_jobs.AddToTail();
+	}
+
+	for( int i=0; i<batchSize; ++i )
+	{
+		PrepareJob( &m_jobs[i], m_sources[ m_sourceIndex + i ] );
+	}
+
+	ParallelProcess( "CNavVisibilityBuilder::ComputeBatch", m_jobs.Base(), batchSize, &ComputeVisibilityJob );
+
+	// merge the results into the area lists
+	for( int i=0; i<batchSize; ++i )
+	{
+		const Job &job = m_jobs[i];
+
+		job.source->m_potentiallyVisibleAreas.EnsureCapacity( job.source->m_potentiallyVisibleAreas.Count() + job.results.Count() );
+
+		FOR_EACH_VEC( job.results, it )
+		{
+			const Result &result = job.results[ it ];
+			CNavArea::AreaBindInfo info;
+
+			if ( result.sourceSees != CNavArea::NOT_VISIBLE )
+			{
+				info.area = result.area;
+				info.attributes = result.sourceSees;
+				job.source->m_potentiallyVisibleAreas.AddToTail( info );
+			}
+
+			if ( result.areaSees != CNavArea::NOT_VISIBLE && result.area != job.source )
+			{
+				info.area = job.source;
+				info.attributes = result.areaSees;
+				result.area->m_potentiallyVisibleAreas.AddToTail( info );
+			}
+		}
+	}
+
+	m_sourceIndex += batchSize;
+
+	return true;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CNavVisibilityBuilder::End( void )
+{
+	m_sources.RemoveAll();
+	m_sourceIndex = 0;
+	m_isSource.RemoveAll();
+	m_isIncremental = false;
+
+	m_jobs.Purge();
+
+	CaptureShapes();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+static void PutVisibilityInt( CUtlBuffer &buffer, unsigned int value )
+{
+	while( value >= 0x80 )
+	{
+		buffer.PutUnsignedChar( (unsigned char)( value | 0x80 ) );
+		value >>= 7;
+	}
+
+	buffer.PutUnsignedChar( (unsigned char)value );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+static bool GetVisibilityInt( const unsigned char *&data, const unsigned char *end, unsigned int *value )
+{
+	*value = 0;
+
+	for( int shift=0; shift<32; shift += 7 )
+	{
+		if ( data >= end )
+		{
+			return false;
+		}
+
+		unsigned char c = *data++;
+		*value |= (unsigned int)( c & 0x7F ) << shift;
+
+		if ( ( c & 0x80 ) == 0 )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Write a sorted list of visibility entries as a compressed bitset - see nav_visibility.h
+ */
+void NavWriteVisibilityBitset( CUtlBuffer &buffer, const CUtlVector< NavVisibilityEntry > &entries )
+{
+	unsigned int next = 0;		// first index after the previous run
+
+	for( int i=0; i<entries.Count(); )
+	{
+		const NavVisibilityEntry &first = entries[i];
+		Assert( first.index >= next && first.attributes <= 0x03 );
+
+		int run = 1;
+		while( i + run < entries.Count() && entries[ i + run ].index == first.index + run && entries[ i + run ].attributes == first.attributes )
+		{
+			++run;
+		}
+
+		unsigned int gap = first.index - next;
+		PutVisibilityInt( buffer, ( gap << 3 ) | ( ( run > 1 ) ? 0x04 : 0 ) | ( first.attributes & 0x03 ) );
+
+		if ( run > 1 )
+		{
+			PutVisibilityInt( buffer, run - 2 );
+		}
+
+		next = first.index + run;
+		i += run;
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Read a compressed visibility bitset - see nav_visibility.h
+ */
+bool NavReadVisibilityBitset( const unsigned char *data, unsigned int size, unsigned int indexLimit, CUtlVector< NavVisibilityEntry > *entries )
+{
+	const unsigned char *end = data + size;
+	unsigned int next = 0;
+
+	if ( entries )
+	{
+		entries->RemoveAll();
+	}
+
+	while( data < end )
+	{
+		unsigned int token, run = 1;
+		if ( !GetVisibilityInt( data, end, &token ) )
+		{
+			return false;
+		}
+
+		if ( token & 0x04 )
+		{
+			if ( !GetVisibilityInt( data, end, &run ) || run > indexLimit )
+			{
+				return false;
+			}
+
+			run += 2;
+		}
+
+		unsigned int gap = token >> 3;
+		if ( gap > indexLimit - next || run > indexLimit - next - gap )
+		{
+			return false;
+		}
+
+		NavVisibilityEntry entry;
+		entry.index = next + gap;
+		entry.attributes = token & 0x03;
+
+		if ( entries )
+		{
+			for( unsigned int r=0; r<run; ++r, ++entry.index )
+			{
+				entries->AddToTail( entry );
+			}
+		}
+
+		next += gap + run;
+	}
+
+	return true;
+}
@@ -0,0 +1,106 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// nav_visibility.h
+// Computation of the potentially visible areas of the Navigation Mesh
+//
+// Visibility is computed for batches of source areas at a time. The PVS and
+// candidate areas of each source are gathered on the main thread, then the
+// line-of-sight traces of the whole batch run in parallel, each job writing
+// to its own result list. Results are merged into the area lists once the
+// batch is done. Each pair of areas is only traced once, from the area with
+// the lower ID.
+//
+// The shape of every area is remembered when visibility is computed or
+// loaded, so that after editing only the pairs involving new or reshaped
+// areas need to be traced again.
+//
+//=============================================================================//
+
+#ifndef _NAV_VISIBILITY_H_
+#define _NAV_VISIBILITY_H_
+
+#include "nav_area.h"
+#include "utlbuffer.h"
+
+
+//--------------------------------------------------------------------------------------------------------------
+class CNavVisibilityBuilder
+{
+public:
+	CNavVisibilityBuilder( void );
+
+	void Reset( void );
+	void OnMeshLoaded( void );					// remember the shape of the loaded areas, if they have visibility data
+
+	void BeginFull( void );						// compute visibility between all areas in view range of each other
+	bool BeginIncremental( void );				// compute visibility only for areas added or reshaped since it was last computed. Returns false if there are none.
+	bool ComputeBatch( void );					// compute the next batch of source areas, returning false once all are done
+	void End( void );							// remember the shape of the areas the new visibility belongs to
+
+	int GetSourceCount( void ) const			{ return m_sources.Count(); }
+	int GetPercentComplete( void ) const		{ return m_sources.Count() ? 100 * m_sourceIndex / m_sources.Count() : 100; }
+
+	struct Result
+	{
+		CNavArea *area;
+		unsigned char sourceSees;				// attributes of 'area' in the source's list
+		unsigned char areaSees;					// attributes of the source in the list of 'area'
+	};
+
+	struct Job
+	{
+		CNavArea *source;
+		CUtlVector< CNavArea * > candidates;
+		CUtlVector< byte > pvs;
+		CUtlVector< Result > results;
+	};
+
+private:
+	struct AreaShape
+	{
+		unsigned int id;						// zero if no area had this ID
+		Vector nwCorner, seCorner;
+		float neZ, swZ;
+	};
+
+	void CaptureShapes( void );
+	bool HasChanged( const CNavArea *area ) const;
+	void PrepareJob( Job *job, CNavArea *source );
+
+	CUtlVector< AreaShape > m_shape;			// indexed by area ID
+	bool m_hasShapes;
+
+	CUtlVector< CNavArea * > m_sources;			// areas to compute visibility from
+	int m_sourceIndex;
+	CUtlVector< unsigned char > m_isSource;		// indexed by area ID
+	bool m_isIncremental;
+
+	CUtlVector< Job > m_jobs;
+	int m_pvsSize;
+};
+
+// singleton accessor
+extern CNavVisibilityBuilder &TheNavVisibilityBuilder( void );
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Compressed visibility bitset.
+ * The list of an area is stored as a bitset over area indices, with the 2-bit visibility
+ * attributes of each set index. It is written as a sequence of runs of consecutive indices
+ * with the same attributes. Each run is a variable-length integer
+ *     ( gap << 3 ) | ( isLong << 2 ) | attributes
+ * where 'gap' is the number of unset indices since the end of the previous run. Runs longer
+ * than one index are flagged with 'isLong' and followed by a second integer, their length minus two.
+ */
+struct NavVisibilityEntry
+{
+	unsigned int index;
+	unsigned char attributes;
+};
+
+extern void NavWriteVisibilityBitset( CUtlBuffer &buffer, const CUtlVector< NavVisibilityEntry > &entries );	// entries must be sorted by index
+extern bool NavReadVisibilityBitset( const unsigned char *data, unsigned int size, unsigned int indexLimit, CUtlVector< NavVisibilityEntry > *entries );	// returns false if the data is malformed. 'entries' may be NULL to only validate.
+
+
+#endif // _NAV_VISIBILITY_H_
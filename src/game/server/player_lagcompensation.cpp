@@ -14,6 +14,10 @@
 #include "BaseAnimatingOverlay.h"
 #include "tier0/vprof.h"
 
+#ifdef NEXT_BOT
+#include "NextBotManager.h"
+#endif
+
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
@@ -37,6 +41,10 @@ ConVar sv_showlagcompensation( "sv_showlagcompensation", "0", FCVAR_CHEAT, "Show
 
 ConVar sv_unlag_fixstuck( "sv_unlag_fixstuck", "0", FCVAR_DEVELOPMENTONLY, "Disallow backtracking a player for lag compensation if it will cause them to become stuck" );
 
+#ifdef NEXT_BOT
+ConVar sv_unlag_nextbots( "sv_unlag_nextbots", "1", FCVAR_DEVELOPMENTONLY, "Enables lag compensation of NextBot NPCs" );
+#endif
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -127,6 +135,74 @@ public:
 };
 
 
+#ifdef NEXT_BOT
+//-----------------------------------------------------------------------------
+// Purpose: Fixed size position history of a NextBot NPC.
+// Records live in a ring buffer with one array per field, so searching for
+// a time only touches the simulation times. Tracks are indexed by bot id.
+//-----------------------------------------------------------------------------
+#define NB_LAG_MAX_TRACKS	512
+#define NB_LAG_MAX_RECORDS	128		// must be a power of two, enough for sv_maxunlag (at most 1 second) at up to 128 ticks per second
+
+// animation state of a NextBot, so its hitboxes follow it back in time
+struct NextBotLagAnim
+{
+	int						m_layerCount;
+	LayerRecord				m_layerRecords[MAX_LAYER_RECORDS];
+	float					m_flPoseParameters[MAXSTUDIOPOSEPARAM];
+};
+
+struct NextBotLagTrack
+{
+	void Reset( CBaseCombatCharacter *pEntity )
+	{
+		m_hEntity = pEntity;
+		m_head = 0;
+		m_count = 0;
+
+		// only bots that exist pay for the animation records
+		if ( pEntity )
+		{
+			m_anim.SetCount( NB_LAG_MAX_RECORDS );
+		}
+		else
+		{
+			m_anim.Purge();
+		}
+	}
+
+	// return ring buffer slot of the i'th newest record
+	int Slot( int i ) const { return ( m_head - i ) & ( NB_LAG_MAX_RECORDS - 1 ); }
+
+	float					m_flSimulationTime[ NB_LAG_MAX_RECORDS ];
+	Vector					m_vecOrigin[ NB_LAG_MAX_RECORDS ];
+	QAngle					m_vecAngles[ NB_LAG_MAX_RECORDS ];
+	int						m_masterSequence[ NB_LAG_MAX_RECORDS ];
+	float					m_masterCycle[ NB_LAG_MAX_RECORDS ];
+	CUtlVector< NextBotLagAnim > m_anim;		// NB_LAG_MAX_RECORDS while tracking a bot
+
+	CHandle< CBaseCombatCharacter > m_hEntity;
+	int						m_head;		// slot of the newest record
+	int						m_count;	// number of valid records
+};
+
+// state of a NextBot before and after we moved it back
+struct NextBotLagRestore
+{
+	int						m_track;
+	int						m_fFlags;
+	float					m_flSimulationTime;
+	Vector					m_vecRestoreOrigin;
+	QAngle					m_vecRestoreAngles;
+	int						m_restoreSequence;
+	float					m_restoreCycle;
+	NextBotLagAnim			m_restoreAnim;
+	Vector					m_vecChangeOrigin;
+	QAngle					m_vecChangeAngles;
+};
+#endif // NEXT_BOT
+
+
 //
 // Try to take the player from his current origin to vWantedPos.
 // If it can't get there, leave the player where he is.
@@ -212,10 +288,23 @@ public:
 private:
 	void			BacktrackPlayer( CBasePlayer *player, float flTargetTime );
 
+#ifdef NEXT_BOT
+	void			RecordNextBots( float flDeadtime );
+	void			BacktrackNextBots( CBasePlayer *player, CUserCmd *cmd, float flTargetTime, const CBitVec<MAX_EDICTS> *pEntityTransmitBits );
+	void			RestoreNextBots( void );
+	bool			WantsLagCompensationOnNextBot( const CBasePlayer *player, const CUserCmd *cmd, CBaseCombatCharacter *pBot, const CBitVec<MAX_EDICTS> *pEntityTransmitBits ) const;
+#endif
+
 	void ClearHistory()
 	{
 		for ( int i=0; i<MAX_PLAYERS; i++ )
 			m_PlayerTrack[i].Purge();
+
+#ifdef NEXT_BOT
+		for ( int i=0; i<NB_LAG_MAX_TRACKS; i++ )
+			m_NextBotTrack[i].Reset( NULL );
+		m_NextBotRestore.RemoveAll();
+#endif
 	}
 
 	// keep a list of lag records for each player
@@ -233,6 +322,12 @@ private:
 	float					m_flTeleportDistanceSqr;
 
 	bool					m_isCurrentlyDoingCompensation;	// Sentinel to prevent calling StartLagCompensation a second time before a Finish.
+
+#ifdef NEXT_BOT
+	NextBotLagTrack			m_NextBotTrack[ NB_LAG_MAX_TRACKS ];	// indexed by INextBot::GetBotId()
+	CUtlVector< NextBotLagRestore > m_NextBotRestore;				// NextBots we moved back this session
+	CUtlVector< INextBot * > m_NextBotScratch;
+#endif
 };
 
 static CLagCompensationManager g_LagCompensationManager( "CLagCompensationManager" );
@@ -337,10 +432,370 @@ void CLagCompensationManager::FrameUpdatePostEntityThink()
 		}
 	}
 
+#ifdef NEXT_BOT
+	RecordNextBots( flDeadtime );
+#endif
+
 	//Clear the current player.
 	m_pCurrentPlayer = NULL;
 }
 
+#ifdef NEXT_BOT
+//-----------------------------------------------------------------------------
+// Purpose: Store the layers and pose parameters of a NextBot
+//-----------------------------------------------------------------------------
+static void CaptureNextBotAnim( CBaseCombatCharacter *pBot, NextBotLagAnim *anim )
+{
+	anim->m_layerCount = MIN( pBot->GetNumAnimOverlays(), MAX_LAYER_RECORDS );
+	for( int layerIndex = 0; layerIndex < anim->m_layerCount; ++layerIndex )
+	{
+		CAnimationLayer *currentLayer = pBot->GetAnimOverlay( layerIndex );
+		if( currentLayer )
+		{
+			anim->m_layerRecords[layerIndex].m_cycle = currentLayer->m_flCycle;
+			anim->m_layerRecords[layerIndex].m_order = currentLayer->m_nOrder;
+			anim->m_layerRecords[layerIndex].m_sequence = currentLayer->m_nSequence;
+			anim->m_layerRecords[layerIndex].m_weight = currentLayer->m_flWeight;
+		}
+	}
+
+	for( int i=0; i<MAXSTUDIOPOSEPARAM; i++ )
+	{
+		anim->m_flPoseParameters[i] = pBot->GetPoseParameter( i );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Put the layers and pose parameters of a NextBot back to 'anim',
+// interpolating layers toward 'prevAnim' by 'frac' where they play the same sequence
+//-----------------------------------------------------------------------------
+static void ApplyNextBotAnim( CBaseCombatCharacter *pBot, const NextBotLagAnim &anim, const NextBotLagAnim *prevAnim = NULL, float frac = 0.0f )
+{
+	int layerCount = MIN( pBot->GetNumAnimOverlays(), anim.m_layerCount );
+	for( int layerIndex = 0; layerIndex < layerCount; ++layerIndex )
+	{
+		CAnimationLayer *currentLayer = pBot->GetAnimOverlay( layerIndex );
+		if( !currentLayer )
+			continue;
+
+		const LayerRecord &layer = anim.m_layerRecords[layerIndex];
+
+		currentLayer->m_nOrder = layer.m_order;
+		currentLayer->m_nSequence = layer.m_sequence;
+		currentLayer->m_flCycle = layer.m_cycle;
+		currentLayer->m_flWeight = layer.m_weight;
+
+		if ( prevAnim && frac > 0.0f && layerIndex < prevAnim->m_layerCount )
+		{
+			// We can't interpolate across a sequence or order change
+			const LayerRecord &prevLayer = prevAnim->m_layerRecords[layerIndex];
+			if ( layer.m_order == prevLayer.m_order && layer.m_sequence == prevLayer.m_sequence )
+			{
+				// the older record is higher in frame than the newer, it must have wrapped around from 1 back to 0
+				float prevCycle = ( layer.m_cycle > prevLayer.m_cycle ) ? prevLayer.m_cycle + 1.0f : prevLayer.m_cycle;
+				float newCycle = Lerp( frac, layer.m_cycle, prevCycle );
+				currentLayer->m_flCycle = newCycle < 1.0f ? newCycle : newCycle - 1.0f;
+				currentLayer->m_flWeight = Lerp( frac, layer.m_weight, prevLayer.m_weight );
+			}
+		}
+	}
+
+	for( int i=0; i<MAXSTUDIOPOSEPARAM; i++ )
+	{
+		// don't lerp pose params, just pick the closest
+		pBot->SetPoseParameter( i, anim.m_flPoseParameters[i] );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Add this tick's state of every NextBot NPC to its track
+//-----------------------------------------------------------------------------
+void CLagCompensationManager::RecordNextBots( float flDeadtime )
+{
+	VPROF_BUDGET( "RecordNextBots", "CLagCompensationManager" );
+
+	if ( !sv_unlag_nextbots.GetBool() )
+		return;
+
+	static bool bWarnedTickRate = false;
+	if ( !bWarnedTickRate && sv_maxunlag.GetFloat() > NB_LAG_MAX_RECORDS * TICK_INTERVAL )
+	{
+		Warning( "NextBot lag compensation only covers %.2f seconds at this tick rate\n", NB_LAG_MAX_RECORDS * TICK_INTERVAL );
+		bWarnedTickRate = true;
+	}
+
+	// forget bots that have gone away
+	for ( int i = 0; i < NB_LAG_MAX_TRACKS; i++ )
+	{
+		if ( m_NextBotTrack[i].m_count && m_NextBotTrack[i].m_hEntity.Get() == NULL )
+		{
+			m_NextBotTrack[i].Reset( NULL );
+		}
+	}
+
+	TheNextBots().CollectAllBots( &m_NextBotScratch );
+
+	FOR_EACH_VEC( m_NextBotScratch, it )
+	{
+		INextBot *bot = m_NextBotScratch[ it ];
+		CBaseCombatCharacter *pEntity = bot->GetEntity();
+
+		// players are tracked above
+		int trackIndex = bot->GetBotId();
+		if ( !pEntity || pEntity->IsPlayer() || trackIndex < 0 )
+			continue;
+
+		if ( trackIndex >= NB_LAG_MAX_TRACKS )
+		{
+			static bool bWarnedTrackCount = false;
+			if ( !bWarnedTrackCount )
+			{
+				Warning( "NextBot lag compensation only tracks %d bots, bots past that are not lag compensated\n", NB_LAG_MAX_TRACKS );
+				bWarnedTrackCount = true;
+			}
+			continue;
+		}
+
+		NextBotLagTrack *track = &m_NextBotTrack[ trackIndex ];
+
+		if ( track->m_hEntity.Get() != pEntity || !pEntity->IsAlive() )
+		{
+			// new occupant of this bot id, or dead - start over
+			// dead bots, such as pooled mobs, don't keep their animation records
+			track->Reset( pEntity->IsAlive() ? pEntity : NULL );
+
+			if ( !pEntity->IsAlive() )
+				continue;
+		}
+
+		// drop records that are too old
+		while ( track->m_count > 0 && track->m_flSimulationTime[ track->Slot( track->m_count - 1 ) ] < flDeadtime )
+		{
+			--track->m_count;
+		}
+
+		// don't add new entry for same or older time
+		if ( track->m_count > 0 && track->m_flSimulationTime[ track->m_head ] >= pEntity->GetSimulationTime() )
+			continue;
+
+		track->m_head = ( track->m_head + 1 ) & ( NB_LAG_MAX_RECORDS - 1 );
+		track->m_count = MIN( track->m_count + 1, NB_LAG_MAX_RECORDS );
+
+		int slot = track->m_head;
+		track->m_flSimulationTime[ slot ] = pEntity->GetSimulationTime();
+		track->m_vecOrigin[ slot ] = pEntity->GetLocalOrigin();
+		track->m_vecAngles[ slot ] = pEntity->GetLocalAngles();
+		track->m_masterSequence[ slot ] = pEntity->GetSequence();
+		track->m_masterCycle[ slot ] = pEntity->GetCycle();
+		CaptureNextBotAnim( pEntity, &track->m_anim[ slot ] );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Same policy as CBasePlayer::WantsLagCompensationOnEntity, for NPCs
+//-----------------------------------------------------------------------------
+bool CLagCompensationManager::WantsLagCompensationOnNextBot( const CBasePlayer *player, const CUserCmd *cmd, CBaseCombatCharacter *pBot, const CBitVec<MAX_EDICTS> *pEntityTransmitBits ) const
+{
+	// Team members shouldn't be adjusted
+	if ( pBot->GetTeamNumber() == player->GetTeamNumber() )
+		return false;
+
+	// If this entity hasn't been transmitted to us and acked, then don't bother lag compensating it.
+	if ( pEntityTransmitBits && !pEntityTransmitBits->Get( pBot->entindex() ) )
+		return false;
+
+	const Vector &vMyOrigin = player->GetAbsOrigin();
+	const Vector &vHisOrigin = pBot->GetAbsOrigin();
+
+	// get max distance the bot could have moved within max lag compensation time
+	float maxDistance = 1.5 * pBot->MyNextBotPointer()->GetLocomotionInterface()->GetRunSpeed() * sv_maxunlag.GetFloat();
+	if ( vHisOrigin.DistTo( vMyOrigin ) < maxDistance )
+		return true;
+
+	// If their origin is not within a 45 degree cone in front of us, no need to lag compensate.
+	Vector vForward;
+	AngleVectors( cmd->viewangles, &vForward );
+
+	Vector vDiff = vHisOrigin - vMyOrigin;
+	VectorNormalize( vDiff );
+
+	return vForward.Dot( vDiff ) >= 0.707107f;
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Move every relevant NextBot NPC back to where it was at flTargetTime
+//-----------------------------------------------------------------------------
+void CLagCompensationManager::BacktrackNextBots( CBasePlayer *player, CUserCmd *cmd, float flTargetTime, const CBitVec<MAX_EDICTS> *pEntityTransmitBits )
+{
+	VPROF_BUDGET( "BacktrackNextBots", "CLagCompensationManager" );
+
+	m_NextBotRestore.RemoveAll();
+
+	if ( !sv_unlag_nextbots.GetBool() )
+		return;
+
+	for ( int trackIndex = 0; trackIndex < NB_LAG_MAX_TRACKS; trackIndex++ )
+	{
+		NextBotLagTrack *track = &m_NextBotTrack[ trackIndex ];
+		if ( track->m_count <= 0 )
+			continue;
+
+		CBaseCombatCharacter *pBot = track->m_hEntity;
+		if ( !pBot || !pBot->IsAlive() || !pBot->MyNextBotPointer() )
+			continue;
+
+		if ( !WantsLagCompensationOnNextBot( player, cmd, pBot, pEntityTransmitBits ) )
+			continue;
+
+		// find the newest record at or before the target time
+		int record = -1;
+		int prevRecord = -1;
+		Vector prevOrg = pBot->GetLocalOrigin();
+		bool bLostTrack = false;
+
+		for ( int i = 0; i < track->m_count; i++ )
+		{
+			prevRecord = record;
+			record = track->Slot( i );
+
+			if ( ( track->m_vecOrigin[ record ] - prevOrg ).Length2DSqr() > m_flTeleportDistanceSqr )
+			{
+				bLostTrack = true;
+				break;
+			}
+
+			if ( track->m_flSimulationTime[ record ] <= flTargetTime )
+				break;
+
+			prevOrg = track->m_vecOrigin[ record ];
+		}
+
+		if ( bLostTrack || record < 0 )
+			continue;
+
+		Vector org = track->m_vecOrigin[ record ];
+		QAngle ang = track->m_vecAngles[ record ];
+		int sequence = track->m_masterSequence[ record ];
+		float cycle = track->m_masterCycle[ record ];
+		float frac = 0.0f;
+
+		if ( prevRecord >= 0 &&
+			 track->m_flSimulationTime[ record ] < flTargetTime &&
+			 track->m_flSimulationTime[ record ] < track->m_flSimulationTime[ prevRecord ] )
+		{
+			// interpolate between the two records around the target time
+			frac = ( flTargetTime - track->m_flSimulationTime[ record ] ) /
+				( track->m_flSimulationTime[ prevRecord ] - track->m_flSimulationTime[ record ] );
+
+			org = Lerp( frac, org, track->m_vecOrigin[ prevRecord ] );
+			ang = Lerp( frac, ang, track->m_vecAngles[ prevRecord ] );
+
+			if ( sequence == track->m_masterSequence[ prevRecord ] )
+			{
+				float prevCycle = track->m_masterCycle[ prevRecord ];
+				if ( cycle > prevCycle )
+				{
+					// wrapped around from 1 back to 0
+					prevCycle += 1.0f;
+				}
+
+				cycle = Lerp( frac, cycle, prevCycle );
+				if ( cycle >= 1.0f )
+				{
+					cycle -= 1.0f;
+				}
+			}
+		}
+
+		NextBotLagRestore &restore = m_NextBotRestore[ m_NextBotRestore.AddToTail() ];
+		restore.m_track = trackIndex;
+		restore.m_fFlags = LC_ANIMATION_CHANGED;
+		restore.m_flSimulationTime = pBot->GetSimulationTime();
+		restore.m_restoreSequence = pBot->GetSequence();
+		restore.m_restoreCycle = pBot->GetCycle();
+		CaptureNextBotAnim( pBot, &restore.m_restoreAnim );
+
+		if ( ( pBot->GetLocalAngles() - ang ).LengthSqr() > LAG_COMPENSATION_EPS_SQR )
+		{
+			restore.m_fFlags |= LC_ANGLES_CHANGED;
+			restore.m_vecRestoreAngles = pBot->GetLocalAngles();
+			restore.m_vecChangeAngles = ang;
+			pBot->SetLocalAngles( ang );
+		}
+
+		// Note, do origin at end since it causes a relink into the k/d tree
+		if ( ( pBot->GetLocalOrigin() - org ).LengthSqr() > LAG_COMPENSATION_EPS_SQR )
+		{
+			restore.m_fFlags |= LC_ORIGIN_CHANGED;
+			restore.m_vecRestoreOrigin = pBot->GetLocalOrigin();
+			restore.m_vecChangeOrigin = org;
+			pBot->SetLocalOrigin( org );
+		}
+
+		pBot->SetSequence( sequence );
+		pBot->SetCycle( cycle );
+		ApplyNextBotAnim( pBot, track->m_anim[ record ], ( frac > 0.0f ) ? &track->m_anim[ prevRecord ] : NULL, frac );
+
+		if ( sv_lagflushbonecache.GetBool() )
+			pBot->InvalidateBoneCache();
+
+		if ( sv_showlagcompensation.GetInt() == 1 )
+		{
+			pBot->DrawServerHitboxes( 4, true );
+		}
+	}
+
+	if ( m_NextBotRestore.Count() )
+	{
+		m_bNeedToRestore = true;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Put NextBots moved by BacktrackNextBots back where they were,
+// unless the game moved them in the meantime
+//-----------------------------------------------------------------------------
+void CLagCompensationManager::RestoreNextBots( void )
+{
+	FOR_EACH_VEC( m_NextBotRestore, it )
+	{
+		const NextBotLagRestore &restore = m_NextBotRestore[ it ];
+
+		CBaseCombatCharacter *pBot = m_NextBotTrack[ restore.m_track ].m_hEntity;
+		if ( !pBot )
+			continue;
+
+		if ( ( restore.m_fFlags & LC_ANGLES_CHANGED ) && pBot->GetLocalAngles() == restore.m_vecChangeAngles )
+		{
+			pBot->SetLocalAngles( restore.m_vecRestoreAngles );
+		}
+
+		if ( restore.m_fFlags & LC_ORIGIN_CHANGED )
+		{
+			Vector delta = pBot->GetLocalOrigin() - restore.m_vecChangeOrigin;
+
+			// If it moved really far, just leave it in the new spot
+			if ( delta.Length2DSqr() < m_flTeleportDistanceSqr )
+			{
+				pBot->SetLocalOrigin( restore.m_vecRestoreOrigin + delta );
+			}
+		}
+
+		pBot->SetSequence( restore.m_restoreSequence );
+		pBot->SetCycle( restore.m_restoreCycle );
+		ApplyNextBotAnim( pBot, restore.m_restoreAnim );
+		pBot->SetSimulationTime( restore.m_flSimulationTime );
+	}
+
+	m_NextBotRestore.RemoveAll();
+}
+#endif // NEXT_BOT
+
 // Called during player movement to set up/restore after lag compensation
 void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCmd *cmd )
 {
@@ -435,6 +890,10 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 		// Move other player back in time
 		BacktrackPlayer( pPlayer, TICKS_TO_TIME( targettick ) );
 	}
+
+#ifdef NEXT_BOT
+	BacktrackNextBots( player, cmd, TICKS_TO_TIME( targettick ), pEntityTransmitBits );
+#endif
 }
 
 void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTargetTime )
@@ -869,6 +1328,10 @@ void CLagCompensationManager::FinishLagCompensation( CBasePlayer *player )
 		}
 	}
 
+#ifdef NEXT_BOT
+	RestoreNextBots();
+#endif
+
 	m_isCurrentlyDoingCompensation = false;
 }
 
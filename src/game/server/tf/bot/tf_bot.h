@@ -8,6 +8,7 @@
 
 #include "Player/NextBotPlayer.h"
 #include "../nav_mesh/tf_nav_mesh.h"
+#include "../nav_mesh/tf_nav_cost_overlay.h"
 #include "tf_bot_vision.h"
 #include "tf_bot_body.h"
 #include "tf_bot_locomotion.h"
@@ -1013,6 +1014,10 @@ public:
 				{
 					dist *= sentryDangerCost;
 				}
+
+				// avoid areas under fire right now
+				const float hazardCost = 5.0f;
+				dist += dist * hazardCost * area->GetCostOverlay( TFNavDangerOverlay( m_me->GetTeamNumber() ) );
 			}
 
 			if ( m_me->IsPlayerClass( TF_CLASS_SPY ) )
@@ -1020,20 +1025,32 @@ public:
 				int enemyTeam = GetEnemyTeam( m_me->GetTeamNumber() );
 
 				// Since spies can get right up to enemy buildings, avoid them.
-				for ( int oit = 0; oit < IBaseObjectAutoList::AutoList().Count(); ++oit )
+				const float enemyBuildingCost = 10.0f;
+				if ( TheNavCostOverlay().IsActive() )
 				{
-					CBaseObject *enemyObj = static_cast< CBaseObject* >( IBaseObjectAutoList::AutoList()[ oit ] );
-
-					if ( ( enemyObj->ObjectType() == OBJ_SENTRYGUN ) &&
-						( enemyObj->GetTeamNumber() == enemyTeam ) )
+					int enemySentryCount = (int)area->GetCostOverlay( ( enemyTeam == TF_TEAM_RED ) ? TF_NAV_COST_RED_SENTRIES : TF_NAV_COST_BLUE_SENTRIES );
+					for ( int s = 0; s < enemySentryCount; ++s )
 					{
-						enemyObj->UpdateLastKnownArea();
+						// There is an enemy building in this area - avoid it as a spy.
+						dist *= enemyBuildingCost;
+					}
+				}
+				else
+				{
+					for ( int oit = 0; oit < IBaseObjectAutoList::AutoList().Count(); ++oit )
+					{
+						CBaseObject *enemyObj = static_cast< CBaseObject* >( IBaseObjectAutoList::AutoList()[ oit ] );
 
-						if ( enemyObj->GetLastKnownArea() == area )
+						if ( ( enemyObj->ObjectType() == OBJ_SENTRYGUN ) &&
+							( enemyObj->GetTeamNumber() == enemyTeam ) )
 						{
-							// There is an enemy building in this area - avoid it as a spy.
-							const float enemyBuildingCost = 10.0f;
-							dist *= enemyBuildingCost;
+							enemyObj->UpdateLastKnownArea();
+
+							if ( enemyObj->GetLastKnownArea() == area )
+							{
+								// There is an enemy building in this area - avoid it as a spy.
+								dist *= enemyBuildingCost;
+							}
 						}
 					}
 				}
@@ -10,6 +10,7 @@
 #include "bot/tf_bot.h"
 #include "nav_pathfind.h"
 #include "vscript_server.h"
+#include "NextBotUtil.h"
 
 ConVar tf_nav_show_incursion_distance( "tf_nav_show_incursion_distance", "0", FCVAR_CHEAT, "Display travel distances from current spawn room (1=red, 2=blue)" );
 ConVar tf_nav_show_bomb_target_distance( "tf_nav_show_bomb_target_distance", "0", FCVAR_CHEAT, "Display travel distances to bomb target (MvM mode)" );
@@ -412,6 +413,13 @@ CTFNavArea::CTFNavArea( void )
 	m_wanderCount = 0;
 	m_combatIntensity = 0.0f;
 	m_distanceToBombTarget = 0.0f;
+	for( int i=0; i<TF_NAV_COST_OVERLAY_COUNT; ++i )
+	{
+		m_costOverlay[i] = 0.0f;
+	}
+	m_costOverlayMarker = 0;
+	m_headroom = 0.0f;
+	m_headroomTimestamp = -1.0f;
 	m_TFMark = 0;
 	m_invasionSearchMarker = (unsigned int)-1;
 	m_hScriptInstance = NULL;
@@ -816,6 +824,25 @@ NavErrorType CTFNavArea::Load( CUtlBuffer &fileBuffer, unsigned int version, uns
 }
 
 
+//------------------------------------------------------------------------------------------------
+void CTFNavArea::SaveCompactData( CUtlBuffer &fileBuffer ) const
+{
+	CNavArea::SaveCompactData( fileBuffer );
+
+	unsigned int attributes = m_attributeFlags & TF_NAV_PERSISTENT_ATTRIBUTES;
+	fileBuffer.PutUnsignedInt( attributes );
+}
+
+
+//------------------------------------------------------------------------------------------------
+void CTFNavArea::LoadCompactData( CUtlBuffer &fileBuffer )
+{
+	CNavArea::LoadCompactData( fileBuffer );
+
+	m_attributeFlags = fileBuffer.GetUnsignedInt();
+}
+
+
 //--------------------------------------------------------------------------------------------------------
 unsigned int CTFNavArea::m_masterTFMark = 1;
 
@@ -901,6 +928,43 @@ float CTFNavArea::GetCombatIntensity( void ) const
 }
 
 
+//--------------------------------------------------------------------------------------------------------
+/**
+ * Return the height above the floor of this area that is clear of world geometry, clip brushes
+ * and props over its whole extent, up to two human heights. Only meaningful for flat areas.
+ * Measured with a single hull trace when asked for, and again once the measurement is a few
+ * seconds old, since brushes and props can move.
+ */
+float CTFNavArea::GetHeadroom( void ) const
+{
+	const float maxHeadroom = 2.0f * HumanHeight;
+	const float refreshInterval = 3.0f;
+
+	if ( m_headroomTimestamp >= 0.0f && gpGlobals->curtime - m_headroomTimestamp < refreshInterval )
+	{
+		return m_headroom;
+	}
+
+	m_headroomTimestamp = gpGlobals->curtime;
+
+	const Vector &nw = GetCorner( NORTH_WEST );
+	const Vector &se = GetCorner( SOUTH_EAST );
+
+	// sweep a thin slab covering the area upward from step height, so the floor itself isn't hit
+	Vector floor( 0.5f * ( nw.x + se.x ), 0.5f * ( nw.y + se.y ), MAX( nw.z, se.z ) + StepHeight );
+	Vector mins( nw.x - floor.x, nw.y - floor.y, 0.0f );
+	Vector maxs( se.x - floor.x, se.y - floor.y, 1.0f );
+
+	NextBotTraceFilterIgnoreActors filter( NULL, COLLISION_GROUP_NONE );
+	trace_t result;
+	UTIL_TraceHull( floor, floor + Vector( 0, 0, maxHeadroom - StepHeight ), mins, maxs, MASK_NPCSOLID | CONTENTS_PLAYERCLIP, &filter, &result );
+
+	m_headroom = result.startsolid ? 0.0f : StepHeight + result.fraction * ( maxHeadroom - StepHeight );
+
+	return m_headroom;
+}
+
+
 //--------------------------------------------------------------------------------------------------------
 // Invoked when combat happens in/near this area
 void CTFNavArea::OnCombat( void )
@@ -58,6 +58,28 @@ enum TFNavAttributeType
 	TF_NAV_PERSISTENT_ATTRIBUTES		= TF_NAV_SNIPER_SPOT | TF_NAV_SENTRY_SPOT | TF_NAV_NO_SPAWNING | TF_NAV_BLUE_SETUP_GATE | TF_NAV_RED_SETUP_GATE | TF_NAV_BLOCKED_AFTER_POINT_CAPTURE | TF_NAV_BLOCKED_UNTIL_POINT_CAPTURE | TF_NAV_BLUE_ONE_WAY_DOOR | TF_NAV_RED_ONE_WAY_DOOR | TF_NAV_DOOR_NEVER_BLOCKS | TF_NAV_DOOR_ALWAYS_BLOCKS | TF_NAV_UNBLOCKABLE | TF_NAV_WITH_SECOND_POINT | TF_NAV_WITH_THIRD_POINT | TF_NAV_WITH_FOURTH_POINT | TF_NAV_WITH_FIFTH_POINT | TF_NAV_RESCUE_CLOSET
 };
 
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Dynamic path costs, recomputed for every area once per tick by CTFNavCostOverlay
+ */
+enum TFNavCostOverlayType
+{
+	TF_NAV_COST_DANGER_TO_RED,				// hazards to movers on each team - sentry fire, area damage, etc
+	TF_NAV_COST_DANGER_TO_BLUE,
+	TF_NAV_COST_DANGER_TO_OTHER,			// hazards to everyone else, such as halloween mobs
+	TF_NAV_COST_CROWD,						// fraction of the area's floor taken up by mobs
+	TF_NAV_COST_RED_SENTRIES,				// number of sentry guns built in the area, for each team
+	TF_NAV_COST_BLUE_SENTRIES,
+
+	TF_NAV_COST_OVERLAY_COUNT
+};
+
+inline TFNavCostOverlayType TFNavDangerOverlay( int team )	// the danger layer for a mover on the given team
+{
+	return ( team == TF_TEAM_RED ) ? TF_NAV_COST_DANGER_TO_RED : ( team == TF_TEAM_BLUE ) ? TF_NAV_COST_DANGER_TO_BLUE : TF_NAV_COST_DANGER_TO_OTHER;
+}
+
+
 class CTFNavArea : public CNavArea
 {
 public:
@@ -77,6 +99,8 @@ public:
 
 	virtual void Save( CUtlBuffer &fileBuffer, unsigned int version ) const;								// (EXTEND)
 	virtual NavErrorType Load( CUtlBuffer &fileBuffer, unsigned int version, unsigned int subVersion );		// (EXTEND)
+	virtual void SaveCompactData( CUtlBuffer &fileBuffer ) const;											// (EXTEND)
+	virtual void LoadCompactData( CUtlBuffer &fileBuffer );													// (EXTEND)
 
 	float GetIncursionDistance( int team ) const;				// return travel distance from the team's active spawn room to this area, -1 for invalid
 	CTFNavArea *GetNextIncursionArea( int team ) const;			// return adjacent area with largest increase in incursion distance
@@ -113,6 +137,11 @@ public:
 	bool IsInCombat( void ) const;								// return true if this area has seen combat recently
 	float GetCombatIntensity( void ) const;						// 1 = in active combat, 0 = quiet
 
+	float GetCostOverlay( TFNavCostOverlayType type ) const		{ return m_costOverlay[ type ]; }
+	float GetMobPathPenalty( TFNavCostOverlayType danger ) const;	// extra travel cost per unit length for mobs to spread out around hazards and crowds
+
+	float GetHeadroom( void ) const;							// clear height above the whole area, ignoring actors - measured on demand, and again every few seconds
+
 	static void MakeNewTFMarker( void );
 	static void ResetTFMarker( void );
 	bool IsTFMarked( void ) const;
@@ -175,6 +204,7 @@ public:
 
 private:
 	friend class CTFNavMesh;
+	friend class CTFNavCostOverlay;
 
 	float m_distanceFromSpawnRoom[ TF_TEAM_COUNT ];
 	CUtlVector< CTFNavArea * > m_invasionAreaVector[ TF_TEAM_COUNT ];	// use our team as index to get list of areas the enemy is invading from
@@ -187,6 +217,12 @@ private:
 	float m_combatIntensity;
 	IntervalTimer m_combatTimer;
 
+	float m_costOverlay[ TF_NAV_COST_OVERLAY_COUNT ];
+	unsigned int m_costOverlayMarker;		// the overlay update that last changed our costs
+
+	mutable float m_headroom;
+	mutable float m_headroomTimestamp;		// when m_headroom was measured, -1 if never
+
 	static unsigned int m_masterTFMark;
 	unsigned int m_TFMark;					// this area's mark
 
@@ -218,6 +254,13 @@ inline CTFNavArea *ToNavArea( HSCRIPT hScript )
 	return ( IsValid( hScript ) ) ? (CTFNavArea *)g_pScriptVM->GetInstanceValue( hScript, GetScriptDescForClass(CTFNavArea) ) : NULL;
 }
 
+inline float CTFNavArea::GetMobPathPenalty( TFNavCostOverlayType danger ) const
+{
+	const float dangerPenalty = 5.0f;
+	const float crowdPenalty = 2.0f;
+	return dangerPenalty * GetCostOverlay( danger ) + crowdPenalty * GetCostOverlay( TF_NAV_COST_CROWD );
+}
+
 inline float CTFNavArea::GetTravelDistanceToBombTarget( void ) const
 {
 	return m_distanceToBombTarget;
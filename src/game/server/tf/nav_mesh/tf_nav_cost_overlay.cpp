@@ -0,0 +1,278 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+// tf_nav_cost_overlay.cpp
+// Dynamic per-area path costs
+//
+//=============================================================================//
+
+#include "cbase.h"
+#include "tf_nav_mesh.h"
+#include "tf_nav_cost_overlay.h"
+#include "tf_obj.h"
+#include "tf_obj_sentrygun.h"
+#include "player_vs_environment/tf_melee_mob.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar tf_nav_cost_overlay( "tf_nav_cost_overlay", "1", FCVAR_CHEAT, "Recompute dynamic path costs (sentry fire, hazards, mob crowds) each tick" );
+ConVar tf_nav_cost_overlay_debug( "tf_nav_cost_overlay_debug", "0", FCVAR_CHEAT, "Draw the areas with dynamic path costs" );
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Singleton accessor.
+ */
+static CTFNavCostOverlay s_navCostOverlay;
+
+CTFNavCostOverlay &TheNavCostOverlay( void )
+{
+	return s_navCostOverlay;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+CTFNavCostOverlay::CTFNavCostOverlay( void ) : CAutoGameSystemPerFrame( "CTFNavCostOverlay" )
+{
+	m_marker = 0;
+	m_isActive = false;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CTFNavCostOverlay::Reset( void )
+{
+	ClearCosts();
+	m_hazardVector.RemoveAll();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CTFNavCostOverlay::AddHazard( int sourceTeam, const Vector &center, float radius, float danger, float duration )
+{
+	Hazard hazard;
+	hazard.m_sourceTeam = sourceTeam;
+	hazard.m_center = center;
+	hazard.m_radius = radius;
+	hazard.m_danger = danger;
+	hazard.m_expireTime = gpGlobals->curtime + duration;
+
+	m_hazardVector.AddToTail( hazard );
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Zero the costs of the areas changed by the last update
+ */
+void CTFNavCostOverlay::ClearCosts( void )
+{
+	FOR_EACH_VEC( m_changedAreaIDs, it )
+	{
+		// the area may have been deleted by editing since
+		CTFNavArea *area = (CTFNavArea *)TheNavMesh->GetNavAreaByID( m_changedAreaIDs[ it ] );
+		if ( area )
+		{
+			for( int i=0; i<TF_NAV_COST_OVERLAY_COUNT; ++i )
+			{
+				area->m_costOverlay[i] = 0.0f;
+			}
+		}
+	}
+
+	m_changedAreaIDs.RemoveAll();
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CTFNavCostOverlay::AddCost( CTFNavArea *area, TFNavCostOverlayType type, float cost )
+{
+	if ( area->m_costOverlayMarker != m_marker )
+	{
+		area->m_costOverlayMarker = m_marker;
+		m_changedAreaIDs.AddToTail( area->GetID() );
+	}
+
+	area->m_costOverlay[ type ] += cost;
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Add danger to everyone in the area who is not on 'sourceTeam'
+ */
+void CTFNavCostOverlay::AddDanger( CTFNavArea *area, int sourceTeam, float danger )
+{
+	TFNavCostOverlayType safeLayer = TFNavDangerOverlay( sourceTeam );
+
+	for( int type = TF_NAV_COST_DANGER_TO_RED; type <= TF_NAV_COST_DANGER_TO_OTHER; ++type )
+	{
+		if ( sourceTeam == TEAM_ANY || type != safeLayer )
+		{
+			AddCost( area, (TFNavCostOverlayType)type, danger );
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Recompute the costs of all areas
+ */
+void CTFNavCostOverlay::Update( void )
+{
+	VPROF_BUDGET( "CTFNavCostOverlay::Update", "NextBot" );
+
+	ClearCosts();
+
+	m_isActive = false;
+
+	if ( !tf_nav_cost_overlay.GetBool() || !TheNavMesh->IsLoaded() || TheNavMesh->IsGenerating() )
+		return;
+
+	m_isActive = true;
+
+	++m_marker;
+	if ( m_marker == 0 )
+	{
+		++m_marker;
+	}
+
+	AddSentryCosts();
+	AddHazardCosts();
+	AddCrowdCosts();
+
+	if ( tf_nav_cost_overlay_debug.GetBool() )
+	{
+		FOR_EACH_VEC( m_changedAreaIDs, it )
+		{
+			CTFNavArea *area = (CTFNavArea *)TheNavMesh->GetNavAreaByID( m_changedAreaIDs[ it ] );
+
+			float danger = MAX( area->GetCostOverlay( TF_NAV_COST_DANGER_TO_RED ), area->GetCostOverlay( TF_NAV_COST_DANGER_TO_BLUE ) );
+			danger = MAX( danger, area->GetCostOverlay( TF_NAV_COST_DANGER_TO_OTHER ) );
+
+			int red = (int)MIN( 255.0f * danger, 255.0f );
+			int blue = (int)MIN( 255.0f * area->GetCostOverlay( TF_NAV_COST_CROWD ), 255.0f );
+			area->DrawFilled( red, 0, blue, 100, NDEBUG_PERSIST_TILL_NEXT_SERVER, true );
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Collects the areas a sentry gun can shoot into
+ */
+class CollectSentryFireAreas
+{
+public:
+	CollectSentryFireAreas( const Vector &sentryPos, CUtlVector< CTFNavArea * > *areaVector ) : m_sentryPos( sentryPos ), m_areaVector( areaVector ) { }
+
+	bool operator() ( CNavArea *area )
+	{
+		if ( ( area->GetCenter() - m_sentryPos ).IsLengthLessThan( SENTRY_MAX_RANGE ) )
+		{
+			m_areaVector->AddToTail( (CTFNavArea *)area );
+		}
+		return true;
+	}
+
+	const Vector &m_sentryPos;
+	CUtlVector< CTFNavArea * > *m_areaVector;
+};
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Count the sentry guns in each area, and mark the areas each active sentry gun is firing into as dangerous.
+ * Spies keep away from every sentry gun, so all of them are counted, even those still being placed,
+ * built, or sapped.
+ */
+void CTFNavCostOverlay::AddSentryCosts( void )
+{
+	CUtlVector< CTFNavArea * > fireAreaVector;
+
+	for( int i=0; i<IBaseObjectAutoList::AutoList().Count(); ++i )
+	{
+		CBaseObject *object = static_cast< CBaseObject * >( IBaseObjectAutoList::AutoList()[i] );
+
+		if ( object->ObjectType() != OBJ_SENTRYGUN )
+			continue;
+
+		object->UpdateLastKnownArea();
+		CTFNavArea *sentryArea = (CTFNavArea *)object->GetLastKnownArea();
+		if ( !sentryArea )
+			continue;
+
+		AddCost( sentryArea, ( object->GetTeamNumber() == TF_TEAM_RED ) ? TF_NAV_COST_RED_SENTRIES : TF_NAV_COST_BLUE_SENTRIES, 1.0f );
+
+		if ( object->IsPlacing() || object->IsBuilding() || object->IsDisabled() )
+			continue;
+
+		CObjectSentrygun *sentry = static_cast< CObjectSentrygun * >( object );
+		if ( !sentry->GetTarget() )
+			continue;
+
+		fireAreaVector.RemoveAll();
+		fireAreaVector.AddToTail( sentryArea );
+
+		CollectSentryFireAreas collect( sentry->GetAbsOrigin(), &fireAreaVector );
+		sentryArea->ForAllPotentiallyVisibleAreas( collect );
+
+		FOR_EACH_VEC( fireAreaVector, it )
+		{
+			AddDanger( fireAreaVector[ it ], sentry->GetTeamNumber(), 1.0f );
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+void CTFNavCostOverlay::AddHazardCosts( void )
+{
+	FOR_EACH_VEC_BACK( m_hazardVector, it )
+	{
+		const Hazard &hazard = m_hazardVector[ it ];
+
+		if ( hazard.m_expireTime < gpGlobals->curtime )
+		{
+			m_hazardVector.FastRemove( it );
+			continue;
+		}
+
+		CTFAreaCollector collect;
+		TheNavMesh->ForAllAreasInRadius( collect, hazard.m_center, hazard.m_radius );
+
+		FOR_EACH_VEC( collect.m_vector, cit )
+		{
+			AddDanger( collect.m_vector[ cit ], hazard.m_sourceTeam, hazard.m_danger );
+		}
+	}
+}
+
+
+//--------------------------------------------------------------------------------------------------------------
+/**
+ * Add the floor space taken up by each melee mob to the area it is in
+ */
+void CTFNavCostOverlay::AddCrowdCosts( void )
+{
+	for( int i=0; i<ITFMeleeMobAutoList::AutoList().Count(); ++i )
+	{
+		CTFMeleeMob *mob = static_cast< CTFMeleeMob * >( ITFMeleeMobAutoList::AutoList()[i] );
+
+		if ( !mob->IsAlive() || mob->IsMarkedForDeletion() )
+			continue;
+
+		CTFNavArea *area = (CTFNavArea *)mob->GetLastKnownArea();
+		if ( !area )
+			continue;
+
+		float areaSize = area->GetSizeX() * area->GetSizeY();
+		if ( areaSize < 1.0f )
+			continue;
+
+		float width = mob->GetBodyInterface()->GetHullWidth();
+
+		AddCost( area, TF_NAV_COST_CROWD, width * width / areaSize );
+	}
+}
@@ -0,0 +1,67 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+// tf_nav_cost_overlay.h
+// Dynamic per-area path costs
+//
+// Once per tick, before anything thinks, the costs of every area touched by
+// a sentry gun, a hazard or a crowd of mobs are recomputed into the area's
+// cost overlay (see TFNavCostOverlayType). Path cost functors then read the
+// precomputed value instead of scanning game state for each area they visit.
+//
+//=============================================================================//
+
+#ifndef TF_NAV_COST_OVERLAY_H
+#define TF_NAV_COST_OVERLAY_H
+
+#include "tf_nav_area.h"
+
+
+//--------------------------------------------------------------------------------------------------------------
+class CTFNavCostOverlay : public CAutoGameSystemPerFrame
+{
+public:
+	CTFNavCostOverlay( void );
+
+	virtual void LevelShutdownPreEntity( void )		{ Reset(); }
+	virtual void FrameUpdatePreEntityThink( void )	{ Update(); }
+
+	/**
+	 * Add danger to the areas within 'radius' of 'center' for 'duration' seconds.
+	 * Movers on 'sourceTeam' are not hurt by it - use TEAM_ANY for hazards to everyone.
+	 * A 'danger' of 1 is about as bad as standing in front of a firing sentry gun.
+	 */
+	void AddHazard( int sourceTeam, const Vector &center, float radius, float danger, float duration );
+
+	void Reset( void );								// clear all costs and hazards
+
+	bool IsActive( void ) const						{ return m_isActive; }	// false if the costs weren't computed this tick, and are all zero
+
+private:
+	void Update( void );
+	void ClearCosts( void );
+	void AddCost( CTFNavArea *area, TFNavCostOverlayType type, float cost );
+	void AddDanger( CTFNavArea *area, int sourceTeam, float danger );
+
+	void AddSentryCosts( void );
+	void AddHazardCosts( void );
+	void AddCrowdCosts( void );
+
+	struct Hazard
+	{
+		int m_sourceTeam;
+		Vector m_center;
+		float m_radius;
+		float m_danger;
+		float m_expireTime;
+	};
+	CUtlVector< Hazard > m_hazardVector;
+
+	CUtlVector< unsigned int > m_changedAreaIDs;	// areas with nonzero costs
+	unsigned int m_marker;
+	bool m_isActive;
+};
+
+// singleton accessor
+extern CTFNavCostOverlay &TheNavCostOverlay( void );
+
+
+#endif // TF_NAV_COST_OVERLAY_H
@@ -5,6 +5,7 @@
 
 #include "cbase.h"
 #include "tf_nav_mesh.h"
+#include "nav_hierarchy.h"
 #include "bot/tf_bot.h"
 #include "bot/tf_bot_manager.h"
 #include "tf_obj.h"
@@ -17,6 +18,8 @@
 #include "props.h"
 #include "filters.h"
 #include "NextBotUtil.h"
+#include "Path/NextBotPathCache.h"
+#include "player_vs_environment/tf_mob_flow_field.h"
 #include "doors.h"
 #include "props.h"
 #include "BasePropDoor.h"
@@ -629,6 +632,10 @@ void CTFNavMesh::OnBlockedAreasChanged( void )
 {
 	VPROF_BUDGET( "CTFNavMesh::OnBlockedAreasChanged", "NextBot" );
 
+	// cached paths and flow fields may lead through areas that are now blocked
+	TheNextBotPathCache().Invalidate();
+	TheMobFlowFields().Reset();
+
 	if ( TheNextBots().GetNextBotCount() == 0 )
 		return;
 
@@ -1402,7 +1409,21 @@ unsigned int CTFNavMesh::GetSubVersionNumber( void ) const
 {
 	// 1: initial implementation
 	// 2: added TF-specific attribute flags
-	return 2;
+	// 3: added the nav hierarchy
+	return 3;
+}
+
+
+//-------------------------------------------------------------------------
+/**
+ * Store Navigation Mesh to a file
+ */
+bool CTFNavMesh::Save( void ) const
+{
+	// the mesh may have been edited since the hierarchy was built
+	TheNavHierarchy().Build();
+
+	return CNavMesh::Save();
 }
 
 
@@ -1412,7 +1433,8 @@ unsigned int CTFNavMesh::GetSubVersionNumber( void ) const
  */
 void CTFNavMesh::SaveCustomData( CUtlBuffer &fileBuffer ) const
 {
-
+	// also written to the compact file after a load, so store the hierarchy as it is
+	TheNavHierarchy().Save( fileBuffer );
 }
 
 
@@ -1422,7 +1444,11 @@ void CTFNavMesh::SaveCustomData( CUtlBuffer &fileBuffer ) const
  */
 void CTFNavMesh::LoadCustomData( CUtlBuffer &fileBuffer, unsigned int subVersion )
 {
-
+	if ( subVersion >= 3 )
+	{
+		// bound to the areas once they are all loaded - older meshes build it then instead
+		TheNavHierarchy().Load( fileBuffer );
+	}
 }
 
 
@@ -41,9 +41,12 @@ public:
 
 	virtual void Update( void );										// invoked on each game frame
 
+	virtual bool Save( void ) const;									// store Navigation Mesh to a file
+
 	virtual unsigned int GetSubVersionNumber( void ) const;									// returns sub-version number of data format used by derived classes
 	virtual void SaveCustomData( CUtlBuffer &fileBuffer ) const;							// store custom mesh data for derived classes
 	virtual void LoadCustomData( CUtlBuffer &fileBuffer, unsigned int subVersion );			// load custom mesh data for derived classes
+	virtual bool IsCompactFileSupported( void ) const { return true; }						// CTFNavArea implements SaveCompactData()
 
 	virtual void OnServerActivate( void );								// (EXTEND) invoked when server loads a new map
 	virtual void OnRoundRestart( void );								// invoked when a game round restarts
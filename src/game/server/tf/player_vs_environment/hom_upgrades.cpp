@@ -4,10 +4,403 @@
 #include "tf_shareddefs.h"
 #include "tf_fx.h"
 #include "tf_gamerules.h"
+#include "baseprojectile.h"
+#include "collisionutils.h"
+#include "KeyValues.h"
+#include "filesystem.h"
+#include "nav_mesh/tf_nav_cost_overlay.h"
 
 #define HOM_MAX_EXPLOSION_EFFECTS 32
 #define HOM_EXPLOSION_DAMAGE 50.0f
 #define HOM_EXPLOSION_RADIUS 100.0f
+#define HOM_EXPLOSION_FALLOFF ( HOM_EXPLOSION_DAMAGE / HOM_EXPLOSION_RADIUS )	// matches CTFRadiusDamageInfo::CalculateFalloff()
+#define HOM_EXPLOSION_CLUSTER_EXTENT 512.0f		// widest span of explosion centers covered by a single entity query
+#define HOM_EXPLOSION_QUERY_MAX 1024
+#define HOM_EXPLOSION_HAZARD_DURATION 2.0f		// how long mobs path around a cluster of explosions
+
+ConVar tf_hom_explosion_max_rounds( "tf_hom_explosion_max_rounds", "8", FCVAR_CHEAT, "Max rounds of chained on-kill explosions resolved per frame, the rest carry over to the next frame" );
+
+//-----------------------------------------------------------------------------
+// On-kill explosions are not applied when the mob dies. They are queued and
+// resolved once per frame: explosions from the same player that overlap are
+// merged into a cluster, each cluster does a single entity query, and every
+// entity it touches takes the summed damage of the explosions that reach it
+// in one hit. Mobs killed by a round queue the next round instead of recursing.
+//-----------------------------------------------------------------------------
+class CHomExplosionQueue : public CAutoGameSystemPerFrame
+{
+public:
+    CHomExplosionQueue( void ) : CAutoGameSystemPerFrame( "CHomExplosionQueue" ) { }
+
+    virtual void LevelShutdownPreEntity( void ) { m_queue.RemoveAll(); }
+    virtual void FrameUpdatePostEntityThink( void );
+
+    void AddExplosion( CTFPlayer *pAttacker, const Vector &vecPos );
+
+private:
+    struct Explosion_t
+    {
+        CHandle< CTFPlayer > m_hAttacker;
+        Vector m_vecPos;
+    };
+
+    struct Cluster_t
+    {
+        CHandle< CTFPlayer > m_hAttacker;
+        Vector m_vecMins, m_vecMaxs;		// bounds of the member explosion centers
+        CUtlVector< int > m_members;
+    };
+
+    void BuildClusters( void );
+    void ResolveCluster( const Cluster_t &cluster );
+    float GetDamageToEntity( const Cluster_t &cluster, CBaseEntity *pEntity, const Vector **ppSource ) const;
+
+    CUtlVector< Explosion_t > m_queue;			// explosions waiting for the next round
+    CUtlVector< Explosion_t > m_round;			// explosions being resolved this round
+    CUtlVector< Cluster_t > m_clusters;
+};
+
+static CHomExplosionQueue s_homExplosions;
+
+void CHomExplosionQueue::AddExplosion( CTFPlayer *pAttacker, const Vector &vecPos )
+{
+    int i = m_queue.AddToTail();
+    m_queue[i].m_hAttacker = pAttacker;
+    m_queue[i].m_vecPos = vecPos;
+}
+
+void CHomExplosionQueue::FrameUpdatePostEntityThink( void )
+{
+    VPROF_BUDGET( "CHomExplosionQueue::FrameUpdatePostEntityThink", "Game" );
+
+    for ( int round = 0; round < tf_hom_explosion_max_rounds.GetInt() && m_queue.Count(); round++ )
+    {
+        // anything killed this round queues its explosions for the next one
+        m_round.Swap( m_queue );
+        m_queue.RemoveAll();
+
+        BuildClusters();
+
+        FOR_EACH_VEC( m_clusters, it )
+        {
+            ResolveCluster( m_clusters[it] );
+        }
+
+        m_round.RemoveAll();
+    }
+}
+
+// Greedily group the round's explosions per attacker, growing a cluster while the new
+// explosion overlaps its bounds and the cluster stays small enough to query at once
+void CHomExplosionQueue::BuildClusters( void )
+{
+    const Vector vecReach( 2.0f * HOM_EXPLOSION_RADIUS, 2.0f * HOM_EXPLOSION_RADIUS, 2.0f * HOM_EXPLOSION_RADIUS );
+
+    m_clusters.RemoveAll();
+
+    FOR_EACH_VEC( m_round, i )
+    {
+        CTFPlayer *pAttacker = m_round[i].m_hAttacker;
+        if ( !pAttacker )
+            continue;
+
+        const Vector &vecPos = m_round[i].m_vecPos;
+
+        Cluster_t *pCluster = NULL;
+        FOR_EACH_VEC( m_clusters, c )
+        {
+            Cluster_t &cluster = m_clusters[c];
+            if ( cluster.m_hAttacker != pAttacker )
+                continue;
+
+            if ( !IsPointInBox( vecPos, cluster.m_vecMins - vecReach, cluster.m_vecMaxs + vecReach ) )
+                continue;
+
+            Vector vecMins = cluster.m_vecMins.Min( vecPos );
+            Vector vecMaxs = cluster.m_vecMaxs.Max( vecPos );
+            Vector vecSpan = vecMaxs - vecMins;
+            if ( vecSpan.x > HOM_EXPLOSION_CLUSTER_EXTENT || vecSpan.y > HOM_EXPLOSION_CLUSTER_EXTENT || vecSpan.z > HOM_EXPLOSION_CLUSTER_EXTENT )
+                continue;
+
+            cluster.m_vecMins = vecMins;
+            cluster.m_vecMaxs = vecMaxs;
+            pCluster = &cluster;
+            break;
+        }
+
+        if ( !pCluster )
+        {
+            pCluster = &m_clusters[ m_clusters.AddToTail() ];
+            pCluster->m_hAttacker = pAttacker;
+            pCluster->m_vecMins = vecPos;
+            pCluster->m_vecMaxs = vecPos;
+        }
+
+        pCluster->m_members.AddToTail( i );
+    }
+}
+
+// Sum the falloff damage of every cluster explosion that reaches 'pEntity', returning the closest one as the source
+float CHomExplosionQueue::GetDamageToEntity( const Cluster_t &cluster, CBaseEntity *pEntity, const Vector **ppSource ) const
+{
+    const float flRadiusSqr = HOM_EXPLOSION_RADIUS * HOM_EXPLOSION_RADIUS;
+
+    float flDamage = 0.0f;
+    float flClosest = FLT_MAX;
+    *ppSource = NULL;
+
+    FOR_EACH_VEC( cluster.m_members, it )
+    {
+        const Vector &vecSrc = m_round[ cluster.m_members[it] ].m_vecPos;
+
+        // same box-then-distance test as CTFGameRules::RadiusDamage()
+        Vector vecNearest;
+        pEntity->CollisionProp()->CalcNearestPoint( vecSrc, &vecNearest );
+        float flNearestSqr = ( vecSrc - vecNearest ).LengthSqr();
+        if ( flNearestSqr > flRadiusSqr )
+            continue;
+
+        float flDistance;
+        if ( pEntity->IsPlayer() )
+        {
+            // use whichever is closer, absorigin or worldspacecenter
+            flDistance = MIN( ( vecSrc - pEntity->WorldSpaceCenter() ).Length(), ( vecSrc - pEntity->GetAbsOrigin() ).Length() );
+        }
+        else
+        {
+            flDistance = FastSqrt( flNearestSqr );
+        }
+
+        flDamage += RemapValClamped( flDistance, 0.0f, HOM_EXPLOSION_RADIUS, HOM_EXPLOSION_DAMAGE, HOM_EXPLOSION_DAMAGE * HOM_EXPLOSION_FALLOFF );
+
+        if ( flDistance < flClosest )
+        {
+            flClosest = flDistance;
+            *ppSource = &vecSrc;
+        }
+    }
+
+    return flDamage;
+}
+
+void CHomExplosionQueue::ResolveCluster( const Cluster_t &cluster )
+{
+    CTFPlayer *pAttacker = cluster.m_hAttacker;
+    if ( !pAttacker )
+        return;
+
+    // chained explosions tend to keep going off in the same place - steer mobs around it for a while
+    Vector vecCenter = 0.5f * ( cluster.m_vecMins + cluster.m_vecMaxs );
+    float flHazardRadius = 0.5f * ( cluster.m_vecMaxs - cluster.m_vecMins ).Length() + HOM_EXPLOSION_RADIUS;
+    TheNavCostOverlay().AddHazard( pAttacker->GetTeamNumber(), vecCenter, flHazardRadius, 1.0f, HOM_EXPLOSION_HAZARD_DURATION );
+
+    // one query for the whole cluster
+    const Vector vecRadius( HOM_EXPLOSION_RADIUS, HOM_EXPLOSION_RADIUS, HOM_EXPLOSION_RADIUS );
+    CBaseEntity *pList[ HOM_EXPLOSION_QUERY_MAX ];
+    int nCount = UTIL_EntitiesInBox( pList, HOM_EXPLOSION_QUERY_MAX, cluster.m_vecMins - vecRadius, cluster.m_vecMaxs + vecRadius, 0 );
+
+    for ( int i = 0; i < nCount; i++ )
+    {
+        CBaseEntity *pEntity = pList[i];
+        if ( !pEntity || pEntity->m_takedamage == DAMAGE_NO || pEntity->IsMarkedForDeletion() )
+            continue;
+
+        // already killed by an earlier cluster
+        if ( pEntity->MyCombatCharacterPointer() && !pEntity->IsAlive() )
+            continue;
+
+        const Vector *pvecSrc;
+        float flDamage = GetDamageToEntity( cluster, pEntity, &pvecSrc );
+        if ( flDamage <= 0.0f )
+            continue;
+
+        // one line of sight check from the closest explosion stands in for all of them
+        Vector vecSpot = pEntity->BodyTarget( *pvecSrc, false );
+        CTraceFilterIgnorePlayers filterPlayers( pAttacker, COLLISION_GROUP_PROJECTILE );
+        CTraceFilterIgnoreProjectiles filterProjectiles( pAttacker, COLLISION_GROUP_PROJECTILE );
+        CTraceFilterChain filter( &filterPlayers, &filterProjectiles );
+
+        trace_t tr;
+        UTIL_TraceLine( *pvecSrc, vecSpot, MASK_RADIUS_DAMAGE, &filter, &tr );
+        if ( tr.startsolid && tr.m_pEnt && tr.m_pEnt != pEntity )
+        {
+            // an explosion inside a wall or displacement doesn't reach through it
+            if ( tr.m_pEnt->IsWorld() )
+                continue;
+
+            // started inside some other entity, look again past it like CTFRadiusDamageInfo::ApplyToEntity
+            filterPlayers.SetPassEntity( tr.m_pEnt );
+            UTIL_TraceLine( *pvecSrc, vecSpot, MASK_RADIUS_DAMAGE, &filter, &tr );
+        }
+
+        // If we don't trace the whole way to the target, and we didn't hit the target entity, we're blocked
+        if ( tr.m_pEnt != pEntity && ( tr.startsolid || tr.fraction != 1.0f ) )
+            continue;
+
+        Vector vecSrc = *pvecSrc;
+        Vector vecDir = vecSpot - vecSrc;
+        VectorNormalize( vecDir );
+
+        int iDmgType = DMG_BLAST | DMG_USEDISTANCEMOD;
+        CTakeDamageInfo info( pAttacker, pAttacker, NULL, vec3_origin, vecSrc, flDamage, iDmgType, TF_DMG_CUSTOM_PUMPKIN_BOMB, &vecSrc );
+        info.SetForceFriendlyFire( true );
+        CalculateExplosiveDamageForce( &info, vecDir, vecSrc );
+
+        pEntity->TakeDamage( info );
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Upgrade definitions. The built-in upgrades are always defined, in HomUpgrade_t
+// order; scripts/hom_upgrades.txt can retune them and add new upgrade types, e.g.
+//
+//  "HomUpgrades"
+//  {
+//      "damage_10"     { "damage_dealt" "1.1" }
+//      "glass_cannon"  { "damage_dealt" "1.25"  "damage_taken" "1.25" }
+//  }
+//-----------------------------------------------------------------------------
+static const char *s_homUpgradeStatNames[HOM_STAT_COUNT] =
+{
+    "max_health",
+    "damage_dealt",
+    "damage_taken",
+    "explosions_on_kill",
+};
+
+// stats that are scaled by each level rather than added to
+static const bool s_homUpgradeStatIsMultiplier[HOM_STAT_COUNT] =
+{
+    true,
+    true,
+    true,
+    false,
+};
+
+static CUtlVector< HomUpgradeDef_t > s_homUpgradeDefs;
+static bool s_bHomUpgradeDefsLoaded = false;
+
+static void AddUpgradeDef( const char *pszName, HomUpgradeStat_t stat, float flValue )
+{
+    HomUpgradeDef_t &def = s_homUpgradeDefs[ s_homUpgradeDefs.AddToTail() ];
+    def.m_name = pszName;
+
+    HomUpgradeEffect_t effect = { stat, flValue };
+    def.m_effects.AddToTail( effect );
+}
+
+void HomUpgradeStats_t::Reset( void )
+{
+    for ( int i = 0; i < HOM_STAT_COUNT; i++ )
+    {
+        m_flValue[i] = s_homUpgradeStatIsMultiplier[i] ? 1.0f : 0.0f;
+    }
+}
+
+void CHomUpgradeHandler::LoadUpgradeDefs( void )
+{
+    s_bHomUpgradeDefsLoaded = true;
+    s_homUpgradeDefs.RemoveAll();
+
+    AddUpgradeDef( "health_10", HOM_STAT_MAX_HEALTH, 1.10f );
+    AddUpgradeDef( "damage_10", HOM_STAT_DAMAGE_DEALT, 1.10f );
+    AddUpgradeDef( "damage_resist_10", HOM_STAT_DAMAGE_TAKEN, 0.9f );
+    AddUpgradeDef( "explode_on_kill", HOM_STAT_EXPLOSIONS_ON_KILL, 1.0f );
+    Assert( s_homUpgradeDefs.Count() == UPGRADE_COUNT );
+
+    KeyValues *pKV = new KeyValues( "HomUpgrades" );
+    if ( !pKV->LoadFromFile( filesystem, "scripts/hom_upgrades.txt", "GAME" ) )
+    {
+        // no script, built-ins only
+        pKV->deleteThis();
+        return;
+    }
+
+    FOR_EACH_TRUE_SUBKEY( pKV, pUpgradeKV )
+    {
+        int upgrade = FindUpgrade( pUpgradeKV->GetName() );
+        if ( upgrade < 0 )
+        {
+            if ( s_homUpgradeDefs.Count() >= HOM_MAX_UPGRADES )
+            {
+                Warning( "scripts/hom_upgrades.txt: too many upgrades, ignoring '%s'\n", pUpgradeKV->GetName() );
+                continue;
+            }
+
+            upgrade = s_homUpgradeDefs.AddToTail();
+            s_homUpgradeDefs[upgrade].m_name = pUpgradeKV->GetName();
+        }
+
+        HomUpgradeDef_t &def = s_homUpgradeDefs[upgrade];
+        def.m_effects.RemoveAll();
+
+        FOR_EACH_VALUE( pUpgradeKV, pEffectKV )
+        {
+            int stat;
+            for ( stat = 0; stat < HOM_STAT_COUNT; stat++ )
+            {
+                if ( FStrEq( pEffectKV->GetName(), s_homUpgradeStatNames[stat] ) )
+                    break;
+            }
+
+            if ( stat == HOM_STAT_COUNT )
+            {
+                Warning( "scripts/hom_upgrades.txt: unknown stat '%s' in upgrade '%s'\n", pEffectKV->GetName(), pUpgradeKV->GetName() );
+                continue;
+            }
+
+            HomUpgradeEffect_t effect = { (HomUpgradeStat_t)stat, pEffectKV->GetFloat() };
+            def.m_effects.AddToTail( effect );
+        }
+    }
+
+    pKV->deleteThis();
+}
+
+void CHomUpgradeHandler::ReloadUpgradeDefs( void )
+{
+    LoadUpgradeDefs();
+
+    // the cached stats of everyone were folded from the old defs
+    for ( int i = 1; i <= gpGlobals->maxClients; i++ )
+    {
+        CTFPlayer *pPlayer = ToTFPlayer( UTIL_PlayerByIndex( i ) );
+        if ( pPlayer )
+        {
+            RecomputeUpgradeStats( pPlayer );
+        }
+    }
+}
+
+int CHomUpgradeHandler::GetUpgradeCount( void )
+{
+    if ( !s_bHomUpgradeDefsLoaded )
+        LoadUpgradeDefs();
+
+    return s_homUpgradeDefs.Count();
+}
+
+const HomUpgradeDef_t *CHomUpgradeHandler::GetUpgradeDef( int upgrade )
+{
+    if ( upgrade < 0 || upgrade >= GetUpgradeCount() )
+        return NULL;
+
+    return &s_homUpgradeDefs[upgrade];
+}
+
+int CHomUpgradeHandler::FindUpgrade( const char *pszName )
+{
+    if ( !s_bHomUpgradeDefsLoaded )
+        LoadUpgradeDefs();
+
+    FOR_EACH_VEC( s_homUpgradeDefs, i )
+    {
+        if ( FStrEq( s_homUpgradeDefs[i].m_name.Get(), pszName ) )
+            return i;
+    }
+
+    return -1;
+}
 
 void GiveUpgrade( const CCommand &args )
 {
@@ -16,56 +409,116 @@ void GiveUpgrade( const CCommand &args )
 	if ( !pPlayer )
 		return;
 
-	HomUpgrade_t upgradeType = HomUpgrade_t( ( args.ArgC() > 1 ) ? atoi(args[1]) : 0 );
+    // by index or by name
+    int upgradeType = 0;
+    if ( args.ArgC() > 1 )
+    {
+        upgradeType = V_isdigit( args[1][0] ) ? atoi( args[1] ) : CHomUpgradeHandler::FindUpgrade( args[1] );
+    }
 
 	CHomUpgradeHandler::ApplyUpgrade( pPlayer, upgradeType );
 }
 
 ConCommand cc_give_upgrade( "give_upgrade", GiveUpgrade, 0, FCVAR_CHEAT );
 
-void CHomUpgradeHandler::ApplyUpgrade( CTFPlayer *pPlayer, HomUpgrade_t upgrade )
+CON_COMMAND_F( hom_upgrades_reload, "Reload scripts/hom_upgrades.txt", FCVAR_CHEAT )
 {
-    pPlayer->m_upgrades[upgrade]++;
-    pPlayer->m_iUpgradeCount++;
+    CHomUpgradeHandler::ReloadUpgradeDefs();
+}
 
-    if ( upgrade == HomUpgrade_t::HEALTH_10 )
+static void FoldUpgradeEffect( HomUpgradeStats_t &stats, const HomUpgradeEffect_t &effect )
+{
+    if ( s_homUpgradeStatIsMultiplier[effect.m_stat] )
+    {
+        stats.m_flValue[effect.m_stat] *= effect.m_flValue;
+    }
+    else
     {
-        float maxHealth = pPlayer->GetMaxHealth();
-        maxHealth += maxHealth * 0.10f;
+        stats.m_flValue[effect.m_stat] += effect.m_flValue;
+    }
+}
+
+// Rebuild the player's combined stats from the levels they own, after the defs changed
+void CHomUpgradeHandler::RecomputeUpgradeStats( CTFPlayer *pPlayer )
+{
+    HomUpgradeStats_t &stats = pPlayer->m_upgradeStats;
+    float flOldHealthScale = stats.Get( HOM_STAT_MAX_HEALTH );
+
+    stats.Reset();
+
+    int upgradeCount = MIN( GetUpgradeCount(), HOM_MAX_UPGRADES );
+    for ( int upgrade = 0; upgrade < upgradeCount; upgrade++ )
+    {
+        const HomUpgradeDef_t &def = s_homUpgradeDefs[upgrade];
+        for ( int level = 0; level < pPlayer->m_upgrades[upgrade]; level++ )
+        {
+            FOR_EACH_VEC( def.m_effects, i )
+            {
+                FoldUpgradeEffect( stats, def.m_effects[i] );
+            }
+        }
+    }
+
+    // max health was scaled as each level was bought, rescale it to the new total
+    float flNewHealthScale = stats.Get( HOM_STAT_MAX_HEALTH );
+    if ( flOldHealthScale > 0.0f && flNewHealthScale != flOldHealthScale )
+    {
+        float maxHealth = pPlayer->GetMaxHealth() * flNewHealthScale / flOldHealthScale;
         pPlayer->SetMaxHealth( maxHealth );
-        pPlayer->SetHealth( maxHealth );
+        pPlayer->SetHealth( MIN( pPlayer->GetHealth(), maxHealth ) );
     }
 }
 
-CTFPlayer* GetAttackingPlayer( const CTakeDamageInfo &info )
+void CHomUpgradeHandler::ApplyUpgrade( CTFPlayer *pPlayer, int upgrade )
 {
-    CBaseEntity *pAttacker = info.GetAttacker();
-	CTFPlayer *pTFAttacker = ToTFPlayer( pAttacker );
-    if ( pTFAttacker )
-        return pTFAttacker;
+    const HomUpgradeDef_t *pDef = GetUpgradeDef( upgrade );
+    if ( !pDef )
+        return;
+
+    pPlayer->m_upgrades[upgrade]++;
+    pPlayer->m_iUpgradeCount++;
 
-    // Try the owner if projectile
-    CBaseProjectile *pProjectile = dynamic_cast< CBaseProjectile* >( pAttacker );
-    if ( pProjectile )
+    // fold this level into the player's combined stats
+    HomUpgradeStats_t &stats = pPlayer->m_upgradeStats;
+    FOR_EACH_VEC( pDef->m_effects, i )
     {
-        pTFAttacker = ToTFPlayer( pProjectile->GetOwnerEntity() );
-        if ( pTFAttacker )
-            return pTFAttacker;
+        const HomUpgradeEffect_t &effect = pDef->m_effects[i];
+        FoldUpgradeEffect( stats, effect );
+
+        if ( effect.m_stat == HOM_STAT_MAX_HEALTH )
+        {
+            float maxHealth = pPlayer->GetMaxHealth() * effect.m_flValue;
+            pPlayer->SetMaxHealth( maxHealth );
+            pPlayer->SetHealth( maxHealth );
+        }
     }
+}
 
-    // Try the inflictor instead of attacker
-    pAttacker = info.GetInflictor();
-    pTFAttacker = ToTFPlayer( pAttacker );
+// The player responsible for an entity, if it is a player or a player's projectile
+static CTFPlayer *GetUpgradePlayer( CBaseEntity *pEntity )
+{
+    if ( !pEntity )
+        return NULL;
+
+    if ( pEntity->IsPlayer() )
+        return ToTFPlayer( pEntity );
+
+    // virtual check instead of a dynamic_cast, this runs on every hit
+    if ( pEntity->IsBaseProjectile() )
+        return ToTFPlayer( pEntity->GetOwnerEntity() );
+
+    return NULL;
+}
+
+CTFPlayer *CHomUpgradeHandler::GetAttackingPlayer( const CTakeDamageInfo &info )
+{
+    CTFPlayer *pTFAttacker = GetUpgradePlayer( info.GetAttacker() );
     if ( pTFAttacker )
         return pTFAttacker;
 
-    pProjectile = dynamic_cast< CBaseProjectile* >( pAttacker );
-    if ( pProjectile )
-    {
-        pTFAttacker = ToTFPlayer( pProjectile->GetOwnerEntity() );
-        if ( pTFAttacker )
-            return pTFAttacker;
-    }
+    // Try the inflictor instead of attacker
+    if ( info.GetInflictor() != info.GetAttacker() )
+        return GetUpgradePlayer( info.GetInflictor() );
 
     return NULL;
 }
@@ -76,13 +529,13 @@ float CHomUpgradeHandler::OnTakeDamage_Alive( float flDamage, const CTakeDamageI
 
     if ( pTFAttacker )
     {
-        flDamage = OnDealDamage_Alive_Player( flDamage, info, pTFAttacker );
+        flDamage *= pTFAttacker->m_upgradeStats.Get( HOM_STAT_DAMAGE_DEALT );
     }
 
 	CTFPlayer *pTFVictim = ToTFPlayer( pVictimBaseEntity );
     if ( pTFVictim )
     {
-        flDamage = OnTakeDamage_Alive_Player( flDamage, info, pTFVictim );
+        flDamage *= pTFVictim->m_upgradeStats.Get( HOM_STAT_DAMAGE_TAKEN );
     }
 
     return flDamage;
@@ -95,11 +548,12 @@ void CHomUpgradeHandler::OnMobKilled( NextBotCombatCharacter *pMob, const CTakeD
     if ( pTFAttacker )
     {
         // Explode enemies on kill?
+        const int nExplosions = (int)pTFAttacker->m_upgradeStats.Get( HOM_STAT_EXPLOSIONS_ON_KILL );
         const QAngle vecAngles = pMob->GetAbsAngles();
         const Vector vecOrigin = pMob->GetAbsOrigin();
         // Spread multiple explosions around a bit
-        const float spread = 8.0f * pTFAttacker->m_upgrades[HomUpgrade_t::EXPLODE_ON_KILL];
-        for ( int i = 0; i < pTFAttacker->m_upgrades[HomUpgrade_t::EXPLODE_ON_KILL]; i++ )
+        const float spread = 8.0f * nExplosions;
+        for ( int i = 0; i < nExplosions; i++ )
         {
             Vector vecExplosion = vecOrigin + Vector(
                 RandomFloat( -48.0f - spread, 48.0f + spread ),
@@ -120,32 +574,8 @@ void CHomUpgradeHandler::OnMobKilled( NextBotCombatCharacter *pMob, const CTakeD
                 UTIL_ScreenShake( vecExplosion, 15.0f, 5.0f, 1.0f, HOM_EXPLOSION_RADIUS * 5.0f, SHAKE_START, true );
             }
 
-            int iDmgType = DMG_BLAST | DMG_USEDISTANCEMOD;
-            CTakeDamageInfo info( pTFAttacker, pTFAttacker, NULL, vecExplosion, vecExplosion, HOM_EXPLOSION_DAMAGE, iDmgType, TF_DMG_CUSTOM_PUMPKIN_BOMB, &vecExplosion );
-            info.SetForceFriendlyFire( true );
-
-            CTFRadiusDamageInfo radiusinfo( &info, vecExplosion, HOM_EXPLOSION_RADIUS, NULL );
-            TFGameRules()->RadiusDamage( radiusinfo );
+            // damage is applied in a batch at the end of the frame
+            s_homExplosions.AddExplosion( pTFAttacker, vecExplosion );
         }
     }
 }
-
-float CHomUpgradeHandler::OnDealDamage_Alive_Player( float flDamage, const CTakeDamageInfo &info, CTFPlayer *pPlayer )
-{
-    for ( int i = 0; i < pPlayer->m_upgrades[HomUpgrade_t::DAMAGE_10]; i++ )
-    {
-        flDamage *= 1.10f;
-    }
-
-    return flDamage;
-}
-
-float CHomUpgradeHandler::OnTakeDamage_Alive_Player( float flDamage, const CTakeDamageInfo &info, CTFPlayer *pPlayer )
-{
-    for ( int i = 0; i < pPlayer->m_upgrades[HomUpgrade_t::DAMAGE_RESIST_10]; i++ )
-    {
-        flDamage *= 0.9f;
-    }
-
-    return flDamage;
-}
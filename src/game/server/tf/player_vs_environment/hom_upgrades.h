@@ -1,9 +1,15 @@
 #ifndef HOM_UPGRADE_H
 #define HOM_UPGRADE_H
 
+#include "utlvector.h"
+#include "utlstring.h"
+
 class CTFPlayer;
 class NextBotCombatCharacter;
 
+#define HOM_MAX_UPGRADES 64     // built-in plus scripted upgrade types
+
+// built-in upgrades, always the first definitions - scripts can add more after these
 typedef enum {
     HEALTH_10,          // 10% extra health
     DAMAGE_10,          // 10% extra damage
@@ -12,16 +18,56 @@ typedef enum {
     UPGRADE_COUNT
 } HomUpgrade_t;
 
+// player stats upgrades can change
+typedef enum {
+    HOM_STAT_MAX_HEALTH,            // max health multiplier
+    HOM_STAT_DAMAGE_DEALT,          // outgoing damage multiplier
+    HOM_STAT_DAMAGE_TAKEN,          // incoming damage multiplier
+    HOM_STAT_EXPLOSIONS_ON_KILL,    // explosions spawned by each kill
+    HOM_STAT_COUNT
+} HomUpgradeStat_t;
+
+struct HomUpgradeEffect_t
+{
+    HomUpgradeStat_t m_stat;
+    float m_flValue;        // multiplied or added to the stat per level, depending on the stat
+};
+
+struct HomUpgradeDef_t
+{
+    CUtlString m_name;
+    CUtlVector< HomUpgradeEffect_t > m_effects;
+};
+
+// Combined effect of every upgrade a player owns, kept up to date by ApplyUpgrade()
+// so damage events read a single value instead of walking upgrade levels
+struct HomUpgradeStats_t
+{
+    HomUpgradeStats_t() { Reset(); }
+    void Reset( void );
+
+    float Get( HomUpgradeStat_t stat ) const { return m_flValue[stat]; }
+
+    float m_flValue[HOM_STAT_COUNT];
+};
+
 class CHomUpgradeHandler
 {
 public:
-    static void ApplyUpgrade( CTFPlayer *pPlayer, HomUpgrade_t upgrade );
+    static void ApplyUpgrade( CTFPlayer *pPlayer, int upgrade );
     static float OnTakeDamage_Alive( float flDamage, const CTakeDamageInfo &info, CBaseEntity *pVictimBaseEntity );
     static void OnMobKilled( NextBotCombatCharacter *pMob, const CTakeDamageInfo &info );
 
+    static int GetUpgradeCount( void );
+    static const HomUpgradeDef_t *GetUpgradeDef( int upgrade );
+    static int FindUpgrade( const char *pszName );      // -1 if not found
+    static void ReloadUpgradeDefs( void );             // also rebuilds the cached stats of every player
+    static void RecomputeUpgradeStats( CTFPlayer *pPlayer );
+
+    static CTFPlayer *GetAttackingPlayer( const CTakeDamageInfo &info );
+
 private:
-    static float OnDealDamage_Alive_Player( float flDamage, const CTakeDamageInfo &info, CTFPlayer *pPlayer );
-    static float OnTakeDamage_Alive_Player( float flDamage, const CTakeDamageInfo &info, CTFPlayer *pPlayer );
+    static void LoadUpgradeDefs( void );
 };
 
-#endif // HOM_UPGRADE_H
\ No newline at end of file
+#endif // HOM_UPGRADE_H
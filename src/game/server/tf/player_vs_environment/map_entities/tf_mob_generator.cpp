@@ -4,8 +4,10 @@
 #include "cbase.h"
 
 #include "tf_mob_generator.h"
+#include "player_vs_environment/tf_mob_pool.h"
 #include "tf_gamerules.h"
 #include "tier3/tier3.h"
+#include "inetchannelinfo.h"
 
 extern ConVar tf_max_active_mobs;
 
@@ -38,6 +40,213 @@ void CreateMob( const CCommand &args )
 
 ConCommand cc_create_mob( "create_mob", CreateMob, 0, FCVAR_CHEAT );
 
+
+//------------------------------------------------------------------------------
+/**
+ * Measures how many bytes a snapshot to the local player grows by for each melee mob in view.
+ * Samples the player's outgoing net channel for a while, spawns a grid of mobs in front
+ * of them, samples again, reports the difference, then removes the mobs.
+ */
+class CTFMobNetBenchmark : public CAutoGameSystemPerFrame
+{
+public:
+	CTFMobNetBenchmark( void ) : CAutoGameSystemPerFrame( "CTFMobNetBenchmark" )
+	{
+		m_state = IDLE;
+	}
+
+	void Start( int mobCount, float duration )
+	{
+		if ( m_state != IDLE )
+		{
+			Msg( "tf_mob_net_benchmark: already running\n" );
+			return;
+		}
+
+		m_mobCount = mobCount;
+		m_duration = duration;
+		m_mobVector.RemoveAll();
+
+		ChangeState( MEASURE_BASELINE );
+	}
+
+	virtual void LevelShutdownPreEntity( void )
+	{
+		m_state = IDLE;
+		m_mobVector.RemoveAll();
+	}
+
+	virtual void FrameUpdatePostEntityThink( void )
+	{
+		if ( m_state == IDLE )
+			return;
+
+		CBasePlayer *player = UTIL_PlayerByIndex( 1 );
+		INetChannelInfo *nci = player ? engine->GetPlayerNetInfo( player->entindex() ) : NULL;
+		if ( !nci )
+		{
+			Msg( "tf_mob_net_benchmark: no player to measure, aborted\n" );
+			RemoveMobs();
+			m_state = IDLE;
+			return;
+		}
+
+		if ( m_state == MEASURE_BASELINE || m_state == MEASURE_MOBS )
+		{
+			// bytes per snapshot, averaged over the measure time
+			float packetsPerSecond = nci->GetAvgPackets( FLOW_OUTGOING );
+			if ( packetsPerSecond > 0.0f )
+			{
+				m_bytesPerSnapshot[ m_state ] += nci->GetAvgData( FLOW_OUTGOING ) / packetsPerSecond;
+				m_choke[ m_state ] += nci->GetAvgChoke( FLOW_OUTGOING );
+				++m_sampleCount[ m_state ];
+			}
+		}
+
+		if ( m_timer.HasStarted() && !m_timer.IsElapsed() )
+			return;
+
+		switch( m_state )
+		{
+		case MEASURE_BASELINE:
+			SpawnMobs( player );
+			ChangeState( SETTLE );
+			break;
+
+		case SETTLE:
+			ChangeState( MEASURE_MOBS );
+			break;
+
+		case MEASURE_MOBS:
+			Report();
+			RemoveMobs();
+			m_state = IDLE;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+private:
+	enum State
+	{
+		MEASURE_BASELINE,
+		MEASURE_MOBS,
+		SETTLE,					// let the net channel averages catch up with the new mobs
+		IDLE,
+	};
+
+	void ChangeState( State state )
+	{
+		m_state = state;
+
+		if ( state != SETTLE )
+		{
+			m_bytesPerSnapshot[ state ] = 0.0f;
+			m_choke[ state ] = 0.0f;
+			m_sampleCount[ state ] = 0;
+		}
+
+		m_timer.Start( ( state == SETTLE ) ? 2.0f : m_duration );
+	}
+
+	void SpawnMobs( CBasePlayer *player )
+	{
+		Vector forward, right;
+		QAngle angles( 0.0f, player->EyeAngles().y, 0.0f );
+		AngleVectors( angles, &forward, &right, NULL );
+
+		const float spacing = 50.0f;
+		int side = (int)ceil( sqrt( (float)m_mobCount ) );
+
+		for( int i=0; i<m_mobCount; ++i )
+		{
+			int row = i / side;
+			int column = i % side;
+
+			Vector pos = player->GetAbsOrigin() + forward * ( 200.0f + spacing * row ) + right * spacing * ( column - 0.5f * ( side - 1 ) );
+
+			CTFMeleeMob *mob = CTFMeleeMob::SpawnAtPos( pos, player->GetAbsOrigin(), NULL, MobType_t::MELEE_NORMAL, 0.0f, TF_TEAM_HALLOWEEN );
+			if ( mob )
+			{
+				m_mobVector.AddToTail( mob );
+			}
+		}
+	}
+
+	void RemoveMobs( void )
+	{
+		FOR_EACH_VEC( m_mobVector, it )
+		{
+			if ( m_mobVector[ it ] )
+			{
+				UTIL_Remove( m_mobVector[ it ] );
+			}
+		}
+
+		m_mobVector.RemoveAll();
+	}
+
+	void Report( void ) const
+	{
+		if ( m_sampleCount[ MEASURE_BASELINE ] == 0 || m_sampleCount[ MEASURE_MOBS ] == 0 )
+		{
+			Msg( "tf_mob_net_benchmark: no packets were sent while measuring\n" );
+			return;
+		}
+
+		float baseline = m_bytesPerSnapshot[ MEASURE_BASELINE ] / m_sampleCount[ MEASURE_BASELINE ];
+		float withMobs = m_bytesPerSnapshot[ MEASURE_MOBS ] / m_sampleCount[ MEASURE_MOBS ];
+		float choke = m_choke[ MEASURE_MOBS ] / m_sampleCount[ MEASURE_MOBS ];
+
+		Msg( "Mob network benchmark, %d of %d melee mobs spawned:\n", m_mobVector.Count(), m_mobCount );
+		Msg( "  baseline:  %.1f bytes/snapshot\n", baseline );
+		Msg( "  with mobs: %.1f bytes/snapshot, %.0f%% choke\n", withMobs, 100.0f * choke );
+		if ( m_mobVector.Count() > 0 )
+		{
+			Msg( "  per mob:   %.1f bytes/snapshot\n", ( withMobs - baseline ) / m_mobVector.Count() );
+		}
+
+		if ( choke > 0.0f )
+		{
+			Msg( "  Snapshots were choked by the client's rate setting, so the numbers above are too low.\n" );
+		}
+	}
+
+	State m_state;
+	int m_mobCount;
+	float m_duration;
+	CountdownTimer m_timer;
+
+	float m_bytesPerSnapshot[ SETTLE ];
+	float m_choke[ SETTLE ];
+	int m_sampleCount[ SETTLE ];
+
+	CUtlVector< CHandle< CTFMeleeMob > > m_mobVector;
+};
+
+static CTFMobNetBenchmark s_mobNetBenchmark;
+
+
+//------------------------------------------------------------------------------
+CON_COMMAND_F( tf_mob_net_benchmark, "Measure the snapshot bytes added per melee mob. Usage: tf_mob_net_benchmark <mob count> [measure seconds]", FCVAR_CHEAT )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() < 2 )
+	{
+		Msg( "Usage: tf_mob_net_benchmark <mob count> [measure seconds]\n" );
+		return;
+	}
+
+	int mobCount = MAX( atoi( args[1] ), 1 );
+	float duration = ( args.ArgC() > 2 ) ? MAX( atof( args[2] ), 1.0f ) : 5.0f;
+
+	s_mobNetBenchmark.Start( mobCount, duration );
+}
+
 //------------------------------------------------------------------------------
 
 BEGIN_DATADESC( CTFMobGenerator )
@@ -121,8 +330,8 @@ void CTFMobGenerator::InputRemoveMobs( inputdata_t &inputdata )
 {
 	for( int i = m_spawnedMobVector.Count() - 1; i >= 0 ; i-- )
 	{
-		NextBotCombatCharacter *pMob = m_spawnedMobVector[i];
-		if ( pMob )
+		NextBotCombatCharacter *pMob = GetSpawnedMob( i );
+		if ( pMob && pMob->IsAlive() )
 		{
 			UTIL_Remove(pMob);
 		}
@@ -131,6 +340,19 @@ void CTFMobGenerator::InputRemoveMobs( inputdata_t &inputdata )
 	}
 }
 
+//------------------------------------------------------------------------------
+NextBotCombatCharacter *CTFMobGenerator::GetSpawnedMob( int i ) const
+{
+	NextBotCombatCharacter *pMob = m_spawnedMobVector[i].m_hMob;
+	if ( pMob && TheMobPool().GetLifeSerial( pMob ) != m_spawnedMobVector[i].m_lifeSerial )
+	{
+		// died and was handed back out by the mob pool
+		return NULL;
+	}
+
+	return pMob;
+}
+
 //------------------------------------------------------------------------------
 void CTFMobGenerator::OnMobKilled( NextBotCombatCharacter *pMob )
 {
@@ -165,11 +387,11 @@ void CTFMobGenerator::GeneratorThink( void )
 //------------------------------------------------------------------------------
 void CTFMobGenerator::SpawnMob( void )
 {
-	// Clear dead mobs
+	// Clear dead mobs - dead mobs may linger dormant in the mob pool rather than being removed
 	for ( int i = m_spawnedMobVector.Count() - 1; i >= 0; i-- )
 	{
-		CHandle< NextBotCombatCharacter > hMob = m_spawnedMobVector[i];
-		if ( hMob == NULL )
+		NextBotCombatCharacter *pMob = GetSpawnedMob( i );
+		if ( pMob == NULL || !pMob->IsAlive() )
 		{
 			m_spawnedMobVector.FastRemove(i);
 		}
@@ -220,7 +442,10 @@ void CTFMobGenerator::SpawnMob( void )
 
 	if ( pMob )
 	{
-		m_spawnedMobVector.AddToTail( pMob );
+		SpawnedMob_t spawned;
+		spawned.m_hMob = pMob;
+		spawned.m_lifeSerial = TheMobPool().GetLifeSerial( pMob );
+		m_spawnedMobVector.AddToTail( spawned );
 
 		m_onMobSpawned.FireOutput( pMob, this );
 
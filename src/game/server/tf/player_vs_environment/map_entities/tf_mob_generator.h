@@ -44,7 +44,14 @@ private:
 	COutputEvent m_onMobKilled;
 	COutputEvent m_onExpended;
 
-	CUtlVector< CHandle< NextBotCombatCharacter > > m_spawnedMobVector;
+	struct SpawnedMob_t
+	{
+		CHandle< NextBotCombatCharacter > m_hMob;
+		int m_lifeSerial;					// pooled mobs are reused, the handle alone can outlive our mob
+	};
+	CUtlVector< SpawnedMob_t > m_spawnedMobVector;
+
+	NextBotCombatCharacter *GetSpawnedMob( int i ) const;	// NULL if that mob is gone or has been reused
 };
 
 #endif // TF_MOB_GENERATOR_H
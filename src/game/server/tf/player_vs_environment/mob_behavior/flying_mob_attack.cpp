@@ -11,6 +11,7 @@
 #include "nav_mesh/tf_nav_area.h"
 
 #include "../tf_flying_mob.h"
+#include "../tf_mob_target_index.h"
 #include "flying_mob_attack.h"
 #include "tf_projectile_rocket.h"
 
@@ -149,49 +150,7 @@ void CTFFlyingMobAttack::SelectVictim( CTFFlyingMob *me )
 	}
 
 	// pick a new victim to chase
-	CBaseCombatCharacter *newVictim = NULL;
-	CUtlVector< CTFPlayer * > playerVector;
-
-	// collect everyone
-	CollectPlayers( &playerVector, TF_TEAM_RED, COLLECT_ONLY_LIVING_PLAYERS );
-	CollectPlayers( &playerVector, TF_TEAM_BLUE, COLLECT_ONLY_LIVING_PLAYERS, APPEND_PLAYERS );
-
-	float victimRangeSq = FLT_MAX;
-	// find closest player
-	for( int i=0; i<playerVector.Count(); ++i )
-	{
-		CTFPlayer *pPlayer = playerVector[i];
-		if ( !IsPotentiallyChaseable( me, pPlayer ) )
-		{
-			continue;
-		}
-
-		// ignore stealth player
-		if ( pPlayer->m_Shared.IsStealthed() )
-		{
-			if ( !pPlayer->m_Shared.InCond( TF_COND_BURNING ) &&
-				!pPlayer->m_Shared.InCond( TF_COND_URINE ) &&
-				!pPlayer->m_Shared.InCond( TF_COND_STEALTHED_BLINK ) &&
-				!pPlayer->m_Shared.InCond( TF_COND_BLEEDING ) )
-			{
-				// cloaked spies are invisible to us
-				continue;
-			}
-		}
-
-		// ignore ghost players
-		if ( pPlayer->m_Shared.InCond( TF_COND_HALLOWEEN_GHOST_MODE ) )
-		{
-			continue;
-		}
-
-		float rangeSq = me->GetRangeSquaredTo( pPlayer );
-		if ( rangeSq < victimRangeSq )
-		{
-			newVictim = pPlayer;
-			victimRangeSq = rangeSq;
-		}
-	}
+	CBaseCombatCharacter *newVictim = TheMobTargetIndex().FindClosestVictim( me->GetAbsOrigin(), MOB_TARGET_CHASEABLE );
 
 	if ( newVictim )
 	{
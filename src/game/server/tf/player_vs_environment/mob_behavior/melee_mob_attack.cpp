@@ -11,12 +11,15 @@
 #include "nav_mesh/tf_nav_area.h"
 
 #include "../tf_melee_mob.h"
+#include "../tf_mob_flow_field.h"
 #include "melee_mob_attack.h"
 #include "melee_mob_special_attack.h"
 #include "melee_mob_giant_special_attack.h"
 
 #define MELEE_MOB_CHASE_MIN_DURATION 3.0f
 
+ConVar tf_melee_mob_use_flow_field( "tf_melee_mob_use_flow_field", "1", FCVAR_CHEAT, "Melee mobs chase their victims along shared flow fields where possible" );
+
 //----------------------------------------------------------------------------------
 ActionResult< CTFMeleeMob >	CTFMeleeMobAttack::OnStart( CTFMeleeMob *me, Action< CTFMeleeMob > *priorAction )
 {
@@ -77,95 +80,8 @@ void CTFMeleeMobAttack::SelectVictim( CTFMeleeMob *me )
 		return;
 	}
 
-	// pick a new victim to chase
-	CBaseCombatCharacter *newVictim = NULL;
-	CUtlVector< CTFPlayer * > playerVector;
-
-	// collect everyone
-	/*
-	if ( me->GetTeamNumber() == TF_TEAM_RED )
-	{
-		CollectPlayers( &playerVector, TF_TEAM_BLUE, COLLECT_ONLY_LIVING_PLAYERS );
-	}
-	else if ( me->GetTeamNumber() == TF_TEAM_BLUE )
-	{
-		CollectPlayers( &playerVector, TF_TEAM_RED, COLLECT_ONLY_LIVING_PLAYERS );
-	}
-	else
-	*/
-	{
-		CollectPlayers( &playerVector, TF_TEAM_RED, COLLECT_ONLY_LIVING_PLAYERS );
-		CollectPlayers( &playerVector, TF_TEAM_BLUE, COLLECT_ONLY_LIVING_PLAYERS, APPEND_PLAYERS );
-	}
-
-	float victimRangeSq = FLT_MAX;
-	// find closest player
-	for( int i=0; i<playerVector.Count(); ++i )
-	{
-		CTFPlayer *pPlayer = playerVector[i];
-		if ( !IsPotentiallyChaseable( me, pPlayer ) )
-		{
-			continue;
-		}
-
-		// ignore stealth player
-		if ( pPlayer->m_Shared.IsStealthed() )
-		{
-			if ( !pPlayer->m_Shared.InCond( TF_COND_BURNING ) &&
-				!pPlayer->m_Shared.InCond( TF_COND_URINE ) &&
-				!pPlayer->m_Shared.InCond( TF_COND_STEALTHED_BLINK ) &&
-				!pPlayer->m_Shared.InCond( TF_COND_BLEEDING ) )
-			{
-				// cloaked spies are invisible to us
-				continue;
-			}
-		}
-
-		/*
-		// ignore player who disguises as my team
-		if ( pPlayer->m_Shared.InCond( TF_COND_DISGUISED ) && pPlayer->m_Shared.GetDisguiseTeam() == me->GetTeamNumber() )
-		{
-			continue;
-		}
-		*/
-
-		// ignore ghost players
-		if ( pPlayer->m_Shared.InCond( TF_COND_HALLOWEEN_GHOST_MODE ) )
-		{
-			continue;
-		}
-
-		float rangeSq = me->GetRangeSquaredTo( pPlayer );
-		if ( rangeSq < victimRangeSq )
-		{
-			newVictim = pPlayer;
-			victimRangeSq = rangeSq;
-		}
-	}
-
-	// find closest zombie
-	/*
-	for ( int i=0; i<ITFMeleeMobAutoList::AutoList().Count(); ++i )
-	{
-		CTFMeleeMob* pTFMeleeMob = static_cast< CTFMeleeMob* >( ITFMeleeMobAutoList::AutoList()[i] );
-		if ( pTFMeleeMob->GetTeamNumber() == me->GetTeamNumber() )
-		{
-			continue;
-		}
-
-		if ( !IsPotentiallyChaseable( me, pTFMeleeMob ) )
-		{
-			continue;
-		}
-
-		float rangeSq = me->GetRangeSquaredTo( pTFMeleeMob );
-		if ( rangeSq < victimRangeSq )
-		{
-			newVictim = pTFMeleeMob;
-			victimRangeSq = rangeSq;
-		}
-	}
-	*/
+	// pick a new victim to chase - the closest chaseable player that isn't too far off the mesh
+	CBaseCombatCharacter *newVictim = me->GetClosestVictim();
 
 	if ( newVictim )
 	{
@@ -174,6 +90,7 @@ void CTFMeleeMobAttack::SelectVictim( CTFMeleeMob *me )
 	}
 
 	m_attackTarget = newVictim;
+	me->SetChaseVictim( newVictim );
 }
 
 
@@ -201,17 +118,28 @@ ActionResult< CTFMeleeMob >	CTFMeleeMobAttack::Update( CTFMeleeMob *me, float in
 	// chase after our chase victim
 	const float standAndSwingRange = me->GetAttackRange() * 0.9f;
 
-	bool isLineOfSightClear = me->IsLineOfSightClear( m_attackTarget );
+	bool isLineOfSightClear = me->IsLineOfSightClearToVictim( m_attackTarget );
 
 	if ( me->IsRangeGreaterThan( m_attackTarget, standAndSwingRange ) || !isLineOfSightClear )
 	{
-		if ( m_path.GetAge() > 0.5f )
+		CTFMobFlowField *flowField = NULL;
+		if ( tf_melee_mob_use_flow_field.GetBool() )
 		{
-			CTFMeleeMobPathCost cost( me );
-			m_path.Compute( me, m_attackTarget, cost );
+			MobFlowFieldLimits_t limits;
+			me->GetLocomotionInterface()->GetFlowFieldLimits( &limits );
+			flowField = TheMobFlowFields().GetFlowField( m_attackTarget, me->GetTeamNumber(), limits );
 		}
 
-		m_path.Update( me );
+		if ( !flowField || !me->GetLocomotionInterface()->ApproachAlongFlowField( *flowField, m_attackTarget->GetAbsOrigin() ) )
+		{
+			if ( m_path.GetAge() > 0.5f && !m_path.IsPathRequestPending() )
+			{
+				// computed later within the NextBot path budget - keep following our current path until then
+				TheNextBots().RequestPath( me, &m_path, m_attackTarget, me->GetPathCost() );
+			}
+
+			m_path.Update( me );
+		}
 	}
 
 	const float specialAttackRange = me->GetSpecialAttackRange();
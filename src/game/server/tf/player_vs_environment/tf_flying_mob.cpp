@@ -14,6 +14,7 @@
 #include "particle_parse.h"
 
 #include "tf_flying_mob.h"
+#include "tf_mob_pool.h"
 #include "mob_behavior/flying_mob_spawn.h"
 #include "map_entities/tf_mob_generator.h"
 
@@ -33,10 +34,31 @@ ConVar tf_flying_mob_jarate_range( "tf_flying_mob_jarate_range", "600", FCVAR_CH
 //-----------------------------------------------------------------------------------------------------
 LINK_ENTITY_TO_CLASS( tf_flying_mob, CTFFlyingMob );
 
+// Only send what the client needs to draw a mob, see DT_TFMeleeMob
 IMPLEMENT_SERVERCLASS_ST( CTFFlyingMob, DT_TFFlyingMob )
+	SendPropExclude( "DT_BaseEntity", "m_vecOrigin" ),
 	SendPropExclude( "DT_BaseEntity", "m_angRotation" ),	// client has its own orientation logic
 	SendPropExclude( "DT_BaseEntity", "m_angAbsRotation" ),	// client has its own orientation logic
-	SendPropVector( SENDINFO( m_lookAtSpot ), 0, SPROP_COORD ),
+	SendPropExclude( "DT_AnimTimeMustBeFirst", "m_flAnimTime" ),
+	SendPropExclude( "DT_BaseAnimating", "m_flPoseParameter" ),	// client aims the eye itself, and sets the anger the server does on spawn
+	SendPropExclude( "DT_BaseAnimating", "m_flEncodedController" ),
+	SendPropExclude( "DT_BaseAnimating", "m_hLightingOrigin" ),
+	SendPropExclude( "DT_BaseAnimating", "m_hLightingOriginRelative" ),
+	SendPropExclude( "DT_BaseAnimating", "m_fadeMinDist" ),
+	SendPropExclude( "DT_BaseAnimating", "m_fadeMaxDist" ),
+	SendPropExclude( "DT_BaseAnimating", "m_flFadeScale" ),
+	SendPropExclude( "DT_BaseFlex", "m_flexWeight" ),
+	SendPropExclude( "DT_BaseFlex", "m_blinktoggle" ),
+	SendPropExclude( "DT_BaseFlex", "m_viewtarget" ),
+	SendPropExclude( "DT_BaseFlex", "m_vecLean" ),
+	SendPropExclude( "DT_BaseFlex", "m_vecShift" ),
+	SendPropExclude( "DT_BaseCombatCharacter", "m_hActiveWeapon" ),
+	SendPropExclude( "DT_BaseCombatCharacter", "m_hMyWeapons" ),
+
+	SendPropVectorXY( SENDINFO( m_vecOrigin ), -1, SPROP_COORD_MP_LOWPRECISION|SPROP_CHANGES_OFTEN, 0.0f, HIGH_DEFAULT, SendProxy_OriginXY ),
+	SendPropFloat( SENDINFO_VECTORELEM( m_vecOrigin, 2 ), -1, SPROP_COORD_MP_LOWPRECISION|SPROP_CHANGES_OFTEN, 0.0f, HIGH_DEFAULT, SendProxy_OriginZ ),
+
+	SendPropVector( SENDINFO( m_lookAtSpot ), -1, SPROP_COORD_MP_LOWPRECISION ),
 END_SEND_TABLE()
 
 IMPLEMENT_AUTO_LIST( ITFFlyingMobAutoList );
@@ -62,6 +84,7 @@ CTFFlyingMob::CTFFlyingMob()
 	m_flAttackRange = 1500.f;
 	m_flAttackDamage = 30.f;
 
+	m_bForceSuicide = false;
 	m_bDeathOutputFired = false;
 }
 
@@ -122,6 +145,12 @@ void CTFFlyingMob::Spawn( void )
 	BaseClass::Spawn();
 
 	AddFlag( FL_NPC );
+	UseClientSideAnimation();
+
+	// we may be a recycled mob from the pool
+	m_bForceSuicide = false;
+	m_bDeathOutputFired = false;
+	m_lifeTimer.Invalidate();
 
 	QAngle qAngle = vec3_angle;
 	qAngle[YAW] = RandomFloat( 0, 360 );
@@ -147,12 +176,25 @@ void CTFFlyingMob::Spawn( void )
 	EmitSound( "Halloween.EyeballBossBecomeAlert" );
 
 	// force kill oldest skeletons in the level (except skeleton king) to keep the number of skeletons under the max active
-	int nForceKill = ITFFlyingMobAutoList::AutoList().Count() - tf_max_active_flying_mobs.GetInt();
+	// dormant mobs in the pool are still on the auto list, but don't count
+	int nActive = 0;
+	for ( int i=0; i<ITFFlyingMobAutoList::AutoList().Count(); ++i )
+	{
+		if ( static_cast< CTFFlyingMob* >( ITFFlyingMobAutoList::AutoList()[i] )->IsAlive() )
+		{
+			++nActive;
+		}
+	}
+
+	int nForceKill = nActive - tf_max_active_flying_mobs.GetInt();
 	for ( int i=0; i<ITFFlyingMobAutoList::AutoList().Count() && nForceKill > 0; ++i )
 	{
 		CTFFlyingMob *pFlyingMob = static_cast< CTFFlyingMob* >( ITFFlyingMobAutoList::AutoList()[i] );
-		pFlyingMob->ForceSuicide();
-		nForceKill--;
+		if ( pFlyingMob->IsAlive() )
+		{
+			pFlyingMob->ForceSuicide();
+			nForceKill--;
+		}
 	}
 	Assert( nForceKill <= 0 );
 }
@@ -232,14 +274,10 @@ void CTFFlyingMob::Event_Killed( const CTakeDamageInfo &info )
 	}
 
 	const Vector spawnOrigin = WorldSpaceCenter();
-	const QAngle spawnAngles = QAngle();
 
 	int cashAmount;
 	int ammoAmount;
 	int healthAmount;
-	const char* cashClass;
-	const char* ammoClass;
-	const char* healthClass;
 
 	switch ( m_nType )
 	{
@@ -249,75 +287,12 @@ void CTFFlyingMob::Event_Killed( const CTakeDamageInfo &info )
 			cashAmount = 100;
 			ammoAmount = 20;
 			healthAmount = 100;
-			cashClass = "item_mobdrop_cash_medium";
-			ammoClass = "item_mobdrop_ammo_medium";
-			healthClass = "item_mobdrop_health_medium";
 			break;
 		}
 	}
 
-	// Spawn some cash
-	CTFMobDrop *pCash = assert_cast<CTFMobDrop*>(CBaseEntity::CreateNoSpawn(
-		cashClass,
-		spawnOrigin,
-		spawnAngles,
-		this
-	));
-
-	if ( pCash )
-	{
-		pCash->SetAmount( cashAmount );
-
-		Vector vecImpulse = RandomVector( -1, 1 );
-		vecImpulse.z = RandomFloat( 3.0f, 15.0f );
-		VectorNormalize( vecImpulse );
-		Vector vecVelocity = vecImpulse * 250.0 * RandomFloat( 1.0f, 4.0f );
-
-		DispatchSpawn( pCash );
-		pCash->DropSingleInstance( vecVelocity, this, 0, 0 );
-	}
-
-	// Spawn some ammo
-	CTFMobDrop *pAmmo = assert_cast<CTFMobDrop*>(CBaseEntity::CreateNoSpawn(
-		ammoClass,
-		spawnOrigin,
-		spawnAngles,
-		this
-	));
-
-	if ( pAmmo )
-	{
-		pAmmo->SetAmount( ammoAmount );
-
-		Vector vecImpulse = RandomVector( -1, 1 );
-		vecImpulse.z = RandomFloat( 3.0f, 15.0f );
-		VectorNormalize( vecImpulse );
-		Vector vecVelocity = vecImpulse * 250.0 * RandomFloat( 1.0f, 4.0f );
-
-		DispatchSpawn( pAmmo );
-		pAmmo->DropSingleInstance( vecVelocity, this, 0, 0 );
-	}
-
-	// Spawn some health
-	CTFMobDrop *pHealth = assert_cast<CTFMobDrop*>(CBaseEntity::CreateNoSpawn(
-		healthClass,
-		spawnOrigin,
-		spawnAngles,
-		this
-	));
-
-	if ( pHealth )
-	{
-		pHealth->SetAmount( healthAmount );
-
-		Vector vecImpulse = RandomVector( -1, 1 );
-		vecImpulse.z = RandomFloat( 3.0f, 15.0f );
-		VectorNormalize( vecImpulse );
-		Vector vecVelocity = vecImpulse * 250.0 * RandomFloat( 1.0f, 4.0f );
-
-		DispatchSpawn( pHealth );
-		pHealth->DropSingleInstance( vecVelocity, this, 0, 0 );
-	}
+	// all of it goes into a single drop, possibly shared with other mobs killed nearby
+	TheMobDrops().DropLoot( spawnOrigin, cashAmount, ammoAmount, healthAmount, this );
 
 	FireDeathOutput( info.GetInflictor() );
 	
@@ -348,13 +323,13 @@ void CTFFlyingMob::FireDeathOutput( CBaseEntity *pCulprit )
 //---------------------------------------------------------------------------------------------
 /*static*/ CTFFlyingMob* CTFFlyingMob::SpawnAtPos( const Vector& vSpawnPos, const Vector& vFaceTowards, CBaseEntity *pOwner /*= NULL*/, MobType_t nMobType /*= FLYING_NORMAL*/, float flLifeTime /*= 0.f*/, int nTeam /*= TF_TEAM_HALLOWEEN*/ )
 {
-	CTFFlyingMob *pFlyingMob = (CTFFlyingMob *)CreateEntityByName( "tf_flying_mob" );
+	CTFFlyingMob *pFlyingMob = (CTFFlyingMob *)TheMobPool().Acquire( "tf_flying_mob" );
 	if ( pFlyingMob )
 	{
 		pFlyingMob->ChangeTeam( nTeam );
 
-		if ( pOwner )
-			pFlyingMob->SetOwnerEntity( pOwner );		
+		// always set, a recycled mob may still have its previous owner
+		pFlyingMob->SetOwnerEntity( pOwner );
 
 		Vector vActualSpawnPos = vSpawnPos;
 
@@ -393,6 +368,16 @@ void CTFFlyingMob::FireDeathOutput( CBaseEntity *pCulprit )
 }
 
 
+//---------------------------------------------------------------------------------------------
+void CTFFlyingMob::Recycle( void )
+{
+	if ( !TheMobPool().Release( this ) )
+	{
+		UTIL_Remove( this );
+	}
+}
+
+
 bool CTFFlyingMob::ShouldSuicide() const
 {
 	// out of life time
@@ -456,7 +441,7 @@ public:
 
 		if ( bDead )
 		{
-			UTIL_Remove( me );
+			me->Recycle();
 			return Done();
 		}
 
@@ -470,7 +455,7 @@ public:
 
 	virtual EventDesiredResult< CTFFlyingMob > OnKilled( CTFFlyingMob *me, const CTakeDamageInfo &info )
 	{
-		UTIL_Remove( me );
+		me->Recycle();
 
 		return TryDone();
 	}
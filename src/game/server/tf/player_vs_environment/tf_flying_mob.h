@@ -147,6 +147,7 @@ public:
 	virtual CTFFlyingMobIntention	*GetIntentionInterface( void ) const	{ return m_intention; }
 	virtual CTFFlyingMobLocomotion	*GetLocomotionInterface( void ) const	{ return m_locomotor; }
 	virtual CTFFlyingMobBody	*GetBodyInterface( void ) const			{ return m_body; }
+	virtual unsigned int GetEventInterest( void ) const		{ return 0; }		// no behavior reacts to NextBot events
 
 	virtual Vector EyePosition( void );
 	virtual void SetLookAtTarget( const Vector &spot );
@@ -159,6 +160,8 @@ public:
 	void SetMobType( MobType_t nType );
 	void AddHat( const char *pszModel );
 
+	void Recycle( void );		// return this dead mob to the mob pool, or remove it if the pool is full
+
 	static CTFFlyingMob* SpawnAtPos( const Vector& vSpawnPos, const Vector& vFaceTowards, CBaseEntity *pOwner = NULL, MobType_t nSkeletonType = FLYING_NORMAL, float flLifeTime = 0.f, int nTeam = TF_TEAM_HALLOWEEN );
 
 	float GetAttackRange() const { return m_flAttackRange; }
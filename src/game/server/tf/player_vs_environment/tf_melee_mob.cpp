@@ -14,6 +14,10 @@
 #include "particle_parse.h"
 
 #include "tf_melee_mob.h"
+#include "tf_mob_crowd.h"
+#include "tf_mob_flow_field.h"
+#include "tf_mob_pool.h"
+#include "tf_mob_target_index.h"
 #include "mob_behavior/melee_mob_spawn.h"
 #include "map_entities/tf_mob_generator.h"
 
@@ -22,6 +26,7 @@
 #define SKELETON_KING_CROWN_MODEL "models/player/items/demo/crown.mdl"
 
 ConVar tf_max_active_melee_mobs( "tf_max_active_melee_mobs", "64", FCVAR_CHEAT );
+ConVar tf_melee_mob_trust_nav( "tf_melee_mob_trust_nav", "1", FCVAR_CHEAT, "Skip collision traces for melee mob moves that stay inside a flat nav area" );
 
 
 //-----------------------------------------------------------------------------------------------------
@@ -29,8 +34,35 @@ ConVar tf_max_active_melee_mobs( "tf_max_active_melee_mobs", "64", FCVAR_CHEAT )
 //-----------------------------------------------------------------------------------------------------
 LINK_ENTITY_TO_CLASS( tf_melee_mob, CTFMeleeMob );
 
+// Mobs come by the hundred, so only send what the client needs to draw one. Mobs animate
+// on the client (see UseClientSideAnimation), which derives the pose parameters, playback
+// rate and head scale from the mob's motion and type.
 IMPLEMENT_SERVERCLASS_ST( CTFMeleeMob, DT_TFMeleeMob )
-	SendPropFloat( SENDINFO( m_flHeadScale ) ),
+	SendPropExclude( "DT_BaseEntity", "m_vecOrigin" ),
+	SendPropExclude( "DT_BaseEntity", "m_angRotation" ),
+	SendPropExclude( "DT_AnimTimeMustBeFirst", "m_flAnimTime" ),
+	SendPropExclude( "DT_BaseAnimating", "m_flPoseParameter" ),
+	SendPropExclude( "DT_BaseAnimating", "m_flPlaybackRate" ),
+	SendPropExclude( "DT_BaseAnimating", "m_flEncodedController" ),
+	SendPropExclude( "DT_BaseAnimating", "m_hLightingOrigin" ),
+	SendPropExclude( "DT_BaseAnimating", "m_hLightingOriginRelative" ),
+	SendPropExclude( "DT_BaseAnimating", "m_fadeMinDist" ),
+	SendPropExclude( "DT_BaseAnimating", "m_fadeMaxDist" ),
+	SendPropExclude( "DT_BaseAnimating", "m_flFadeScale" ),
+	SendPropExclude( "DT_BaseFlex", "m_flexWeight" ),
+	SendPropExclude( "DT_BaseFlex", "m_blinktoggle" ),
+	SendPropExclude( "DT_BaseFlex", "m_viewtarget" ),
+	SendPropExclude( "DT_BaseFlex", "m_vecLean" ),
+	SendPropExclude( "DT_BaseFlex", "m_vecShift" ),
+	SendPropExclude( "DT_BaseCombatCharacter", "m_hActiveWeapon" ),
+	SendPropExclude( "DT_BaseCombatCharacter", "m_hMyWeapons" ),
+
+	// mobs stand upright, so only yaw is sent
+	SendPropVectorXY( SENDINFO( m_vecOrigin ), -1, SPROP_COORD_MP_LOWPRECISION|SPROP_CHANGES_OFTEN, 0.0f, HIGH_DEFAULT, SendProxy_OriginXY ),
+	SendPropFloat( SENDINFO_VECTORELEM( m_vecOrigin, 2 ), -1, SPROP_COORD_MP_LOWPRECISION|SPROP_CHANGES_OFTEN, 0.0f, HIGH_DEFAULT, SendProxy_OriginZ ),
+	SendPropAngle( SENDINFO_VECTORELEM( m_angRotation, 1 ), 10, SPROP_CHANGES_OFTEN ),
+
+	SendPropInt( SENDINFO( m_nType ), 2, SPROP_UNSIGNED ),
 END_SEND_TABLE()
 
 IMPLEMENT_AUTO_LIST( ITFMeleeMobAutoList );
@@ -55,17 +87,19 @@ CTFMeleeMob::CTFMeleeMob()
 	m_intention = new CTFMeleeMobIntention( this );
 	m_locomotor = new CTFMeleeMobLocomotion( this );
 	m_body = new CTFMeleeMobBody( this );
+	m_pathCost = new CTFMeleeMobPathCost( this );
 
 	m_nType = MobType_t::MELEE_NORMAL;
 
-	m_flHeadScale = 1.f;
-
 	m_flAttackRange = 50.f;
 	m_flAttackDamage = 30.f;
 	m_flSpecialAttackRange = 500.f;
 	m_flSpecialAttackDamage = 50.f;
 
+	m_bForceSuicide = false;
 	m_bDeathOutputFired = false;
+
+	m_think.m_tick = -1;
 }
 
 
@@ -80,6 +114,9 @@ CTFMeleeMob::~CTFMeleeMob()
 
 	if ( m_body )
 		delete m_body;
+
+	if ( m_pathCost )
+		delete m_pathCost;
 }
 
 
@@ -132,6 +169,15 @@ void CTFMeleeMob::Spawn( void )
 	BaseClass::Spawn();
 
 	AddFlag( FL_NPC );
+	UseClientSideAnimation();
+
+	// we may be a recycled mob from the pool
+	m_bForceSuicide = false;
+	m_bDeathOutputFired = false;
+	m_lifeTimer.Invalidate();
+	m_hChaseVictim = NULL;
+	m_think.m_tick = -1;
+	RemoveAllGestures();
 
 	QAngle qAngle = vec3_angle;
 	qAngle[YAW] = RandomFloat( 0, 360 );
@@ -157,11 +203,21 @@ void CTFMeleeMob::Spawn( void )
 	}
 
 	// force kill oldest skeletons in the level (except skeleton king) to keep the number of skeletons under the max active
-	int nForceKill = ITFMeleeMobAutoList::AutoList().Count() - tf_max_active_melee_mobs.GetInt();
+	// dormant mobs in the pool are still on the auto list, but don't count
+	int nActive = 0;
+	for ( int i=0; i<ITFMeleeMobAutoList::AutoList().Count(); ++i )
+	{
+		if ( static_cast< CTFMeleeMob* >( ITFMeleeMobAutoList::AutoList()[i] )->IsAlive() )
+		{
+			++nActive;
+		}
+	}
+
+	int nForceKill = nActive - tf_max_active_melee_mobs.GetInt();
 	for ( int i=0; i<ITFMeleeMobAutoList::AutoList().Count() && nForceKill > 0; ++i )
 	{
 		CTFMeleeMob *pMeleeMob = static_cast< CTFMeleeMob* >( ITFMeleeMobAutoList::AutoList()[i] );
-		if (pMeleeMob->GetMobType() != MobType_t::MELEE_GIANT)
+		if ( pMeleeMob->IsAlive() && pMeleeMob->GetMobType() != MobType_t::MELEE_GIANT )
 		{
 			pMeleeMob->ForceSuicide();
 			nForceKill--;
@@ -245,14 +301,10 @@ void CTFMeleeMob::Event_Killed( const CTakeDamageInfo &info )
 	EmitSound( "Halloween.skeleton_break" );
 
 	const Vector spawnOrigin = WorldSpaceCenter();
-	const QAngle spawnAngles = QAngle();
 
 	int cashAmount;
 	int ammoAmount;
 	int healthAmount;
-	const char* cashClass;
-	const char* ammoClass;
-	const char* healthClass;
 
 	switch ( m_nType )
 	{
@@ -262,9 +314,6 @@ void CTFMeleeMob::Event_Killed( const CTakeDamageInfo &info )
 			cashAmount = 10;
 			ammoAmount = 4;
 			healthAmount = 20;
-			cashClass = "item_mobdrop_cash_small";
-			ammoClass = "item_mobdrop_ammo_small";
-			healthClass = "item_mobdrop_health_small";
 			break;
 		}
 
@@ -273,75 +322,12 @@ void CTFMeleeMob::Event_Killed( const CTakeDamageInfo &info )
 			cashAmount = 50;
 			ammoAmount = 10;
 			healthAmount = 100;
-			cashClass = "item_mobdrop_cash_large";
-			ammoClass = "item_mobdrop_ammo_medium";
-			healthClass = "item_mobdrop_health_medium";
 			break;
 		}
 	}
 
-	// Spawn some cash
-	CTFMobDrop *pCash = assert_cast<CTFMobDrop*>(CBaseEntity::CreateNoSpawn(
-		cashClass,
-		spawnOrigin,
-		spawnAngles,
-		this
-	));
-
-	if ( pCash )
-	{
-		pCash->SetAmount( cashAmount );
-
-		Vector vecImpulse = RandomVector( -1, 1 );
-		vecImpulse.z = RandomFloat( 3.0f, 15.0f );
-		VectorNormalize( vecImpulse );
-		Vector vecVelocity = vecImpulse * 250.0 * RandomFloat( 1.0f, 4.0f );
-
-		DispatchSpawn( pCash );
-		pCash->DropSingleInstance( vecVelocity, this, 0, 0 );
-	}
-
-	// Spawn some ammo
-	CTFMobDrop *pAmmo = assert_cast<CTFMobDrop*>(CBaseEntity::CreateNoSpawn(
-		ammoClass,
-		spawnOrigin,
-		spawnAngles,
-		this
-	));
-
-	if ( pAmmo )
-	{
-		pAmmo->SetAmount( ammoAmount );
-
-		Vector vecImpulse = RandomVector( -1, 1 );
-		vecImpulse.z = RandomFloat( 3.0f, 15.0f );
-		VectorNormalize( vecImpulse );
-		Vector vecVelocity = vecImpulse * 250.0 * RandomFloat( 1.0f, 4.0f );
-
-		DispatchSpawn( pAmmo );
-		pAmmo->DropSingleInstance( vecVelocity, this, 0, 0 );
-	}
-
-	// Spawn some health
-	CTFMobDrop *pHealth = assert_cast<CTFMobDrop*>(CBaseEntity::CreateNoSpawn(
-		healthClass,
-		spawnOrigin,
-		spawnAngles,
-		this
-	));
-
-	if ( pHealth )
-	{
-		pHealth->SetAmount( healthAmount );
-
-		Vector vecImpulse = RandomVector( -1, 1 );
-		vecImpulse.z = RandomFloat( 3.0f, 15.0f );
-		VectorNormalize( vecImpulse );
-		Vector vecVelocity = vecImpulse * 250.0 * RandomFloat( 1.0f, 4.0f );
-
-		DispatchSpawn( pHealth );
-		pHealth->DropSingleInstance( vecVelocity, this, 0, 0 );
-	}
+	// all of it goes into a single drop, possibly shared with other mobs killed nearby
+	TheMobDrops().DropLoot( spawnOrigin, cashAmount, ammoAmount, healthAmount, this );
 
 	FireDeathOutput( info.GetInflictor() );
 	
@@ -354,6 +340,21 @@ void CTFMeleeMob::Event_Killed( const CTakeDamageInfo &info )
 
 //-----------------------------------------------------------------------------------------------------
 void CTFMeleeMob::UpdateOnRemove()
+{
+	// dormant mobs already broke apart when they died
+	if ( !IsDormant() )
+	{
+		BreakModel();
+	}
+
+	UTIL_Remove( m_hHat );
+
+	BaseClass::UpdateOnRemove();
+}
+
+
+//-----------------------------------------------------------------------------------------------------
+void CTFMeleeMob::BreakModel( void )
 {
 	CPVSFilter filter( GetAbsOrigin() );
 	UserMessageBegin( filter, "BreakModel" );
@@ -362,10 +363,28 @@ void CTFMeleeMob::UpdateOnRemove()
 		WRITE_ANGLES( GetAbsAngles() );
 		WRITE_SHORT( m_nSkin );
 	MessageEnd();
+}
 
-	UTIL_Remove( m_hHat );
 
-	BaseClass::UpdateOnRemove();
+//-----------------------------------------------------------------------------------------------------
+void CTFMeleeMob::Recycle( void )
+{
+	if ( !TheMobPool().Release( this ) )
+	{
+		UTIL_Remove( this );
+		return;
+	}
+
+	// we won't be removed, so do what UpdateOnRemove() would have
+	BreakModel();
+	StowHat();
+
+	// don't hold on to victims while dormant
+	m_hChaseVictim = NULL;
+	m_think.m_tick = -1;
+	m_think.m_closestVictim = NULL;
+	m_think.m_losSubject[0] = NULL;
+	m_think.m_losSubject[1] = NULL;
 }
 
 
@@ -391,13 +410,13 @@ void CTFMeleeMob::FireDeathOutput( CBaseEntity *pCulprit )
 //---------------------------------------------------------------------------------------------
 /*static*/ CTFMeleeMob* CTFMeleeMob::SpawnAtPos( const Vector& vSpawnPos, const Vector& vFaceTowards, CBaseEntity *pOwner /*= NULL*/, MobType_t nMobType /*= MELEE_NORMAL*/, float flLifeTime /*= 0.f*/, int nTeam /*= TF_TEAM_HALLOWEEN*/ )
 {
-	CTFMeleeMob *pMeleeMob = (CTFMeleeMob *)CreateEntityByName( "tf_melee_mob" );
+	CTFMeleeMob *pMeleeMob = (CTFMeleeMob *)TheMobPool().Acquire( "tf_melee_mob" );
 	if ( pMeleeMob )
 	{
 		pMeleeMob->ChangeTeam( nTeam );
 
-		if ( pOwner )
-			pMeleeMob->SetOwnerEntity( pOwner );		
+		// always set, a recycled mob may still have its previous owner
+		pMeleeMob->SetOwnerEntity( pOwner );
 
 		Vector vActualSpawnPos = vSpawnPos;
 
@@ -436,6 +455,104 @@ bool CTFMeleeMob::ShouldSuicide() const
 }
 
 
+//----------------------------------------------------------------------------------
+void CTFMeleeMob::PrepareParallelThink( void )
+{
+	// victim queries must not rebuild the index from worker threads
+	TheMobTargetIndex().Update();
+}
+
+
+//----------------------------------------------------------------------------------
+// Runs on a worker thread - only read the world and write m_think
+void CTFMeleeMob::ParallelThink( void )
+{
+	m_think.m_closestVictim = TheMobTargetIndex().FindClosestVictim( GetAbsOrigin(), MOB_TARGET_CHASEABLE, GetSpecialAttackRange() );
+
+	CBaseEntity *subject[2] = { m_hChaseVictim, m_think.m_closestVictim };
+	for( int i=0; i<2; ++i )
+	{
+		m_think.m_losSubject[i] = subject[i];
+		m_think.m_isLOSClear[i] = false;
+
+		if ( subject[i] && subject[i]->IsAlive() )
+		{
+			if ( i > 0 && subject[i] == subject[0] )
+			{
+				m_think.m_isLOSClear[i] = m_think.m_isLOSClear[0];
+			}
+			else
+			{
+				m_think.m_isLOSClear[i] = ComputeLineOfSight( subject[i] );
+			}
+		}
+	}
+
+	m_think.m_tick = gpGlobals->tickcount;
+}
+
+
+//----------------------------------------------------------------------------------
+CTFPlayer *CTFMeleeMob::GetClosestVictim( void )
+{
+	if ( m_think.m_tick == gpGlobals->tickcount )
+	{
+		return m_think.m_closestVictim;
+	}
+
+	return TheMobTargetIndex().FindClosestVictim( GetAbsOrigin(), MOB_TARGET_CHASEABLE, GetSpecialAttackRange() );
+}
+
+
+//----------------------------------------------------------------------------------
+bool CTFMeleeMob::IsLineOfSightClearToVictim( CBaseEntity *victim )
+{
+	if ( victim && m_think.m_tick == gpGlobals->tickcount )
+	{
+		for( int i=0; i<2; ++i )
+		{
+			if ( m_think.m_losSubject[i] == victim )
+			{
+				return m_think.m_isLOSClear[i];
+			}
+		}
+	}
+
+	return victim && ComputeLineOfSight( victim );
+}
+
+
+//----------------------------------------------------------------------------------
+// CBaseCombatCharacter::IsLineOfSightClear( entity ), safe to call from worker threads.
+// Our eyes are at our center, as IBody places them, without going through its shared static.
+bool CTFMeleeMob::ComputeLineOfSight( CBaseEntity *subject ) const
+{
+	const Vector eye = WorldSpaceCenter();
+	const Vector spot[3] = { subject->WorldSpaceCenter(), subject->EyePosition(), subject->GetAbsOrigin() };
+
+	CTraceFilterSkipTwoEntities filter( this, subject, COLLISION_GROUP_NONE );
+	for( int i=0; i<3; ++i )
+	{
+		trace_t result;
+		UTIL_TraceLine( eye, spot[i], MASK_OPAQUE | CONTENTS_IGNORE_NODRAW_OPAQUE, &filter, &result );
+		if ( result.fraction == 1.0f )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+//----------------------------------------------------------------------------------
+// Spawning and special attacks are timed animations - don't let update LOD stretch them
+bool CTFMeleeMob::ShouldUpdateAtFullRate( void ) const
+{
+	return !GetBodyInterface()->IsActivity( ACT_MP_RUN_MELEE );
+}
+
+
 //-----------------------------------------------------------------------------------------------------
 void CTFMeleeMob::SetMobType( MobType_t nType )
 {
@@ -446,8 +563,6 @@ void CTFMeleeMob::SetMobType( MobType_t nType )
 		case MobType_t::MELEE_NORMAL:
 		default:
 		{
-			m_flHeadScale = 1.f;
-
 			m_flAttackRange = 50.f;
 			m_flAttackDamage = 30.f;
 
@@ -471,8 +586,6 @@ void CTFMeleeMob::SetMobType( MobType_t nType )
 
 		case MobType_t::MELEE_GIANT:
 		{
-			m_flHeadScale = 1.f;
-
 			m_flAttackRange = 70.f;
 			m_flAttackDamage = 50.f;
 
@@ -495,7 +608,24 @@ void CTFMeleeMob::SetMobType( MobType_t nType )
 //-----------------------------------------------------------------------------------------------------
 void CTFMeleeMob::AddHat( const char *pszModel )
 {
-	if ( !m_hHat )
+	if ( m_hHat && m_hHat->IsEffectActive( EF_NODRAW ) )
+	{
+		// reuse the hat we stowed when we were last recycled
+		int iHead = LookupBone( "bip_head" );
+		if ( iHead != -1 )
+		{
+			m_hHat->SetModel( pszModel );
+
+			Vector pos;
+			QAngle angles;
+			GetBonePosition( iHead, pos, angles );
+			m_hHat->SetAbsOrigin( pos );
+			m_hHat->SetAbsAngles( angles );
+			m_hHat->RemoveEffects( EF_NODRAW );
+			m_hHat->FollowEntity( this, true );
+		}
+	}
+	else if ( !m_hHat )
 	{
 		int iHead = LookupBone( "bip_head" );
 		Assert( iHead != -1 );
@@ -518,6 +648,18 @@ void CTFMeleeMob::AddHat( const char *pszModel )
 }
 
 
+//-----------------------------------------------------------------------------------------------------
+// Hide the hat while we sit dormant in the mob pool, it is put back on by AddHat()
+void CTFMeleeMob::StowHat( void )
+{
+	if ( m_hHat )
+	{
+		m_hHat->StopFollowingEntity();
+		m_hHat->AddEffects( EF_NODRAW );
+	}
+}
+
+
 //---------------------------------------------------------------------------------------------
 //---------------------------------------------------------------------------------------------
 class CTFMeleeMobBehavior : public Action< CTFMeleeMob >
@@ -544,7 +686,7 @@ public:
 
 		if ( bDead )
 		{
-			UTIL_Remove( me );
+			me->Recycle();
 			return Done();
 		}
 
@@ -558,7 +700,7 @@ public:
 
 	virtual EventDesiredResult< CTFMeleeMob > OnKilled( CTFMeleeMob *me, const CTakeDamageInfo &info )
 	{
-		UTIL_Remove( me );
+		me->Recycle();
 
 		return TryDone();
 	}
@@ -684,3 +826,103 @@ bool CTFMeleeMobLocomotion::ShouldCollideWith( const CBaseEntity *object ) const
 {
 	return false;
 }
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Mobs don't collide with each other - the crowd steering computed for all of
+ * them this tick keeps them apart, so apply ours as part of the move.
+ */
+Vector CTFMeleeMobLocomotion::ResolveCrowdCollisions( const Vector &pos )
+{
+	CTFMeleeMob *me = (CTFMeleeMob *)GetBot()->GetEntity();
+
+	return pos + GetUpdateInterval() * TheMobCrowd().GetSteering( me );
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Mobs only collide with the world. A move that keeps our whole hull inside a flat,
+ * standing height nav area with nothing overhead can't hit anything, so there is no
+ * need to trace it. The nav mesh doesn't know about props, clip brushes and low
+ * ceilings, so the area's measured headroom must fit our hull.
+ */
+bool CTFMeleeMobLocomotion::IsMoveClearOfCollisions( const Vector &from, const Vector &to ) const
+{
+	if ( !tf_melee_mob_trust_nav.GetBool() )
+		return false;
+
+	CTFNavArea *area = (CTFNavArea *)GetBot()->GetEntity()->GetLastKnownArea();
+	if ( !area || !area->IsFlat() || area->HasAttributes( NAV_MESH_CROUCH ) )
+		return false;
+
+	if ( area->GetHeadroom() < GetBot()->GetBodyInterface()->GetHullHeight() )
+		return false;
+
+	const float halfHull = 0.5f * GetBot()->GetBodyInterface()->GetHullWidth();
+	const Vector nw = area->GetCorner( NORTH_WEST );
+	const Vector se = area->GetCorner( SOUTH_EAST );
+
+	// the area is convex, so a move between two inset points stays inside it - any move leaving it is traced
+	if ( from.x < nw.x + halfHull || from.x > se.x - halfHull || from.y < nw.y + halfHull || from.y > se.y - halfHull )
+		return false;
+
+	if ( to.x < nw.x + halfHull || to.x > se.x - halfHull || to.y < nw.y + halfHull || to.y > se.y - halfHull )
+		return false;
+
+	// must still be walking on the area, not stepping off an edge or up onto something
+	return fabs( to.z - area->GetZ( to.x, to.y ) ) < GetStepHeight();
+}
+
+
+//---------------------------------------------------------------------------------------------
+void CTFMeleeMobLocomotion::GetFlowFieldLimits( MobFlowFieldLimits_t *limits ) const
+{
+	limits->m_stepHeight = GetStepHeight();
+	limits->m_maxJumpHeight = GetMaxJumpHeight();
+	limits->m_deathDropHeight = GetDeathDropHeight();
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Move toward 'goalPos' by stepping into the next area of the flow field.
+ * Returns false when the field can't guide us - we're off the field, or the next
+ * step requires a jump - in which case the caller should fall back to path following.
+ */
+bool CTFMeleeMobLocomotion::ApproachAlongFlowField( const CTFMobFlowField &flowField, const Vector &goalPos )
+{
+	CNavArea *myArea = GetBot()->GetEntity()->GetLastKnownArea();
+	if ( !myArea || !flowField.IsReachable( myArea ) )
+		return false;
+
+	Vector moveGoal;
+	if ( myArea == flowField.GetTargetArea() )
+	{
+		// we're in the target's area, head straight for them
+		moveGoal = goalPos;
+	}
+	else
+	{
+		CNavArea *nextArea = flowField.GetNextArea( myArea );
+		if ( !nextArea )
+			return false;
+
+		if ( myArea->ComputeAdjacentConnectionHeightChange( nextArea ) >= GetStepHeight() )
+		{
+			// let the path follower handle climbing
+			return false;
+		}
+
+		Vector nextCenter = nextArea->GetCenter();
+		NavDirType dir = myArea->ComputeDirection( &nextCenter );
+		myArea->ComputeClosestPointInPortal( nextArea, dir, GetFeet(), &moveGoal );
+	}
+
+	SetDesiredSpeed( GetRunSpeed() );
+	FaceTowards( moveGoal );
+	Approach( moveGoal );
+
+	return true;
+}
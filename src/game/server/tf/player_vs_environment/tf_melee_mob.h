@@ -12,8 +12,14 @@
 #include "Path/NextBotPathFollow.h"
 #include "tf_melee_mob_body.h"
 #include "player_vs_environment/tf_mob_common.h"
+#include "nav_mesh/tf_nav_area.h"
 
 class CTFMeleeMob;
+class CTFMeleeMobPathCost;
+class CTFMobFlowField;
+struct MobFlowFieldLimits_t;
+
+#define MELEE_MOB_PATH_LANES 4		// number of distinct route preferences mobs are spread across
 
 
 //----------------------------------------------------------------------------
@@ -29,8 +35,15 @@ public:
 
 	virtual bool ShouldCollideWith( const CBaseEntity *object ) const;
 
+	// move toward 'goalPos' along the flow field, returning false if the field can't guide us from here
+	bool ApproachAlongFlowField( const CTFMobFlowField &flowField, const Vector &goalPos );
+	void GetFlowFieldLimits( MobFlowFieldLimits_t *limits ) const;
+
 private:
 	virtual float GetMaxYawRate( void ) const;				// return max rate of yaw rotation
+
+	virtual Vector ResolveCrowdCollisions( const Vector &pos );
+	virtual bool IsMoveClearOfCollisions( const Vector &from, const Vector &to ) const;
 };
 
 
@@ -78,15 +91,30 @@ public:
 	virtual CTFMeleeMobIntention	*GetIntentionInterface( void ) const	{ return m_intention; }
 	virtual CTFMeleeMobLocomotion	*GetLocomotionInterface( void ) const	{ return m_locomotor; }
 	virtual CTFMeleeMobBody	*GetBodyInterface( void ) const			{ return m_body; }
+	virtual bool ShouldUpdateAtFullRate( void ) const;
+	virtual unsigned int GetEventInterest( void ) const		{ return NEXTBOT_EVENT_OTHER_KILLED; }	// only the attack behavior reacts, to kills it could have seen
+	virtual float GetEventInterestRange( NextBotEventKind kind ) const	{ return 750.0f; }
+	virtual bool HasParallelThink( void ) const		{ return true; }
+	virtual void PrepareParallelThink( void );
+	virtual void ParallelThink( void );
+
+	// decisions made by ParallelThink() this tick, computed on the spot if it didn't run
+	CTFPlayer *GetClosestVictim( void );						// closest chaseable player
+	bool IsLineOfSightClearToVictim( CBaseEntity *victim );	// same test as IsLineOfSightClear( victim )
+	void SetChaseVictim( CBaseEntity *victim )	{ m_hChaseVictim = victim; }	// who ParallelThink() should check line of sight to next tick
+
+	const CTFMeleeMobPathCost &GetPathCost( void ) const	{ return *m_pathCost; }
 
 	void StartLifeTimer( float flLifeTime ) { m_lifeTimer.Start( flLifeTime ); }
 	bool ShouldSuicide() const;
 	void ForceSuicide() { m_bForceSuicide = true; }
 
-	MobType_t GetMobType() const { return m_nType; }
+	MobType_t GetMobType() const { return (MobType_t)m_nType.Get(); }
 	void SetMobType( MobType_t nType );
 	void AddHat( const char *pszModel );
 
+	void Recycle( void );		// return this dead mob to the mob pool, or remove it if the pool is full
+
 	static CTFMeleeMob* SpawnAtPos( const Vector& vSpawnPos, const Vector& vFaceTowards, CBaseEntity *pOwner = NULL, MobType_t nSkeletonType = MELEE_NORMAL, float flLifeTime = 0.f, int nTeam = TF_TEAM_HALLOWEEN );
 
 	float GetAttackRange() const { return m_flAttackRange; }
@@ -96,12 +124,16 @@ public:
 
 	void FireDeathOutput( CBaseEntity *pCulprit );
 private:
+	void BreakModel( void );
+	void StowHat( void );
+	bool ComputeLineOfSight( CBaseEntity *subject ) const;
+
 	CTFMeleeMobIntention *m_intention;
 	CTFMeleeMobLocomotion *m_locomotor;
 	CTFMeleeMobBody *m_body;
+	CTFMeleeMobPathCost *m_pathCost;
 
-	MobType_t m_nType;
-	CNetworkVar( float, m_flHeadScale );
+	CNetworkVar( int, m_nType );		// MobType_t
 
 	CHandle< CBaseAnimating > m_hHat;
 
@@ -121,6 +153,17 @@ private:
 
 	bool m_bDeathOutputFired;
 	COutputEvent m_OnDeath;
+
+	EHANDLE m_hChaseVictim;
+
+	struct ThinkResult_t
+	{
+		int m_tick;								// tick these results are valid for
+		CHandle< CTFPlayer > m_closestVictim;
+		EHANDLE m_losSubject[2];				// chase victim and closest victim
+		bool m_isLOSClear[2];
+	};
+	ThinkResult_t m_think;
 };
 
 
@@ -187,16 +230,25 @@ public:
 				return -1.0f;
 			}
 
-			// this term causes the same bot to choose different routes over time,
+			// spread out around hazards and crowds of other mobs
+			dist += dist * static_cast< CTFNavArea * >( area )->GetMobPathPenalty( TFNavDangerOverlay( m_me->GetTeamNumber() ) );
+
+			// this term causes bots in different lanes to choose different routes over time,
 			// but keep the same route for a period in case of repaths
 			int timeMod = (int)( gpGlobals->curtime / 10.0f ) + 1;
-			float preference = 1.0f + 50.0f * ( 1.0f + FastCos( (float)( m_me->GetEntity()->entindex() * area->GetID() * timeMod ) ) );
+			float preference = 1.0f + 50.0f * ( 1.0f + FastCos( (float)( GetShareKey() * area->GetID() * timeMod ) ) );
 			float cost = dist * preference;
 
 			return cost + fromArea->GetCostSoFar();
 		}
 	}
 
+	// all mobs in the same lane compute identical paths, so they can share them
+	virtual int GetShareKey( void ) const
+	{
+		return 1 + ( m_me->entindex() % MELEE_MOB_PATH_LANES );
+	}
+
 	CTFMeleeMob *m_me;
 };
 
@@ -33,6 +33,7 @@ bool CTFMeleeMobBody::StartActivity( Activity act, unsigned int flags )
 		me->SetPlaybackRate( 1.0f );
 		me->SetCycle( 0 );
 		me->ResetSequenceInfo();
+		me->ResetClientsideFrame();		// mobs animate on the client, so restart it there too
 
 		return true;
 	}
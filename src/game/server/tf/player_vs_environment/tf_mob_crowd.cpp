@@ -0,0 +1,221 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Crowd simulation for melee mobs.
+// Once per tick every grounded melee mob is hashed by position and its
+// separation/avoidance steering against its neighbors is computed in one pass.
+// Locomotion then applies that velocity instead of colliding mobs into each other.
+//
+//=============================================================================
+#include "cbase.h"
+
+#include "tf_melee_mob.h"
+#include "tf_mob_crowd.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar tf_mob_crowd( "tf_mob_crowd", "1", FCVAR_CHEAT, "Steer melee mobs apart from each other" );
+ConVar tf_mob_crowd_radius( "tf_mob_crowd_radius", "32", FCVAR_CHEAT, "Personal space of a melee mob" );
+ConVar tf_mob_crowd_separation_speed( "tf_mob_crowd_separation_speed", "150", FCVAR_CHEAT, "Speed at which fully overlapping mobs are pushed apart" );
+ConVar tf_mob_crowd_avoid_speed( "tf_mob_crowd_avoid_speed", "100", FCVAR_CHEAT, "Speed at which mobs sidestep slower mobs ahead of them" );
+ConVar tf_mob_crowd_max_speed( "tf_mob_crowd_max_speed", "200", FCVAR_CHEAT );
+ConVar tf_mob_crowd_debug( "tf_mob_crowd_debug", "0", FCVAR_CHEAT );
+
+#define MOB_CROWD_MAX_HEIGHT_DIFF	48.0f		// mobs further apart vertically are on different floors
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Singleton accessor.
+ */
+CTFMobCrowd &TheMobCrowd( void )
+{
+	static CTFMobCrowd crowd;
+	return crowd;
+}
+
+
+//---------------------------------------------------------------------------------------------
+CTFMobCrowd::CTFMobCrowd( void ) : m_hash( MOB_CROWD_CELL_SIZE )
+{
+	m_buildTick = -1;
+
+	for( int i=0; i<MAX_EDICTS; ++i )
+	{
+		m_entryByEntIndex[i] = -1;
+	}
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Rebuild the crowd if it was not yet built this tick.
+ * The first mob to move in a tick pays for everyone.
+ */
+void CTFMobCrowd::Update( void )
+{
+	if ( m_buildTick == gpGlobals->tickcount )
+		return;
+
+	m_buildTick = gpGlobals->tickcount;
+
+	Build();
+}
+
+
+//---------------------------------------------------------------------------------------------
+void CTFMobCrowd::Build( void )
+{
+	VPROF_BUDGET( "CTFMobCrowd::Build", "NextBot" );
+
+	FOR_EACH_VEC( m_entries, it )
+	{
+		m_entryByEntIndex[ m_entries[ it ].m_entIndex ] = -1;
+	}
+
+	m_entries.RemoveAll();
+	m_hash.Reset( MOB_CROWD_CELL_SIZE );
+
+	if ( !tf_mob_crowd.GetBool() )
+		return;
+
+	for( int i=0; i<ITFMeleeMobAutoList::AutoList().Count(); ++i )
+	{
+		CTFMeleeMob *mob = static_cast< CTFMeleeMob* >( ITFMeleeMobAutoList::AutoList()[i] );
+
+		// dead and pooled mobs, and mobs in the air or on ladders, don't take part
+		if ( !mob->IsAlive() || mob->IsMarkedForDeletion() )
+			continue;
+
+		CTFMeleeMobLocomotion *mover = mob->GetLocomotionInterface();
+		if ( !mover->IsOnGround() || mover->IsClimbingOrJumping() || mover->IsUsingLadder() )
+			continue;
+
+		Entry_t entry;
+		entry.m_pos = mover->GetFeet();
+		entry.m_velocity = mover->GetVelocity();
+		entry.m_steering = vec3_origin;
+		entry.m_entIndex = mob->entindex();
+
+		m_entryByEntIndex[ entry.m_entIndex ] = m_entries.AddToTail( entry );
+		m_hash.Insert( entry.m_pos );
+	}
+
+	FOR_EACH_VEC( m_entries, it )
+	{
+		ComputeSteering( it );
+	}
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Separation pushes us out of anyone inside our personal space.
+ * Avoidance sidesteps slower mobs in front of us before we run into them.
+ */
+void CTFMobCrowd::ComputeSteering( int i )
+{
+	Entry_t &me = m_entries[i];
+
+	const float radius = tf_mob_crowd_radius.GetFloat();
+	const float avoidRange = 2.0f * radius;
+
+	Vector2D myDir = me.m_velocity.AsVector2D();
+	float mySpeed = myDir.NormalizeInPlace();
+	const bool isMoving = mySpeed > 10.0f;
+
+	Vector2D separation( 0.0f, 0.0f );
+	Vector2D avoidance( 0.0f, 0.0f );
+
+	// search enough cells around us to cover the avoid range - 3x3 with the default radius
+	int cellRange = (int)ceil( avoidRange / MOB_CROWD_CELL_SIZE );
+
+	const int myCellX = m_hash.GetCellX( i );
+	const int myCellY = m_hash.GetCellY( i );
+
+	for( int cx = myCellX - cellRange; cx <= myCellX + cellRange; ++cx )
+	{
+		for( int cy = myCellY - cellRange; cy <= myCellY + cellRange; ++cy )
+		{
+			for( int j = m_hash.FirstInCell( cx, cy ); j >= 0; j = m_hash.NextInCell( j ) )
+			{
+				if ( j == i )
+					continue;
+
+				const Entry_t &them = m_entries[j];
+
+				if ( fabs( them.m_pos.z - me.m_pos.z ) > MOB_CROWD_MAX_HEIGHT_DIFF )
+					continue;
+
+				Vector2D toThem = them.m_pos.AsVector2D() - me.m_pos.AsVector2D();
+				float range = toThem.NormalizeInPlace();
+
+				if ( range > avoidRange )
+					continue;
+
+				if ( range < 0.001f )
+				{
+					// exactly on top of each other - split along an arbitrary but consistent axis
+					toThem = ( i < j ) ? Vector2D( 1.0f, 0.0f ) : Vector2D( -1.0f, 0.0f );
+				}
+
+				if ( range < radius )
+				{
+					separation -= ( 1.0f - range / radius ) * toThem;
+				}
+
+				if ( isMoving )
+				{
+					float ahead = DotProduct2D( toThem, myDir );
+					if ( ahead > 0.5f && DotProduct2D( them.m_velocity.AsVector2D(), myDir ) < mySpeed )
+					{
+						// they are in our way and we'd catch up - step to the side they are not on
+						Vector2D side( -myDir.y, myDir.x );
+						float sideSign = ( DotProduct2D( toThem, side ) > 0.0f ) ? -1.0f : 1.0f;
+						avoidance += sideSign * ahead * ( 1.0f - range / avoidRange ) * side;
+					}
+				}
+			}
+		}
+	}
+
+	Vector2D steering = tf_mob_crowd_separation_speed.GetFloat() * separation + tf_mob_crowd_avoid_speed.GetFloat() * avoidance;
+
+	const float maxSpeed = tf_mob_crowd_max_speed.GetFloat();
+	if ( steering.IsLengthGreaterThan( maxSpeed ) )
+	{
+		steering.NormalizeInPlace();
+		steering *= maxSpeed;
+	}
+
+	me.m_steering.x = steering.x;
+	me.m_steering.y = steering.y;
+	me.m_steering.z = 0.0f;
+
+	if ( tf_mob_crowd_debug.GetBool() && !me.m_steering.IsZero() )
+	{
+		NDebugOverlay::HorzArrow( me.m_pos, me.m_pos + 0.25f * me.m_steering, 2.0f, 255, 255, 0, 255, true, 0.1f );
+	}
+}
+
+
+//---------------------------------------------------------------------------------------------
+const Vector &CTFMobCrowd::GetSteering( const CTFMeleeMob *mob )
+{
+	Update();
+
+	int i = m_entryByEntIndex[ mob->entindex() ];
+	if ( i < 0 )
+		return vec3_origin;
+
+	return m_entries[i].m_steering;
+}
+
+
+//---------------------------------------------------------------------------------------------
+int CTFMobCrowd::GetCrowdSize( void )
+{
+	Update();
+
+	return m_entries.Count();
+}
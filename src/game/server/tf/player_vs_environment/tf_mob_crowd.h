@@ -0,0 +1,59 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Crowd simulation for melee mobs.
+// Once per tick every grounded melee mob is hashed by position and its
+// separation/avoidance steering against its neighbors is computed in one pass.
+// Locomotion then applies that velocity instead of colliding mobs into each other.
+//
+//=============================================================================
+#ifndef TF_MOB_CROWD_H
+#define TF_MOB_CROWD_H
+
+#include "NextBotSpatialHash.h"
+
+class CTFMeleeMob;
+
+#define MOB_CROWD_CELL_SIZE			64.0f		// size of a spatial bucket in world units, at least the neighbor range
+#define MOB_CROWD_HASH_SIZE			1024		// number of spatial buckets (power of two)
+
+
+//----------------------------------------------------------------------------
+class CTFMobCrowd
+{
+public:
+	CTFMobCrowd( void );
+
+	/**
+	 * Return the steering velocity that keeps 'mob' apart from the mobs around it.
+	 * Zero if the mob is not part of the crowd this tick (dead, airborne, etc).
+	 */
+	const Vector &GetSteering( const CTFMeleeMob *mob );
+
+	int GetCrowdSize( void );							// number of mobs in this tick's crowd
+
+	void Invalidate( void )		{ m_buildTick = -1; }	// force a rebuild on next query
+
+private:
+	void Update( void );								// rebuild the crowd if it is stale
+	void Build( void );
+	void ComputeSteering( int i );
+
+	struct Entry_t
+	{
+		Vector m_pos;
+		Vector m_velocity;
+		Vector m_steering;			// result
+		int m_entIndex;
+	};
+
+	CUtlVector< Entry_t > m_entries;
+	CNextBotSpatialHash< MOB_CROWD_HASH_SIZE > m_hash;		// entry positions, same indices as m_entries
+	int m_entryByEntIndex[ MAX_EDICTS ];			// entry of each mob, or -1
+
+	int m_buildTick;
+};
+
+// singleton accessor
+extern CTFMobCrowd &TheMobCrowd( void );
+
+#endif // TF_MOB_CROWD_H
@@ -29,7 +29,11 @@
 
 #define TF_MOBDROP_GLOW_THINK_TIME	0.1f	// how often should we check if should glow
 
+#define TF_MOBDROP_PICKUP_BLOAT		24.0f	// matches the trigger bloat of a regular item
+
 ConVar tf_mob_drop_lifetime( "tf_mob_drop_lifetime", "30", FCVAR_CHEAT );
+ConVar tf_mob_drop_merge_range( "tf_mob_drop_merge_range", "96", FCVAR_CHEAT, "New mob loot is added to an existing drop within this range instead of creating a new one" );
+ConVar tf_mob_drop_pickup_interval( "tf_mob_drop_pickup_interval", "0.1", FCVAR_CHEAT, "Seconds between checks for players touching mob drops" );
 
 LINK_ENTITY_TO_CLASS( item_mobdrop_cash_large, 	  CTFMobDropCashLarge    );
 LINK_ENTITY_TO_CLASS( item_mobdrop_cash_medium,   CTFMobDropCashMedium   );
@@ -40,6 +44,7 @@ LINK_ENTITY_TO_CLASS( item_mobdrop_ammo_small, 	  CTFMobDropAmmoSmall    );
 LINK_ENTITY_TO_CLASS( item_mobdrop_health_large,  CTFMobDropHealthLarge  );
 LINK_ENTITY_TO_CLASS( item_mobdrop_health_medium, CTFMobDropHealthMedium );
 LINK_ENTITY_TO_CLASS( item_mobdrop_health_small,  CTFMobDropHealthSmall  );
+LINK_ENTITY_TO_CLASS( item_mobdrop_bundle, 		  CTFMobDropBundle       );
 
 
 IMPLEMENT_SERVERCLASS_ST( CTFMobDrop, DT_MobDrop )
@@ -60,7 +65,10 @@ IMPLEMENT_AUTO_LIST( ITFMobDropAutoList );
 //-----------------------------------------------------------------------------
 CTFMobDrop::CTFMobDrop()
 {
-	m_nAmount = 0;
+	m_nCash = 0;
+	m_nAmmo = 0;
+	m_nHealth = 0;
+	m_blinkCount = 0;
 	m_bTouched = false;
 	m_bClaimed = false;
 }
@@ -97,19 +105,11 @@ void CTFMobDrop::UpdateOnRemove( void )
 
 
 //-----------------------------------------------------------------------------
-// Purpose: Always transmitted to clients
+// Purpose: Only clients that can see the drop need it
 //-----------------------------------------------------------------------------
 int CTFMobDrop::UpdateTransmitState( void )
 {
-	return SetTransmitState( FL_EDICT_ALWAYS );
-}
-
-//-----------------------------------------------------------------------------
-// Purpose:
-//-----------------------------------------------------------------------------
-int CTFMobDrop::ShouldTransmit( const CCheckTransmitInfo *pInfo )
-{
-	return FL_EDICT_ALWAYS;
+	return SetTransmitState( FL_EDICT_PVSCHECK );
 }
 
 //-----------------------------------------------------------------------------
@@ -119,27 +119,25 @@ void CTFMobDrop::Spawn( void )
 {
 	BaseClass::Spawn();
 	m_blinkCount = 0;
-	m_blinkTimer.Invalidate();
-	SetContextThink( &CTFMobDrop::BlinkThink, gpGlobals->curtime + GetLifeTime() - TF_MOBDROP_BLINK_PERIOD - RandomFloat( 0.0, TF_MOBDROP_BLINK_DURATION ), "MobDropWaitingToBlinkThink" );
-	
+
 	// Force collision size to see if this fixes a bunch of stuck-in-geo issues goes away
 	SetCollisionBounds( Vector( -10, -10, -10 ), Vector( 10, 10, 10 ) );
 
+	// not a trigger - the drop manager checks for players touching us
+	RemoveSolidFlags( FSOLID_TRIGGER );
+
 	const char* particles = GetSpawnParticles();
 	if ( particles )
 		DispatchParticleEffect( particles, PATTACH_ABSORIGIN_FOLLOW, this );
+
+	TheMobDrops().Register( this );
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: Blink off/on when about to expire and play expire sound
+// Purpose: Blink off/on when about to expire
 //-----------------------------------------------------------------------------
-void CTFMobDrop::BlinkThink( void )
+void CTFMobDrop::Blink( void )
 {
-	// This means the pack was claimed by a player via Radius Currency Collection and
-	// is likely flying toward them.  Regardless, one second later it fires Touch().
-	if ( IsClaimed() )
-		return;
-
 	++m_blinkCount;
 
 	SetRenderMode( kRenderTransAlpha );
@@ -152,8 +150,18 @@ void CTFMobDrop::BlinkThink( void )
 	{
 		SetRenderColorA( 255 );
 	}
+}
 
-	SetContextThink( &CTFMobDrop::BlinkThink, gpGlobals->curtime + TF_MOBDROP_BLINK_DURATION, "MobDropBlinkThink" );
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CTFMobDrop::StopBlinking( void )
+{
+	if ( m_blinkCount )
+	{
+		m_blinkCount = 0;
+		SetRenderColorA( 255 );
+	}
 }
 
 
@@ -164,8 +172,8 @@ void CTFMobDrop::ComeToRest( void )
 {
 	BaseClass::ComeToRest();
 
-	if ( IsClaimed() )
-		return;
+	// stay out of the engine's touch list, see Spawn()
+	RemoveSolidFlags( FSOLID_TRIGGER );
 }
 
 //-----------------------------------------------------------------------------
@@ -173,7 +181,58 @@ void CTFMobDrop::ComeToRest( void )
 //-----------------------------------------------------------------------------
 void CTFMobDrop::SetAmount( float nAmount )
 {
-	m_nAmount = nAmount;
+	switch ( GetDropType() )
+	{
+		case TF_MOB_DROP_CASH_LARGE:
+		case TF_MOB_DROP_CASH_MEDIUM:
+		case TF_MOB_DROP_CASH_SMALL:
+			m_nCash = nAmount;
+			break;
+
+		case TF_MOB_DROP_AMMO_LARGE:
+		case TF_MOB_DROP_AMMO_MEDIUM:
+		case TF_MOB_DROP_AMMO_SMALL:
+			m_nAmmo = nAmount;
+			break;
+
+		case TF_MOB_DROP_HEALTH_LARGE:
+		case TF_MOB_DROP_HEALTH_MEDIUM:
+		case TF_MOB_DROP_HEALTH_SMALL:
+			m_nHealth = nAmount;
+			break;
+
+		default:
+			Assert( 0 );
+			break;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Add loot to a bundle
+//-----------------------------------------------------------------------------
+void CTFMobDrop::AddContents( int nCash, int nAmmo, int nHealth )
+{
+	const char *pszOldModel = GetDefaultPowerupModel();
+
+	m_nCash += nCash;
+	m_nAmmo += nAmmo;
+	m_nHealth += nHealth;
+
+	// bundles show what they hold, once spawned
+	const char *pszNewModel = GetDefaultPowerupModel();
+	if ( GetModelIndex() && pszNewModel != pszOldModel )
+	{
+		SetModel( pszNewModel );
+		SetCollisionBounds( Vector( -10, -10, -10 ), Vector( 10, 10, 10 ) );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+bool CTFMobDrop::CanMerge( void )
+{
+	return GetDropType() == TF_MOB_DROP_BUNDLE && !m_bTouched && !m_bClaimed && !IsMarkedForDeletion();
 }
 
 void CTFMobDrop::PrecacheDrops( void )
@@ -244,47 +303,29 @@ bool CTFMobDrop::MyTouch( CBasePlayer *pPlayer )
 			EmitSound( filter, entindex(), sound );
 		}
 
-		switch (GetDropType())
+		if ( m_nCash > 0 )
 		{
-			case TF_MOB_DROP_CASH_LARGE:
-			case TF_MOB_DROP_CASH_MEDIUM:
-			case TF_MOB_DROP_CASH_SMALL:
-			{
-				TFGameRules()->DistributeCurrencyAmount( m_nAmount, pTFPlayer );
-				CTF_GameStats.Event_PlayerCollectedCurrency( pTFPlayer, m_nAmount );
-				pTFPlayer->SpeakConceptIfAllowed( MP_CONCEPT_MVM_MONEY_PICKUP );
-				break;
-			}
-
-			case TF_MOB_DROP_AMMO_LARGE:
-			case TF_MOB_DROP_AMMO_MEDIUM:
-			case TF_MOB_DROP_AMMO_SMALL:
-			{
-				pTFPlayer->GiveAmmo( m_nAmount, TF_AMMO_PRIMARY, true, kAmmoSource_Pickup );
-				pTFPlayer->GiveAmmo( m_nAmount, TF_AMMO_SECONDARY, true, kAmmoSource_Pickup );
-				pTFPlayer->GiveAmmo( m_nAmount, TF_AMMO_METAL, true, kAmmoSource_Pickup );
-				break;
-			}
+			TFGameRules()->DistributeCurrencyAmount( m_nCash, pTFPlayer );
+			CTF_GameStats.Event_PlayerCollectedCurrency( pTFPlayer, m_nCash );
+			pTFPlayer->SpeakConceptIfAllowed( MP_CONCEPT_MVM_MONEY_PICKUP );
+		}
 
-			case TF_MOB_DROP_HEALTH_LARGE:
-			case TF_MOB_DROP_HEALTH_MEDIUM:
-			case TF_MOB_DROP_HEALTH_SMALL:
-			{
-				float flHealth = m_nAmount;
-				CALL_ATTRIB_HOOK_FLOAT_ON_OTHER( pTFPlayer, flHealth, mult_health_frompacks );
-				int nHealthGiven = pTFPlayer->TakeHealth( flHealth, DMG_GENERIC );
-				if ( pTFPlayer->m_Shared.InCond( TF_COND_BURNING ) )
-				{
-					pTFPlayer->EmitSound( "TFPlayer.FlameOut" );
-					pTFPlayer->m_Shared.RemoveCond( TF_COND_BURNING );
-				}
-				break;
-			}
+		if ( m_nAmmo > 0 )
+		{
+			pTFPlayer->GiveAmmo( m_nAmmo, TF_AMMO_PRIMARY, true, kAmmoSource_Pickup );
+			pTFPlayer->GiveAmmo( m_nAmmo, TF_AMMO_SECONDARY, true, kAmmoSource_Pickup );
+			pTFPlayer->GiveAmmo( m_nAmmo, TF_AMMO_METAL, true, kAmmoSource_Pickup );
+		}
 
-			default:
+		if ( m_nHealth > 0 )
+		{
+			float flHealth = m_nHealth;
+			CALL_ATTRIB_HOOK_FLOAT_ON_OTHER( pTFPlayer, flHealth, mult_health_frompacks );
+			pTFPlayer->TakeHealth( flHealth, DMG_GENERIC );
+			if ( pTFPlayer->m_Shared.InCond( TF_COND_BURNING ) )
 			{
-				Assert(0);
-				break;
+				pTFPlayer->EmitSound( "TFPlayer.FlameOut" );
+				pTFPlayer->m_Shared.RemoveCond( TF_COND_BURNING );
 			}
 		}
 
@@ -296,3 +337,213 @@ bool CTFMobDrop::MyTouch( CBasePlayer *pPlayer )
 	return m_bTouched;
 }
 
+
+//=============================================================================
+//
+// CTF MobDropBundle functions.
+//
+
+//-----------------------------------------------------------------------------
+// Purpose: Look like the most valuable thing we're carrying
+//-----------------------------------------------------------------------------
+const char *CTFMobDropBundle::GetDefaultPowerupModel( void )
+{
+	if ( m_nCash >= 50 )
+		return "models/items/currencypack_large.mdl";
+
+	if ( m_nCash >= 25 )
+		return "models/items/currencypack_medium.mdl";
+
+	if ( m_nCash > 0 )
+		return "models/items/currencypack_small.mdl";
+
+	if ( m_nHealth > 0 )
+		return "models/items/medkit_small.mdl";
+
+	return "models/items/ammopack_small.mdl";
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+const char *CTFMobDropBundle::GetPickupSound( void )
+{
+	if ( m_nCash > 0 )
+		return "MVM.MoneyPickup";
+
+	if ( m_nHealth > 0 )
+		return "HealthKit.Touch";
+
+	return "AmmoPack.Touch";
+}
+
+
+//=============================================================================
+//
+// CTF MobDropManager functions.
+//
+
+//-----------------------------------------------------------------------------
+// Purpose: Singleton accessor
+//-----------------------------------------------------------------------------
+static CTFMobDropManager s_mobDropManager;
+
+CTFMobDropManager &TheMobDrops( void )
+{
+	return s_mobDropManager;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Drop loot at 'origin'. When mobs die in bunches - explosions,
+// AoE kill chains - this piles their loot into a few drops rather than
+// creating an entity per item per mob.
+//-----------------------------------------------------------------------------
+void CTFMobDropManager::DropLoot( const Vector &origin, int nCash, int nAmmo, int nHealth, CBaseCombatCharacter *pSource )
+{
+	const float flMergeRangeSq = tf_mob_drop_merge_range.GetFloat() * tf_mob_drop_merge_range.GetFloat();
+
+	FOR_EACH_VEC( m_dropVector, i )
+	{
+		CTFMobDrop *pDrop = m_dropVector[i].m_hDrop;
+		if ( !pDrop || !pDrop->CanMerge() )
+			continue;
+
+		if ( ( pDrop->GetAbsOrigin() - origin ).LengthSqr() < flMergeRangeSq )
+		{
+			pDrop->AddContents( nCash, nAmmo, nHealth );
+			pDrop->StopBlinking();
+			ResetLifeTime( i );
+			return;
+		}
+	}
+
+	CTFMobDrop *pDrop = assert_cast<CTFMobDrop*>( CBaseEntity::CreateNoSpawn( "item_mobdrop_bundle", origin, vec3_angle, pSource ) );
+	if ( !pDrop )
+		return;
+
+	pDrop->AddContents( nCash, nAmmo, nHealth );
+
+	Vector vecImpulse = RandomVector( -1, 1 );
+	vecImpulse.z = RandomFloat( 3.0f, 15.0f );
+	VectorNormalize( vecImpulse );
+	Vector vecVelocity = vecImpulse * 250.0 * RandomFloat( 1.0f, 4.0f );
+
+	DispatchSpawn( pDrop );
+	pDrop->DropSingleInstance( vecVelocity, pSource, 0, 0 );
+
+	// we expire drops ourselves
+	pDrop->SetContextThink( NULL, 0, "PowerupRemoveThink" );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CTFMobDropManager::Register( CTFMobDrop *pDrop )
+{
+	int i = m_dropVector.AddToTail();
+	m_dropVector[i].m_hDrop = pDrop;
+	ResetLifeTime( i );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void CTFMobDropManager::ResetLifeTime( int i )
+{
+	DropRecord_t &record = m_dropVector[i];
+
+	record.m_flExpireTime = gpGlobals->curtime + record.m_hDrop->GetLifeTime();
+	record.m_flNextBlinkTime = record.m_flExpireTime - TF_MOBDROP_BLINK_PERIOD - RandomFloat( 0.0, TF_MOBDROP_BLINK_DURATION );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Gather the players that may pick up drops, along with their bounds
+//-----------------------------------------------------------------------------
+void CTFMobDropManager::CollectPickupCandidates( void )
+{
+	m_candidateVector.RemoveAll();
+
+	CUtlVector< CTFPlayer * > playerVector;
+	CollectPlayers( &playerVector, TF_TEAM_RED, COLLECT_ONLY_LIVING_PLAYERS );
+	CollectPlayers( &playerVector, TF_TEAM_BLUE, COLLECT_ONLY_LIVING_PLAYERS, APPEND_PLAYERS );
+
+	FOR_EACH_VEC( playerVector, i )
+	{
+		// bots don't pick up drops
+		if ( playerVector[i]->IsBot() )
+			continue;
+
+		Candidate_t &candidate = m_candidateVector[ m_candidateVector.AddToTail() ];
+		candidate.m_player = playerVector[i];
+		playerVector[i]->CollisionProp()->WorldSpaceAABB( &candidate.m_vecMins, &candidate.m_vecMaxs );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: The one think for all mob drops
+//-----------------------------------------------------------------------------
+void CTFMobDropManager::FrameUpdatePostEntityThink( void )
+{
+	VPROF_BUDGET( "CTFMobDropManager::FrameUpdatePostEntityThink", VPROF_BUDGETGROUP_GAME );
+
+	if ( m_dropVector.Count() == 0 )
+		return;
+
+	bool bCheckPickup = m_pickupTimer.IsElapsed();
+	if ( bCheckPickup )
+	{
+		m_pickupTimer.Start( tf_mob_drop_pickup_interval.GetFloat() );
+		CollectPickupCandidates();
+	}
+
+	const Vector vecBloat( TF_MOBDROP_PICKUP_BLOAT, TF_MOBDROP_PICKUP_BLOAT, TF_MOBDROP_PICKUP_BLOAT );
+
+	for( int i=m_dropVector.Count()-1; i>=0; --i )
+	{
+		DropRecord_t &record = m_dropVector[i];
+
+		CTFMobDrop *pDrop = record.m_hDrop;
+		if ( !pDrop || pDrop->IsMarkedForDeletion() )
+		{
+			m_dropVector.FastRemove( i );
+			continue;
+		}
+
+		if ( gpGlobals->curtime >= record.m_flExpireTime )
+		{
+			UTIL_Remove( pDrop );
+			m_dropVector.FastRemove( i );
+			continue;
+		}
+
+		// Claimed packs are flying toward a player via Radius Currency Collection,
+		// and will be picked up shortly.
+		if ( gpGlobals->curtime >= record.m_flNextBlinkTime && !pDrop->IsClaimed() )
+		{
+			pDrop->Blink();
+			record.m_flNextBlinkTime = gpGlobals->curtime + TF_MOBDROP_BLINK_DURATION;
+		}
+
+		if ( bCheckPickup && m_candidateVector.Count() )
+		{
+			Vector vecMins, vecMaxs;
+			pDrop->CollisionProp()->WorldSpaceAABB( &vecMins, &vecMaxs );
+			vecMins -= vecBloat;
+			vecMaxs += vecBloat;
+
+			FOR_EACH_VEC( m_candidateVector, c )
+			{
+				const Candidate_t &candidate = m_candidateVector[c];
+
+				if ( IsBoxIntersectingBox( vecMins, vecMaxs, candidate.m_vecMins, candidate.m_vecMaxs ) )
+				{
+					// runs the regular item pickup logic, removing the drop if taken
+					pDrop->Touch( candidate.m_player );
+
+					if ( pDrop->IsTouched() )
+						break;
+				}
+			}
+		}
+	}
+}
@@ -14,6 +14,7 @@
 #include "player.h"
 #include "tf_shareddefs.h"
 
+class CTFPlayer;
 
 //=============================================================================
 //
@@ -39,18 +40,23 @@ public:
 	void	Precache( void );
 	void	UpdateOnRemove( void );
 	virtual int UpdateTransmitState() OVERRIDE;
-	virtual int ShouldTransmit( const CCheckTransmitInfo *pInfo ) OVERRIDE;
 	virtual float	GetLifeTime( void ) { return tf_mob_drop_lifetime.GetFloat(); }
 	bool	MyTouch( CBasePlayer *pPlayer );
 	virtual bool AffectedByRadiusCollection() const { return true; }
 
-	void	SetAmount( float flAmount );
+	void	SetAmount( float flAmount );						// set the contents of a single type drop
+	void	AddContents( int nCash, int nAmmo, int nHealth );
 	void	SetClaimed( void )
 	{
 		m_bClaimed = true;
 		SetFriction(0.2f); // Radius collection code "steers" packs toward the player
 	}
 	bool	IsClaimed( void ) { return m_bClaimed; }	// So don't allow other players to interfere
+	bool	IsTouched( void ) const { return m_bTouched; }
+	bool	CanMerge( void );								// can more loot be piled into this drop?
+
+	void	Blink( void );
+	void	StopBlinking( void );
 	
 	virtual MobDrops_t	GetDropType( void ) { return TF_MOB_DROP_CASH_LARGE; }
 	virtual const char *GetDefaultPowerupModel( void ) { return "models/items/currencypack_large.mdl"; }
@@ -62,16 +68,31 @@ public:
 protected:
 	virtual void ComeToRest( void );
 
-	void BlinkThink( void );
-
-	int		m_nAmount;
+	int		m_nCash;
+	int		m_nAmmo;
+	int		m_nHealth;
 	int m_blinkCount;
-	CountdownTimer m_blinkTimer;
 	bool	m_bTouched;
 	bool	m_bClaimed;
 	//CNetworkVar( bool, m_bDistributed );
 };
 
+// --------------------------------
+// Bundle - everything a mob dropped
+// --------------------------------
+class CTFMobDropBundle : public CTFMobDrop
+{
+public:
+	DECLARE_CLASS( CTFMobDropBundle, CTFMobDrop );
+
+	virtual MobDrops_t	GetDropType( void ) { return TF_MOB_DROP_BUNDLE; }
+	virtual const char *GetDefaultPowerupModel( void );
+	virtual const char *GetPickupSound( void );
+	virtual const char *GetVanishSound( void ) { return m_nCash > 0 ? "Fire.Engulf" : nullptr; }
+	virtual const char *GetSpawnParticles( void ) { return m_nCash > 0 ? "mvm_cash_embers" : nullptr; }
+	virtual const char *GetVanishParticles( void ) { return m_nCash > 0 ? "mvm_cash_explosion" : nullptr; }
+};
+
 // --------------------------------
 // Cash
 // --------------------------------
@@ -186,6 +207,52 @@ public:
 	virtual const char *GetVanishParticles( void ) { return nullptr; }
 };
 
+
+//=============================================================================
+//
+// Owns all live mob drops. New loot is piled into drops already lying nearby,
+// and a single per-frame update expires, blinks and hands out every drop -
+// drops are not triggers, pickup is a batched proximity check against players.
+//
+class CTFMobDropManager : public CAutoGameSystemPerFrame
+{
+public:
+	CTFMobDropManager( void ) : CAutoGameSystemPerFrame( "CTFMobDropManager" ) { }
+
+	virtual void LevelShutdownPreEntity( void )		{ m_dropVector.RemoveAll(); }
+	virtual void FrameUpdatePostEntityThink( void );
+
+	// drop the given loot at 'origin', merging it into a nearby drop if there is one
+	void DropLoot( const Vector &origin, int nCash, int nAmmo, int nHealth, CBaseCombatCharacter *pSource );
+
+	void Register( CTFMobDrop *pDrop );				// start managing the given drop
+	int GetDropCount( void ) const		{ return m_dropVector.Count(); }
+
+private:
+	void ResetLifeTime( int i );
+	void CollectPickupCandidates( void );
+
+	struct DropRecord_t
+	{
+		CHandle< CTFMobDrop > m_hDrop;
+		float m_flExpireTime;
+		float m_flNextBlinkTime;
+	};
+	CUtlVector< DropRecord_t > m_dropVector;
+
+	struct Candidate_t
+	{
+		CTFPlayer *m_player;
+		Vector m_vecMins, m_vecMaxs;
+	};
+	CUtlVector< Candidate_t > m_candidateVector;
+
+	CountdownTimer m_pickupTimer;
+};
+
+// singleton accessor
+extern CTFMobDropManager &TheMobDrops( void );
+
 #endif // TF_MOB_DROP_H
 
 
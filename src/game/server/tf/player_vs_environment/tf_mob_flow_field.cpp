@@ -0,0 +1,295 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Flow fields toward commonly chased targets.
+// One reverse Dijkstra search from the target's area gives every mob on the
+// mesh its next area toward the target, regardless of how many are chasing.
+//
+//=============================================================================
+#include "cbase.h"
+
+#include "nav_mesh.h"
+#include "nav_mesh/tf_nav_area.h"
+#include "utlpriorityqueue.h"
+
+#include "tf_mob_flow_field.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar tf_mob_flow_field_refresh( "tf_mob_flow_field_refresh", "0.5", FCVAR_CHEAT, "Seconds between rebuilds of a flow field whose target changed areas" );
+ConVar tf_mob_flow_field_expire( "tf_mob_flow_field_expire", "5", FCVAR_CHEAT, "Seconds an unused flow field is kept around" );
+ConVar tf_mob_flow_field_debug( "tf_mob_flow_field_debug", "0", FCVAR_CHEAT );
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Singleton accessor.
+ */
+static CTFMobFlowFieldManager s_mobFlowFieldManager;
+
+CTFMobFlowFieldManager &TheMobFlowFields( void )
+{
+	return s_mobFlowFieldManager;
+}
+
+
+//---------------------------------------------------------------------------------------------
+struct FlowFieldOpen_t
+{
+	float m_cost;
+	CNavArea *m_area;
+};
+
+static bool FlowFieldOpenLess( const FlowFieldOpen_t &lhs, const FlowFieldOpen_t &rhs )
+{
+	// the priority queue keeps the "largest" element at its head - we want the cheapest
+	return lhs.m_cost > rhs.m_cost;
+}
+
+
+//---------------------------------------------------------------------------------------------
+CTFMobFlowField::CTFMobFlowField( void )
+{
+	m_target = NULL;
+	m_targetArea = NULL;
+	m_teamID = TEAM_ANY;
+	m_limits.m_stepHeight = 0.0f;
+	m_limits.m_maxJumpHeight = 0.0f;
+	m_limits.m_deathDropHeight = 0.0f;
+	m_lastUsedTime = 0.0f;
+	m_lastDrawTick = -1;
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Compute the cost to the target area from every area that can reach it.
+ * The search runs backwards from the target over reversed connections,
+ * so each area records the neighbor it should move into next.
+ */
+void CTFMobFlowField::Build( CBaseCombatCharacter *target, int teamID, const MobFlowFieldLimits_t &limits )
+{
+	VPROF_BUDGET( "CTFMobFlowField::Build", "NextBot" );
+
+	m_target = target;
+	m_teamID = teamID;
+	m_limits = limits;
+	m_targetArea = target ? target->GetLastKnownArea() : NULL;
+	m_ageTimer.Start();
+
+	unsigned int maxID = 0;
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		maxID = MAX( maxID, TheNavAreas[ it ]->GetID() );
+	}
+
+	m_cost.SetCount( maxID + 1 );
+	m_next.SetCount( maxID + 1 );
+
+	for( int i=0; i<m_cost.Count(); ++i )
+	{
+		m_cost[i] = FLT_MAX;
+		m_next[i] = NULL;
+	}
+
+	if ( !m_targetArea || m_targetArea->IsBlocked( teamID ) )
+		return;
+
+	CUtlPriorityQueue< FlowFieldOpen_t > openQueue( 0, TheNavAreas.Count(), FlowFieldOpenLess );
+
+	FlowFieldOpen_t start;
+	start.m_cost = 0.0f;
+	start.m_area = m_targetArea;
+	m_cost[ m_targetArea->GetID() ] = 0.0f;
+	openQueue.Insert( start );
+
+	TFNavCostOverlayType dangerOverlay = TFNavDangerOverlay( teamID );
+
+	while( openQueue.Count() )
+	{
+		FlowFieldOpen_t open = openQueue.ElementAtHead();
+		openQueue.RemoveAtHead();
+
+		CNavArea *area = open.m_area;
+
+		if ( open.m_cost > m_cost[ area->GetID() ] )
+		{
+			// stale queue entry - already reached more cheaply
+			continue;
+		}
+
+		for( int pass=0; pass<2; ++pass )
+		{
+			for( int dir=0; dir<NUM_DIRECTIONS; ++dir )
+			{
+				// first pass - areas connected both ways, second pass - one-way connections into this area
+				const NavConnectVector *connectVector = ( pass == 0 ) ? area->GetAdjacentAreas( (NavDirType)dir ) : area->GetIncomingConnections( (NavDirType)dir );
+				NavDirType dirToArea = OppositeDirection( (NavDirType)dir );
+
+				FOR_EACH_VEC( (*connectVector), cit )
+				{
+					CNavArea *fromArea = (*connectVector)[ cit ].area;
+
+					if ( pass == 0 && !fromArea->IsConnected( area, dirToArea ) )
+						continue;
+
+					if ( fromArea->IsBlocked( teamID ) )
+						continue;
+
+					float dist = (*connectVector)[ cit ].length;
+					if ( dist <= 0.0f )
+					{
+						dist = ( area->GetCenter() - fromArea->GetCenter() ).Length();
+					}
+
+					float deltaZ = fromArea->ComputeAdjacentConnectionHeightChange( area );
+					if ( deltaZ >= limits.m_stepHeight )
+					{
+						if ( deltaZ >= limits.m_maxJumpHeight )
+						{
+							// too high to reach
+							continue;
+						}
+
+						// jumping is slower than flat ground
+						const float jumpPenalty = 5.0f;
+						dist += jumpPenalty * dist;
+					}
+					else if ( deltaZ < -limits.m_deathDropHeight )
+					{
+						// too far to drop
+						continue;
+					}
+
+					// spread out around hazards and crowds, like CTFMeleeMobPathCost
+					dist += dist * static_cast< CTFNavArea * >( area )->GetMobPathPenalty( dangerOverlay );
+
+					float newCost = open.m_cost + dist;
+					unsigned int fromID = fromArea->GetID();
+					if ( newCost < m_cost[ fromID ] )
+					{
+						m_cost[ fromID ] = newCost;
+						m_next[ fromID ] = area;
+
+						FlowFieldOpen_t next;
+						next.m_cost = newCost;
+						next.m_area = fromArea;
+						openQueue.Insert( next );
+					}
+				}
+			}
+		}
+	}
+}
+
+
+//---------------------------------------------------------------------------------------------
+bool CTFMobFlowField::IsReachable( const CNavArea *area ) const
+{
+	return GetCostToTarget( area ) < FLT_MAX;
+}
+
+
+//---------------------------------------------------------------------------------------------
+CNavArea *CTFMobFlowField::GetNextArea( const CNavArea *area ) const
+{
+	if ( !area || area->GetID() >= (unsigned int)m_next.Count() )
+		return NULL;
+
+	return m_next[ area->GetID() ];
+}
+
+
+//---------------------------------------------------------------------------------------------
+float CTFMobFlowField::GetCostToTarget( const CNavArea *area ) const
+{
+	if ( !area || area->GetID() >= (unsigned int)m_cost.Count() )
+		return FLT_MAX;
+
+	return m_cost[ area->GetID() ];
+}
+
+
+//---------------------------------------------------------------------------------------------
+void CTFMobFlowField::Draw( void ) const
+{
+	FOR_EACH_VEC( TheNavAreas, it )
+	{
+		CNavArea *area = TheNavAreas[ it ];
+		CNavArea *next = GetNextArea( area );
+		if ( next )
+		{
+			NDebugOverlay::HorzArrow( area->GetCenter(), next->GetCenter(), 3.0f, 0, 255, 0, 255, true, NDEBUG_PERSIST_TILL_NEXT_SERVER );
+		}
+	}
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Return a flow field toward 'target' for the given team, building or refreshing it if needed.
+ * Mobs that step, jump or drop differently (giants) get their own field.
+ * A field is rebuilt when it is older than the refresh interval and its target has moved
+ * into a different area since it was built.
+ */
+CTFMobFlowField *CTFMobFlowFieldManager::GetFlowField( CBaseCombatCharacter *target, int teamID, const MobFlowFieldLimits_t &limits )
+{
+	if ( !target || !TheNavMesh->IsLoaded() )
+		return NULL;
+
+	RemoveStaleFields();
+
+	CTFMobFlowField *field = NULL;
+	FOR_EACH_VEC( m_fieldVector, it )
+	{
+		if ( m_fieldVector[ it ]->GetTarget() == target && m_fieldVector[ it ]->GetTeam() == teamID && m_fieldVector[ it ]->GetLimits() == limits )
+		{
+			field = m_fieldVector[ it ];
+			break;
+		}
+	}
+
+	if ( !field )
+	{
+		field = new CTFMobFlowField;
+		field->Build( target, teamID, limits );
+		m_fieldVector.AddToTail( field );
+	}
+	else if ( field->GetAge() > tf_mob_flow_field_refresh.GetFloat() && field->GetTargetArea() != target->GetLastKnownArea() )
+	{
+		field->Build( target, teamID, limits );
+	}
+
+	field->m_lastUsedTime = gpGlobals->curtime;
+
+	// every mob chasing the target asks for its field each tick, only draw it once
+	if ( tf_mob_flow_field_debug.GetBool() && field->m_lastDrawTick != gpGlobals->tickcount )
+	{
+		field->m_lastDrawTick = gpGlobals->tickcount;
+		field->Draw();
+	}
+
+	return field;
+}
+
+
+//---------------------------------------------------------------------------------------------
+void CTFMobFlowFieldManager::RemoveStaleFields( void )
+{
+	for( int i=m_fieldVector.Count()-1; i>=0; --i )
+	{
+		CTFMobFlowField *field = m_fieldVector[i];
+		if ( field->GetTarget() == NULL || gpGlobals->curtime - field->m_lastUsedTime > tf_mob_flow_field_expire.GetFloat() )
+		{
+			delete field;
+			m_fieldVector.FastRemove( i );
+		}
+	}
+}
+
+
+//---------------------------------------------------------------------------------------------
+void CTFMobFlowFieldManager::Reset( void )
+{
+	m_fieldVector.PurgeAndDeleteElements();
+}
@@ -0,0 +1,95 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Flow fields toward commonly chased targets.
+// One reverse Dijkstra search from the target's area gives every mob on the
+// mesh its next area toward the target, regardless of how many are chasing.
+//
+//=============================================================================
+#ifndef TF_MOB_FLOW_FIELD_H
+#define TF_MOB_FLOW_FIELD_H
+
+class CNavArea;
+
+
+//----------------------------------------------------------------------------
+/**
+ * Movement limits the flow field is built for
+ */
+struct MobFlowFieldLimits_t
+{
+	float m_stepHeight;			// higher steps are treated as jumps
+	float m_maxJumpHeight;		// higher steps are impassable
+	float m_deathDropHeight;	// deeper drops are impassable
+
+	bool operator==( const MobFlowFieldLimits_t &other ) const
+	{
+		return m_stepHeight == other.m_stepHeight && m_maxJumpHeight == other.m_maxJumpHeight && m_deathDropHeight == other.m_deathDropHeight;
+	}
+};
+
+
+//----------------------------------------------------------------------------
+class CTFMobFlowField
+{
+public:
+	CTFMobFlowField( void );
+
+	void Build( CBaseCombatCharacter *target, int teamID, const MobFlowFieldLimits_t &limits );
+
+	CBaseCombatCharacter *GetTarget( void ) const	{ return m_target; }
+	int GetTeam( void ) const						{ return m_teamID; }
+	const MobFlowFieldLimits_t &GetLimits( void ) const	{ return m_limits; }
+	CNavArea *GetTargetArea( void ) const			{ return m_targetArea; }
+	float GetAge( void ) const						{ return m_ageTimer.GetElapsedTime(); }
+
+	bool IsReachable( const CNavArea *area ) const;				// return true if the target can be reached from the given area
+	CNavArea *GetNextArea( const CNavArea *area ) const;		// return the next area toward the target, or NULL
+	float GetCostToTarget( const CNavArea *area ) const;		// return travel cost from the given area to the target area, or FLT_MAX
+
+	void Draw( void ) const;
+
+private:
+	friend class CTFMobFlowFieldManager;
+
+	CHandle< CBaseCombatCharacter > m_target;
+	CNavArea *m_targetArea;
+	int m_teamID;
+	MobFlowFieldLimits_t m_limits;
+
+	// indexed by nav area ID
+	CUtlVector< float > m_cost;
+	CUtlVector< CNavArea * > m_next;
+
+	IntervalTimer m_ageTimer;
+	float m_lastUsedTime;
+	int m_lastDrawTick;
+};
+
+
+//----------------------------------------------------------------------------
+/**
+ * Owns the active flow fields, rebuilding them on an interval as their targets move
+ */
+class CTFMobFlowFieldManager : public CAutoGameSystem
+{
+public:
+	CTFMobFlowFieldManager( void ) : CAutoGameSystem( "CTFMobFlowFieldManager" ) { }
+
+	virtual void LevelShutdownPostEntity( void )	{ Reset(); }
+
+	// return a flow field toward 'target' for the given team and movement limits, building or refreshing it if needed
+	CTFMobFlowField *GetFlowField( CBaseCombatCharacter *target, int teamID, const MobFlowFieldLimits_t &limits );
+
+	void Reset( void );											// discard all flow fields
+	int GetFlowFieldCount( void ) const		{ return m_fieldVector.Count(); }
+
+private:
+	void RemoveStaleFields( void );
+
+	CUtlVector< CTFMobFlowField * > m_fieldVector;
+};
+
+// singleton accessor
+extern CTFMobFlowFieldManager &TheMobFlowFields( void );
+
+#endif // TF_MOB_FLOW_FIELD_H
@@ -0,0 +1,160 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Pool of dead mobs kept dormant for reuse.
+// Waves spawn and kill mobs by the thousand - rather than destroying each dead
+// mob and creating a new entity for the next spawn, dead mobs are put to sleep
+// and handed back out by the next SpawnAtPos() of the same class.
+//
+//=============================================================================
+#include "cbase.h"
+
+#include "tf_mob_pool.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar tf_mob_pool_max( "tf_mob_pool_max", "256", FCVAR_CHEAT, "Maximum number of dead mobs of each type kept dormant for reuse (0 disables pooling)" );
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Singleton accessor.
+ */
+static CTFMobPool s_mobPool;
+
+CTFMobPool &TheMobPool( void )
+{
+	return s_mobPool;
+}
+
+
+//---------------------------------------------------------------------------------------------
+CTFMobPool::Bucket_t *CTFMobPool::FindBucket( const char *className, bool create )
+{
+	FOR_EACH_VEC( m_bucketVector, it )
+	{
+		if ( FStrEq( STRING( m_bucketVector[ it ]->m_className ), className ) )
+			return m_bucketVector[ it ];
+	}
+
+	if ( !create )
+		return NULL;
+
+	Bucket_t *bucket = new Bucket_t;
+	bucket->m_className = AllocPooledString( className );
+	m_bucketVector.AddToTail( bucket );
+
+	return bucket;
+}
+
+
+//---------------------------------------------------------------------------------------------
+CBaseEntity *CTFMobPool::Acquire( const char *className )
+{
+	Bucket_t *bucket = FindBucket( className, false );
+
+	while( bucket && bucket->m_dormant.Count() )
+	{
+		CBaseEntity *mob = bucket->m_dormant.Tail();
+		bucket->m_dormant.RemoveMultipleFromTail( 1 );
+
+		// removed out from under us by a round restart, etc
+		if ( !mob || mob->IsMarkedForDeletion() )
+			continue;
+
+		// undo MakeDormant() - Spawn() restores the rest
+		mob->RemoveEFlags( EFL_DORMANT );
+		mob->RemoveEffects( EF_NODRAW );
+		mob->RemoveSolidFlags( FSOLID_NOT_SOLID );
+		mob->m_lifeState = LIFE_ALIVE;
+		++m_lifeSerial[ mob->entindex() ];
+
+		// don't let clients interpolate from where we died
+		mob->IncrementInterpolationFrame();
+
+		return mob;
+	}
+
+	return CreateEntityByName( className );
+}
+
+
+//---------------------------------------------------------------------------------------------
+bool CTFMobPool::Release( CBaseEntity *mob )
+{
+	if ( !mob || mob->IsMarkedForDeletion() )
+		return false;
+
+	Bucket_t *bucket = FindBucket( mob->GetClassname(), true );
+
+	if ( bucket->m_pending.Find( mob ) != bucket->m_pending.InvalidIndex() )
+	{
+		// already on its way in
+		return true;
+	}
+
+	if ( bucket->m_dormant.Count() + bucket->m_pending.Count() >= tf_mob_pool_max.GetInt() )
+		return false;
+
+	bucket->m_pending.AddToTail( mob );
+
+	return true;
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Put mobs released this frame to sleep, now that they are done dying.
+ */
+void CTFMobPool::FrameUpdatePostEntityThink( void )
+{
+	FOR_EACH_VEC( m_bucketVector, it )
+	{
+		Bucket_t *bucket = m_bucketVector[ it ];
+
+		FOR_EACH_VEC( bucket->m_pending, pit )
+		{
+			CBaseEntity *mob = bucket->m_pending[ pit ];
+			if ( !mob || mob->IsMarkedForDeletion() )
+				continue;
+
+			MakeMobDormant( mob );
+			bucket->m_dormant.AddToTail( mob );
+		}
+
+		bucket->m_pending.RemoveAll();
+	}
+}
+
+
+//---------------------------------------------------------------------------------------------
+void CTFMobPool::MakeMobDormant( CBaseEntity *mob )
+{
+	mob->m_takedamage = DAMAGE_NO;
+	mob->m_lifeState = LIFE_DEAD;
+	mob->SetOwnerEntity( NULL );
+	mob->SetAbsVelocity( vec3_origin );
+
+	// stops thinking (and with it NextBot updates), collisions and transmission
+	mob->MakeDormant();
+}
+
+
+//---------------------------------------------------------------------------------------------
+void CTFMobPool::Reset( void )
+{
+	m_bucketVector.PurgeAndDeleteElements();
+}
+
+
+//---------------------------------------------------------------------------------------------
+int CTFMobPool::GetDormantCount( void ) const
+{
+	int count = 0;
+	FOR_EACH_VEC( m_bucketVector, it )
+	{
+		count += m_bucketVector[ it ]->m_dormant.Count();
+	}
+
+	return count;
+}
@@ -0,0 +1,64 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Pool of dead mobs kept dormant for reuse.
+// Waves spawn and kill mobs by the thousand - rather than destroying each dead
+// mob and creating a new entity for the next spawn, dead mobs are put to sleep
+// and handed back out by the next SpawnAtPos() of the same class.
+//
+//=============================================================================
+#ifndef TF_MOB_POOL_H
+#define TF_MOB_POOL_H
+
+
+//----------------------------------------------------------------------------
+class CTFMobPool : public CAutoGameSystemPerFrame
+{
+public:
+	CTFMobPool( void ) : CAutoGameSystemPerFrame( "CTFMobPool" )
+	{
+		V_memset( m_lifeSerial, 0, sizeof( m_lifeSerial ) );
+	}
+
+	virtual void LevelShutdownPreEntity( void )		{ Reset(); }
+	virtual void FrameUpdatePostEntityThink( void );
+
+	/**
+	 * Return a dormant mob of the given class woken up and ready to be spawned again,
+	 * or a newly created entity if there are none.
+	 */
+	CBaseEntity *Acquire( const char *className );
+
+	/**
+	 * Queue the dead mob to go dormant at the end of the frame, like UTIL_Remove() does.
+	 * Returns false if the pool is full and the caller should remove the mob instead.
+	 */
+	bool Release( CBaseEntity *mob );
+
+	/**
+	 * Pooled entities keep their handle serial when they are handed back out, so a handle
+	 * can outlive the mob it was taken for. This changes each time the entity is reused.
+	 */
+	int GetLifeSerial( const CBaseEntity *mob ) const	{ return m_lifeSerial[ mob->entindex() ]; }
+
+	void Reset( void );								// forget all pooled mobs
+	int GetDormantCount( void ) const;
+
+private:
+	struct Bucket_t
+	{
+		string_t m_className;
+		CUtlVector< EHANDLE > m_dormant;
+		CUtlVector< EHANDLE > m_pending;			// released this frame, not yet dormant
+	};
+
+	Bucket_t *FindBucket( const char *className, bool create );
+	void MakeMobDormant( CBaseEntity *mob );
+
+	CUtlVector< Bucket_t * > m_bucketVector;
+	int m_lifeSerial[ MAX_EDICTS ];
+};
+
+// singleton accessor
+extern CTFMobPool &TheMobPool( void );
+
+#endif // TF_MOB_POOL_H
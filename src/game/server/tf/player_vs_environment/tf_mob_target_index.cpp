@@ -0,0 +1,236 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Per-tick index of the players mobs may want to chase.
+// Built once per tick, after all player movement, and shared by every mob's victim selection.
+//
+//=============================================================================
+#include "cbase.h"
+
+#include "tf_player.h"
+#include "tf_gamerules.h"
+#include "nav_mesh/tf_nav_area.h"
+
+#include "tf_mob_target_index.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Singleton accessor.
+ */
+static CTFMobTargetIndex s_mobTargetIndex;
+
+CTFMobTargetIndex &TheMobTargetIndex( void )
+{
+	return s_mobTargetIndex;
+}
+
+
+//---------------------------------------------------------------------------------------------
+CTFMobTargetIndex::CTFMobTargetIndex( void ) : CAutoGameSystemPerFrame( "CTFMobTargetIndex" ), m_hash( MOB_TARGET_CELL_SIZE )
+{
+	m_buildTick = -1;
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Rebuild the index once every entity, players included, has simulated this tick.
+ * Mobs query it during the next tick, before players move again.
+ */
+void CTFMobTargetIndex::FrameUpdatePostEntityThink( void )
+{
+	m_buildTick = gpGlobals->tickcount;
+
+	Build();
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Build the index now if it was not built at the end of the last tick, such as
+ * on the first tick of a level or after Invalidate().
+ */
+void CTFMobTargetIndex::Update( void )
+{
+	if ( m_buildTick >= 0 && m_buildTick >= gpGlobals->tickcount - 1 )
+		return;
+
+	m_buildTick = gpGlobals->tickcount;
+
+	Build();
+}
+
+
+//---------------------------------------------------------------------------------------------
+void CTFMobTargetIndex::Build( void )
+{
+	VPROF_BUDGET( "CTFMobTargetIndex::Build", "NextBot" );
+
+	m_entries.RemoveAll();
+	m_hash.Reset( MOB_TARGET_CELL_SIZE );
+
+	CUtlVector< CTFPlayer * > playerVector;
+	CollectPlayers( &playerVector, TF_TEAM_RED, COLLECT_ONLY_LIVING_PLAYERS );
+	CollectPlayers( &playerVector, TF_TEAM_BLUE, COLLECT_ONLY_LIVING_PLAYERS, APPEND_PLAYERS );
+
+	for( int i=0; i<playerVector.Count(); ++i )
+	{
+		CTFPlayer *player = playerVector[i];
+
+		Entry_t entry;
+		entry.m_player = player;
+		entry.m_area = (CTFNavArea *)player->GetLastKnownArea();
+		entry.m_pos = player->GetAbsOrigin();
+		entry.m_offMeshRange = 0.0f;
+		entry.m_flags = 0;
+
+		if ( entry.m_area && !entry.m_area->HasAttributeTF( TF_NAV_SPAWN_ROOM_BLUE | TF_NAV_SPAWN_ROOM_RED ) )
+		{
+			entry.m_flags |= MOB_TARGET_REACHABLE_AREA;
+
+			if ( player->GetGroundEntity() != NULL )
+			{
+				Vector areaPos;
+				entry.m_area->GetClosestPointOnArea( entry.m_pos, &areaPos );
+				entry.m_offMeshRange = ( entry.m_pos - areaPos ).AsVector2D().Length();
+			}
+		}
+
+		// cloaked spies are invisible to us, unless something gives them away
+		if ( !player->m_Shared.IsStealthed() ||
+			 player->m_Shared.InCond( TF_COND_BURNING ) ||
+			 player->m_Shared.InCond( TF_COND_URINE ) ||
+			 player->m_Shared.InCond( TF_COND_STEALTHED_BLINK ) ||
+			 player->m_Shared.InCond( TF_COND_BLEEDING ) )
+		{
+			entry.m_flags |= MOB_TARGET_DETECTABLE;
+		}
+
+		if ( !player->m_Shared.InCond( TF_COND_HALLOWEEN_GHOST_MODE ) )
+		{
+			entry.m_flags |= MOB_TARGET_NOT_GHOST;
+		}
+
+		m_entries.AddToTail( entry );
+		m_hash.Insert( entry.m_pos );
+	}
+}
+
+
+//---------------------------------------------------------------------------------------------
+/**
+ * Return the closest living player to 'from' that has all of 'requiredFlags' set.
+ * Buckets are searched in expanding rings around 'from', stopping as soon as
+ * no unsearched bucket can contain anyone closer than the best found so far.
+ */
+CTFPlayer *CTFMobTargetIndex::FindClosestVictim( const Vector &from, int requiredFlags, float maxOffMeshRange )
+{
+	Update();
+
+	if ( m_entries.Count() == 0 )
+		return NULL;
+
+	const int cx = m_hash.CellCoord( from.x );
+	const int cy = m_hash.CellCoord( from.y );
+
+	const int minCellX = m_hash.GetMinCellX();
+	const int minCellY = m_hash.GetMinCellY();
+	const int maxCellX = m_hash.GetMaxCellX();
+	const int maxCellY = m_hash.GetMaxCellY();
+
+	int maxRing = MAX( abs( cx - minCellX ), abs( cx - maxCellX ) );
+	maxRing = MAX( maxRing, abs( cy - minCellY ) );
+	maxRing = MAX( maxRing, abs( cy - maxCellY ) );
+
+	CTFPlayer *closest = NULL;
+	float closeRangeSq = FLT_MAX;
+
+	for( int ring=0; ring<=maxRing; ++ring )
+	{
+		if ( closest && ring > 0 )
+		{
+			// nothing in this ring can be closer than this
+			float ringRange = ( ring - 1 ) * MOB_TARGET_CELL_SIZE;
+			if ( ringRange * ringRange > closeRangeSq )
+				break;
+		}
+
+		const int xLo = MAX( cx - ring, minCellX );
+		const int xHi = MIN( cx + ring, maxCellX );
+		const int yLo = MAX( cy - ring, minCellY );
+		const int yHi = MIN( cy + ring, maxCellY );
+
+		for( int x=xLo; x<=xHi; ++x )
+		{
+			bool isEdgeColumn = ( abs( x - cx ) == ring );
+
+			for( int y=yLo; y<=yHi; ++y )
+			{
+				// only visit the outline of the ring, the interior was covered already
+				if ( !isEdgeColumn && abs( y - cy ) != ring )
+					continue;
+
+				for( int i=m_hash.FirstInCell( x, y ); i >= 0; i = m_hash.NextInCell( i ) )
+				{
+					const Entry_t &entry = m_entries[i];
+
+					if ( ( entry.m_flags & requiredFlags ) != requiredFlags )
+						continue;
+
+					if ( entry.m_offMeshRange > maxOffMeshRange )
+						continue;
+
+					// may have died or left since the index was built
+					CTFPlayer *player = entry.m_player;
+					if ( !player || !player->IsAlive() )
+						continue;
+
+					float rangeSq = ( entry.m_pos - from ).LengthSqr();
+					if ( rangeSq < closeRangeSq )
+					{
+						closest = player;
+						closeRangeSq = rangeSq;
+					}
+				}
+			}
+		}
+	}
+
+	return closest;
+}
+
+
+//---------------------------------------------------------------------------------------------
+int CTFMobTargetIndex::FindEntry( const CTFPlayer *player ) const
+{
+	for( int i=0; i<m_entries.Count(); ++i )
+	{
+		if ( m_entries[i].m_player.Get() == player )
+			return i;
+	}
+
+	return -1;
+}
+
+
+//---------------------------------------------------------------------------------------------
+int CTFMobTargetIndex::GetFlags( const CTFPlayer *player )
+{
+	Update();
+
+	int i = FindEntry( player );
+	return ( i >= 0 ) ? m_entries[i].m_flags : 0;
+}
+
+
+//---------------------------------------------------------------------------------------------
+CTFNavArea *CTFMobTargetIndex::GetArea( const CTFPlayer *player )
+{
+	Update();
+
+	int i = FindEntry( player );
+	return ( i >= 0 ) ? m_entries[i].m_area : NULL;
+}
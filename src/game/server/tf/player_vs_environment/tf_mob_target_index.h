@@ -0,0 +1,71 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Per-tick index of the players mobs may want to chase.
+// Built once per tick, after all player movement, and shared by every mob's victim selection.
+//
+//=============================================================================
+#ifndef TF_MOB_TARGET_INDEX_H
+#define TF_MOB_TARGET_INDEX_H
+
+#include "NextBotSpatialHash.h"
+
+class CTFPlayer;
+class CTFNavArea;
+
+#define MOB_TARGET_CELL_SIZE		512.0f		// size of a spatial bucket in world units
+#define MOB_TARGET_HASH_SIZE		64			// number of spatial buckets (power of two)
+
+enum MobTargetFlags_t
+{
+	MOB_TARGET_REACHABLE_AREA	= 0x01,		// has a last known area that is not a spawn room
+	MOB_TARGET_DETECTABLE		= 0x02,		// not an undetectable cloaked spy
+	MOB_TARGET_NOT_GHOST		= 0x04,		// not in halloween ghost mode
+
+	MOB_TARGET_CHASEABLE		= MOB_TARGET_REACHABLE_AREA | MOB_TARGET_DETECTABLE | MOB_TARGET_NOT_GHOST,
+};
+
+
+//----------------------------------------------------------------------------
+class CTFMobTargetIndex : public CAutoGameSystemPerFrame
+{
+public:
+	CTFMobTargetIndex( void );
+
+	virtual void LevelShutdownPreEntity( void )		{ Invalidate(); }
+	virtual void FrameUpdatePostEntityThink( void );
+
+	/**
+	 * Return the closest living player to 'from' that has all of 'requiredFlags' set.
+	 * Players standing further than 'maxOffMeshRange' from their last known area are skipped.
+	 */
+	CTFPlayer *FindClosestVictim( const Vector &from, int requiredFlags = MOB_TARGET_CHASEABLE, float maxOffMeshRange = FLT_MAX );
+
+	int GetFlags( const CTFPlayer *player );			// return chaseability flags of the given player, 0 if not indexed
+	CTFNavArea *GetArea( const CTFPlayer *player );		// return the indexed last known area of the given player
+
+	void Invalidate( void )		{ m_buildTick = -1; }	// force a rebuild on next query
+	void Update( void );								// build the index if it is missing - queries from worker threads need this done first
+
+private:
+	void Build( void );
+	int FindEntry( const CTFPlayer *player ) const;
+
+	struct Entry_t
+	{
+		CHandle< CTFPlayer > m_player;		// players can disconnect before the next build
+		CTFNavArea *m_area;
+		Vector m_pos;
+		float m_offMeshRange;		// 2D distance from the player to its last known area, if grounded
+		int m_flags;
+	};
+
+	CUtlVector< Entry_t > m_entries;
+	CNextBotSpatialHash< MOB_TARGET_HASH_SIZE > m_hash;	// entry positions, same indices as m_entries
+
+	int m_buildTick;
+};
+
+// singleton accessor
+extern CTFMobTargetIndex &TheMobTargetIndex( void );
+
+#endif // TF_MOB_TARGET_INDEX_H
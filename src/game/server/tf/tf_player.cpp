@@ -1013,11 +1013,12 @@ CTFPlayer::CTFPlayer()
 
 	SetDefLessFunc( m_Cappers );		// Tracks victims for demo achievement
 
-	for ( int i = 0; i < HomUpgrade_t::UPGRADE_COUNT; i++ )
+	for ( int i = 0; i < HOM_MAX_UPGRADES; i++ )
 	{
 		m_upgrades[i] = 0;
 	}
 	m_iUpgradeCount = 0;
+	m_upgradeStats.Reset();
 
  	//=============================================================================
 	// HPE_BEGIN:
@@ -21312,11 +21313,12 @@ void CTFPlayer::CalculateExperienceLevel( bool bAnnounce /*= true*/ )
 
 void CTFPlayer::RemoveAllUpgrades()
 {
-	for ( int i = 0; i < HomUpgrade_t::UPGRADE_COUNT; i++ )
+	for ( int i = 0; i < HOM_MAX_UPGRADES; i++ )
 	{
 		m_upgrades[i] = 0;
 	}
 	m_iUpgradeCount = 0;
+	m_upgradeStats.Reset();
 	// HOM TODO reset health etc.
 }
 
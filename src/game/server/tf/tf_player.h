@@ -1259,8 +1259,9 @@ private:
 public:
 	void RemoveAllUpgrades();
 
-	int m_upgrades[HomUpgrade_t::UPGRADE_COUNT];
+	int m_upgrades[HOM_MAX_UPGRADES];
 	int m_iUpgradeCount;
+	HomUpgradeStats_t m_upgradeStats;		// combined effect of m_upgrades
 
 	// Marking for death.
 	CHandle<CTFPlayer>	m_pMarkedForDeathTarget;
@@ -18,7 +18,7 @@
 
 
 
-#define QUERYCACHE_SIZE 1024
+#define QUERYCACHE_SIZE 4096
 
 static QueryCacheEntry_t s_QCache[QUERYCACHE_SIZE];
 
@@ -156,6 +156,10 @@ static void CalculateOffsettedPosition( CBaseEntity *pEntity, EEntityOffsetMode_
 			*pVecOut = pEntity->EyePosition();
 			break;
 
+		case EOFFSET_MODE_ABSORIGIN:
+			*pVecOut = pEntity->GetAbsOrigin();
+			break;
+
 		case EOFFSET_MODE_NONE:
 			pVecOut->Init();
 			break;
@@ -183,7 +187,14 @@ void ProcessQueryCacheUpdate( QueryCacheUpdateRecord_t &workItem )
 		for( QueryCacheEntry_t *pEntry = s_HashChains[i + workItem.m_nStartHashChain].m_pHead ; pEntry; pEntry = pNext )
 		{
 			pNext = pEntry->m_pNext;
-			if ( pEntry->m_bUsedSinceUpdated )
+			if ( !pEntry->HasAllEntities() )
+			{
+				// IssueQuery() would free it, but the victim list is shared by all threads
+				pEntry->m_QueryParams.m_Type = EQUERY_INVALID;
+				s_HashChains[pEntry->m_QueryParams.m_nHashIdx].RemoveNode( pEntry );
+				workItem.m_KilledList.AddToHead( pEntry );
+			}
+			else if ( pEntry->m_bUsedSinceUpdated )
 			{
 				if ( flCurTime - pEntry->m_flLastUpdateTime >= 
 					 pEntry->m_QueryParams.m_flMinimumUpdateInterval )
@@ -264,6 +275,17 @@ void InvalidateQueryCache( void )
 }
 
 
+bool QueryCacheEntry_t::HasAllEntities( void ) const
+{
+	for( int i = 0 ; i < m_QueryParams.m_nNumValidPoints; i++ )
+	{
+		if ( ! m_QueryParams.m_pEntities[i] )
+			return false;
+	}
+	return true;
+}
+
+
 void QueryCacheEntry_t::IssueQuery( void )
 {
 	for( int i = 0 ; i < m_QueryParams.m_nNumValidPoints; i++ )
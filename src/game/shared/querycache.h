@@ -35,6 +35,7 @@ enum EEntityOffsetMode_t
 {
 	EOFFSET_MODE_WORLDSPACE_CENTER,
 	EOFFSET_MODE_EYEPOSITION,
+	EOFFSET_MODE_ABSORIGIN,
 	EOFFSET_MODE_NONE,										// nop
 };
 
@@ -72,6 +73,7 @@ struct QueryCacheEntry_t
 	bool m_bResult;											// for queries with a boolean result
 
 	void IssueQuery( void );
+	bool HasAllEntities( void ) const;						// false once any entity of the query is gone
 
 };
 
@@ -8,4 +8,16 @@ typedef enum
     FLYING_NORMAL,
 } MobType_t;
 
+// Scale of a melee mob's head bones. Not networked, the client derives it from the mob type.
+inline float GetMobHeadScale( MobType_t type )
+{
+    switch ( type )
+    {
+    case MELEE_NORMAL:
+    case MELEE_GIANT:
+    default:
+        return 1.0f;
+    }
+}
+
 #endif // TF_MOB_COMMON_H
\ No newline at end of file
@@ -1901,6 +1901,8 @@ enum MobDrops_t
 	TF_MOB_DROP_HEALTH_SMALL,
 	TF_MOB_DROP_HEALTH_MEDIUM,
 	TF_MOB_DROP_HEALTH_LARGE,
+
+	TF_MOB_DROP_BUNDLE,			// any mix of cash, ammo and health
 };
 
 // In-game currency
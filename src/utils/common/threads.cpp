@@ -13,13 +13,18 @@
 
 #define	USED
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
 #include "cmdlib.h"
 #define NO_THREAD_NAMES
 #include "threads.h"
 #include "pacifier.h"
-
-#define	MAX_THREADS	16
+#include "tier0/threadtools.h"
+#include "tier1/utlvector.h"
 
 
 class CRunThreadsData
@@ -30,17 +35,20 @@ public:
 	RunThreadsFn m_Fn;
 };
 
-CRunThreadsData g_RunThreadsData[MAX_THREADS];
+CUtlVector< CRunThreadsData > g_RunThreadsData;
 
 
-int		dispatch;
+CInterlockedInt	dispatch;
 int		workcount;
 qboolean		pacifier;
 
 qboolean	threaded;
 bool g_bLowPriorityThreads = false;
 
-HANDLE g_ThreadHandles[MAX_THREADS];
+CUtlVector< ThreadHandle_t > g_ThreadHandles;
+
+// Only one thread at a time draws the pacifier, the others don't wait for it.
+CThreadFastMutex g_PacifierMutex;
 
 
 
@@ -52,22 +60,18 @@ GetThreadWork
 */
 int	GetThreadWork (void)
 {
-	int	r;
-
-	ThreadLock ();
+	// Hand out work items with an atomic counter, so threads that finish
+	// early keep taking items without contending for the global lock.
+	int r = ++dispatch - 1;
+	if ( r >= workcount )
+		return -1;
 
-	if (dispatch == workcount)
+	if ( pacifier && g_PacifierMutex.TryLock() )
 	{
-		ThreadUnlock ();
-		return -1;
+		UpdatePacifier( (float)r / workcount );
+		g_PacifierMutex.Unlock();
 	}
 
-	UpdatePacifier( (float)dispatch / workcount );
-
-	r = dispatch;
-	dispatch++;
-	ThreadUnlock ();
-
 	return r;
 }
 
@@ -101,45 +105,53 @@ void RunThreadsOnIndividual (int workcnt, qboolean showpacifier, ThreadWorkerFn
 /*
 ===================================================================
 
-WIN32
+Threads are created through tier0, so this works on both Win32 and POSIX
 
 ===================================================================
 */
 
 int		numthreads = -1;
-CRITICAL_SECTION		crit;
+CThreadMutex	crit;
 static int enter;
 
 
-class CCritInit
-{
-public:
-	CCritInit()
-	{
-		InitializeCriticalSection (&crit);
-	}
-} g_CritInit;
-
-
-
 void SetLowPriority()
 {
+#ifdef _WIN32
 	SetPriorityClass( GetCurrentProcess(), IDLE_PRIORITY_CLASS );
+#else
+	setpriority( PRIO_PROCESS, 0, 19 );
+#endif
 }
 
 
-void ThreadSetDefault (void)
+static int GetProcessorCount()
 {
+#ifdef _WIN32
 	SYSTEM_INFO info;
+	GetSystemInfo (&info);
+	return info.dwNumberOfProcessors;
+#else
+	return (int)sysconf( _SC_NPROCESSORS_ONLN );
+#endif
+}
+
 
+void ThreadSetDefault (void)
+{
 	if (numthreads == -1)	// not set manually
 	{
-		GetSystemInfo (&info);
-		numthreads = info.dwNumberOfProcessors;
-		if (numthreads < 1 || numthreads > 32)
+		numthreads = GetProcessorCount();
+		if (numthreads < 1)
 			numthreads = 1;
 	}
 
+	if ( numthreads > MAX_TOOL_THREADS )
+	{
+		Warning( "%i threads requested, using %i\n", numthreads, MAX_TOOL_THREADS );
+		numthreads = MAX_TOOL_THREADS;
+	}
+
 	Msg ("%i threads\n", numthreads);
 }
 
@@ -148,7 +160,7 @@ void ThreadLock (void)
 {
 	if (!threaded)
 		return;
-	EnterCriticalSection (&crit);
+	crit.Lock();
 	if (enter)
 		Error ("Recursive ThreadLock\n");
 	enter = 1;
@@ -161,12 +173,12 @@ void ThreadUnlock (void)
 	if (!enter)
 		Error ("ThreadUnlock without lock\n");
 	enter = 0;
-	LeaveCriticalSection (&crit);
+	crit.Unlock();
 }
 
 
 // This runs in the thread and dispatches a RunThreadsFn call.
-DWORD WINAPI InternalRunThreadsFn( LPVOID pParameter )
+static uintp InternalRunThreadsFn( void *pParameter )
 {
 	CRunThreadsData *pData = (CRunThreadsData*)pParameter;
 	pData->m_Fn( pData->m_iThread, pData->m_pUserData );
@@ -174,6 +186,16 @@ DWORD WINAPI InternalRunThreadsFn( LPVOID pParameter )
 }
 
 
+static void SetToolThreadPriority( ThreadHandle_t hThread, bool bIdle )
+{
+#ifdef _WIN32
+	SetThreadPriority( (HANDLE)hThread, bIdle ? THREAD_PRIORITY_IDLE : THREAD_PRIORITY_LOWEST );
+#else
+	ThreadSetPriority( hThread, TP_PRIORITY_LOWEST );
+#endif
+}
+
+
 void RunThreads_Start( RunThreadsFn fn, void *pUserData, ERunThreadsPriority ePriority )
 {
 	Assert( numthreads > 0 );
@@ -182,29 +204,28 @@ void RunThreads_Start( RunThreadsFn fn, void *pUserData, ERunThreadsPriority ePr
 	if ( numthreads > MAX_TOOL_THREADS )
 		numthreads = MAX_TOOL_THREADS;
 
+	// Size these before starting any thread, the threads hold pointers into g_RunThreadsData.
+	g_RunThreadsData.SetCount( numthreads );
+	g_ThreadHandles.SetCount( numthreads );
+
 	for ( int i=0; i < numthreads ;i++ )
 	{
 		g_RunThreadsData[i].m_iThread = i;
 		g_RunThreadsData[i].m_pUserData = pUserData;
 		g_RunThreadsData[i].m_Fn = fn;
 
-		DWORD dwDummy;
-		g_ThreadHandles[i] = CreateThread(
-		   NULL,	// LPSECURITY_ATTRIBUTES lpsa,
-		   0,		// DWORD cbStack,
-		   InternalRunThreadsFn,	// LPTHREAD_START_ROUTINE lpStartAddr,
-		   &g_RunThreadsData[i],	// LPVOID lpvThreadParm,
-		   0,			// DWORD fdwCreate,
-		   &dwDummy );
+		g_ThreadHandles[i] = CreateSimpleThread( InternalRunThreadsFn, &g_RunThreadsData[i] );
+		if ( !g_ThreadHandles[i] )
+			Error( "RunThreads_Start: couldn't create thread %d\n", i );
 
 		if ( ePriority == k_eRunThreadsPriority_UseGlobalState )
 		{
 			if( g_bLowPriorityThreads )
-				SetThreadPriority( g_ThreadHandles[i], THREAD_PRIORITY_LOWEST );
+				SetToolThreadPriority( g_ThreadHandles[i], false );
 		}
 		else if ( ePriority == k_eRunThreadsPriority_Idle )
 		{
-			SetThreadPriority( g_ThreadHandles[i], THREAD_PRIORITY_IDLE );
+			SetToolThreadPriority( g_ThreadHandles[i], true );
 		}
 	}
 }
@@ -212,9 +233,12 @@ void RunThreads_Start( RunThreadsFn fn, void *pUserData, ERunThreadsPriority ePr
 
 void RunThreads_End()
 {
-	WaitForMultipleObjects( numthreads, g_ThreadHandles, TRUE, INFINITE );
-	for ( int i=0; i < numthreads; i++ )
-		CloseHandle( g_ThreadHandles[i] );
+	for ( int i=0; i < g_ThreadHandles.Count(); i++ )
+	{
+		ThreadJoin( g_ThreadHandles[i] );
+		ReleaseThreadHandle( g_ThreadHandles[i] );
+	}
+	g_ThreadHandles.RemoveAll();
 
 	threaded = false;
 }
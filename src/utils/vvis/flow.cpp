@@ -469,6 +469,27 @@ void WritePortalTrace( const char *source )
 	Warning("Wrote %s!!!\n", filename);
 }
 
+/*
+==================
+MarkPortalVisible
+
+Several tasks can flow the same base portal at once when its flow is split,
+so they set its bits with an atomic or. Bit n is bit n&31 of little endian
+word n>>5, the same bit CheckBit reads.
+==================
+*/
+inline void MarkPortalVisible( threaddata_t *thread, int pnum )
+{
+	if ( thread->sharedvis )
+	{
+		ThreadInterlockedOr( (int32 volatile *)thread->base->portalvis + ( pnum >> 5 ), 1 << ( pnum & 31 ) );
+	}
+	else
+	{
+		SetBit( thread->base->portalvis, pnum );
+	}
+}
+
 /*
 ==================
 RecursiveLeafFlow
@@ -509,12 +530,22 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 	stack.next = NULL;
 	stack.leaf = leaf;
 	stack.portal = NULL;
+	stack.depth = prevstack->depth + 1;
 
 	might = (long *)stack.mightsee;
 	vis = (long *)thread->base->portalvis;
+
+	// a task split off a portal's flow only follows its own branch this deep
+	int firstportal = 0;
+	int lastportal = leaf->portals.Count();
+	if ( prevstack->depth < thread->numbranches )
+	{
+		firstportal = thread->branch[ prevstack->depth ];
+		lastportal = MIN( firstportal + 1, lastportal );
+	}
 	
 	// check all portals for flowing into other leafs	
-	for (i=0 ; i<leaf->portals.Count() ; i++)
+	for (i=firstportal ; i<lastportal ; i++)
 	{
 
 		p = leaf->portals[i];
@@ -598,7 +629,7 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 		{	// the second leaf can only be blocked if coplanar
 
 			// mark the portal as visible
-			SetBit( thread->base->portalvis, pnum );
+			MarkPortalVisible( thread, pnum );
 
 			RecursiveLeafFlow (p->leaf, thread, &stack);
 			continue;
@@ -613,7 +644,7 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 			continue;
 
 		// mark the portal as visible
-		SetBit( thread->base->portalvis, pnum );
+		MarkPortalVisible( thread, pnum );
 
 		// flow through it for real
 		RecursiveLeafFlow (p->leaf, thread, &stack);
@@ -621,6 +652,27 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 }
 
 
+/*
+===============
+PortalFlowInit
+
+sets up the flow of a portal through its own leaf
+===============
+*/
+void PortalFlowInit (portal_t *p, threaddata_t *data)
+{
+	int				i;
+
+	memset (data, 0, sizeof(*data));
+	data->base = p;
+	
+	data->pstack_head.portal = p;
+	data->pstack_head.source = p->winding;
+	data->pstack_head.portalplane = p->plane;
+	for (i=0 ; i<portallongs ; i++)
+		((long *)data->pstack_head.mightsee)[i] = ((long *)p->portalflood)[i];
+}
+
 /*
 ===============
 PortalFlow
@@ -631,7 +683,6 @@ generates the portalvis bit vector
 void PortalFlow (int iThread, int portalnum)
 {
 	threaddata_t	data;
-	int				i;
 	portal_t		*p;
 	int				c_might, c_can;
 
@@ -640,14 +691,7 @@ void PortalFlow (int iThread, int portalnum)
 				
 	c_might = CountBits (p->portalflood, g_numportals*2);
 
-	memset (&data, 0, sizeof(data));
-	data.base = p;
-	
-	data.pstack_head.portal = p;
-	data.pstack_head.source = p->winding;
-	data.pstack_head.portalplane = p->plane;
-	for (i=0 ; i<portallongs ; i++)
-		((long *)data.pstack_head.mightsee)[i] = ((long *)p->portalflood)[i];
+	PortalFlowInit (p, &data);
 
 	RecursiveLeafFlow (p->leaf, &data, &data.pstack_head);
 
@@ -0,0 +1,487 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Work-stealing scheduler for the portal flow
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+// flowscheduler.cpp
+
+#include "vis.h"
+#include "threads.h"
+#include "pacifier.h"
+#include "tier0/threadtools.h"
+#include "tier1/utlvector.h"
+
+/*
+===============================================================================
+
+The cost of flowing a portal varies enormously, a handful of portals that
+might see most of the map take longer than all of the others together.
+Handing out one portal per work item leaves every thread but one idle while
+those finish, so the flow of an expensive portal is split into one task per
+branch out of the first two leafs, and idle threads steal tasks from each
+other until every portal is done.
+
+Portals are still started in sorted_portals order, from the one that might
+see the least to the one that might see the most, so the expensive ones are
+clipped against the final vis of the cheap ones.
+
+===============================================================================
+*/
+
+struct flowtask_t
+{
+	int			portalnum;		// index into sorted_portals
+	int			numbranches;
+	int			branch[MAX_FLOW_BRANCH_DEPTH];
+};
+
+// Tasks of one thread. The owner takes them from the tail, the most recently
+// queued, thieves from the head.
+struct flowqueue_t
+{
+	CUtlVector<flowtask_t>	tasks;
+	int						head;
+	CThreadFastMutex		mutex;
+};
+
+// Flow state of one portal, indexed like sorted_portals
+struct flowportal_t
+{
+	CInterlockedInt		tasksleft;
+	CInterlockedInt		chains;
+};
+
+struct flowthreadstats_t
+{
+	double		busytime;
+	int			portals;		// portals started by this thread
+	int			tasks;			// tasks run, including stolen ones
+	int			steals;
+};
+
+static flowqueue_t			g_FlowQueues[MAX_TOOL_THREADS];
+static flowthreadstats_t	g_FlowStats[MAX_TOOL_THREADS];
+static flowportal_t			*g_FlowPortals;
+
+static int					g_FlowWorkCount;
+static CInterlockedInt		g_FlowNextPortal;
+static CInterlockedInt		g_FlowPortalsLeft;
+static int					g_FlowSplitMightSee;	// portals that might see more than this are split
+static CInterlockedInt		g_FlowSplitPortals;
+
+static ThreadWorkerFn		g_FlowUnsplitFn;		// runs unsplittable work items, like BasePortalVis
+
+static CThreadFastMutex		g_FlowPacifierMutex;
+
+
+/*
+==================
+PushFlowTask
+==================
+*/
+static void PushFlowTask (int iThread, const flowtask_t &task)
+{
+	flowqueue_t &queue = g_FlowQueues[iThread];
+	AUTO_LOCK( queue.mutex );
+
+	queue.tasks.AddToTail( task );
+}
+
+/*
+==================
+PopFlowTask
+
+takes the most recently queued task of our own
+==================
+*/
+static bool PopFlowTask (int iThread, flowtask_t &task)
+{
+	flowqueue_t &queue = g_FlowQueues[iThread];
+	AUTO_LOCK( queue.mutex );
+
+	if ( queue.head >= queue.tasks.Count() )
+		return false;
+
+	task = queue.tasks.Tail();
+	queue.tasks.RemoveMultipleFromTail( 1 );
+
+	if ( queue.head >= queue.tasks.Count() )
+	{
+		queue.tasks.RemoveAll();
+		queue.head = 0;
+	}
+	return true;
+}
+
+/*
+==================
+StealFlowTask
+
+takes the oldest queued task of another thread
+==================
+*/
+static bool StealFlowTask (int iThread, flowtask_t &task)
+{
+	for ( int i=1 ; i<numthreads ; i++ )
+	{
+		flowqueue_t &queue = g_FlowQueues[ (iThread + i) % numthreads ];
+
+		// don't queue up behind a thread that is busy with its own deque
+		if ( !queue.mutex.TryLock() )
+			continue;
+
+		bool bStolen = false;
+		if ( queue.head < queue.tasks.Count() )
+		{
+			task = queue.tasks[queue.head++];
+			bStolen = true;
+		}
+
+		queue.mutex.Unlock();
+
+		if ( bStolen )
+		{
+			g_FlowStats[iThread].steals++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+==================
+FinishFlowPortal
+==================
+*/
+static void FinishFlowPortal (int portalnum)
+{
+	portal_t	*p;
+	int			c_might, c_can;
+
+	p = sorted_portals[portalnum];
+	p->status = stat_done;
+
+	c_might = CountBits (p->portalflood, g_numportals*2);
+	c_can = CountBits (p->portalvis, g_numportals*2);
+
+	qprintf ("portal:%4i  mightsee:%4i  cansee:%4i (%i chains)\n",
+		(int)(p - portals),	c_might, c_can, (int)g_FlowPortals[portalnum].chains);
+
+	int left = --g_FlowPortalsLeft;
+
+	if ( g_FlowPacifierMutex.TryLock() )
+	{
+		UpdatePacifier( (float)(g_FlowWorkCount - left) / g_FlowWorkCount );
+		g_FlowPacifierMutex.Unlock();
+	}
+}
+
+/*
+==================
+RunFlowTask
+==================
+*/
+static void RunFlowTask (const flowtask_t &task)
+{
+	threaddata_t	data;
+	portal_t		*p;
+
+	p = sorted_portals[task.portalnum];
+
+	PortalFlowInit (p, &data);
+	data.numbranches = task.numbranches;
+	for ( int i=0 ; i<task.numbranches ; i++ )
+		data.branch[i] = task.branch[i];
+	data.sharedvis = ( task.numbranches > 0 );
+
+	RecursiveLeafFlow (p->leaf, &data, &data.pstack_head);
+
+	g_FlowPortals[task.portalnum].chains += data.c_chains;
+
+	// the last task to finish completes the portal
+	if ( --g_FlowPortals[task.portalnum].tasksleft == 0 )
+	{
+		FinishFlowPortal (task.portalnum);
+	}
+}
+
+/*
+==================
+SplitFlowPortal
+
+queues a task for each branch out of the portal's leaf and out of the
+leafs behind it, returns the number of tasks queued
+==================
+*/
+static int SplitFlowPortal (int iThread, int portalnum)
+{
+	portal_t	*p = sorted_portals[portalnum];
+	leaf_t		*leaf = &leafs[p->leaf];
+	flowtask_t	task;
+	int			i, j, count;
+
+	// count the tasks first, so a stolen task can't complete the portal
+	// before all of them are queued
+	count = 0;
+	for ( i=0 ; i<leaf->portals.Count() ; i++ )
+	{
+		// the flow won't go through portals the base portal can't possibly see
+		if ( !CheckBit( p->portalflood, leaf->portals[i] - portals ) )
+			continue;
+		count += MAX( leafs[leaf->portals[i]->leaf].portals.Count(), 1 );
+	}
+
+	if ( !count )
+		return 0;
+
+	g_FlowPortals[portalnum].tasksleft = count;
+
+	task.portalnum = portalnum;
+	for ( i=0 ; i<leaf->portals.Count() ; i++ )
+	{
+		if ( !CheckBit( p->portalflood, leaf->portals[i] - portals ) )
+			continue;
+
+		task.branch[0] = i;
+
+		int nextcount = leafs[leaf->portals[i]->leaf].portals.Count();
+		if ( !nextcount )
+		{
+			task.numbranches = 1;
+			PushFlowTask (iThread, task);
+			continue;
+		}
+
+		task.numbranches = 2;
+		for ( j=0 ; j<nextcount ; j++ )
+		{
+			task.branch[1] = j;
+			PushFlowTask (iThread, task);
+		}
+	}
+
+	return count;
+}
+
+/*
+==================
+StartFlowPortal
+==================
+*/
+static void StartFlowPortal (int iThread, int portalnum)
+{
+	portal_t	*p = sorted_portals[portalnum];
+	p->status = stat_working;
+
+	g_FlowStats[iThread].portals++;
+
+	if ( numthreads > 1 && p->nummightsee > g_FlowSplitMightSee )
+	{
+		if ( SplitFlowPortal (iThread, portalnum) )
+		{
+			g_FlowSplitPortals++;
+		}
+		else
+		{
+			FinishFlowPortal (portalnum);
+		}
+		return;
+	}
+
+	// cheap portals flow whole, like PortalFlow does
+	flowtask_t	task;
+	task.portalnum = portalnum;
+	task.numbranches = 0;
+
+	g_FlowPortals[portalnum].tasksleft = 1;
+	RunFlowTask (task);
+	g_FlowStats[iThread].tasks++;
+}
+
+/*
+==================
+FlowSchedulerThread
+==================
+*/
+static void FlowSchedulerThread (int iThread, void *pUserData)
+{
+	flowtask_t	task;
+
+	while ( g_FlowPortalsLeft > 0 )
+	{
+		double start = Plat_FloatTime();
+
+		// finish the portals already started before starting more,
+		// their vis is a tighter bound for the following ones
+		if ( PopFlowTask (iThread, task) || StealFlowTask (iThread, task) )
+		{
+			RunFlowTask (task);
+			g_FlowStats[iThread].tasks++;
+		}
+		else
+		{
+			int work = ++g_FlowNextPortal - 1;
+			if ( work >= g_FlowWorkCount )
+			{
+				// nothing left to start, wait for the tasks still running
+				ThreadSleep( 0 );
+				continue;
+			}
+
+			if ( g_FlowUnsplitFn )
+			{
+				g_FlowUnsplitFn (iThread, work);
+				g_FlowStats[iThread].portals++;
+				g_FlowStats[iThread].tasks++;
+
+				int left = --g_FlowPortalsLeft;
+				if ( g_FlowPacifierMutex.TryLock() )
+				{
+					UpdatePacifier( (float)(g_FlowWorkCount - left) / g_FlowWorkCount );
+					g_FlowPacifierMutex.Unlock();
+				}
+			}
+			else
+			{
+				StartFlowPortal (iThread, work);
+			}
+		}
+
+		g_FlowStats[iThread].busytime += Plat_FloatTime() - start;
+	}
+}
+
+/*
+==================
+PrintFlowStats
+
+shows how evenly the work was spread over the threads
+==================
+*/
+static void PrintFlowStats (const char *name, double elapsed)
+{
+	double	minbusy, maxbusy, totalbusy;
+	int		totaltasks, totalsteals;
+	int		i;
+
+	minbusy = maxbusy = g_FlowStats[0].busytime;
+	totalbusy = 0;
+	totaltasks = totalsteals = 0;
+	for ( i=0 ; i<numthreads ; i++ )
+	{
+		const flowthreadstats_t &stats = g_FlowStats[i];
+
+		qprintf ("  thread %3i: %7.2fs busy, %6i portals, %7i tasks, %6i stolen\n",
+			i, stats.busytime, stats.portals, stats.tasks, stats.steals);
+
+		minbusy = MIN( minbusy, stats.busytime );
+		maxbusy = MAX( maxbusy, stats.busytime );
+		totalbusy += stats.busytime;
+		totaltasks += stats.tasks;
+		totalsteals += stats.steals;
+	}
+
+	double avgbusy = totalbusy / numthreads;
+	double balance = ( maxbusy > 0 ) ? 100.0 * avgbusy / maxbusy : 100.0;
+
+	Msg ("%s: %.2fs, %i threads busy %.2f/%.2f/%.2fs min/avg/max (%.0f%% balanced), %i tasks, %i stolen",
+		name, elapsed, numthreads, minbusy, avgbusy, maxbusy, balance, totaltasks, totalsteals);
+
+	if ( !g_FlowUnsplitFn )
+	{
+		Msg (", %i portals split", (int)g_FlowSplitPortals);
+	}
+
+	Msg ("\n");
+}
+
+/*
+==================
+RunFlowScheduler
+==================
+*/
+static void RunFlowScheduler (const char *name, int workcnt, ThreadWorkerFn unsplitfn)
+{
+	int		i;
+
+	if (numthreads == -1)
+		ThreadSetDefault ();
+
+	printf ("%-20s ", name);
+
+	g_FlowWorkCount = workcnt;
+	g_FlowNextPortal = 0;
+	g_FlowPortalsLeft = workcnt;
+	g_FlowSplitPortals = 0;
+	g_FlowUnsplitFn = unsplitfn;
+
+	// split the portals that might see more than twice as much as the average one
+	g_FlowSplitMightSee = 0;
+	if ( !unsplitfn && workcnt > 0 )
+	{
+		double totalmightsee = 0;
+		for ( i=0 ; i<workcnt ; i++ )
+			totalmightsee += sorted_portals[i]->nummightsee;
+		g_FlowSplitMightSee = (int)( 2.0 * totalmightsee / workcnt );
+	}
+
+	g_FlowPortals = new flowportal_t[ MAX( workcnt, 1 ) ];
+	for ( i=0 ; i<workcnt ; i++ )
+	{
+		g_FlowPortals[i].tasksleft = 0;
+		g_FlowPortals[i].chains = 0;
+	}
+
+	for ( i=0 ; i<numthreads ; i++ )
+	{
+		g_FlowQueues[i].tasks.RemoveAll();
+		g_FlowQueues[i].head = 0;
+		memset( &g_FlowStats[i], 0, sizeof( g_FlowStats[i] ) );
+	}
+
+	double start = Plat_FloatTime();
+	StartPacifier("");
+
+	if ( workcnt > 0 )
+	{
+		RunThreads_Start( FlowSchedulerThread, NULL );
+		RunThreads_End();
+	}
+
+	double end = Plat_FloatTime();
+	EndPacifier(false);
+	printf (" (%i)\n", (int)(end - start));
+
+	PrintFlowStats (name, end - start);
+
+	delete [] g_FlowPortals;
+	g_FlowPortals = NULL;
+}
+
+/*
+==================
+RunPortalFlow
+
+flows all the portals in sorted_portals, like running PortalFlow on each of them
+==================
+*/
+void RunPortalFlow (void)
+{
+	RunFlowScheduler ("PortalFlow:", g_numportals*2, NULL);
+}
+
+/*
+==================
+RunBasePortalVis
+
+BasePortalVis is too cheap per portal to split, but goes through the
+scheduler for its timing stats
+==================
+*/
+void RunBasePortalVis (void)
+{
+	RunFlowScheduler ("BasePortalVis:", g_numportals*2, BasePortalVis);
+}
@@ -77,13 +77,22 @@ struct pstack_t
 	int			freewindings[3];
 
 	plane_t		portalplane;
+	int			depth;		// number of leafs flowed through to get here
 };
 
+#define	MAX_FLOW_BRANCH_DEPTH	2
+
 struct threaddata_t
 {
 	portal_t	*base;
 	int			c_chains;
 	pstack_t	pstack_head;
+
+	// When a portal's flow is split into tasks, each task only follows
+	// portal branch[i] out of the leaf i deep into the flow, for i < numbranches
+	int			numbranches;
+	int			branch[MAX_FLOW_BRANCH_DEPTH];
+	bool		sharedvis;	// other threads are setting bits in base->portalvis too
 };
 
 extern	int			g_numportals;
@@ -113,6 +122,10 @@ void LeafFlow (int leafnum);
 void BasePortalVis (int iThread, int portalnum);
 void BetterPortalVis (int portalnum);
 void PortalFlow (int iThread, int portalnum);
+void PortalFlowInit (portal_t *p, threaddata_t *data);
+void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack);
+void RunPortalFlow (void);
+void RunBasePortalVis (void);
 void WritePortalTrace( const char *source );
 
 extern	portal_t	*sorted_portals[MAX_MAP_PORTALS*2];
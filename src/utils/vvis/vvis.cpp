@@ -310,7 +310,7 @@ void CalcPortalVis (void)
 	else 
 #endif
 	{
-		RunThreadsOnIndividual (g_numportals*2, true, PortalFlow);
+		RunPortalFlow ();
 	}
 }
 
@@ -341,7 +341,7 @@ void CalcVis (void)
 	else 
 #endif
 	{
-	    RunThreadsOnIndividual (g_numportals*2, true, BasePortalVis);
+	    RunBasePortalVis ();
 	}
 
 	SortPortals ();